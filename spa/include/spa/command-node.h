@@ -70,6 +70,13 @@ spa_type_command_node_map(struct spa_type_map *map, struct spa_type_command_node
  *          and @monotonic_time in nanoseconds
  * @scale: update to the speed stored as Q16.16, @change_mask = 1<<1
  * @state: the new clock state, when @change_mask = 1<<2
+ * @flags: extra flags
+ * @latency: the duration of one cycle of the graph in nanoseconds,
+ *           when @change_mask = 1<<3
+ *
+ * With #SPA_COMMAND_NODE_CLOCK_UPDATE_FLAG_SLAVE, another node drives
+ * the graph. The node should not pace itself with a timer but produce
+ * or consume @latency worth of data when it is scheduled.
  */
 struct spa_command_node_clock_update_body {
 	struct spa_pod_object_body body;
@@ -85,6 +92,7 @@ struct spa_command_node_clock_update_body {
 	struct spa_pod_int scale		SPA_ALIGNED(8);
 	struct spa_pod_int state		SPA_ALIGNED(8);
 #define SPA_COMMAND_NODE_CLOCK_UPDATE_FLAG_LIVE	(1 << 0)
+#define SPA_COMMAND_NODE_CLOCK_UPDATE_FLAG_SLAVE	(1 << 1)
 	struct spa_pod_int flags		SPA_ALIGNED(8);
 	struct spa_pod_long latency		SPA_ALIGNED(8);
 };
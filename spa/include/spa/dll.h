@@ -0,0 +1,122 @@
+/* Simple Plugin API
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_DLL_H__
+#define __SPA_DLL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <math.h>
+
+#include <spa/defs.h>
+
+/**
+ * spa_dll:
+ * @b: first loop coefficient
+ * @c: second loop coefficient
+ * @period: the number of frames in a period
+ * @t0: filtered time of the last period
+ * @t1: predicted time of the next period
+ * @e2: filtered duration of a period
+ * @count: number of periods since the dll was reset
+ *
+ * A second order delay-locked loop that filters the times at which the
+ * periods of a device start. The device clock is compared to the clock
+ * of the times to get the actual rate of the device, a device that runs
+ * on its own crystal is never exactly at its nominal rate.
+ *
+ * The times are in seconds, usually CLOCK_MONOTONIC.
+ */
+struct spa_dll {
+	double b;
+	double c;
+	double period;
+	double t0;
+	double t1;
+	double e2;
+	uint32_t count;
+};
+
+/**
+ * spa_dll_init:
+ * @dll: a #struct spa_dll
+ * @bw: the bandwidth of the loop in Hz
+ * @period: the number of frames in a period
+ * @rate: the nominal rate of the device
+ *
+ * Initialize @dll. A smaller bandwidth filters more jitter but takes
+ * longer to lock.
+ */
+static inline void spa_dll_init(struct spa_dll *dll, double bw, uint32_t period, uint32_t rate)
+{
+	double omega = 2.0 * M_PI * bw * period / rate;
+
+	dll->b = sqrt(2.0) * omega;
+	dll->c = omega * omega;
+	dll->period = period;
+	dll->e2 = (double) period / rate;
+	dll->t0 = dll->t1 = 0.0;
+	dll->count = 0;
+}
+
+/**
+ * spa_dll_update:
+ * @dll: a #struct spa_dll
+ * @time: the time at which the next period started
+ *
+ * Update @dll with the time of a new period. The first update only
+ * starts the loop.
+ *
+ * Returns: the filtered time of the period
+ */
+static inline double spa_dll_update(struct spa_dll *dll, double time)
+{
+	double e;
+
+	if (dll->count++ == 0) {
+		dll->t0 = time;
+		dll->t1 = time + dll->e2;
+		return time;
+	}
+	e = time - dll->t1;
+	dll->t0 = dll->t1;
+	dll->t1 += dll->b * e + dll->e2;
+	dll->e2 += dll->c * e;
+
+	return dll->t0;
+}
+
+/**
+ * spa_dll_get_rate:
+ * @dll: a #struct spa_dll
+ *
+ * Returns: the measured rate of the device in frames per second
+ */
+static inline double spa_dll_get_rate(struct spa_dll *dll)
+{
+	return dll->period / dll->e2;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_DLL_H__ */
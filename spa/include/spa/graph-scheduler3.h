@@ -25,6 +25,25 @@ extern "C" {
 #endif
 
 #include <spa/graph.h>
+#include <spa/probe.h>
+
+static inline int spa_graph_impl_process_input(struct spa_graph_node *node)
+{
+	int res;
+	SPA_PROBE(spa, node_process_start, node, SPA_DIRECTION_INPUT);
+	res = spa_node_process_input(node->implementation);
+	SPA_PROBE(spa, node_process_end, node, SPA_DIRECTION_INPUT, res);
+	return res;
+}
+
+static inline int spa_graph_impl_process_output(struct spa_graph_node *node)
+{
+	int res;
+	SPA_PROBE(spa, node_process_start, node, SPA_DIRECTION_OUTPUT);
+	res = spa_node_process_output(node->implementation);
+	SPA_PROBE(spa, node_process_end, node, SPA_DIRECTION_OUTPUT, res);
+	return res;
+}
 
 static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *node)
 {
@@ -53,7 +72,7 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 	}
 
 	spa_list_for_each_safe(n, t, &ready, ready_link) {
-		n->state = spa_node_process_output(n->implementation);
+		n->state = spa_graph_impl_process_output(n);
 		spa_debug("peer %p processed out %d", n, n->state);
 		if (n->state == SPA_RESULT_NEED_BUFFER)
 			spa_graph_need_input(n->graph, n);
@@ -70,7 +89,7 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 	spa_debug("node %p ready:%d required:%d", node, node->ready[SPA_DIRECTION_INPUT], node->required[SPA_DIRECTION_INPUT]);
 
 	if (node->required[SPA_DIRECTION_INPUT] > 0 && node->ready[SPA_DIRECTION_INPUT] == node->required[SPA_DIRECTION_INPUT]) {
-		node->state = spa_node_process_input(node->implementation);
+		node->state = spa_graph_impl_process_input(node);
 		spa_debug("node %p processed in %d", node, node->state);
 		if (node->state == SPA_RESULT_HAVE_BUFFER) {
 			spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
@@ -117,7 +136,7 @@ static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *
 	}
 
 	spa_list_for_each_safe(n, t, &ready, ready_link) {
-		n->state = spa_node_process_input(n->implementation);
+		n->state = spa_graph_impl_process_input(n);
 		spa_debug("node %p chain processed in %d", n, n->state);
 		if (n->state == SPA_RESULT_HAVE_BUFFER)
 			spa_graph_have_output(n->graph, n);
@@ -133,7 +152,7 @@ static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *
 		n->ready_link.next = NULL;
 	}
 
-	node->state = spa_node_process_output(node->implementation);
+	node->state = spa_graph_impl_process_output(node);
 	spa_debug("node %p processed out %d", node, node->state);
 	if (node->state == SPA_RESULT_NEED_BUFFER) {
 		node->ready[SPA_DIRECTION_INPUT] = 0;
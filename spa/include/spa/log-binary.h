@@ -0,0 +1,216 @@
+/* Simple Plugin API
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_LOG_BINARY_H__
+#define __SPA_LOG_BINARY_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPA_TYPE__LogBinary		SPA_TYPE_INTERFACE_BASE "LogBinary"
+
+#include <string.h>
+
+#include <spa/defs.h>
+#include <spa/log.h>
+
+/** Info key with the file to dump the binary log to when the logger is
+ * destroyed. Setting it enables the binary log. */
+#define SPA_LOG_BINARY_KEY_FILE		"log.binary.file"
+
+/**
+ * struct spa_log_binary:
+ *
+ * In binary mode, the debug and trace messages of a log are not
+ * formatted. The pointers to the format, file and function and the
+ * arguments are stored with a timestamp in a ringbuffer per thread,
+ * without locks or system calls. The format, file and function strings
+ * are copied once per thread so that they can be dumped after the code
+ * that logged them is unloaded. The rings are written out in the format
+ * below with dump() and the messages are formatted later by
+ * spa-trace-decode.
+ */
+struct spa_log_binary {
+#define SPA_VERSION_LOG_BINARY	0
+	uint32_t version;
+
+	/**
+	 * struct spa_log_binary::dump
+	 * @log: a #struct spa_log_binary
+	 * @fd: a file descriptor to write to
+	 *
+	 * Write the messages that are in the rings to @fd and remove them
+	 * from the rings.
+	 *
+	 * Returns: #SPA_RESULT_OK on success
+	 */
+	int (*dump) (struct spa_log_binary *log, int fd);
+};
+
+#define spa_log_binary_dump(l,...)	(l)->dump((l),__VA_ARGS__)
+
+/* The dump starts with a header, followed by chunks. The chunks with
+ * strings contain the strings for all the pointers in the records, the
+ * chunks of a thread contain the records of one thread ordered by time.
+ * All sizes are multiples of 8 bytes. */
+#define SPA_LOG_BINARY_MAGIC		"SPALOGB1"
+#define SPA_LOG_BINARY_VERSION		0
+
+struct spa_log_binary_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t padding;
+};
+
+enum spa_log_binary_chunk_type {
+	SPA_LOG_BINARY_CHUNK_STRING = 1,	/**< uint64_t pointer + nul terminated string */
+	SPA_LOG_BINARY_CHUNK_THREAD = 2,	/**< struct spa_log_binary_thread + records */
+};
+
+struct spa_log_binary_chunk {
+	uint32_t type;		/**< enum spa_log_binary_chunk_type */
+	uint32_t size;		/**< size of the chunk after this header */
+};
+
+struct spa_log_binary_thread {
+	uint32_t tid;		/**< the thread id */
+	uint32_t dropped;	/**< messages lost because the ring was full */
+};
+
+/* A record is followed by n_args 8 byte values. A string argument is
+ * stored as the length of the string, including the nul byte, followed by
+ * the string, padded to 8 bytes. */
+struct spa_log_binary_record {
+	uint32_t size;		/**< size of the record with the arguments */
+	uint32_t level;		/**< enum spa_log_level */
+	uint32_t line;
+	uint32_t n_args;
+	uint64_t time;		/**< CLOCK_MONOTONIC in nanoseconds */
+	uint64_t file;		/**< pointer to the file name */
+	uint64_t func;		/**< pointer to the function name */
+	uint64_t fmt;		/**< pointer to the format */
+};
+
+enum spa_log_binary_arg {
+	SPA_LOG_BINARY_ARG_NONE,	/**< no argument, %% */
+	SPA_LOG_BINARY_ARG_INT,
+	SPA_LOG_BINARY_ARG_LONG,
+	SPA_LOG_BINARY_ARG_LONG_LONG,
+	SPA_LOG_BINARY_ARG_SIZE,
+	SPA_LOG_BINARY_ARG_INTMAX,
+	SPA_LOG_BINARY_ARG_PTRDIFF,
+	SPA_LOG_BINARY_ARG_DOUBLE,
+	SPA_LOG_BINARY_ARG_LONG_DOUBLE,	/**< stored as a double */
+	SPA_LOG_BINARY_ARG_STRING,
+	SPA_LOG_BINARY_ARG_POINTER,
+	SPA_LOG_BINARY_ARG_ERRNO,	/**< %m, stored as the string */
+};
+
+/** a conversion in a printf format */
+struct spa_log_binary_spec {
+	const char *start;		/**< the % */
+	const char *end;		/**< after the conversion character */
+	bool star_width;		/**< width is an int argument */
+	bool star_precision;		/**< precision is an int argument */
+	enum spa_log_binary_arg arg;	/**< the type of the argument */
+};
+
+/** Find the next conversion in \a fmt.
+ * \return true when a conversion was found, false at the end of \a fmt */
+static inline bool
+spa_log_binary_next_spec(const char *fmt, struct spa_log_binary_spec *spec)
+{
+	const char *p;
+	int length = 0;
+
+	if ((p = strchr(fmt, '%')) == NULL)
+		return false;
+
+	spec->start = p++;
+	spec->star_width = spec->star_precision = false;
+
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	if (*p == '*') {
+		spec->star_width = true;
+		p++;
+	}
+	while (*p >= '0' && *p <= '9')
+		p++;
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			spec->star_precision = true;
+			p++;
+		}
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+	for (;; p++) {
+		if (*p == 'h')
+			continue;
+		else if (*p == 'l')
+			length = length == 'l' ? 'q' : 'l';
+		else if (*p == 'q' || *p == 'L' || *p == 'j' || *p == 'z' || *p == 't')
+			length = *p;
+		else
+			break;
+	}
+
+	switch (*p) {
+	case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+		spec->arg = length == 'l' ? SPA_LOG_BINARY_ARG_LONG :
+			    length == 'q' ? SPA_LOG_BINARY_ARG_LONG_LONG :
+			    length == 'L' ? SPA_LOG_BINARY_ARG_LONG_LONG :
+			    length == 'z' ? SPA_LOG_BINARY_ARG_SIZE :
+			    length == 'j' ? SPA_LOG_BINARY_ARG_INTMAX :
+			    length == 't' ? SPA_LOG_BINARY_ARG_PTRDIFF :
+			    SPA_LOG_BINARY_ARG_INT;
+		break;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+		spec->arg = length == 'L' ?
+			SPA_LOG_BINARY_ARG_LONG_DOUBLE : SPA_LOG_BINARY_ARG_DOUBLE;
+		break;
+	case 's':
+		spec->arg = SPA_LOG_BINARY_ARG_STRING;
+		break;
+	case 'p': case 'n':
+		spec->arg = SPA_LOG_BINARY_ARG_POINTER;
+		break;
+	case 'm':
+		spec->arg = SPA_LOG_BINARY_ARG_ERRNO;
+		break;
+	case '\0':
+		spec->arg = SPA_LOG_BINARY_ARG_NONE;
+		spec->end = p;
+		return true;
+	default:
+		spec->arg = SPA_LOG_BINARY_ARG_NONE;
+		break;
+	}
+	spec->end = p + 1;
+	return true;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_LOG_BINARY_H__ */
@@ -106,7 +106,13 @@ struct spa_log {
 		      va_list args) SPA_PRINTF_FUNC(6, 0);
 };
 
-#define spa_log_level_enabled(l,lev) ((l) && (l)->level >= (lev))
+/* Messages above this level are removed at compile time, the format
+ * arguments are not evaluated. Set by the max_log_level build option. */
+#ifndef SPA_LOG_MAX_LEVEL
+#define SPA_LOG_MAX_LEVEL	SPA_LOG_LEVEL_TRACE
+#endif
+
+#define spa_log_level_enabled(l,lev) ((lev) <= SPA_LOG_MAX_LEVEL && (l) && (l)->level >= (lev))
 
 #if __STDC_VERSION__ >= 199901L
 
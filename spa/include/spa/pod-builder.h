@@ -42,6 +42,12 @@ struct spa_pod_builder {
 			   uint32_t size);
 	bool in_array;
 	bool first;
+	/** called when \a size bytes don't fit in data. The callback can make room
+	 * by updating data and size and returning 0. Because data can move, pointers
+	 * into the builder need to be looked up again with SPA_POD_BUILDER_DEREF()
+	 * after adding more data. */
+	int (*overflow) (void *overflow_data, struct spa_pod_builder *builder, uint32_t size);
+	void *overflow_data;
 };
 
 #define SPA_POD_BUILDER_INIT(buffer,size)  { buffer, size, }
@@ -50,10 +56,7 @@ struct spa_pod_builder {
 
 static inline void spa_pod_builder_init(struct spa_pod_builder *builder, void *data, uint32_t size)
 {
-	builder->data = data;
-	builder->size = size;
-	builder->offset = 0;
-	builder->stack = NULL;
+	*builder = (struct spa_pod_builder) SPA_POD_BUILDER_INIT(data, size);
 }
 
 static inline uint32_t
@@ -81,7 +84,10 @@ spa_pod_builder_raw(struct spa_pod_builder *builder, const void *data, uint32_t
 		ref = builder->write(builder, -1, data, size);
 	} else {
 		ref = builder->offset;
-		if (ref + size > builder->size)
+		if (ref + size > builder->size &&
+		    (builder->overflow == NULL ||
+		     builder->overflow(builder->overflow_data, builder, ref + size) < 0 ||
+		     ref + size > builder->size))
 			ref = -1;
 		else
 			memcpy(builder->data + ref, data, size);
@@ -357,7 +363,7 @@ spa_pod_builder_addv(struct spa_pod_builder *builder, uint32_t type, va_list arg
 			goto primitive;
 		case SPA_POD_TYPE_LONG:
 			head.long_pod.pod.type = SPA_POD_TYPE_LONG;
-			head.long_pod.pod.size = body_size = sizeof(uint32_t);
+			head.long_pod.pod.size = body_size = sizeof(uint64_t);
 			head.long_pod.value = va_arg(args, int64_t);
 			head_size = sizeof(struct spa_pod);
 			body = &head.long_pod.value;
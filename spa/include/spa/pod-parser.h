@@ -0,0 +1,283 @@
+/* Simple Plugin API
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_POD_PARSER_H__
+#define __SPA_POD_PARSER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdarg.h>
+#include <string.h>
+
+#include <spa/defs.h>
+#include <spa/pod-utils.h>
+
+/** Maximum nesting of containers accepted by the validation */
+#define SPA_POD_MAX_DEPTH	16
+
+static inline bool
+spa_pod_validate_contents(const void *data, uint32_t size, uint32_t depth,
+			  uint32_t *offsets, uint32_t max_offsets, uint32_t *n_offsets);
+
+/** Check the body of a pod that is not a container */
+static inline bool
+spa_pod_validate_primitive(uint32_t type, const void *body, uint32_t size)
+{
+	switch (type) {
+	case SPA_POD_TYPE_BOOL:
+	case SPA_POD_TYPE_ID:
+	case SPA_POD_TYPE_INT:
+	case SPA_POD_TYPE_FLOAT:
+		return size >= sizeof(int32_t);
+	case SPA_POD_TYPE_LONG:
+	case SPA_POD_TYPE_DOUBLE:
+	case SPA_POD_TYPE_RECTANGLE:
+	case SPA_POD_TYPE_FRACTION:
+		return size >= sizeof(int64_t);
+	case SPA_POD_TYPE_STRING:
+		/* fixed size string buffers are padded with 0 */
+		return size > 0 && (((const char *) body)[size - 1] == '\0' ||
+				    memchr(body, '\0', size) != NULL);
+	case SPA_POD_TYPE_POINTER:
+		return size >= sizeof(struct spa_pod_pointer_body);
+	default:
+		/* opaque data */
+		return true;
+	}
+}
+
+#define SPA_POD_TYPE_IS_CONTAINER(t)	((t) >= SPA_POD_TYPE_ARRAY && (t) <= SPA_POD_TYPE_PROP)
+
+/** Check that the body of a pod with \a type and \a size is well formed.
+ * Containers are checked recursively so that all the sizes inside can be
+ * trusted afterwards. */
+static inline bool
+spa_pod_validate_body(uint32_t type, const void *body, uint32_t size, uint32_t depth)
+{
+	switch (type) {
+	case SPA_POD_TYPE_ARRAY:
+	{
+		const struct spa_pod_array_body *b = body;
+
+		if (size < sizeof(struct spa_pod_array_body))
+			return false;
+		/* elements are iterated with the child size */
+		return size == sizeof(struct spa_pod_array_body) || b->child.size > 0;
+	}
+	case SPA_POD_TYPE_STRUCT:
+		if (depth >= SPA_POD_MAX_DEPTH)
+			return false;
+		return spa_pod_validate_contents(body, size, depth + 1, NULL, 0, NULL);
+	case SPA_POD_TYPE_OBJECT:
+		if (depth >= SPA_POD_MAX_DEPTH || size < sizeof(struct spa_pod_object_body))
+			return false;
+		return spa_pod_validate_contents(SPA_MEMBER(body, sizeof(struct spa_pod_object_body),
+							    const void),
+						 size - sizeof(struct spa_pod_object_body),
+						 depth + 1, NULL, 0, NULL);
+	case SPA_POD_TYPE_PROP:
+	{
+		const struct spa_pod_prop_body *b = body;
+
+		/* there must be at least a default value and the number of values
+		 * is computed with the value size */
+		if (size < sizeof(struct spa_pod_prop_body) || b->value.size == 0 ||
+		    size - sizeof(struct spa_pod_prop_body) < b->value.size)
+			return false;
+		if (depth >= SPA_POD_MAX_DEPTH)
+			return false;
+		return spa_pod_validate_body(b->value.type, SPA_POD_BODY_CONST(&b->value),
+					     b->value.size, depth + 1);
+	}
+	default:
+		return spa_pod_validate_primitive(type, body, size);
+	}
+}
+
+/** Check a series of pods in \a data and optionally store the offset of
+ * each pod in \a offsets. Trailing bytes that can't hold a pod header are
+ * rejected because SPA_POD_FOREACH() would read past the end. */
+static inline bool
+spa_pod_validate_contents(const void *data, uint32_t size, uint32_t depth,
+			  uint32_t *offsets, uint32_t max_offsets, uint32_t *n_offsets)
+{
+	uint32_t offset = 0, n = 0;
+
+	while (offset < size) {
+		const struct spa_pod *pod = SPA_MEMBER(data, offset, const struct spa_pod);
+
+		if (size - offset < sizeof(struct spa_pod) ||
+		    pod->size > size - offset - sizeof(struct spa_pod))
+			return false;
+
+		if (SPA_POD_TYPE_IS_CONTAINER(pod->type)) {
+			if (!spa_pod_validate_body(pod->type, SPA_POD_BODY_CONST(pod), pod->size, depth))
+				return false;
+		} else if (!spa_pod_validate_primitive(pod->type, SPA_POD_BODY_CONST(pod), pod->size))
+			return false;
+
+		if (offsets) {
+			if (n == max_offsets)
+				return false;
+			offsets[n] = offset;
+		}
+		n++;
+
+		offset += SPA_ROUND_UP_N(SPA_POD_SIZE(pod), 8);
+	}
+	if (n_offsets)
+		*n_offsets = n;
+
+	return true;
+}
+
+/** Check that \a pod of at most \a size bytes is well formed */
+static inline bool spa_pod_validate(const struct spa_pod *pod, uint32_t size)
+{
+	if (pod == NULL || size < sizeof(struct spa_pod) ||
+	    pod->size > size - sizeof(struct spa_pod))
+		return false;
+
+	return spa_pod_validate_body(pod->type, SPA_POD_BODY_CONST(pod), pod->size, 0);
+}
+
+/** A parser for the fields of a struct or object.
+ *
+ * The pod is validated in one pass when the parser is initialized. The
+ * offset of each field is kept in a caller provided array so that any
+ * field can be retrieved without walking the pod again.
+ */
+struct spa_pod_parser {
+	void *data;		/**< contents of the struct or object */
+	uint32_t *offsets;	/**< offset in data of each field */
+	uint32_t n_fields;	/**< number of fields */
+	uint32_t pos;		/**< next field for spa_pod_parser_get() */
+};
+
+/** The maximum number of fields in a pod of \a size bytes */
+#define SPA_POD_PARSER_MAX_FIELDS(size)	((size) / sizeof(struct spa_pod))
+
+/** Validate the struct or object pod in \a data and index its fields.
+ *
+ * \param parser a parser to initialize
+ * \param data a struct or object pod
+ * \param size the available size of \a data
+ * \param offsets array to store the field offsets in
+ * \param max_fields number of elements in \a offsets
+ * \return true when the pod is valid and has at most \a max_fields fields
+ */
+static inline bool
+spa_pod_parser_init(struct spa_pod_parser *parser, void *data, uint32_t size,
+		    uint32_t *offsets, uint32_t max_fields)
+{
+	struct spa_pod *pod = data;
+	uint32_t skip;
+
+	parser->data = NULL;
+	parser->offsets = offsets;
+	parser->n_fields = 0;
+	parser->pos = 0;
+
+	if (pod == NULL || size < sizeof(struct spa_pod) ||
+	    pod->size > size - sizeof(struct spa_pod))
+		return false;
+
+	switch (pod->type) {
+	case SPA_POD_TYPE_STRUCT:
+		skip = sizeof(struct spa_pod_struct);
+		break;
+	case SPA_POD_TYPE_OBJECT:
+		if (pod->size < sizeof(struct spa_pod_object_body))
+			return false;
+		skip = sizeof(struct spa_pod_object);
+		break;
+	default:
+		return false;
+	}
+
+	if (!spa_pod_validate_contents(SPA_MEMBER(pod, skip, void), SPA_POD_SIZE(pod) - skip, 1,
+				       offsets, max_fields, &parser->n_fields))
+		return false;
+
+	parser->data = SPA_MEMBER(pod, skip, void);
+	return true;
+}
+
+/** Get the number of fields that were not retrieved yet */
+static inline uint32_t spa_pod_parser_remaining(const struct spa_pod_parser *parser)
+{
+	return parser->n_fields - parser->pos;
+}
+
+/** Get the field at \a index or NULL when there is no such field */
+static inline struct spa_pod *
+spa_pod_parser_field(const struct spa_pod_parser *parser, uint32_t index)
+{
+	if (index >= parser->n_fields)
+		return NULL;
+	return SPA_MEMBER(parser->data, parser->offsets[index], struct spa_pod);
+}
+
+/** Move to the field at \a index */
+static inline bool spa_pod_parser_seek(struct spa_pod_parser *parser, uint32_t index)
+{
+	if (index > parser->n_fields)
+		return false;
+	parser->pos = index;
+	return true;
+}
+
+static inline bool spa_pod_parser_getv(struct spa_pod_parser *parser, uint32_t type, va_list args)
+{
+	while (type) {
+		struct spa_pod *pod = spa_pod_parser_field(parser, parser->pos);
+
+		if (pod == NULL)
+			return false;
+
+		SPA_POD_COLLECT(pod, type, args, error);
+
+		parser->pos++;
+		type = va_arg(args, uint32_t);
+	}
+	return true;
+      error:
+	return false;
+}
+
+/** Get the values of the next fields, like spa_pod_iter_get() */
+static inline bool spa_pod_parser_get(struct spa_pod_parser *parser, uint32_t type, ...)
+{
+	va_list args;
+	bool res;
+
+	va_start(args, type);
+	res = spa_pod_parser_getv(parser, type, args);
+	va_end(args);
+
+	return res;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_POD_PARSER_H__ */
@@ -0,0 +1,50 @@
+/* Simple Plugin API
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_PROBE_H__
+#define __SPA_PROBE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * SPA_PROBE:
+ * @provider: the provider name, spa or pipewire
+ * @name: the probe name
+ * @...: up to 12 integer or pointer arguments
+ *
+ * A static tracepoint. With SPA_ENABLE_PROBES, set by the systemtap build
+ * option, this is a USDT probe from <sys/sdt.h> that can be attached to
+ * with systemtap, perf, bpftrace or gdb. A probe is a nop instruction
+ * when nothing is attached. Without SPA_ENABLE_PROBES, it expands to
+ * nothing.
+ */
+#ifdef SPA_ENABLE_PROBES
+#include <sys/sdt.h>
+#define SPA_PROBE(provider,name,...)	STAP_PROBEV(provider,name,##__VA_ARGS__)
+#else
+#define SPA_PROBE(provider,name,...)
+#endif
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_PROBE_H__ */
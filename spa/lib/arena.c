@@ -0,0 +1,60 @@
+/* Simple Plugin API
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+
+#include <lib/arena.h>
+
+#define MIN_SIZE	1024
+/* the builder sizes are 32 bits, leave room to round up */
+#define MAX_SIZE	(1u << 30)
+
+static int arena_overflow(void *overflow_data, struct spa_pod_builder *builder, uint32_t size)
+{
+	struct spa_pod_arena *arena = overflow_data;
+	uint32_t new_size;
+	void *data;
+
+	if (size > MAX_SIZE)
+		return SPA_RESULT_NO_MEMORY;
+
+	for (new_size = SPA_MAX(arena->size, MIN_SIZE); new_size < size; new_size *= 2);
+
+	if ((data = realloc(arena->data, new_size)) == NULL)
+		return SPA_RESULT_NO_MEMORY;
+
+	arena->data = builder->data = data;
+	arena->size = builder->size = new_size;
+
+	return SPA_RESULT_OK;
+}
+
+void spa_pod_arena_builder(struct spa_pod_arena *arena, struct spa_pod_builder *builder)
+{
+	spa_pod_builder_init(builder, arena->data, arena->size);
+	builder->overflow = arena_overflow;
+	builder->overflow_data = arena;
+}
+
+void spa_pod_arena_clear(struct spa_pod_arena *arena)
+{
+	free(arena->data);
+	arena->data = NULL;
+	arena->size = 0;
+}
@@ -0,0 +1,54 @@
+/* Simple Plugin API
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_LIBARENA_H__
+#define __SPA_LIBARENA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <spa/pod-builder.h>
+
+/** Growable memory for building pods.
+ *
+ * A builder initialized with spa_pod_arena_builder() writes into the arena
+ * and enlarges it when the pod does not fit. The memory is reused for the
+ * next builder so that, once the arena has grown to the largest pod, no
+ * more allocations are done. Pods built in the arena stay valid until the
+ * next call to spa_pod_arena_builder() or spa_pod_arena_clear().
+ */
+struct spa_pod_arena {
+	void *data;
+	uint32_t size;
+};
+
+#define SPA_POD_ARENA_INIT	{ NULL, 0 }
+
+/** Initialize \a builder to write from the start of \a arena */
+void spa_pod_arena_builder(struct spa_pod_arena *arena, struct spa_pod_builder *builder);
+
+/** Free the memory of \a arena */
+void spa_pod_arena_clear(struct spa_pod_arena *arena);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __SPA_LIBARENA_H__ */
@@ -21,9 +21,23 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 
 #include <spa/props.h>
 
+/* largest ratio of two float steps that is tried to find a common grid */
+#define MAX_STEP_RATIO	1024
+
+static inline int compare_i64(int64_t v1, int64_t v2)
+{
+	return v1 < v2 ? -1 : v1 > v2 ? 1 : 0;
+}
+
+static inline int compare_f64(double v1, double v2)
+{
+	return v1 < v2 ? -1 : v1 > v2 ? 1 : 0;
+}
+
 static int compare_value(enum spa_pod_type type, const void *r1, const void *r2)
 {
 	switch (type) {
@@ -33,13 +47,13 @@ static int compare_value(enum spa_pod_type type, const void *r1, const void *r2)
 	case SPA_POD_TYPE_ID:
 		return *(int32_t *) r1 == *(uint32_t *) r2 ? 0 : 1;
 	case SPA_POD_TYPE_INT:
-		return *(int32_t *) r1 - *(int32_t *) r2;
+		return compare_i64(*(int32_t *) r1, *(int32_t *) r2);
 	case SPA_POD_TYPE_LONG:
-		return *(int64_t *) r1 - *(int64_t *) r2;
+		return compare_i64(*(int64_t *) r1, *(int64_t *) r2);
 	case SPA_POD_TYPE_FLOAT:
-		return *(float *) r1 - *(float *) r2;
+		return compare_f64(*(float *) r1, *(float *) r2);
 	case SPA_POD_TYPE_DOUBLE:
-		return *(double *) r1 - *(double *) r2;
+		return compare_f64(*(double *) r1, *(double *) r2);
 	case SPA_POD_TYPE_STRING:
 		return strcmp(r1, r2);
 	case SPA_POD_TYPE_RECTANGLE:
@@ -60,12 +74,7 @@ static int compare_value(enum spa_pod_type type, const void *r1, const void *r2)
 		int64_t n1, n2;
 		n1 = ((int64_t) f1->num) * f2->denom;
 		n2 = ((int64_t) f2->num) * f1->denom;
-		if (n1 < n2)
-			return -1;
-		else if (n1 > n2)
-			return 1;
-		else
-			return 0;
+		return compare_i64(n1, n2);
 	}
 	default:
 		break;
@@ -73,6 +82,397 @@ static int compare_value(enum spa_pod_type type, const void *r1, const void *r2)
 	return 0;
 }
 
+/* Values of integer types are handled per component so that ranges of
+ * rectangles are intersected for the width and height separately. */
+static inline uint32_t n_components(uint32_t type)
+{
+	switch (type) {
+	case SPA_POD_TYPE_INT:
+	case SPA_POD_TYPE_LONG:
+		return 1;
+	case SPA_POD_TYPE_RECTANGLE:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+static inline int64_t get_component(uint32_t type, const void *v, uint32_t c)
+{
+	switch (type) {
+	case SPA_POD_TYPE_INT:
+		return *(int32_t *) v;
+	case SPA_POD_TYPE_LONG:
+		return *(int64_t *) v;
+	case SPA_POD_TYPE_RECTANGLE:
+		return c == 0 ? ((struct spa_rectangle *) v)->width :
+				((struct spa_rectangle *) v)->height;
+	default:
+		return 0;
+	}
+}
+
+static inline void set_component(uint32_t type, void *v, uint32_t c, int64_t val)
+{
+	switch (type) {
+	case SPA_POD_TYPE_INT:
+		*(int32_t *) v = val;
+		break;
+	case SPA_POD_TYPE_LONG:
+		*(int64_t *) v = val;
+		break;
+	case SPA_POD_TYPE_RECTANGLE:
+		if (c == 0)
+			((struct spa_rectangle *) v)->width = val;
+		else
+			((struct spa_rectangle *) v)->height = val;
+		break;
+	default:
+		break;
+	}
+}
+
+static inline int64_t gcd_i64(int64_t a, int64_t b)
+{
+	while (b != 0) {
+		int64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* types with ranges that can have a step */
+static inline bool has_step(uint32_t type)
+{
+	switch (type) {
+	case SPA_POD_TYPE_FLOAT:
+	case SPA_POD_TYPE_DOUBLE:
+	case SPA_POD_TYPE_FRACTION:
+		return true;
+	default:
+		return n_components(type) > 0;
+	}
+}
+
+static inline double get_f64(uint32_t type, const void *v)
+{
+	return type == SPA_POD_TYPE_FLOAT ? *(float *) v : *(double *) v;
+}
+
+static inline void set_f64(uint32_t type, void *v, double val)
+{
+	if (type == SPA_POD_TYPE_FLOAT)
+		*(float *) v = val;
+	else
+		*(double *) v = val;
+}
+
+/* the relative error that is allowed for floats on a grid */
+static inline double f64_epsilon(uint32_t type)
+{
+	return type == SPA_POD_TYPE_FLOAT ? 1e-5 : 1e-9;
+}
+
+static inline bool f64_on_grid(double v, double min, double step, double eps)
+{
+	double r = (v - min) / step;
+	return fabs(r - floor(r + 0.5)) <= eps * SPA_MAX(1.0, fabs(r));
+}
+
+/* put fractions on a common denominator so that they can be handled as
+ * integers, NULL fractions are scaled to 0. Fails when the denominator
+ * gets too large to keep the numerators inside 64 bits. */
+static bool
+fraction_scale(const void *f[], uint32_t n, int64_t *vals, int64_t *denom)
+{
+	uint32_t i;
+	int64_t d = 1;
+
+	for (i = 0; i < n; i++) {
+		const struct spa_fraction *fr = f[i];
+
+		if (fr == NULL)
+			continue;
+		if (fr->denom == 0)
+			return false;
+		d = (d / gcd_i64(d, fr->denom)) * fr->denom;
+		if (d > INT32_MAX)
+			return false;
+	}
+	for (i = 0; i < n; i++) {
+		const struct spa_fraction *fr = f[i];
+		vals[i] = fr ? (int64_t) fr->num * (d / fr->denom) : 0;
+	}
+	*denom = d;
+	return true;
+}
+
+static bool fraction_unscale(int64_t v, int64_t denom, void *f)
+{
+	struct spa_fraction *fr = f;
+	int64_t g = gcd_i64(v, denom);
+
+	if (v < 0 || v / g > UINT32_MAX)
+		return false;
+
+	fr->num = v / g;
+	fr->denom = denom / g;
+	return true;
+}
+
+/* check if v is inside min and max and on the grid of step when not NULL */
+static bool
+value_in_range(uint32_t type, const void *v, const void *min, const void *max, const void *step)
+{
+	uint32_t i, n = n_components(type);
+
+	if (n == 0) {
+		if (compare_value(type, v, min) < 0 || compare_value(type, v, max) > 0)
+			return false;
+		if (step == NULL)
+			return true;
+
+		switch (type) {
+		case SPA_POD_TYPE_FLOAT:
+		case SPA_POD_TYPE_DOUBLE:
+		{
+			double s = get_f64(type, step);
+			return s <= 0 || f64_on_grid(get_f64(type, v), get_f64(type, min), s,
+						     f64_epsilon(type));
+		}
+		case SPA_POD_TYPE_FRACTION:
+		{
+			const void *f[3] = { v, min, step };
+			int64_t vals[3], d;
+
+			/* fractions that can't be scaled are only checked
+			 * against the bounds */
+			if (!fraction_scale(f, 3, vals, &d) || vals[2] <= 0)
+				return true;
+			return (vals[0] - vals[1]) % vals[2] == 0;
+		}
+		default:
+			return true;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		int64_t c = get_component(type, v, i), c0 = get_component(type, min, i);
+
+		if (c < c0 || c > get_component(type, max, i))
+			return false;
+		if (step) {
+			int64_t s = get_component(type, step, i);
+			if (s > 0 && (c - c0) % s != 0)
+				return false;
+		}
+	}
+	return true;
+}
+
+/* intersect [min1, max1] with [min2, max2] */
+static bool
+intersect_range(uint32_t type, uint32_t size,
+		const void *min1, const void *max1,
+		const void *min2, const void *max2,
+		void *min, void *max)
+{
+	uint32_t i, n = n_components(type);
+
+	if (n == 0) {
+		memcpy(min, compare_value(type, min1, min2) < 0 ? min2 : min1, size);
+		memcpy(max, compare_value(type, max1, max2) < 0 ? max1 : max2, size);
+		return compare_value(type, min, max) <= 0;
+	}
+
+	memcpy(min, min1, size);
+	memcpy(max, max1, size);
+	for (i = 0; i < n; i++) {
+		int64_t lo = SPA_MAX(get_component(type, min1, i), get_component(type, min2, i));
+		int64_t hi = SPA_MIN(get_component(type, max1, i), get_component(type, max2, i));
+
+		if (lo > hi)
+			return false;
+
+		set_component(type, min, i, lo);
+		set_component(type, max, i, hi);
+	}
+	return true;
+}
+
+/* intersect two stepped ranges of one component, a step of 0 is a plain range.
+ * The result is the grid with the least common multiple of both steps, starting
+ * at the first value in both ranges that is on both grids. */
+static bool
+intersect_step_component(int64_t min1, int64_t max1, int64_t step1,
+			 int64_t min2, int64_t max2, int64_t step2,
+			 int64_t *min, int64_t *max, int64_t *step)
+{
+	int64_t lo = SPA_MAX(min1, min2), hi = SPA_MIN(max1, max2), v, i, n, g;
+
+	if (step1 <= 0)
+		step1 = 1;
+	if (step2 <= 0)
+		step2 = 1;
+
+	if (lo > hi)
+		return false;
+
+	/* first value on the grid of the first range not below lo */
+	v = min1 + ((lo - min1 + step1 - 1) / step1) * step1;
+
+	/* walk the first grid until it meets the second grid, the grids
+	 * meet within step2 / gcd(step1, step2) steps or never */
+	g = gcd_i64(step1, step2);
+	n = step2 / g;
+	for (i = 0; i < n && v <= hi; i++, v += step1) {
+		if ((v - min2) % step2 == 0)
+			break;
+	}
+	if (i == n || v > hi)
+		return false;
+
+	*step = (step1 / g) * step2;
+	*min = v;
+	*max = v + ((hi - v) / *step) * *step;
+
+	return true;
+}
+
+/* intersect two stepped ranges of floats, a step of 0 is a plain range.
+ * The grids meet when a small multiple of both steps is equal. */
+static bool
+intersect_step_f64(double min1, double max1, double step1,
+		   double min2, double max2, double step2, double eps,
+		   double *min, double *max, double *step)
+{
+	double lo = SPA_MAX(min1, min2), hi = SPA_MIN(max1, max2), v, q;
+	int64_t i, p;
+
+	if (lo > hi)
+		return false;
+
+	/* make the first range the one with a step */
+	if (step1 <= 0) {
+		double t;
+		t = min1, min1 = min2, min2 = t;
+		t = step1, step1 = step2, step2 = t;
+	}
+	if (step1 <= 0) {
+		*min = lo;
+		*max = hi;
+		*step = 0;
+		return true;
+	}
+
+	/* first value on the grid of the first range not below lo */
+	v = min1 + ceil((lo - min1) / step1 - eps) * step1;
+
+	p = 1;
+	if (step2 > 0) {
+		for (; p <= MAX_STEP_RATIO; p++) {
+			q = floor(p * step1 / step2 + 0.5);
+			if (q >= 1 && fabs(p * step1 - q * step2) <= eps * p * step1)
+				break;
+		}
+		if (p > MAX_STEP_RATIO)
+			return false;
+
+		/* walk the first grid until it meets the second grid */
+		for (i = 0; i < p && v <= hi + eps * step1; i++, v += step1) {
+			if (f64_on_grid(v, min2, step2, eps))
+				break;
+		}
+		if (i == p)
+			return false;
+	}
+	if (v > hi) {
+		if (v - hi > eps * step1)
+			return false;
+		v = hi;
+	}
+
+	*step = p * step1;
+	*min = v;
+	*max = SPA_MIN(v + floor((hi - v) / *step + eps) * *step, hi);
+
+	return true;
+}
+
+static int
+intersect_step(uint32_t type, uint32_t size,
+	       const void *min1, const void *max1, const void *step1,
+	       const void *min2, const void *max2, const void *step2,
+	       void *min, void *max, void *step)
+{
+	uint32_t i, n = n_components(type);
+
+	memcpy(min, min1, size);
+	memcpy(max, max1, size);
+	memcpy(step, step1 ? step1 : step2, size);
+
+	switch (type) {
+	case SPA_POD_TYPE_FLOAT:
+	case SPA_POD_TYPE_DOUBLE:
+	{
+		double lo, hi, s;
+
+		if (!intersect_step_f64(get_f64(type, min1), get_f64(type, max1),
+					step1 ? get_f64(type, step1) : 0,
+					get_f64(type, min2), get_f64(type, max2),
+					step2 ? get_f64(type, step2) : 0,
+					f64_epsilon(type), &lo, &hi, &s))
+			return SPA_RESULT_INCOMPATIBLE_PROPS;
+
+		set_f64(type, min, lo);
+		set_f64(type, max, hi);
+		set_f64(type, step, s);
+		return SPA_RESULT_OK;
+	}
+	case SPA_POD_TYPE_FRACTION:
+	{
+		/* fractions are intersected as integers on a common denominator */
+		const void *f[6] = { min1, max1, step1, min2, max2, step2 };
+		int64_t vals[6], d, lo, hi, s;
+
+		if (!fraction_scale(f, 6, vals, &d))
+			return SPA_RESULT_NOT_IMPLEMENTED;
+
+		if (!intersect_step_component(vals[0], vals[1], vals[2],
+					      vals[3], vals[4], vals[5],
+					      &lo, &hi, &s))
+			return SPA_RESULT_INCOMPATIBLE_PROPS;
+
+		if (!fraction_unscale(lo, d, min) ||
+		    !fraction_unscale(hi, d, max) ||
+		    !fraction_unscale(s, d, step))
+			return SPA_RESULT_NOT_IMPLEMENTED;
+		return SPA_RESULT_OK;
+	}
+	default:
+		break;
+	}
+
+	for (i = 0; i < n; i++) {
+		int64_t lo, hi, s;
+
+		if (!intersect_step_component(get_component(type, min1, i),
+					      get_component(type, max1, i),
+					      step1 ? get_component(type, step1, i) : 0,
+					      get_component(type, min2, i),
+					      get_component(type, max2, i),
+					      step2 ? get_component(type, step2, i) : 0,
+					      &lo, &hi, &s))
+			return SPA_RESULT_INCOMPATIBLE_PROPS;
+
+		set_component(type, min, i, lo);
+		set_component(type, max, i, hi);
+		set_component(type, step, i, s);
+	}
+	return SPA_RESULT_OK;
+}
+
 static void fix_default(struct spa_pod_prop *prop)
 {
 	void *val = SPA_MEMBER(prop, sizeof(struct spa_pod_prop), void),
@@ -118,195 +518,215 @@ static void fix_default(struct spa_pod_prop *prop)
 	}
 }
 
-static inline struct spa_pod_prop *find_prop(const struct spa_pod *pod, uint32_t size, uint32_t key)
+#define NEXT_POD(pod) SPA_MEMBER((pod), SPA_ROUND_UP_N(SPA_POD_SIZE(pod), 8), const struct spa_pod)
+
+/* find the property with key. *hint is set to the pod after the found
+ * property and is checked first on the next lookup. The properties of
+ * formats and their filters are mostly in the same order so that a lookup
+ * usually only looks at one property. */
+static inline struct spa_pod_prop *
+find_prop(const struct spa_pod *pod, uint32_t size, uint32_t key, const struct spa_pod **hint)
 {
-	const struct spa_pod *res;
+	const struct spa_pod *end = SPA_MEMBER(pod, size, const struct spa_pod), *res;
+
+	res = *hint;
+	if (res && res < end && res->type == SPA_POD_TYPE_PROP
+	    && ((struct spa_pod_prop *) res)->body.key == key)
+		goto found;
+
 	SPA_POD_FOREACH(pod, size, res) {
 		if (res->type == SPA_POD_TYPE_PROP
 		    && ((struct spa_pod_prop *) res)->body.key == key)
-			return (struct spa_pod_prop *) res;
+			goto found;
 	}
 	return NULL;
+
+      found:
+	*hint = NEXT_POD(res);
+	return (struct spa_pod_prop *) res;
 }
 
-int
-spa_props_filter(struct spa_pod_builder *b,
-		 const struct spa_pod *props,
-		 uint32_t props_size,
-		 const struct spa_pod *filter,
-		 uint32_t filter_size)
+static int
+filter_prop(struct spa_pod_builder *b,
+	    const struct spa_pod_prop *p1,
+	    const struct spa_pod_prop *p2)
 {
-	int j, k;
-	const struct spa_pod *pr;
-
-	SPA_POD_FOREACH(props, props_size, pr) {
-		struct spa_pod_frame f;
-		struct spa_pod_prop *p1, *p2, *np;
-		int nalt1, nalt2;
-		void *alt1, *alt2, *a1, *a2;
-		uint32_t rt1, rt2;
-
-		if (pr->type != SPA_POD_TYPE_PROP)
-			continue;
-
-		p1 = (struct spa_pod_prop *) pr;
-
-		if (filter == NULL || (p2 = find_prop(filter, filter_size, p1->body.key)) == NULL) {
-			/* no filter, copy the complete property */
-			spa_pod_builder_raw_padded(b, p1, SPA_POD_SIZE(p1));
-			continue;
-		}
-
-		/* incompatible property types */
-		if (p1->body.value.type != p2->body.value.type)
-			return SPA_RESULT_INCOMPATIBLE_PROPS;
-
-		rt1 = p1->body.flags & SPA_POD_PROP_RANGE_MASK;
-		rt2 = p2->body.flags & SPA_POD_PROP_RANGE_MASK;
-
-		/* else we filter. start with copying the property */
-		spa_pod_builder_push_prop(b, &f, p1->body.key, 0),
-		    np = SPA_POD_BUILDER_DEREF(b, f.ref, struct spa_pod_prop);
-
-		/* default value */
-		spa_pod_builder_raw(b, &p1->body.value,
-				    sizeof(p1->body.value) + p1->body.value.size);
-
-		alt1 = SPA_MEMBER(p1, sizeof(struct spa_pod_prop), void);
-		nalt1 = SPA_POD_PROP_N_VALUES(p1);
-		alt2 = SPA_MEMBER(p2, sizeof(struct spa_pod_prop), void);
-		nalt2 = SPA_POD_PROP_N_VALUES(p2);
-
-		if (p1->body.flags & SPA_POD_PROP_FLAG_UNSET) {
-			alt1 = SPA_MEMBER(alt1, p1->body.value.size, void);
-			nalt1--;
-		} else {
-			nalt1 = 1;
-			rt1 = SPA_POD_PROP_RANGE_NONE;
-		}
+	struct spa_pod_frame f;
+	struct spa_pod_prop *np;
+	uint32_t flags = 0;
+	int j, k, nalt1, nalt2, n_copied = 0;
+	void *alt1, *alt2, *a1, *a2;
+	uint32_t rt1, rt2, type, size;
+	uint8_t min[64], max[64], step[64];
+	int res;
+
+	/* incompatible property types */
+	if (p1->body.value.type != p2->body.value.type)
+		return SPA_RESULT_INCOMPATIBLE_PROPS;
+
+	type = p1->body.value.type;
+	size = p1->body.value.size;
+
+	rt1 = p1->body.flags & SPA_POD_PROP_RANGE_MASK;
+	rt2 = p2->body.flags & SPA_POD_PROP_RANGE_MASK;
+
+	alt1 = SPA_MEMBER(p1, sizeof(struct spa_pod_prop), void);
+	nalt1 = SPA_POD_PROP_N_VALUES(p1);
+	alt2 = SPA_MEMBER(p2, sizeof(struct spa_pod_prop), void);
+	nalt2 = SPA_POD_PROP_N_VALUES(p2);
+
+	if (p1->body.flags & SPA_POD_PROP_FLAG_UNSET) {
+		alt1 = SPA_MEMBER(alt1, size, void);
+		nalt1--;
+	} else {
+		nalt1 = 1;
+		rt1 = SPA_POD_PROP_RANGE_NONE;
+	}
 
-		if (p2->body.flags & SPA_POD_PROP_FLAG_UNSET) {
-			alt2 = SPA_MEMBER(alt2, p2->body.value.size, void);
-			nalt2--;
-		} else {
-			nalt2 = 1;
-			rt2 = SPA_POD_PROP_RANGE_NONE;
-		}
+	if (p2->body.flags & SPA_POD_PROP_FLAG_UNSET) {
+		alt2 = SPA_MEMBER(alt2, p2->body.value.size, void);
+		nalt2--;
+	} else {
+		nalt2 = 1;
+		rt2 = SPA_POD_PROP_RANGE_NONE;
+	}
 
-		if ((rt1 == SPA_POD_PROP_RANGE_NONE && rt2 == SPA_POD_PROP_RANGE_NONE) ||
-		    (rt1 == SPA_POD_PROP_RANGE_NONE && rt2 == SPA_POD_PROP_RANGE_ENUM) ||
-		    (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_NONE) ||
-		    (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_ENUM)) {
-			int n_copied = 0;
-			/* copy all equal values */
-			for (j = 0, a1 = alt1; j < nalt1; j++, a1 += p1->body.value.size) {
-				for (k = 0, a2 = alt2; k < nalt2; k++, a2 += p2->body.value.size) {
-					if (compare_value(p1->body.value.type, a1, a2) == 0) {
-						spa_pod_builder_raw(b, a1, p1->body.value.size);
-						n_copied++;
-					}
+	/* a fixed value is an enumeration of one value */
+	if (rt1 == SPA_POD_PROP_RANGE_NONE)
+		rt1 = SPA_POD_PROP_RANGE_ENUM;
+	if (rt2 == SPA_POD_PROP_RANGE_NONE)
+		rt2 = SPA_POD_PROP_RANGE_ENUM;
+
+	if (rt1 == SPA_POD_PROP_RANGE_FLAGS || rt2 == SPA_POD_PROP_RANGE_FLAGS)
+		return SPA_RESULT_NOT_IMPLEMENTED;
+
+	if ((rt1 == SPA_POD_PROP_RANGE_MIN_MAX && nalt1 < 2) ||
+	    (rt1 == SPA_POD_PROP_RANGE_STEP && nalt1 < 3) ||
+	    (rt2 == SPA_POD_PROP_RANGE_MIN_MAX && nalt2 < 2) ||
+	    (rt2 == SPA_POD_PROP_RANGE_STEP && nalt2 < 3))
+		return SPA_RESULT_INVALID_FORMAT_PROPERTIES;
+
+	if (rt1 != SPA_POD_PROP_RANGE_ENUM && rt2 != SPA_POD_PROP_RANGE_ENUM &&
+	    size > sizeof(min))
+		return SPA_RESULT_NOT_IMPLEMENTED;
+
+	/* start with copying the property */
+	spa_pod_builder_push_prop(b, &f, p1->body.key, 0);
+
+	/* default value */
+	spa_pod_builder_raw(b, &p1->body.value, sizeof(p1->body.value) + size);
+
+	if (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_ENUM) {
+		/* copy all equal values */
+		for (j = 0, a1 = alt1; j < nalt1; j++, a1 += size) {
+			for (k = 0, a2 = alt2; k < nalt2; k++, a2 += size) {
+				if (compare_value(type, a1, a2) == 0) {
+					spa_pod_builder_raw(b, a1, size);
+					n_copied++;
 				}
 			}
-			if (n_copied == 0)
-				return SPA_RESULT_INCOMPATIBLE_PROPS;
-			np->body.flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
 		}
-
-		if ((rt1 == SPA_POD_PROP_RANGE_NONE && rt2 == SPA_POD_PROP_RANGE_MIN_MAX) ||
-		    (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_MIN_MAX)) {
-			int n_copied = 0;
-			/* copy all values inside the range */
-			for (j = 0, a1 = alt1, a2 = alt2; j < nalt1; j++, a1 += p1->body.value.size) {
-				if (compare_value(p1->body.value.type, a1, a2) < 0)
-					continue;
-				if (compare_value(p1->body.value.type, a1, a2 + p2->body.value.size)
-				    > 0)
-					continue;
-				spa_pod_builder_raw(b, a1, p1->body.value.size);
-				n_copied++;
-			}
-			if (n_copied == 0)
-				return SPA_RESULT_INCOMPATIBLE_PROPS;
-			np->body.flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
-		}
-
-		if ((rt1 == SPA_POD_PROP_RANGE_NONE && rt2 == SPA_POD_PROP_RANGE_STEP) ||
-		    (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_STEP)) {
-			return SPA_RESULT_NOT_IMPLEMENTED;
+		if (n_copied == 0)
+			return SPA_RESULT_INCOMPATIBLE_PROPS;
+		flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
+	}
+	else if (rt1 == SPA_POD_PROP_RANGE_ENUM) {
+		/* copy all values inside the range */
+		a2 = rt2 == SPA_POD_PROP_RANGE_STEP ? alt2 + 2 * size : NULL;
+		for (j = 0, a1 = alt1; j < nalt1; j++, a1 += size) {
+			if (!value_in_range(type, a1, alt2, alt2 + size, a2))
+				continue;
+			spa_pod_builder_raw(b, a1, size);
+			n_copied++;
 		}
-
-		if ((rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_NONE) ||
-		    (rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_ENUM)) {
-			int n_copied = 0;
-			/* copy all values inside the range */
-			for (k = 0, a1 = alt1, a2 = alt2; k < nalt2; k++, a2 += p2->body.value.size) {
-				if (compare_value(p1->body.value.type, a2, a1) < 0)
-					continue;
-				if (compare_value(p1->body.value.type, a2, a1 + p1->body.value.size)
-				    > 0)
-					continue;
-				spa_pod_builder_raw(b, a2, p2->body.value.size);
-				n_copied++;
-			}
-			if (n_copied == 0)
-				return SPA_RESULT_INCOMPATIBLE_PROPS;
-			np->body.flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
+		if (n_copied == 0)
+			return SPA_RESULT_INCOMPATIBLE_PROPS;
+		flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
+	}
+	else if (rt2 == SPA_POD_PROP_RANGE_ENUM) {
+		/* copy all values inside the range */
+		a1 = rt1 == SPA_POD_PROP_RANGE_STEP ? alt1 + 2 * size : NULL;
+		for (k = 0, a2 = alt2; k < nalt2; k++, a2 += size) {
+			if (!value_in_range(type, a2, alt1, alt1 + size, a1))
+				continue;
+			spa_pod_builder_raw(b, a2, size);
+			n_copied++;
 		}
+		if (n_copied == 0)
+			return SPA_RESULT_INCOMPATIBLE_PROPS;
+		flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
+	}
+	else if ((rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_MIN_MAX) ||
+		 !has_step(type)) {
+		/* intersect the ranges, keep a step when there is one */
+		if (!intersect_range(type, size, alt1, alt1 + size, alt2, alt2 + size, min, max))
+			return SPA_RESULT_INCOMPATIBLE_PROPS;
 
-		if (rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_MIN_MAX) {
-			if (compare_value(p1->body.value.type, alt1, alt2) < 0)
-				spa_pod_builder_raw(b, alt2, p2->body.value.size);
-			else
-				spa_pod_builder_raw(b, alt1, p1->body.value.size);
-
-			alt1 += p1->body.value.size;
-			alt2 += p2->body.value.size;
-
-			if (compare_value(p1->body.value.type, alt1, alt2) < 0)
-				spa_pod_builder_raw(b, alt1, p1->body.value.size);
-			else
-				spa_pod_builder_raw(b, alt2, p2->body.value.size);
+		spa_pod_builder_raw(b, min, size);
+		spa_pod_builder_raw(b, max, size);
 
-			np->body.flags |= SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET;
+		if (rt1 == SPA_POD_PROP_RANGE_STEP || rt2 == SPA_POD_PROP_RANGE_STEP) {
+			a1 = rt1 == SPA_POD_PROP_RANGE_STEP ? alt1 : alt2;
+			spa_pod_builder_raw(b, a1 + 2 * size, size);
+			flags |= SPA_POD_PROP_RANGE_STEP | SPA_POD_PROP_FLAG_UNSET;
+		} else {
+			flags |= SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET;
 		}
+	}
+	else {
+		/* at least one stepped range */
+		if ((res = intersect_step(type, size,
+					  alt1, alt1 + size,
+					  rt1 == SPA_POD_PROP_RANGE_STEP ? alt1 + 2 * size : NULL,
+					  alt2, alt2 + size,
+					  rt2 == SPA_POD_PROP_RANGE_STEP ? alt2 + 2 * size : NULL,
+					  min, max, step)) < 0)
+			return res;
+
+		spa_pod_builder_raw(b, min, size);
+		spa_pod_builder_raw(b, max, size);
+		spa_pod_builder_raw(b, step, size);
+		flags |= SPA_POD_PROP_RANGE_STEP | SPA_POD_PROP_FLAG_UNSET;
+	}
 
-		if (rt1 == SPA_POD_PROP_RANGE_NONE && rt2 == SPA_POD_PROP_RANGE_FLAGS)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-
-		if (rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_STEP)
-			return SPA_RESULT_NOT_IMPLEMENTED;
+	/* the builder can have moved the data, look up the prop again */
+	if (f.ref == -1) {
+		spa_pod_builder_pop(b, &f);
+		return SPA_RESULT_NO_MEMORY;
+	}
+	np = SPA_POD_BUILDER_DEREF(b, f.ref, struct spa_pod_prop);
+	np->body.flags |= flags;
 
-		if (rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_FLAGS)
-			return SPA_RESULT_NOT_IMPLEMENTED;
+	spa_pod_builder_pop(b, &f);
+	fix_default(np);
 
-		if (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_FLAGS)
-			return SPA_RESULT_NOT_IMPLEMENTED;
+	return SPA_RESULT_OK;
+}
 
-		if (rt1 == SPA_POD_PROP_RANGE_STEP && rt2 == SPA_POD_PROP_RANGE_NONE)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_STEP && rt2 == SPA_POD_PROP_RANGE_MIN_MAX)
-			return SPA_RESULT_NOT_IMPLEMENTED;
+int
+spa_props_filter(struct spa_pod_builder *b,
+		 const struct spa_pod *props,
+		 uint32_t props_size,
+		 const struct spa_pod *filter,
+		 uint32_t filter_size)
+{
+	const struct spa_pod *pr, *hint = NULL;
+	int res;
 
-		if (rt1 == SPA_POD_PROP_RANGE_STEP && rt2 == SPA_POD_PROP_RANGE_STEP)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_STEP && rt2 == SPA_POD_PROP_RANGE_ENUM)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_STEP && rt2 == SPA_POD_PROP_RANGE_FLAGS)
-			return SPA_RESULT_NOT_IMPLEMENTED;
+	SPA_POD_FOREACH(props, props_size, pr) {
+		const struct spa_pod_prop *p1, *p2;
 
-		if (rt1 == SPA_POD_PROP_RANGE_FLAGS && rt2 == SPA_POD_PROP_RANGE_NONE)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_FLAGS && rt2 == SPA_POD_PROP_RANGE_MIN_MAX)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_FLAGS && rt2 == SPA_POD_PROP_RANGE_STEP)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_FLAGS && rt2 == SPA_POD_PROP_RANGE_ENUM)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_FLAGS && rt2 == SPA_POD_PROP_RANGE_FLAGS)
-			return SPA_RESULT_NOT_IMPLEMENTED;
+		if (pr->type != SPA_POD_TYPE_PROP)
+			continue;
 
-		spa_pod_builder_pop(b, &f);
-		fix_default(np);
+		p1 = (const struct spa_pod_prop *) pr;
+		if (filter == NULL || (p2 = find_prop(filter, filter_size, p1->body.key, &hint)) == NULL) {
+			/* no filter, copy the complete property */
+			spa_pod_builder_raw_padded(b, p1, SPA_POD_SIZE(p1));
+			continue;
+		}
+		if ((res = filter_prop(b, p1, p2)) < 0)
+			return res;
 	}
 	return SPA_RESULT_OK;
 }
@@ -316,18 +736,18 @@ int spa_props_compare(const struct spa_pod *props1,
                       const struct spa_pod *props2,
                       uint32_t props2_size)
 {
-	const struct spa_pod *pr;
+	const struct spa_pod *pr, *hint = NULL;
 
 	SPA_POD_FOREACH(props1, props1_size, pr) {
-		struct spa_pod_prop *p1, *p2;
+		const struct spa_pod_prop *p1, *p2;
 		void *a1, *a2;
 
 		if (pr->type != SPA_POD_TYPE_PROP)
 			continue;
 
-		p1 = (struct spa_pod_prop *) pr;
+		p1 = (const struct spa_pod_prop *) pr;
 
-		if ((p2 = find_prop(props2, props2_size, p1->body.key)) == NULL)
+		if ((p2 = find_prop(props2, props2_size, p1->body.key, &hint)) == NULL)
 			return SPA_RESULT_INCOMPATIBLE_PROPS;
 
 		/* incompatible property types */
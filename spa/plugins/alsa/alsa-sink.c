@@ -146,6 +146,9 @@ static int impl_node_send_command(struct spa_node *node, const struct spa_comman
 				       false,
 				       this);
 
+	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.ClockUpdate) {
+		return spa_alsa_clock_update(this,
+				(const struct spa_command_node_clock_update *) command);
 	} else
 		return SPA_RESULT_NOT_IMPLEMENTED;
 }
@@ -311,7 +314,7 @@ impl_node_port_get_format(struct spa_node *node,
 	if (!this->have_format)
 		return SPA_RESULT_NO_FORMAT;
 
-	spa_pod_builder_init(&b, this->format_buffer, sizeof(this->format_buffer));
+	spa_pod_arena_builder(&this->format_arena, &b);
 	spa_pod_builder_format(&b, &f[0], this->type.format,
 		this->type.media_type.audio,
 		this->type.media_subtype.raw,
@@ -572,6 +575,7 @@ static int impl_node_process_output(struct spa_node *node)
 
 static const struct spa_dict_item node_info_items[] = {
 	{ "media.class", "Audio/Sink" },
+	{ "node.driver", "1" },
 };
 
 static const struct spa_dict node_info = {
@@ -624,6 +628,15 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id,
 
 static int impl_clear(struct spa_handle *handle)
 {
+	struct state *this;
+
+	spa_return_val_if_fail(handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = (struct state *) handle;
+
+	spa_pod_arena_clear(&this->format_arena);
+	spa_pod_arena_clear(&this->enum_arena);
+
 	return SPA_RESULT_OK;
 }
 
@@ -8,6 +8,7 @@
 #include <math.h>
 #include <limits.h>
 #include <sys/timerfd.h>
+#include <inttypes.h>
 
 #include <lib/debug.h>
 #include <lib/format.h>
@@ -107,6 +108,14 @@ static snd_pcm_format_t spa_alsa_format_to_alsa(struct type *map, uint32_t forma
 	return SND_PCM_FORMAT_UNKNOWN;
 }
 
+/* the data of the builder can move when it grows, look up the prop to
+ * change its flags */
+static void set_prop_flags(struct spa_pod_builder *b, struct spa_pod_frame *f, uint32_t flags)
+{
+	if (f->ref != -1)
+		SPA_POD_BUILDER_DEREF(b, f->ref, struct spa_pod_prop)->body.flags |= flags;
+}
+
 int
 spa_alsa_enum_format(struct state *state, struct spa_format **format, const struct spa_format *filter, uint32_t index)
 {
@@ -115,10 +124,8 @@ spa_alsa_enum_format(struct state *state, struct spa_format **format, const stru
 	snd_pcm_format_mask_t *fmask;
 	int err, i, j, dir;
 	unsigned int min, max;
-	uint8_t buffer[4096];
-	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod_builder b;
 	struct spa_pod_frame f[2];
-	struct spa_pod_prop *prop;
 	struct spa_format *fmt;
 	int res;
 	bool opened;
@@ -134,6 +141,7 @@ spa_alsa_enum_format(struct state *state, struct spa_format **format, const stru
 	snd_pcm_hw_params_alloca(&params);
 	CHECK(snd_pcm_hw_params_any(hndl, params), "Broken configuration: no configurations available");
 
+	spa_pod_arena_builder(&state->enum_arena, &b);
 	spa_pod_builder_push_format(&b, &f[0], state->type.format,
 				    state->type.media_type.audio, state->type.media_subtype.raw);
 
@@ -141,7 +149,6 @@ spa_alsa_enum_format(struct state *state, struct spa_format **format, const stru
 	snd_pcm_hw_params_get_format_mask(params, fmask);
 
 	spa_pod_builder_push_prop(&b, &f[1], state->type.format_audio.format, SPA_POD_PROP_RANGE_NONE);
-	prop = SPA_POD_BUILDER_DEREF(&b, f[1].ref, struct spa_pod_prop);
 
 	for (i = 1, j = 0; i < SPA_N_ELEMENTS(format_info); i++) {
 		const struct format_info *fi = &format_info[i];
@@ -154,20 +161,19 @@ spa_alsa_enum_format(struct state *state, struct spa_format **format, const stru
 		}
 	}
 	if (j > 1)
-		prop->body.flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
+		set_prop_flags(&b, &f[1], SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
 	spa_pod_builder_pop(&b, &f[1]);
 
 	CHECK(snd_pcm_hw_params_get_rate_min(params, &min, &dir), "get_rate_min");
 	CHECK(snd_pcm_hw_params_get_rate_max(params, &max, &dir), "get_rate_max");
 
 	spa_pod_builder_push_prop(&b, &f[1], state->type.format_audio.rate, SPA_POD_PROP_RANGE_NONE);
-	prop = SPA_POD_BUILDER_DEREF(&b, f[1].ref, struct spa_pod_prop);
 
 	spa_pod_builder_int(&b, SPA_CLAMP(44100, min, max));
 	if (min != max) {
 		spa_pod_builder_int(&b, min);
 		spa_pod_builder_int(&b, max);
-		prop->body.flags |= SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET;
+		set_prop_flags(&b, &f[1], SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET);
 	}
 	spa_pod_builder_pop(&b, &f[1]);
 
@@ -175,20 +181,22 @@ spa_alsa_enum_format(struct state *state, struct spa_format **format, const stru
 	CHECK(snd_pcm_hw_params_get_channels_max(params, &max), "get_channels_max");
 
 	spa_pod_builder_push_prop(&b, &f[1], state->type.format_audio.channels, SPA_POD_PROP_RANGE_NONE);
-	prop = SPA_POD_BUILDER_DEREF(&b, f[1].ref, struct spa_pod_prop);
 
 	spa_pod_builder_int(&b, SPA_CLAMP(2, min, max));
 	if (min != max) {
 		spa_pod_builder_int(&b, min);
 		spa_pod_builder_int(&b, max);
-		prop->body.flags |= SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET;
+		set_prop_flags(&b, &f[1], SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET);
 	}
 	spa_pod_builder_pop(&b, &f[1]);
 	spa_pod_builder_pop(&b, &f[0]);
 
+	if (f[0].ref == -1)
+		return SPA_RESULT_NO_MEMORY;
+
 	fmt = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_format);
 
-	spa_pod_builder_init(&b, state->format_buffer, sizeof(state->format_buffer));
+	spa_pod_arena_builder(&state->format_arena, &b);
 	if ((res = spa_format_filter(fmt, filter, &b)) < 0)
 		return res;
 
@@ -450,6 +458,30 @@ static int alsa_try_resume(struct state *state)
 	return res;
 }
 
+/* wake up every graph cycle when we know the quantum */
+static int calc_threshold(struct state *state)
+{
+	uint64_t frames;
+
+	if (state->quantum == 0 || state->rate == 0)
+		return state->props.min_latency;
+
+	frames = state->quantum * state->rate / SPA_NSEC_PER_SEC;
+	return SPA_CLAMP(frames, 16, state->buffer_frames / 2);
+}
+
+int spa_alsa_clock_update(struct state *state, const struct spa_command_node_clock_update *cu)
+{
+	if (cu->body.change_mask.value & SPA_COMMAND_NODE_CLOCK_UPDATE_LATENCY) {
+		state->quantum = cu->body.latency.value;
+		if (state->started)
+			state->threshold = calc_threshold(state);
+		spa_log_info(state->log, "alsa %p: quantum %" PRIu64 " threshold %d",
+			     state, state->quantum, calc_threshold(state));
+	}
+	return SPA_RESULT_OK;
+}
+
 static inline void calc_timeout(size_t target, size_t current,
 				size_t rate, snd_htimestamp_t *now,
 				struct timespec *ts)
@@ -650,7 +682,7 @@ int spa_alsa_start(struct state *state, bool xrun_recover)
 	state->source.rmask = 0;
 	spa_loop_add_source(state->data_loop, &state->source);
 
-	state->threshold = state->props.min_latency;
+	state->threshold = calc_threshold(state);
 
 	if (state->stream == SND_PCM_STREAM_PLAYBACK) {
 		state->alsa_started = false;
@@ -39,6 +39,8 @@ extern "C" {
 #include <spa/audio/format-utils.h>
 #include <spa/format-builder.h>
 
+#include <lib/arena.h>
+
 struct props {
 	char device[64];
 	char device_name[128];
@@ -129,7 +131,8 @@ struct state {
 
 	bool have_format;
 	struct spa_audio_info current_format;
-	uint8_t format_buffer[1024];
+	struct spa_pod_arena format_arena;
+	struct spa_pod_arena enum_arena;
 
 	snd_pcm_uframes_t buffer_frames;
 	snd_pcm_uframes_t period_frames;
@@ -159,6 +162,8 @@ struct state {
 	int64_t sample_count;
 	int64_t last_ticks;
 	int64_t last_monotonic;
+
+	uint64_t quantum;		/* duration of a graph cycle in nsec or 0 */
 };
 
 #define PROP(f,key,type,...)							\
@@ -184,6 +189,8 @@ int spa_alsa_start(struct state *state, bool xrun_recover);
 int spa_alsa_pause(struct state *state, bool xrun_recover);
 int spa_alsa_close(struct state *state);
 
+int spa_alsa_clock_update(struct state *state, const struct spa_command_node_clock_update *cu);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
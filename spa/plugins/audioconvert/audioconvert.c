@@ -0,0 +1,1126 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <spa/log.h>
+#include <spa/type-map.h>
+#include <spa/node.h>
+#include <spa/list.h>
+#include <spa/audio/format-utils.h>
+#include <spa/format-builder.h>
+#include <spa/param-alloc.h>
+#include <lib/props.h>
+#include <lib/format.h>
+
+#include "fmt-ops.h"
+#include "channelmix.h"
+
+#define NAME "audioconvert"
+
+#define MAX_BUFFERS	16
+#define MAX_CHANNELS	CHANNELMIX_MAX_CHANNELS
+
+/* frames that are converted in one go, the size of the temporary
+ * buffers of a channel */
+#define BLOCK_SIZE	1024
+
+/* info key with the coefficients of the channel matrix, n_out rows of
+ * n_in coefficients separated by spaces or commas */
+#define KEY_MATRIX	"audioconvert.matrix"
+
+struct buffer {
+	struct spa_buffer *outbuf;
+	bool outstanding;
+	struct spa_meta_header *h;
+	struct spa_list link;
+};
+
+struct port {
+	bool have_format;
+	struct spa_audio_info format;
+	enum fmt fmt;
+	bool planar;
+	uint32_t sample_size;
+	uint32_t bpf;		/* bytes of a frame, of all planes together */
+
+	struct spa_port_info info;
+	uint8_t params_buffer[1024];
+
+	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+	struct spa_port_io *io;
+
+	uint32_t offset;	/* frames of the input buffer that are consumed */
+
+	struct spa_list empty;
+};
+
+struct type {
+	uint32_t node;
+	uint32_t format;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+	struct spa_type_event_node event_node;
+	struct spa_type_command_node command_node;
+	struct spa_type_param_alloc_buffers param_alloc_buffers;
+	struct spa_type_param_alloc_meta_enable param_alloc_meta_enable;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+	spa_type_event_node_map(map, &type->event_node);
+	spa_type_command_node_map(map, &type->command_node);
+	spa_type_param_alloc_buffers_map(map, &type->param_alloc_buffers);
+	spa_type_param_alloc_meta_enable_map(map, &type->param_alloc_meta_enable);
+}
+
+struct impl {
+	struct spa_handle handle;
+	struct spa_node node;
+
+	struct type type;
+	struct spa_type_map *map;
+	struct spa_log *log;
+
+	const struct spa_node_callbacks *callbacks;
+	void *callbacks_data;
+
+	uint8_t format_buffer[1024];
+
+	struct port in_ports[1];
+	struct port out_ports[1];
+
+	char *matrix;		/* configured channel matrix or NULL */
+
+	/* the conversion, selected when both ports have a format. The
+	 * samples are copied, converted in one pass or unpacked to planar
+	 * floats, mixed and packed again. */
+	bool have_convert;
+	bool passthrough;
+	const struct fmt_ops *direct;
+	const struct fmt_ops *unpack;
+	const struct fmt_ops *pack;
+	struct channelmix mix;
+	bool have_mix;
+
+	float *tmp[2][MAX_CHANNELS];
+	void *tmp_data;
+
+	bool started;
+};
+
+#define CHECK_IN_PORT(this,d,p)  ((d) == SPA_DIRECTION_INPUT && (p) == 0)
+#define CHECK_OUT_PORT(this,d,p) ((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
+#define CHECK_PORT(this,d,p)     ((p) == 0)
+#define GET_PORT(this,d,p)       ((d) == SPA_DIRECTION_INPUT ? &(this)->in_ports[p] : &(this)->out_ports[p])
+#define GET_OTHER_PORT(this,d)   ((d) == SPA_DIRECTION_INPUT ? &(this)->out_ports[0] : &(this)->in_ports[0])
+
+#define PROP(f,key,type,...)							\
+	SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)						\
+	SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |				\
+			SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_U_EN(f,key,type,n,...)						\
+	SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |				\
+			SPA_POD_PROP_RANGE_ENUM,type,n,__VA_ARGS__)
+
+static enum fmt get_fmt(struct impl *this, uint32_t format)
+{
+	struct spa_type_audio_format *t = &this->type.audio_format;
+
+	if (format == t->S16)
+		return FMT_S16;
+	if (format == t->S24)
+		return FMT_S24;
+	if (format == t->S24_32)
+		return FMT_S24_32;
+	if (format == t->S32)
+		return FMT_S32;
+	if (format == t->F32)
+		return FMT_F32;
+	if (format == t->F64)
+		return FMT_F64;
+	return FMT_UNKNOWN;
+}
+
+static void clear_convert(struct impl *this)
+{
+	free(this->tmp_data);
+	this->tmp_data = NULL;
+	this->have_convert = false;
+}
+
+static int setup_mix(struct impl *this, uint32_t n_src, uint32_t n_dst)
+{
+	float matrix[MAX_CHANNELS * MAX_CHANNELS];
+	const float *m = NULL;
+
+	if (this->matrix) {
+		if (channelmix_parse_matrix(this->matrix, n_src, n_dst, matrix) == SPA_RESULT_OK)
+			m = matrix;
+		else
+			spa_log_warn(this->log, NAME " %p: invalid matrix for %d -> %d channels, "
+				     "using default", this, n_src, n_dst);
+	}
+	return channelmix_init(&this->mix, n_src, n_dst, m, CHANNELMIX_CPU_SSE);
+}
+
+static int setup_convert(struct impl *this)
+{
+	struct port *in = &this->in_ports[0], *out = &this->out_ports[0];
+	uint32_t n_src, n_dst, i, j, n_tmp;
+	float *p;
+	int res;
+
+	clear_convert(this);
+
+	if (!in->have_format || !out->have_format)
+		return SPA_RESULT_OK;
+
+	n_src = in->format.info.raw.channels;
+	n_dst = out->format.info.raw.channels;
+
+	if ((res = setup_mix(this, n_src, n_dst)) < 0)
+		return res;
+
+	this->have_mix = !this->mix.identity;
+	this->passthrough = !this->have_mix && in->fmt == out->fmt && in->planar == out->planar;
+	this->direct = this->unpack = this->pack = NULL;
+
+	if (!this->passthrough && !this->have_mix)
+		this->direct = fmt_ops_find(in->fmt, in->planar, out->fmt, out->planar,
+					    n_src, FMT_OPS_CPU_SSE2);
+
+	if (!this->passthrough && this->direct == NULL) {
+		if (in->fmt != FMT_F32 || !in->planar)
+			this->unpack = fmt_ops_find(in->fmt, in->planar, FMT_F32, true,
+						    n_src, FMT_OPS_CPU_SSE2);
+		if (out->fmt != FMT_F32 || !out->planar)
+			this->pack = fmt_ops_find(FMT_F32, true, out->fmt, out->planar,
+						  n_dst, FMT_OPS_CPU_SSE2);
+	}
+
+	/* room for the unpacked input and the mixed output */
+	n_tmp = SPA_MAX(n_src, n_dst);
+	this->tmp_data = malloc(2 * n_tmp * BLOCK_SIZE * sizeof(float) + 16);
+	if (this->tmp_data == NULL)
+		return SPA_RESULT_NO_MEMORY;
+
+	p = (float *) SPA_ROUND_UP_N((uintptr_t) this->tmp_data, 16);
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < n_tmp; j++, p += BLOCK_SIZE)
+			this->tmp[i][j] = p;
+	}
+	this->have_convert = true;
+
+	spa_log_info(this->log, NAME " %p: %d/%d -> %d/%d channels %d -> %d, %s%s%s%s%s",
+		     this, in->fmt, in->planar, out->fmt, out->planar, n_src, n_dst,
+		     this->passthrough ? "copy " : "",
+		     this->direct ? "direct " : "",
+		     this->unpack ? "unpack " : "",
+		     this->have_mix ? "mix " : "",
+		     this->pack ? "pack" : "");
+
+	return SPA_RESULT_OK;
+}
+
+static int impl_node_get_props(struct spa_node *node, struct spa_props **props)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int impl_node_set_props(struct spa_node *node, const struct spa_props *props)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int impl_node_send_command(struct spa_node *node, const struct spa_command *command)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+	spa_return_val_if_fail(command != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (SPA_COMMAND_TYPE(command) == this->type.command_node.Start) {
+		this->started = true;
+	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Pause) {
+		this->started = false;
+	} else
+		return SPA_RESULT_NOT_IMPLEMENTED;
+
+	return SPA_RESULT_OK;
+}
+
+static int
+impl_node_set_callbacks(struct spa_node *node,
+			const struct spa_node_callbacks *callbacks,
+			void *data)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	this->callbacks = callbacks;
+	this->callbacks_data = data;
+
+	return SPA_RESULT_OK;
+}
+
+static int
+impl_node_get_n_ports(struct spa_node *node,
+		      uint32_t *n_input_ports,
+		      uint32_t *max_input_ports,
+		      uint32_t *n_output_ports,
+		      uint32_t *max_output_ports)
+{
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	if (n_input_ports)
+		*n_input_ports = 1;
+	if (max_input_ports)
+		*max_input_ports = 1;
+	if (n_output_ports)
+		*n_output_ports = 1;
+	if (max_output_ports)
+		*max_output_ports = 1;
+
+	return SPA_RESULT_OK;
+}
+
+static int
+impl_node_get_port_ids(struct spa_node *node,
+		       uint32_t n_input_ports,
+		       uint32_t *input_ids,
+		       uint32_t n_output_ports,
+		       uint32_t *output_ids)
+{
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	if (n_input_ports > 0 && input_ids)
+		input_ids[0] = 0;
+	if (n_output_ports > 0 && output_ids)
+		output_ids[0] = 0;
+
+	return SPA_RESULT_OK;
+}
+
+
+static int impl_node_add_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+impl_node_remove_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+impl_node_port_enum_formats(struct spa_node *node,
+			    enum spa_direction direction,
+			    uint32_t port_id,
+			    struct spa_format **format,
+			    const struct spa_format *filter,
+			    uint32_t index)
+{
+	struct impl *this;
+	int res;
+	struct spa_format *fmt;
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_frame f[2];
+	uint32_t count, match, def_format, def_layout, def_rate, def_channels;
+	struct port *other;
+	struct spa_type_audio_format *t;
+
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+	spa_return_val_if_fail(format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+	other = GET_OTHER_PORT(this, direction);
+	t = &this->type.audio_format;
+
+	/* prefer the format of the other port, nothing needs to be
+	 * converted then */
+	if (other->have_format) {
+		def_format = other->format.info.raw.format;
+		def_layout = other->format.info.raw.layout;
+		def_rate = other->format.info.raw.rate;
+		def_channels = other->format.info.raw.channels;
+	} else {
+		def_format = t->F32;
+		def_layout = SPA_AUDIO_LAYOUT_INTERLEAVED;
+		def_rate = 48000;
+		def_channels = 2;
+	}
+
+	count = match = filter ? 0 : index;
+
+      next:
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (count++) {
+	case 0:
+		/* the rate is not converted */
+		if (other->have_format) {
+			spa_pod_builder_format(&b, &f[0], this->type.format,
+				this->type.media_type.audio,
+				this->type.media_subtype.raw,
+				PROP_U_EN(&f[1], this->type.format_audio.format, SPA_POD_TYPE_ID, 7,
+					def_format,
+					t->S16, t->S24, t->S24_32, t->S32, t->F32, t->F64),
+				PROP_U_EN(&f[1], this->type.format_audio.layout, SPA_POD_TYPE_INT, 3,
+					def_layout,
+					SPA_AUDIO_LAYOUT_INTERLEAVED, SPA_AUDIO_LAYOUT_NON_INTERLEAVED),
+				PROP(&f[1], this->type.format_audio.rate, SPA_POD_TYPE_INT,
+					def_rate),
+				PROP_U_MM(&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT,
+					def_channels,
+					1, MAX_CHANNELS));
+		} else {
+			spa_pod_builder_format(&b, &f[0], this->type.format,
+				this->type.media_type.audio,
+				this->type.media_subtype.raw,
+				PROP_U_EN(&f[1], this->type.format_audio.format, SPA_POD_TYPE_ID, 7,
+					def_format,
+					t->S16, t->S24, t->S24_32, t->S32, t->F32, t->F64),
+				PROP_U_EN(&f[1], this->type.format_audio.layout, SPA_POD_TYPE_INT, 3,
+					def_layout,
+					SPA_AUDIO_LAYOUT_INTERLEAVED, SPA_AUDIO_LAYOUT_NON_INTERLEAVED),
+				PROP_U_MM(&f[1], this->type.format_audio.rate, SPA_POD_TYPE_INT,
+					def_rate,
+					1, INT32_MAX),
+				PROP_U_MM(&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT,
+					def_channels,
+					1, MAX_CHANNELS));
+		}
+		break;
+	default:
+		return SPA_RESULT_ENUM_END;
+	}
+	fmt = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_format);
+	spa_pod_builder_init(&b, this->format_buffer, sizeof(this->format_buffer));
+
+	if ((res = spa_format_filter(fmt, filter, &b)) != SPA_RESULT_OK || match++ != index)
+		goto next;
+
+	*format = SPA_POD_BUILDER_DEREF(&b, 0, struct spa_format);
+
+	return SPA_RESULT_OK;
+}
+
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers > 0) {
+		spa_log_info(this->log, NAME " %p: clear buffers", this);
+		port->n_buffers = 0;
+		port->offset = 0;
+		spa_list_init(&port->empty);
+	}
+	return SPA_RESULT_OK;
+}
+
+static int
+impl_node_port_set_format(struct spa_node *node,
+			  enum spa_direction direction,
+			  uint32_t port_id,
+			  uint32_t flags,
+			  const struct spa_format *format)
+{
+	struct impl *this;
+	struct port *port, *other;
+
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+	port = GET_PORT(this, direction, port_id);
+	other = GET_OTHER_PORT(this, direction);
+
+	if (format == NULL) {
+		port->have_format = false;
+		clear_buffers(this, port);
+		clear_convert(this);
+	} else {
+		struct spa_audio_info info = { SPA_FORMAT_MEDIA_TYPE(format),
+			SPA_FORMAT_MEDIA_SUBTYPE(format),
+		};
+		enum fmt fmt;
+
+		if (info.media_type != this->type.media_type.audio ||
+		    info.media_subtype != this->type.media_subtype.raw)
+			return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+		if (!spa_format_audio_raw_parse(format, &info.info.raw, &this->type.format_audio))
+			return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+		if ((fmt = get_fmt(this, info.info.raw.format)) == FMT_UNKNOWN ||
+		    info.info.raw.rate == 0 ||
+		    info.info.raw.channels == 0 ||
+		    info.info.raw.channels > MAX_CHANNELS)
+			return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+		if (other->have_format &&
+		    info.info.raw.rate != other->format.info.raw.rate)
+			return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+		port->format = info;
+		port->fmt = fmt;
+		port->planar = info.info.raw.layout == SPA_AUDIO_LAYOUT_NON_INTERLEAVED;
+		port->sample_size = fmt_ops_sample_size(fmt);
+		port->bpf = port->sample_size * info.info.raw.channels;
+		port->have_format = true;
+
+		return setup_convert(this);
+	}
+
+	return SPA_RESULT_OK;
+}
+
+static int
+impl_node_port_get_format(struct spa_node *node,
+			  enum spa_direction direction,
+			  uint32_t port_id,
+			  const struct spa_format **format)
+{
+	struct impl *this;
+	struct port *port;
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_frame f[2];
+
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+	spa_return_val_if_fail(format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return SPA_RESULT_NO_FORMAT;
+
+	spa_pod_builder_init(&b, this->format_buffer, sizeof(this->format_buffer));
+	spa_pod_builder_format(&b, &f[0], this->type.format,
+		this->type.media_type.audio,
+		this->type.media_subtype.raw,
+		PROP(&f[1], this->type.format_audio.format, SPA_POD_TYPE_ID,
+			port->format.info.raw.format),
+		PROP(&f[1], this->type.format_audio.layout, SPA_POD_TYPE_INT,
+			port->format.info.raw.layout),
+		PROP(&f[1], this->type.format_audio.rate, SPA_POD_TYPE_INT,
+			port->format.info.raw.rate),
+		PROP(&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT,
+			port->format.info.raw.channels));
+	*format = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_format);
+
+	return SPA_RESULT_OK;
+}
+
+static int
+impl_node_port_get_info(struct spa_node *node,
+			enum spa_direction direction,
+			uint32_t port_id,
+			const struct spa_port_info **info)
+{
+	struct impl *this;
+	struct port *port;
+
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+	spa_return_val_if_fail(info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+	port = GET_PORT(this, direction, port_id);
+	*info = &port->info;
+
+	return SPA_RESULT_OK;
+}
+
+static int
+impl_node_port_enum_params(struct spa_node *node,
+			   enum spa_direction direction,
+			   uint32_t port_id,
+			   uint32_t index,
+			   struct spa_param **param)
+{
+	struct spa_pod_builder b = { NULL };
+	struct spa_pod_frame f[2];
+	struct impl *this;
+	struct port *port;
+
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+	spa_return_val_if_fail(param != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return SPA_RESULT_NO_FORMAT;
+
+	spa_pod_builder_init(&b, port->params_buffer, sizeof(port->params_buffer));
+
+	switch (index) {
+	case 0:
+		spa_pod_builder_object(&b, &f[0], 0, this->type.param_alloc_buffers.Buffers,
+			PROP_U_MM(&f[1], this->type.param_alloc_buffers.size,    SPA_POD_TYPE_INT,
+										  BLOCK_SIZE * port->bpf,
+										  16 * port->bpf,
+										  INT32_MAX / port->bpf),
+			PROP     (&f[1], this->type.param_alloc_buffers.stride,  SPA_POD_TYPE_INT, 0),
+			PROP_U_MM(&f[1], this->type.param_alloc_buffers.buffers, SPA_POD_TYPE_INT,
+										  2, 1, MAX_BUFFERS),
+			PROP     (&f[1], this->type.param_alloc_buffers.align,   SPA_POD_TYPE_INT, 16));
+		break;
+
+	case 1:
+		spa_pod_builder_object(&b, &f[0], 0, this->type.param_alloc_meta_enable.MetaEnable,
+			PROP(&f[1], this->type.param_alloc_meta_enable.type, SPA_POD_TYPE_ID,
+				this->type.meta.Header),
+			PROP(&f[1], this->type.param_alloc_meta_enable.size, SPA_POD_TYPE_INT,
+				sizeof(struct spa_meta_header)));
+		break;
+
+	default:
+		return SPA_RESULT_NOT_IMPLEMENTED;
+	}
+
+	*param = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_param);
+
+	return SPA_RESULT_OK;
+}
+
+static int
+impl_node_port_set_param(struct spa_node *node,
+			 enum spa_direction direction,
+			 uint32_t port_id,
+			 const struct spa_param *param)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+impl_node_port_use_buffers(struct spa_node *node,
+			   enum spa_direction direction,
+			   uint32_t port_id,
+			   struct spa_buffer **buffers,
+			   uint32_t n_buffers)
+{
+	struct impl *this;
+	struct port *port;
+	uint32_t i, j;
+
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return SPA_RESULT_NO_FORMAT;
+
+	clear_buffers(this, port);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b;
+		struct spa_data *d = buffers[i]->datas;
+
+		b = &port->buffers[i];
+		b->outbuf = buffers[i];
+		b->outstanding = direction == SPA_DIRECTION_INPUT;
+		b->h = spa_buffer_find_meta(buffers[i], this->type.meta.Header);
+
+		for (j = 0; j < buffers[i]->n_datas; j++) {
+			if ((d[j].type != this->type.data.MemPtr &&
+			     d[j].type != this->type.data.MemFd &&
+			     d[j].type != this->type.data.DmaBuf) || d[j].data == NULL) {
+				spa_log_error(this->log, NAME " %p: invalid memory on buffer %p",
+					      this, buffers[i]);
+				return SPA_RESULT_ERROR;
+			}
+		}
+		if (buffers[i]->n_datas == 0) {
+			spa_log_error(this->log, NAME " %p: no data on buffer %p", this, buffers[i]);
+			return SPA_RESULT_ERROR;
+		}
+		if (direction == SPA_DIRECTION_OUTPUT)
+			spa_list_insert(port->empty.prev, &b->link);
+	}
+	port->n_buffers = n_buffers;
+
+	return SPA_RESULT_OK;
+}
+
+static int
+impl_node_port_alloc_buffers(struct spa_node *node,
+			     enum spa_direction direction,
+			     uint32_t port_id,
+			     struct spa_param **params,
+			     uint32_t n_params,
+			     struct spa_buffer **buffers,
+			     uint32_t *n_buffers)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+impl_node_port_set_io(struct spa_node *node,
+		      enum spa_direction direction,
+		      uint32_t port_id,
+		      struct spa_port_io *io)
+{
+	struct impl *this;
+	struct port *port;
+
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+	port = GET_PORT(this, direction, port_id);
+	port->io = io;
+
+	return SPA_RESULT_OK;
+}
+
+static void recycle_buffer(struct impl *this, uint32_t id)
+{
+	struct port *port = &this->out_ports[0];
+	struct buffer *b = &port->buffers[id];
+
+	if (!b->outstanding) {
+		spa_log_warn(this->log, NAME " %p: buffer %d not outstanding", this, id);
+		return;
+	}
+
+	spa_list_insert(port->empty.prev, &b->link);
+	b->outstanding = false;
+	spa_log_trace(this->log, NAME " %p: recycle buffer %d", this, id);
+}
+
+static int impl_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *this;
+	struct port *port;
+
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, SPA_DIRECTION_OUTPUT, port_id),
+			       SPA_RESULT_INVALID_PORT);
+
+	port = &this->out_ports[port_id];
+
+	if (port->n_buffers == 0)
+		return SPA_RESULT_NO_BUFFERS;
+
+	if (buffer_id >= port->n_buffers)
+		return SPA_RESULT_INVALID_BUFFER_ID;
+
+	recycle_buffer(this, buffer_id);
+
+	return SPA_RESULT_OK;
+}
+
+static int
+impl_node_port_send_command(struct spa_node *node,
+			    enum spa_direction direction,
+			    uint32_t port_id,
+			    const struct spa_command *command)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static struct buffer *find_free_buffer(struct impl *this, struct port *port)
+{
+	struct buffer *b;
+
+	if (spa_list_is_empty(&port->empty))
+		return NULL;
+
+	b = spa_list_first(&port->empty, struct buffer, link);
+	spa_list_remove(&b->link);
+	b->outstanding = true;
+
+	return b;
+}
+
+/* Get the pointers to the samples of \a buf, starting at frame \a offset.
+ * The planes of planar samples are in the datas of the buffer or, when
+ * there are not enough datas, after each other in the first data. */
+static void get_samples(struct port *port, struct spa_buffer *buf, uint32_t n_frames,
+			uint32_t offset, void *ptrs[])
+{
+	struct spa_data *d = buf->datas;
+	uint32_t i, channels = port->format.info.raw.channels;
+
+	if (!port->planar) {
+		ptrs[0] = SPA_MEMBER(d[0].data, d[0].chunk->offset + offset * port->bpf, void);
+	} else if (buf->n_datas >= channels) {
+		for (i = 0; i < channels; i++)
+			ptrs[i] = SPA_MEMBER(d[i].data,
+					     d[i].chunk->offset + offset * port->sample_size, void);
+	} else {
+		for (i = 0; i < channels; i++)
+			ptrs[i] = SPA_MEMBER(d[0].data, d[0].chunk->offset +
+					     (i * n_frames + offset) * port->sample_size, void);
+	}
+}
+
+static uint32_t get_frames(struct port *port, struct spa_buffer *buf, bool avail)
+{
+	struct spa_data *d = buf->datas;
+	uint32_t size, channels = port->format.info.raw.channels;
+
+	if (port->planar && buf->n_datas >= channels)
+		size = (avail ? d[0].chunk->size : d[0].maxsize) * channels;
+	else
+		size = avail ? d[0].chunk->size : d[0].maxsize;
+
+	return size / port->bpf;
+}
+
+static void convert(struct impl *this, void *dst[], const void *src[], uint32_t n_frames)
+{
+	struct port *in = &this->in_ports[0], *out = &this->out_ports[0];
+	uint32_t i, n_src = in->format.info.raw.channels, n_dst = out->format.info.raw.channels;
+	const void **s = src;
+	void **d;
+
+	if (this->passthrough) {
+		if (in->planar) {
+			for (i = 0; i < n_src; i++)
+				memcpy(dst[i], src[i], n_frames * in->sample_size);
+		} else
+			memcpy(dst[0], src[0], n_frames * in->bpf);
+		return;
+	}
+	if (this->direct) {
+		this->direct->func(dst, src, n_src, n_frames);
+		return;
+	}
+	if (this->unpack) {
+		d = (this->have_mix || this->pack) ? (void **) this->tmp[0] : dst;
+		this->unpack->func(d, s, n_src, n_frames);
+		s = (const void **) d;
+	}
+	if (this->have_mix) {
+		d = this->pack ? (void **) this->tmp[1] : dst;
+		channelmix_process(&this->mix, (float **) d, (const float **) s, n_frames);
+		s = (const void **) d;
+	}
+	if (this->pack)
+		this->pack->func(dst, s, n_dst, n_frames);
+}
+
+/* Convert the input that is left in sbuf into dbuf. Returns true when
+ * all of sbuf is consumed. */
+static bool do_convert(struct impl *this, struct buffer *dbuf, struct buffer *sbuf)
+{
+	struct port *in = &this->in_ports[0], *out = &this->out_ports[0];
+	struct spa_buffer *sb = sbuf->outbuf, *db = dbuf->outbuf;
+	uint32_t in_frames, n_frames, done, n, i;
+	void *src[MAX_CHANNELS], *dst[MAX_CHANNELS];
+
+	in_frames = get_frames(in, sb, true);
+	n_frames = SPA_MIN(in_frames - SPA_MIN(in->offset, in_frames), get_frames(out, db, false));
+
+	for (i = 0; i < db->n_datas; i++)
+		db->datas[i].chunk->offset = 0;
+
+	for (done = 0; done < n_frames; done += n) {
+		n = SPA_MIN(n_frames - done, BLOCK_SIZE);
+
+		get_samples(in, sb, in_frames, in->offset + done, src);
+		get_samples(out, db, n_frames, done, dst);
+
+		convert(this, dst, (const void **) src, n);
+	}
+	in->offset += n_frames;
+
+	if (out->planar && db->n_datas >= out->format.info.raw.channels) {
+		for (i = 0; i < out->format.info.raw.channels; i++) {
+			db->datas[i].chunk->size = n_frames * out->sample_size;
+			db->datas[i].chunk->stride = out->sample_size;
+		}
+	} else {
+		db->datas[0].chunk->size = n_frames * out->bpf;
+		db->datas[0].chunk->stride = out->planar ? out->sample_size : out->bpf;
+	}
+
+	if (sbuf->h && dbuf->h) {
+		dbuf->h->seq = sbuf->h->seq;
+		dbuf->h->pts = sbuf->h->pts;
+		dbuf->h->dts_offset = sbuf->h->dts_offset;
+	}
+
+	spa_log_trace(this->log, NAME " %p: %d frames", this, n_frames);
+
+	return in->offset >= in_frames;
+}
+
+static int impl_node_process_input(struct spa_node *node)
+{
+	struct impl *this;
+	struct spa_port_io *input;
+	struct spa_port_io *output;
+	struct port *in_port, *out_port;
+	struct buffer *dbuf;
+
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	out_port = &this->out_ports[0];
+	output = out_port->io;
+	spa_return_val_if_fail(output != NULL, SPA_RESULT_ERROR);
+
+	if (output->status == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_HAVE_BUFFER;
+
+	in_port = &this->in_ports[0];
+	input = in_port->io;
+	spa_return_val_if_fail(input != NULL, SPA_RESULT_ERROR);
+
+	if (!this->have_convert)
+		return SPA_RESULT_NO_FORMAT;
+
+	if (input->buffer_id >= in_port->n_buffers)
+		return SPA_RESULT_NEED_BUFFER;
+
+	if ((dbuf = find_free_buffer(this, out_port)) == NULL)
+		return SPA_RESULT_OUT_OF_BUFFERS;
+
+	/* keep the input buffer when the output buffer was too small */
+	if (do_convert(this, dbuf, &in_port->buffers[input->buffer_id])) {
+		in_port->offset = 0;
+		input->status = SPA_RESULT_NEED_BUFFER;
+	}
+
+	output->buffer_id = dbuf->outbuf->id;
+	output->status = SPA_RESULT_HAVE_BUFFER;
+
+	return SPA_RESULT_HAVE_BUFFER;
+}
+
+static int impl_node_process_output(struct spa_node *node)
+{
+	struct impl *this;
+	struct port *in_port, *out_port;
+	struct spa_port_io *input, *output;
+
+	spa_return_val_if_fail(node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	out_port = &this->out_ports[0];
+	output = out_port->io;
+	spa_return_val_if_fail(output != NULL, SPA_RESULT_ERROR);
+
+	if (output->status == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_HAVE_BUFFER;
+
+	/* recycle */
+	if (output->buffer_id < out_port->n_buffers) {
+		recycle_buffer(this, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	in_port = &this->in_ports[0];
+	input = in_port->io;
+	spa_return_val_if_fail(input != NULL, SPA_RESULT_ERROR);
+
+	/* ask for the same number of frames in the input format */
+	input->range = output->range;
+	if (this->have_convert) {
+		input->range.min_size = output->range.min_size / out_port->bpf * in_port->bpf;
+		input->range.max_size = output->range.max_size / out_port->bpf * in_port->bpf;
+	}
+	input->status = SPA_RESULT_NEED_BUFFER;
+
+	return SPA_RESULT_NEED_BUFFER;
+}
+
+static const struct spa_node impl_node = {
+	SPA_VERSION_NODE,
+	NULL,
+	impl_node_get_props,
+	impl_node_set_props,
+	impl_node_send_command,
+	impl_node_set_callbacks,
+	impl_node_get_n_ports,
+	impl_node_get_port_ids,
+	impl_node_add_port,
+	impl_node_remove_port,
+	impl_node_port_enum_formats,
+	impl_node_port_set_format,
+	impl_node_port_get_format,
+	impl_node_port_get_info,
+	impl_node_port_enum_params,
+	impl_node_port_set_param,
+	impl_node_port_use_buffers,
+	impl_node_port_alloc_buffers,
+	impl_node_port_set_io,
+	impl_node_port_reuse_buffer,
+	impl_node_port_send_command,
+	impl_node_process_input,
+	impl_node_process_output,
+};
+
+static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id, void **interface)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+	spa_return_val_if_fail(interface != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = (struct impl *) handle;
+
+	if (interface_id == this->type.node)
+		*interface = &this->node;
+	else
+		return SPA_RESULT_UNKNOWN_INTERFACE;
+
+	return SPA_RESULT_OK;
+}
+
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = (struct impl *) handle;
+
+	clear_convert(this);
+	free(this->matrix);
+
+	return SPA_RESULT_OK;
+}
+
+static int
+impl_init(const struct spa_handle_factory *factory,
+	  struct spa_handle *handle,
+	  const struct spa_dict *info,
+	  const struct spa_support *support,
+	  uint32_t n_support)
+{
+	struct impl *this;
+	uint32_t i;
+	const char *str;
+
+	spa_return_val_if_fail(factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+	spa_return_val_if_fail(handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
+
+	this = (struct impl *) handle;
+
+	for (i = 0; i < n_support; i++) {
+		if (strcmp(support[i].type, SPA_TYPE__TypeMap) == 0)
+			this->map = support[i].data;
+		else if (strcmp(support[i].type, SPA_TYPE__Log) == 0)
+			this->log = support[i].data;
+	}
+	if (this->map == NULL) {
+		spa_log_error(this->log, "a type-map is needed");
+		return SPA_RESULT_ERROR;
+	}
+	init_type(&this->type, this->map);
+
+	this->node = impl_node;
+
+	if (info && (str = spa_dict_lookup(info, KEY_MATRIX)))
+		this->matrix = strdup(str);
+
+	this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+	spa_list_init(&this->in_ports[0].empty);
+
+	this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
+	    SPA_PORT_INFO_FLAG_NO_REF;
+	spa_list_init(&this->out_ports[0].empty);
+
+	return SPA_RESULT_OK;
+}
+
+static const struct spa_interface_info impl_interfaces[] = {
+	{SPA_TYPE__Node,},
+};
+
+static int
+impl_enum_interface_info(const struct spa_handle_factory *factory,
+			 const struct spa_interface_info **info,
+			 uint32_t index)
+{
+	spa_return_val_if_fail(factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+	spa_return_val_if_fail(info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	switch (index) {
+	case 0:
+		*info = &impl_interfaces[index];
+		break;
+	default:
+		return SPA_RESULT_ENUM_END;
+	}
+	return SPA_RESULT_OK;
+}
+
+const struct spa_handle_factory spa_audioconvert_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	NAME,
+	NULL,
+	sizeof(struct impl),
+	impl_init,
+	impl_enum_interface_info,
+};
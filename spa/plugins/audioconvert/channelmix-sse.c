@@ -0,0 +1,65 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <xmmintrin.h>
+
+#include "channelmix.h"
+
+/* The channels are not aligned. Like the C kernel, the first input with a
+ * coefficient sets the output and the others are added to it. */
+void channelmix_sse(struct channelmix *mix, float *dst[], const float *src[], uint32_t n_samples)
+{
+	uint32_t o, i, n;
+
+	for (o = 0; o < mix->n_dst; o++) {
+		const float *m = mix->matrix[o];
+		float *d = dst[o];
+		bool first = true;
+
+		for (i = 0; i < mix->n_src; i++) {
+			const float *s = src[i];
+			__m128 c = _mm_set1_ps(m[i]);
+
+			if (m[i] == 0.0f)
+				continue;
+
+			n = 0;
+			if (first && m[i] == 1.0f) {
+				memcpy(d, s, n_samples * sizeof(float));
+				first = false;
+			} else if (first) {
+				for (; n + 4 <= n_samples; n += 4)
+					_mm_storeu_ps(&d[n], _mm_mul_ps(_mm_loadu_ps(&s[n]), c));
+				for (; n < n_samples; n++)
+					d[n] = s[n] * m[i];
+				first = false;
+			} else {
+				for (; n + 4 <= n_samples; n += 4)
+					_mm_storeu_ps(&d[n], _mm_add_ps(_mm_loadu_ps(&d[n]),
+							_mm_mul_ps(_mm_loadu_ps(&s[n]), c)));
+				for (; n < n_samples; n++)
+					d[n] += s[n] * m[i];
+			}
+		}
+		if (first)
+			memset(d, 0, n_samples * sizeof(float));
+	}
+}
@@ -0,0 +1,215 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "channelmix.h"
+
+#define M_SQRT1_2f	0.70710678f
+
+/* positions of the channels, in the order of the channels of the
+ * common layouts */
+enum pos {
+	FL, FR, FC, LFE, RL, RR, SL, SR, N_POS
+};
+
+static const enum pos layouts[][8] = {
+	[3] = { FL, FR, FC },
+	[4] = { FL, FR, RL, RR },
+	[5] = { FL, FR, FC, RL, RR },
+	[6] = { FL, FR, FC, LFE, RL, RR },
+	[8] = { FL, FR, FC, LFE, RL, RR, SL, SR },
+};
+
+static bool has_layout(uint32_t n_channels)
+{
+	return n_channels < SPA_N_ELEMENTS(layouts) && layouts[n_channels][1] == FR;
+}
+
+static void channelmix_c(struct channelmix *mix, float *dst[], const float *src[],
+			 uint32_t n_samples)
+{
+	uint32_t o, i, n;
+
+	for (o = 0; o < mix->n_dst; o++) {
+		const float *m = mix->matrix[o];
+		float *d = dst[o];
+		bool first = true;
+
+		for (i = 0; i < mix->n_src; i++) {
+			const float *s = src[i];
+			float c = m[i];
+
+			if (c == 0.0f)
+				continue;
+
+			if (first) {
+				if (c == 1.0f)
+					memcpy(d, s, n_samples * sizeof(float));
+				else
+					for (n = 0; n < n_samples; n++)
+						d[n] = s[n] * c;
+				first = false;
+			} else if (c == 1.0f) {
+				for (n = 0; n < n_samples; n++)
+					d[n] += s[n];
+			} else {
+				for (n = 0; n < n_samples; n++)
+					d[n] += s[n] * c;
+			}
+		}
+		if (first)
+			memset(d, 0, n_samples * sizeof(float));
+	}
+}
+
+/* Fold the channels of a common layout into stereo. The centre and the
+ * surround channels are added to both sides at -3dB, the LFE is dropped. */
+static void make_stereo_downmix(struct channelmix *mix)
+{
+	const enum pos *l = layouts[mix->n_src];
+	uint32_t i;
+
+	for (i = 0; i < mix->n_src; i++) {
+		switch (l[i]) {
+		case FL:
+			mix->matrix[0][i] = 1.0f;
+			break;
+		case FR:
+			mix->matrix[1][i] = 1.0f;
+			break;
+		case FC:
+			mix->matrix[0][i] = M_SQRT1_2f;
+			mix->matrix[1][i] = M_SQRT1_2f;
+			break;
+		case RL:
+		case SL:
+			mix->matrix[0][i] = M_SQRT1_2f;
+			break;
+		case RR:
+		case SR:
+			mix->matrix[1][i] = M_SQRT1_2f;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static void make_default_matrix(struct channelmix *mix)
+{
+	uint32_t i, j, n_src = mix->n_src, n_dst = mix->n_dst;
+	float max = 0.0f;
+
+	if (n_dst == 1) {
+		/* everything to mono */
+		for (i = 0; i < n_src; i++)
+			mix->matrix[0][i] = 1.0f;
+	} else if (n_src == 1) {
+		/* mono to the front channels */
+		mix->matrix[0][0] = 1.0f;
+		mix->matrix[1][0] = 1.0f;
+	} else if (n_dst == 2 && has_layout(n_src)) {
+		make_stereo_downmix(mix);
+	} else {
+		/* the channels that both sides have are kept, the others
+		 * are dropped or silent */
+		for (i = 0; i < SPA_MIN(n_src, n_dst); i++)
+			mix->matrix[i][i] = 1.0f;
+	}
+
+	/* no output channel can be louder than the loudest input */
+	for (i = 0; i < n_dst; i++) {
+		float sum = 0.0f;
+		for (j = 0; j < n_src; j++)
+			sum += mix->matrix[i][j];
+		max = SPA_MAX(max, sum);
+	}
+	if (max > 1.0f) {
+		for (i = 0; i < n_dst; i++)
+			for (j = 0; j < n_src; j++)
+				mix->matrix[i][j] /= max;
+	}
+}
+
+static bool is_identity(struct channelmix *mix)
+{
+	uint32_t i, j;
+
+	if (mix->n_src != mix->n_dst)
+		return false;
+
+	for (i = 0; i < mix->n_dst; i++) {
+		for (j = 0; j < mix->n_src; j++) {
+			if (mix->matrix[i][j] != (i == j ? 1.0f : 0.0f))
+				return false;
+		}
+	}
+	return true;
+}
+
+int channelmix_init(struct channelmix *mix, uint32_t n_src, uint32_t n_dst,
+		    const float *matrix, uint32_t cpu_flags)
+{
+	uint32_t i, j;
+
+	if (n_src == 0 || n_src > CHANNELMIX_MAX_CHANNELS ||
+	    n_dst == 0 || n_dst > CHANNELMIX_MAX_CHANNELS)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	mix->n_src = n_src;
+	mix->n_dst = n_dst;
+	memset(mix->matrix, 0, sizeof(mix->matrix));
+
+	if (matrix) {
+		for (i = 0; i < n_dst; i++)
+			for (j = 0; j < n_src; j++)
+				mix->matrix[i][j] = matrix[i * n_src + j];
+	} else
+		make_default_matrix(mix);
+
+	mix->identity = is_identity(mix);
+
+	mix->cpu_flags = 0;
+	mix->process = channelmix_c;
+#if defined (HAVE_SSE)
+	if ((cpu_flags & CHANNELMIX_CPU_SSE) && __builtin_cpu_supports("sse")) {
+		mix->cpu_flags |= CHANNELMIX_CPU_SSE;
+		mix->process = channelmix_sse;
+	}
+#endif
+	return SPA_RESULT_OK;
+}
+
+int channelmix_parse_matrix(const char *str, uint32_t n_src, uint32_t n_dst, float *matrix)
+{
+	uint32_t i, n = n_src * n_dst;
+	char *end;
+
+	for (i = 0; i < n; i++) {
+		while (*str == ' ' || *str == ',')
+			str++;
+		matrix[i] = strtof(str, &end);
+		if (end == str)
+			return SPA_RESULT_INVALID_ARGUMENTS;
+		str = end;
+	}
+	return SPA_RESULT_OK;
+}
@@ -0,0 +1,68 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <spa/defs.h>
+
+#define CHANNELMIX_MAX_CHANNELS	32
+
+/* implementations of the kernel that can be selected */
+#define CHANNELMIX_CPU_SSE	(1 << 0)
+
+struct channelmix;
+
+typedef void (*channelmix_func_t) (struct channelmix *mix, float *dst[], const float *src[],
+				   uint32_t n_samples);
+
+/**
+ * struct channelmix:
+ *
+ * Mixes planar float channels with a matrix, every output channel is the
+ * sum of the input channels multiplied by a row of the matrix.
+ */
+struct channelmix {
+	uint32_t n_src;
+	uint32_t n_dst;
+	uint32_t cpu_flags;	/* CHANNELMIX_CPU_ flags of the selected kernel */
+	bool identity;		/* the output is the same as the input */
+
+	float matrix[CHANNELMIX_MAX_CHANNELS][CHANNELMIX_MAX_CHANNELS];
+
+	channelmix_func_t process;
+};
+
+/** Initialize \a mix for \a n_src to \a n_dst channels. \a matrix contains
+ * n_dst rows of n_src coefficients or is NULL for the default matrix.
+ * \a cpu_flags limits the kernels that can be used and is masked with the
+ * features of the cpu. */
+int channelmix_init(struct channelmix *mix, uint32_t n_src, uint32_t n_dst,
+		    const float *matrix, uint32_t cpu_flags);
+
+/** Parse a matrix from a string of n_dst * n_src coefficients, separated by
+ * spaces or commas, into \a matrix. */
+int channelmix_parse_matrix(const char *str, uint32_t n_src, uint32_t n_dst, float *matrix);
+
+static inline void
+channelmix_process(struct channelmix *mix, float *dst[], const float *src[], uint32_t n_samples)
+{
+	mix->process(mix, dst, src, n_samples);
+}
+
+#if defined (HAVE_SSE)
+void channelmix_sse(struct channelmix *mix, float *dst[], const float *src[], uint32_t n_samples);
+#endif
@@ -0,0 +1,156 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <emmintrin.h>
+
+#include "fmt-ops.h"
+
+/* The same conversions as the C kernels, the samples are not aligned.
+ * The floats are clamped and truncated like the C kernels do so that the
+ * results are the same. */
+
+static inline __m128i s16_lo_to_s32(__m128i v)
+{
+	return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+}
+
+static inline __m128i s16_hi_to_s32(__m128i v)
+{
+	return _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+}
+
+static inline __m128i f32_to_s32_scaled(__m128 v, __m128 scale)
+{
+	v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+	return _mm_cvttps_epi32(_mm_mul_ps(v, scale));
+}
+
+void conv_s16_to_f32_sse2(void *dst[], const void *src[], uint32_t n_channels, uint32_t n_samples)
+{
+	const int16_t *s = src[0];
+	float *d = dst[0];
+	uint32_t i = 0, n = n_channels * n_samples;
+	__m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	__m128i in;
+
+	for (; i + 8 <= n; i += 8) {
+		in = _mm_loadu_si128((const __m128i *) &s[i]);
+		_mm_storeu_ps(&d[i], _mm_mul_ps(_mm_cvtepi32_ps(s16_lo_to_s32(in)), scale));
+		_mm_storeu_ps(&d[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(s16_hi_to_s32(in)), scale));
+	}
+	for (; i < n; i++)
+		d[i] = s[i] * (1.0f / 32768.0f);
+}
+
+void conv_f32_to_s16_sse2(void *dst[], const void *src[], uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s = src[0];
+	int16_t *d = dst[0];
+	uint32_t i = 0, n = n_channels * n_samples;
+	__m128 scale = _mm_set1_ps(32767.0f);
+	__m128i lo, hi;
+
+	for (; i + 8 <= n; i += 8) {
+		lo = f32_to_s32_scaled(_mm_loadu_ps(&s[i]), scale);
+		hi = f32_to_s32_scaled(_mm_loadu_ps(&s[i + 4]), scale);
+		_mm_storeu_si128((__m128i *) &d[i], _mm_packs_epi32(lo, hi));
+	}
+	for (; i < n; i++)
+		d[i] = (int16_t) (SPA_CLAMP(s[i], -1.0f, 1.0f) * 32767.0f);
+}
+
+void conv_s16_to_f32d_2_sse2(void *dst[], const void *src[], uint32_t n_channels, uint32_t n_samples)
+{
+	const int16_t *s = src[0];
+	float *d0 = dst[0], *d1 = dst[1];
+	uint32_t i = 0;
+	__m128 scale = _mm_set1_ps(1.0f / 32768.0f), lo, hi;
+	__m128i in;
+
+	for (; i + 4 <= n_samples; i += 4) {
+		in = _mm_loadu_si128((const __m128i *) &s[2 * i]);
+		lo = _mm_mul_ps(_mm_cvtepi32_ps(s16_lo_to_s32(in)), scale);
+		hi = _mm_mul_ps(_mm_cvtepi32_ps(s16_hi_to_s32(in)), scale);
+		_mm_storeu_ps(&d0[i], _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(&d1[i], _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+	for (; i < n_samples; i++) {
+		d0[i] = s[2 * i] * (1.0f / 32768.0f);
+		d1[i] = s[2 * i + 1] * (1.0f / 32768.0f);
+	}
+}
+
+void conv_f32d_to_s16_2_sse2(void *dst[], const void *src[], uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1];
+	int16_t *d = dst[0];
+	uint32_t i = 0;
+	__m128 scale = _mm_set1_ps(32767.0f), l, r;
+	__m128i lo, hi;
+
+	for (; i + 4 <= n_samples; i += 4) {
+		l = _mm_loadu_ps(&s0[i]);
+		r = _mm_loadu_ps(&s1[i]);
+		lo = f32_to_s32_scaled(_mm_unpacklo_ps(l, r), scale);
+		hi = f32_to_s32_scaled(_mm_unpackhi_ps(l, r), scale);
+		_mm_storeu_si128((__m128i *) &d[2 * i], _mm_packs_epi32(lo, hi));
+	}
+	for (; i < n_samples; i++) {
+		d[2 * i] = (int16_t) (SPA_CLAMP(s0[i], -1.0f, 1.0f) * 32767.0f);
+		d[2 * i + 1] = (int16_t) (SPA_CLAMP(s1[i], -1.0f, 1.0f) * 32767.0f);
+	}
+}
+
+void conv_f32_to_f32d_2_sse2(void *dst[], const void *src[], uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s = src[0];
+	float *d0 = dst[0], *d1 = dst[1];
+	uint32_t i = 0;
+	__m128 lo, hi;
+
+	for (; i + 4 <= n_samples; i += 4) {
+		lo = _mm_loadu_ps(&s[2 * i]);
+		hi = _mm_loadu_ps(&s[2 * i + 4]);
+		_mm_storeu_ps(&d0[i], _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(&d1[i], _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+	for (; i < n_samples; i++) {
+		d0[i] = s[2 * i];
+		d1[i] = s[2 * i + 1];
+	}
+}
+
+void conv_f32d_to_f32_2_sse2(void *dst[], const void *src[], uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1];
+	float *d = dst[0];
+	uint32_t i = 0;
+	__m128 l, r;
+
+	for (; i + 4 <= n_samples; i += 4) {
+		l = _mm_loadu_ps(&s0[i]);
+		r = _mm_loadu_ps(&s1[i]);
+		_mm_storeu_ps(&d[2 * i], _mm_unpacklo_ps(l, r));
+		_mm_storeu_ps(&d[2 * i + 4], _mm_unpackhi_ps(l, r));
+	}
+	for (; i < n_samples; i++) {
+		d[2 * i] = s0[i];
+		d[2 * i + 1] = s1[i];
+	}
+}
@@ -0,0 +1,318 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <endian.h>
+
+#include "fmt-ops.h"
+
+#define S16_SCALE	32767.0f
+#define S24_SCALE	8388607.0f
+
+/* The integer samples are converted to floats between -1.0 and 1.0, the
+ * floats are clamped and truncated to integers. S32 has more precision
+ * than a float and is converted through 24 bits. */
+
+static inline float read_s16(const uint8_t *p)
+{
+	return *(const int16_t *) p * (1.0f / 32768.0f);
+}
+
+static inline void write_s16(uint8_t *p, float v)
+{
+	*(int16_t *) p = (int16_t) (SPA_CLAMP(v, -1.0f, 1.0f) * S16_SCALE);
+}
+
+static inline int32_t read_s24_int(const uint8_t *p)
+{
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	return (int32_t) (((uint32_t) p[2] << 24) | (p[1] << 16) | (p[0] << 8)) >> 8;
+#else
+	return (int32_t) (((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8)) >> 8;
+#endif
+}
+
+static inline float read_s24(const uint8_t *p)
+{
+	return read_s24_int(p) * (1.0f / 8388608.0f);
+}
+
+static inline void write_s24(uint8_t *p, float v)
+{
+	int32_t s = (int32_t) (SPA_CLAMP(v, -1.0f, 1.0f) * S24_SCALE);
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	p[0] = s;
+	p[1] = s >> 8;
+	p[2] = s >> 16;
+#else
+	p[0] = s >> 16;
+	p[1] = s >> 8;
+	p[2] = s;
+#endif
+}
+
+static inline float read_s24_32(const uint8_t *p)
+{
+	return ((int32_t) (*(const uint32_t *) p << 8) >> 8) * (1.0f / 8388608.0f);
+}
+
+static inline void write_s24_32(uint8_t *p, float v)
+{
+	*(int32_t *) p = (int32_t) (SPA_CLAMP(v, -1.0f, 1.0f) * S24_SCALE);
+}
+
+static inline float read_s32(const uint8_t *p)
+{
+	return *(const int32_t *) p * (1.0f / 2147483648.0f);
+}
+
+static inline void write_s32(uint8_t *p, float v)
+{
+	*(int32_t *) p = (int32_t) (SPA_CLAMP(v, -1.0f, 1.0f) * S24_SCALE) << 8;
+}
+
+static inline float read_f64(const uint8_t *p)
+{
+	return *(const double *) p;
+}
+
+static inline void write_f64(uint8_t *p, float v)
+{
+	*(double *) p = v;
+}
+
+/* the conversions from and to planar F32 for a format, the planar formats
+ * have a d suffix */
+#define MAKE_CONV(fmt,size)								\
+static void conv_##fmt##_to_f32d_c(void *dst[], const void *src[],			\
+				   uint32_t n_channels, uint32_t n_samples)		\
+{											\
+	const uint8_t *s = src[0];							\
+	float **d = (float **) dst;							\
+	uint32_t i, j;									\
+											\
+	for (j = 0; j < n_samples; j++) {						\
+		for (i = 0; i < n_channels; i++, s += size)				\
+			d[i][j] = read_##fmt(s);					\
+	}										\
+}											\
+static void conv_##fmt##d_to_f32d_c(void *dst[], const void *src[],			\
+				    uint32_t n_channels, uint32_t n_samples)		\
+{											\
+	float **d = (float **) dst;							\
+	uint32_t i, j;									\
+											\
+	for (i = 0; i < n_channels; i++) {						\
+		const uint8_t *s = src[i];						\
+		for (j = 0; j < n_samples; j++, s += size)				\
+			d[i][j] = read_##fmt(s);					\
+	}										\
+}											\
+static void conv_f32d_to_##fmt##_c(void *dst[], const void *src[],			\
+				   uint32_t n_channels, uint32_t n_samples)		\
+{											\
+	const float **s = (const float **) src;						\
+	uint8_t *d = dst[0];								\
+	uint32_t i, j;									\
+											\
+	for (j = 0; j < n_samples; j++) {						\
+		for (i = 0; i < n_channels; i++, d += size)				\
+			write_##fmt(d, s[i][j]);					\
+	}										\
+}											\
+static void conv_f32d_to_##fmt##d_c(void *dst[], const void *src[],			\
+				    uint32_t n_channels, uint32_t n_samples)		\
+{											\
+	const float **s = (const float **) src;						\
+	uint32_t i, j;									\
+											\
+	for (i = 0; i < n_channels; i++) {						\
+		uint8_t *d = dst[i];							\
+		for (j = 0; j < n_samples; j++, d += size)				\
+			write_##fmt(d, s[i][j]);					\
+	}										\
+}											\
+static void conv_##fmt##_to_f32_c(void *dst[], const void *src[],			\
+				  uint32_t n_channels, uint32_t n_samples)		\
+{											\
+	const uint8_t *s = src[0];							\
+	float *d = dst[0];								\
+	uint32_t i, n = n_channels * n_samples;						\
+											\
+	for (i = 0; i < n; i++, s += size)						\
+		d[i] = read_##fmt(s);							\
+}											\
+static void conv_f32_to_##fmt##_c(void *dst[], const void *src[],			\
+				  uint32_t n_channels, uint32_t n_samples)		\
+{											\
+	const float *s = src[0];							\
+	uint8_t *d = dst[0];								\
+	uint32_t i, n = n_channels * n_samples;						\
+											\
+	for (i = 0; i < n; i++, d += size)						\
+		write_##fmt(d, s[i]);							\
+}
+
+MAKE_CONV(s16, 2)
+MAKE_CONV(s24, 3)
+MAKE_CONV(s24_32, 4)
+MAKE_CONV(s32, 4)
+MAKE_CONV(f64, 8)
+
+static void conv_f32_to_f32d_c(void *dst[], const void *src[],
+			       uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s = src[0];
+	float **d = (float **) dst;
+	uint32_t i, j;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++)
+			d[i][j] = *s++;
+	}
+}
+
+static void conv_f32d_to_f32_c(void *dst[], const void *src[],
+			       uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	float *d = dst[0];
+	uint32_t i, j;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++)
+			*d++ = s[i][j];
+	}
+}
+
+static void conv_f32d_to_f32d_c(void *dst[], const void *src[],
+				uint32_t n_channels, uint32_t n_samples)
+{
+	uint32_t i;
+
+	for (i = 0; i < n_channels; i++)
+		memcpy(dst[i], src[i], n_samples * sizeof(float));
+}
+
+#define UNPACK(fmt,f,planar,n,cpu)	{ fmt, planar, FMT_F32, true, n, cpu, f }
+#define PACK(fmt,f,planar,n,cpu)	{ FMT_F32, true, fmt, planar, n, cpu, f }
+#define DIRECT(sf,df,f,n,cpu)		{ sf, false, df, false, n, cpu, f }
+
+/* the first kernel that matches is used, the SIMD kernels and the
+ * kernels for a number of channels must come first */
+static const struct fmt_ops fmt_ops_table[] = {
+#if defined (HAVE_SSE2)
+	DIRECT(FMT_S16, FMT_F32, conv_s16_to_f32_sse2, 0, FMT_OPS_CPU_SSE2),
+	DIRECT(FMT_F32, FMT_S16, conv_f32_to_s16_sse2, 0, FMT_OPS_CPU_SSE2),
+	/* mono is the same interleaved and planar */
+	UNPACK(FMT_S16, conv_s16_to_f32_sse2, false, 1, FMT_OPS_CPU_SSE2),
+	PACK(FMT_S16, conv_f32_to_s16_sse2, false, 1, FMT_OPS_CPU_SSE2),
+	UNPACK(FMT_S16, conv_s16_to_f32d_2_sse2, false, 2, FMT_OPS_CPU_SSE2),
+	PACK(FMT_S16, conv_f32d_to_s16_2_sse2, false, 2, FMT_OPS_CPU_SSE2),
+	UNPACK(FMT_F32, conv_f32_to_f32d_2_sse2, false, 2, FMT_OPS_CPU_SSE2),
+	PACK(FMT_F32, conv_f32d_to_f32_2_sse2, false, 2, FMT_OPS_CPU_SSE2),
+#endif
+	DIRECT(FMT_S16, FMT_F32, conv_s16_to_f32_c, 0, 0),
+	DIRECT(FMT_F32, FMT_S16, conv_f32_to_s16_c, 0, 0),
+	DIRECT(FMT_S24, FMT_F32, conv_s24_to_f32_c, 0, 0),
+	DIRECT(FMT_F32, FMT_S24, conv_f32_to_s24_c, 0, 0),
+	DIRECT(FMT_S24_32, FMT_F32, conv_s24_32_to_f32_c, 0, 0),
+	DIRECT(FMT_F32, FMT_S24_32, conv_f32_to_s24_32_c, 0, 0),
+	DIRECT(FMT_S32, FMT_F32, conv_s32_to_f32_c, 0, 0),
+	DIRECT(FMT_F32, FMT_S32, conv_f32_to_s32_c, 0, 0),
+	DIRECT(FMT_F64, FMT_F32, conv_f64_to_f32_c, 0, 0),
+	DIRECT(FMT_F32, FMT_F64, conv_f32_to_f64_c, 0, 0),
+
+	UNPACK(FMT_S16, conv_s16_to_f32d_c, false, 0, 0),
+	UNPACK(FMT_S16, conv_s16d_to_f32d_c, true, 0, 0),
+	UNPACK(FMT_S24, conv_s24_to_f32d_c, false, 0, 0),
+	UNPACK(FMT_S24, conv_s24d_to_f32d_c, true, 0, 0),
+	UNPACK(FMT_S24_32, conv_s24_32_to_f32d_c, false, 0, 0),
+	UNPACK(FMT_S24_32, conv_s24_32d_to_f32d_c, true, 0, 0),
+	UNPACK(FMT_S32, conv_s32_to_f32d_c, false, 0, 0),
+	UNPACK(FMT_S32, conv_s32d_to_f32d_c, true, 0, 0),
+	UNPACK(FMT_F32, conv_f32_to_f32d_c, false, 0, 0),
+	UNPACK(FMT_F32, conv_f32d_to_f32d_c, true, 0, 0),
+	UNPACK(FMT_F64, conv_f64_to_f32d_c, false, 0, 0),
+	UNPACK(FMT_F64, conv_f64d_to_f32d_c, true, 0, 0),
+
+	PACK(FMT_S16, conv_f32d_to_s16_c, false, 0, 0),
+	PACK(FMT_S16, conv_f32d_to_s16d_c, true, 0, 0),
+	PACK(FMT_S24, conv_f32d_to_s24_c, false, 0, 0),
+	PACK(FMT_S24, conv_f32d_to_s24d_c, true, 0, 0),
+	PACK(FMT_S24_32, conv_f32d_to_s24_32_c, false, 0, 0),
+	PACK(FMT_S24_32, conv_f32d_to_s24_32d_c, true, 0, 0),
+	PACK(FMT_S32, conv_f32d_to_s32_c, false, 0, 0),
+	PACK(FMT_S32, conv_f32d_to_s32d_c, true, 0, 0),
+	PACK(FMT_F32, conv_f32d_to_f32_c, false, 0, 0),
+	PACK(FMT_F64, conv_f32d_to_f64_c, false, 0, 0),
+	PACK(FMT_F64, conv_f32d_to_f64d_c, true, 0, 0),
+};
+
+#undef UNPACK
+#undef PACK
+#undef DIRECT
+
+uint32_t fmt_ops_sample_size(enum fmt fmt)
+{
+	switch (fmt) {
+	case FMT_S16:
+		return 2;
+	case FMT_S24:
+		return 3;
+	case FMT_S24_32:
+	case FMT_S32:
+	case FMT_F32:
+		return 4;
+	case FMT_F64:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+static uint32_t cpu_features(void)
+{
+	uint32_t flags = 0;
+#if defined (HAVE_SSE2)
+	if (__builtin_cpu_supports("sse2"))
+		flags |= FMT_OPS_CPU_SSE2;
+#endif
+	return flags;
+}
+
+const struct fmt_ops *fmt_ops_find(enum fmt src_fmt, bool src_planar,
+				   enum fmt dst_fmt, bool dst_planar,
+				   uint32_t n_channels, uint32_t cpu_flags)
+{
+	uint32_t i;
+
+	cpu_flags &= cpu_features();
+
+	for (i = 0; i < SPA_N_ELEMENTS(fmt_ops_table); i++) {
+		const struct fmt_ops *o = &fmt_ops_table[i];
+
+		if (o->src_fmt == src_fmt && o->src_planar == src_planar &&
+		    o->dst_fmt == dst_fmt && o->dst_planar == dst_planar &&
+		    (o->n_channels == 0 || o->n_channels == n_channels) &&
+		    (o->cpu_flags & cpu_flags) == o->cpu_flags)
+			return o;
+	}
+	return NULL;
+}
@@ -0,0 +1,72 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <spa/defs.h>
+
+/* implementations of the kernels that can be selected */
+#define FMT_OPS_CPU_SSE2	(1 << 0)
+
+/* the sample formats, in native endianness */
+enum fmt {
+	FMT_UNKNOWN,
+	FMT_S16,
+	FMT_S24,
+	FMT_S24_32,
+	FMT_S32,
+	FMT_F32,
+	FMT_F64,
+};
+
+/**
+ * Convert \a n_samples frames of \a n_channels channels from \a src to
+ * \a dst. Interleaved samples are in the first pointer of the arrays,
+ * planar samples have a pointer for each channel.
+ */
+typedef void (*convert_func_t) (void *dst[], const void *src[],
+				uint32_t n_channels, uint32_t n_samples);
+
+struct fmt_ops {
+	enum fmt src_fmt;
+	bool src_planar;
+	enum fmt dst_fmt;
+	bool dst_planar;
+	uint32_t n_channels;	/* 0 for any number of channels */
+	uint32_t cpu_flags;	/* FMT_OPS_CPU_ flags of the kernel */
+	convert_func_t func;
+};
+
+/** The size of a sample of \a fmt */
+uint32_t fmt_ops_sample_size(enum fmt fmt);
+
+/** Find the fastest kernel that converts between the formats. Only the
+ * kernels that use the features in \a cpu_flags and of the cpu are
+ * considered. Conversions to and from planar F32 always exist, the direct
+ * conversions between other formats only for some pairs. */
+const struct fmt_ops *fmt_ops_find(enum fmt src_fmt, bool src_planar,
+				   enum fmt dst_fmt, bool dst_planar,
+				   uint32_t n_channels, uint32_t cpu_flags);
+
+#if defined (HAVE_SSE2)
+void conv_s16_to_f32_sse2(void *dst[], const void *src[], uint32_t n_channels, uint32_t n_samples);
+void conv_f32_to_s16_sse2(void *dst[], const void *src[], uint32_t n_channels, uint32_t n_samples);
+void conv_s16_to_f32d_2_sse2(void *dst[], const void *src[], uint32_t n_channels, uint32_t n_samples);
+void conv_f32d_to_s16_2_sse2(void *dst[], const void *src[], uint32_t n_channels, uint32_t n_samples);
+void conv_f32_to_f32d_2_sse2(void *dst[], const void *src[], uint32_t n_channels, uint32_t n_samples);
+void conv_f32d_to_f32_2_sse2(void *dst[], const void *src[], uint32_t n_channels, uint32_t n_samples);
+#endif
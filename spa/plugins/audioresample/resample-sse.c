@@ -0,0 +1,48 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <xmmintrin.h>
+
+#include "resample.h"
+
+/* The taps are aligned to 16 bytes and n_taps is a multiple of 8, the
+ * history is not aligned. */
+float resample_inner_product_ip_sse(const float *s, const float *t0, const float *t1,
+				    float x, uint32_t n_taps)
+{
+	__m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps(), v;
+	float r;
+	uint32_t i;
+
+	for (i = 0; i < n_taps; i += 8) {
+		v = _mm_loadu_ps(s + i);
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(v, _mm_load_ps(t0 + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(v, _mm_load_ps(t1 + i)));
+		v = _mm_loadu_ps(s + i + 4);
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(v, _mm_load_ps(t0 + i + 4)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(v, _mm_load_ps(t1 + i + 4)));
+	}
+	/* interpolate between the phases before the horizontal sum */
+	sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_sub_ps(sum1, sum0), _mm_set1_ps(x)));
+	sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+	sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 0x55));
+	_mm_store_ss(&r, sum0);
+
+	return r;
+}
@@ -0,0 +1,284 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "resample.h"
+
+/* frames of input that are resampled in one go */
+#define BLOCK_SIZE	1024
+#define MAX_TAPS	1024
+
+static const struct quality {
+	uint32_t n_taps;
+	uint32_t n_phases;
+	double cutoff;
+} qualities[RESAMPLE_MAX_QUALITY + 1] = {
+	{   8,  32, 0.80 },
+	{  16,  64, 0.85 },
+	{  32, 128, 0.90 },
+	{  48, 128, 0.92 },
+	{  64, 256, 0.94 },
+	{  96, 256, 0.95 },
+};
+
+static float
+inner_product_ip_c(const float *s, const float *t0, const float *t1, float x, uint32_t n_taps)
+{
+	float sum0 = 0.0f, sum1 = 0.0f;
+	uint32_t i;
+
+	for (i = 0; i < n_taps; i++) {
+		sum0 += s[i] * t0[i];
+		sum1 += s[i] * t1[i];
+	}
+	return sum0 + (sum1 - sum0) * x;
+}
+
+static inline double sinc(double x)
+{
+	if (x == 0.0)
+		return 1.0;
+	x *= M_PI;
+	return sin(x) / x;
+}
+
+/* Blackman-Harris window, x between -1.0 and 1.0 */
+static inline double window(double x)
+{
+	double n;
+
+	if (x < -1.0 || x > 1.0)
+		return 0.0;
+	n = M_PI * (x + 1.0);
+	return 0.35875 - 0.48829 * cos(n) + 0.14128 * cos(2.0 * n) - 0.01168 * cos(3.0 * n);
+}
+
+static void build_filter(struct resample *r, double cutoff)
+{
+	uint32_t p, t, half = r->n_taps / 2;
+
+	for (p = 0; p <= r->n_phases; p++) {
+		float *taps = &r->filter[p * r->stride];
+		double frac = (double) p / r->n_phases, sum = 0.0;
+
+		for (t = 0; t < r->n_taps; t++) {
+			double d = (double) t - (half - 1) - frac;
+			taps[t] = cutoff * sinc(cutoff * d) * window(d / half);
+			sum += taps[t];
+		}
+		/* unity gain for every phase */
+		for (t = 0; t < r->n_taps; t++)
+			taps[t] /= sum;
+		for (; t < r->stride; t++)
+			taps[t] = 0.0f;
+	}
+}
+
+int resample_init(struct resample *r, uint32_t channels, uint32_t in_rate,
+		  uint32_t out_rate, uint32_t quality, uint32_t cpu_flags)
+{
+	const struct quality *q;
+	double cutoff, ratio;
+	size_t filter_size, hist_size;
+	uint8_t *mem;
+	uint32_t c;
+
+	if (channels == 0 || channels > RESAMPLE_MAX_CHANNELS ||
+	    in_rate == 0 || out_rate == 0)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	quality = SPA_MIN(quality, RESAMPLE_MAX_QUALITY);
+	q = &qualities[quality];
+
+	r->channels = channels;
+	r->in_rate = in_rate;
+	r->out_rate = out_rate;
+	r->quality = quality;
+
+	/* when downsampling, the cutoff is lowered to the new nyquist
+	 * frequency and more taps are needed for the same quality */
+	ratio = (double) out_rate / in_rate;
+	cutoff = q->cutoff;
+	r->n_taps = q->n_taps;
+	if (ratio < 1.0) {
+		cutoff *= ratio;
+		r->n_taps = SPA_MIN(SPA_ROUND_UP_N((uint32_t) ceil(r->n_taps / ratio), 8),
+				    MAX_TAPS);
+	}
+	r->n_phases = q->n_phases;
+	r->stride = SPA_ROUND_UP_N(r->n_taps, 4);
+	r->hist_size = r->n_taps + BLOCK_SIZE;
+
+	filter_size = (r->n_phases + 1) * r->stride * sizeof(float);
+	hist_size = SPA_ROUND_UP_N(r->hist_size * sizeof(float), 16);
+
+	r->data = malloc(filter_size + channels * hist_size + 16);
+	if (r->data == NULL)
+		return SPA_RESULT_NO_MEMORY;
+
+	mem = (uint8_t *) SPA_ROUND_UP_N((uintptr_t) r->data, 16);
+	r->filter = (float *) mem;
+	mem += filter_size;
+	for (c = 0; c < channels; c++) {
+		r->history[c] = (float *) mem;
+		mem += hist_size;
+	}
+
+	build_filter(r, cutoff);
+
+	r->cpu_flags = 0;
+	r->inner_product = inner_product_ip_c;
+#if defined (HAVE_SSE)
+	if ((cpu_flags & RESAMPLE_CPU_SSE) && __builtin_cpu_supports("sse")) {
+		r->cpu_flags |= RESAMPLE_CPU_SSE;
+		r->inner_product = resample_inner_product_ip_sse;
+	}
+#endif
+	resample_update_rate(r, 1.0);
+	resample_reset(r);
+
+	return SPA_RESULT_OK;
+}
+
+void resample_free(struct resample *r)
+{
+	free(r->data);
+	r->data = NULL;
+	r->filter = NULL;
+}
+
+void resample_reset(struct resample *r)
+{
+	uint32_t c;
+
+	/* start with half a filter of silence so that the first output
+	 * frame is at the first input frame */
+	r->hist_len = r->n_taps / 2 - 1;
+	for (c = 0; c < r->channels; c++)
+		memset(r->history[c], 0, r->hist_len * sizeof(float));
+	r->index = 0;
+	r->frac = 0.0;
+}
+
+void resample_update_rate(struct resample *r, double rate)
+{
+	r->rate = rate;
+	r->step = (double) r->in_rate * rate / r->out_rate;
+}
+
+uint32_t resample_in_len(struct resample *r, uint32_t out_len)
+{
+	uint32_t need;
+
+	if (out_len == 0)
+		return 0;
+
+	need = r->index + (uint32_t) floor(r->frac + (out_len - 1) * r->step) + r->n_taps;
+
+	return need > r->hist_len ? need - r->hist_len : 0;
+}
+
+uint32_t resample_out_len(struct resample *r, uint32_t in_len)
+{
+	double avail = (double) r->hist_len + in_len - r->n_taps - r->index;
+
+	if (avail < 0.0)
+		return 0;
+
+	return (uint32_t) ceil((avail + 1.0 - r->frac) / r->step);
+}
+
+static inline void
+fill_history(struct resample *r, const float *src, uint32_t n_frames)
+{
+	uint32_t c, i, channels = r->channels;
+
+	if (channels == 1) {
+		memcpy(&r->history[0][r->hist_len], src, n_frames * sizeof(float));
+	} else {
+		for (c = 0; c < channels; c++) {
+			float *h = &r->history[c][r->hist_len];
+			const float *s = &src[c];
+
+			for (i = 0; i < n_frames; i++, s += channels)
+				h[i] = *s;
+		}
+	}
+	r->hist_len += n_frames;
+}
+
+static inline void drop_history(struct resample *r)
+{
+	uint32_t c, drop = SPA_MIN(r->index, r->hist_len);
+
+	if (drop == 0)
+		return;
+
+	r->hist_len -= drop;
+	for (c = 0; c < r->channels; c++)
+		memmove(r->history[c], &r->history[c][drop], r->hist_len * sizeof(float));
+	r->index -= drop;
+}
+
+void resample_process(struct resample *r, const float *src, uint32_t *in_len,
+		      float *dst, uint32_t *out_len)
+{
+	uint32_t channels = r->channels, n_taps = r->n_taps, stride = r->stride;
+	uint32_t consumed = 0, produced = 0, c, n;
+	float *d = dst;
+
+	while (produced < *out_len) {
+		/* skip the input that is not needed when the last output
+		 * jumped over the end of the history */
+		if (r->index > r->hist_len) {
+			n = SPA_MIN(r->index - r->hist_len, *in_len - consumed);
+			consumed += n;
+			r->index -= n;
+		}
+		n = SPA_MIN(*in_len - consumed, r->hist_size - r->hist_len);
+		fill_history(r, &src[consumed * channels], n);
+		consumed += n;
+
+		if (r->index + n_taps > r->hist_len)
+			break;
+
+		while (produced < *out_len && r->index + n_taps <= r->hist_len) {
+			double ph = r->frac * r->n_phases;
+			uint32_t p = (uint32_t) ph, adv;
+			const float *t0 = &r->filter[p * stride];
+			const float *t1 = t0 + stride;
+			float x = ph - p;
+
+			for (c = 0; c < channels; c++)
+				*d++ = r->inner_product(&r->history[c][r->index], t0, t1, x, n_taps);
+
+			produced++;
+			r->frac += r->step;
+			adv = (uint32_t) r->frac;
+			r->frac -= adv;
+			r->index += adv;
+		}
+		drop_history(r);
+	}
+	*in_len = consumed;
+	*out_len = produced;
+}
@@ -0,0 +1,97 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <spa/defs.h>
+
+#define RESAMPLE_MAX_CHANNELS	64
+#define RESAMPLE_MAX_QUALITY	5
+#define RESAMPLE_DEFAULT_QUALITY 3
+
+/* implementations of the filter kernel that can be selected */
+#define RESAMPLE_CPU_SSE	(1 << 0)
+
+typedef float (*resample_ip_func_t) (const float *s, const float *t0, const float *t1,
+				     float x, uint32_t n_taps);
+
+/**
+ * struct resample:
+ *
+ * A polyphase windowed sinc resampler for interleaved float samples.
+ *
+ * The filter is computed for n_phases positions between two input
+ * samples, the phases in between are interpolated linearly so that the
+ * ratio can be changed at any time with resample_update_rate() without
+ * recomputing the filter.
+ */
+struct resample {
+	uint32_t channels;
+	uint32_t in_rate;
+	uint32_t out_rate;
+	uint32_t quality;
+	uint32_t cpu_flags;	/* RESAMPLE_CPU_ flags of the selected kernel */
+
+	double rate;		/* correction of the ratio, 1.0 is nominal */
+	double step;		/* input frames per output frame */
+	double frac;		/* position between two input frames */
+	uint32_t index;		/* input frame in the history of the next output */
+
+	uint32_t n_taps;
+	uint32_t n_phases;
+	uint32_t stride;	/* floats per phase in filter */
+	float *filter;		/* (n_phases + 1) * stride taps */
+
+	uint32_t hist_size;	/* frames in the history of a channel */
+	uint32_t hist_len;
+	float *history[RESAMPLE_MAX_CHANNELS];
+
+	void *data;		/* allocated memory */
+
+	resample_ip_func_t inner_product;
+};
+
+/** Initialize \a r. \a cpu_flags limits the kernels that can be used
+ * and is masked with the features of the cpu. */
+int resample_init(struct resample *r, uint32_t channels, uint32_t in_rate,
+		  uint32_t out_rate, uint32_t quality, uint32_t cpu_flags);
+
+void resample_free(struct resample *r);
+
+/** Clear the history, the next output starts at a new stream */
+void resample_reset(struct resample *r);
+
+/** Set the correction of the ratio. With \a rate > 1.0 more input is
+ * consumed for the same output. */
+void resample_update_rate(struct resample *r, double rate);
+
+/** The number of input frames needed to make \a out_len output frames */
+uint32_t resample_in_len(struct resample *r, uint32_t out_len);
+
+/** The number of output frames that are made from \a in_len input frames */
+uint32_t resample_out_len(struct resample *r, uint32_t in_len);
+
+/** Resample at most \a *in_len frames from \a src into at most \a *out_len
+ * frames in \a dst. On return \a in_len and \a out_len contain the number
+ * of frames consumed and produced. */
+void resample_process(struct resample *r, const float *src, uint32_t *in_len,
+		      float *dst, uint32_t *out_len);
+
+#if defined (HAVE_SSE)
+float resample_inner_product_ip_sse(const float *s, const float *t0, const float *t1,
+				    float x, uint32_t n_taps);
+#endif
@@ -53,6 +53,9 @@ struct type {
 	uint32_t prop_volume;
 	uint32_t wave_sine;
 	uint32_t wave_square;
+	uint32_t wave_noise;
+	uint32_t wave_impulse;
+	uint32_t wave_silence;
 	struct spa_type_meta meta;
 	struct spa_type_data data;
 	struct spa_type_media_type media_type;
@@ -77,6 +80,9 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	type->prop_volume = spa_type_map_get_id(map, SPA_TYPE_PROPS__volume);
 	type->wave_sine = spa_type_map_get_id(map, SPA_TYPE_PROPS__waveType ":sine");
 	type->wave_square = spa_type_map_get_id(map, SPA_TYPE_PROPS__waveType ":square");
+	type->wave_noise = spa_type_map_get_id(map, SPA_TYPE_PROPS__waveType ":noise");
+	type->wave_impulse = spa_type_map_get_id(map, SPA_TYPE_PROPS__waveType ":impulse");
+	type->wave_silence = spa_type_map_get_id(map, SPA_TYPE_PROPS__waveType ":silence");
 	spa_type_meta_map(map, &type->meta);
 	spa_type_data_map(map, &type->data);
 	spa_type_media_type_map(map, &type->media_type);
@@ -130,6 +136,8 @@ struct impl {
 	bool async;
 	struct spa_source timer_source;
 	struct itimerspec timerspec;
+	bool follower;			/* scheduled by the graph, no timer */
+	uint64_t quantum;		/* duration of a graph cycle in nsec */
 
 	struct spa_port_info info;
 	uint8_t params_buffer[1024];
@@ -139,8 +147,10 @@ struct impl {
 	struct spa_audio_info current_format;
 	uint8_t format_buffer[1024];
 	size_t bpf;
+	int format_idx;
 	render_func_t render_func;
 	double accumulator;
+	uint32_t noise_state;
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
@@ -169,6 +179,8 @@ static void reset_props(struct impl *this, struct props *props)
 	props->volume = DEFAULT_VOLUME;
 }
 
+#include "render.c"
+
 #define PROP(f,key,type,...)							\
 	SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
 #define PROP_MM(f,key,type,...)							\
@@ -197,10 +209,13 @@ static int impl_node_get_props(struct spa_node *node, struct spa_props **props)
 	spa_pod_builder_props(&b, &f[0], this->type.props,
 		PROP(&f[1], this->type.prop_live, SPA_POD_TYPE_BOOL,
 			this->props.live),
-		PROP_EN(&f[1], this->type.prop_wave, SPA_POD_TYPE_ID, 3,
+		PROP_EN(&f[1], this->type.prop_wave, SPA_POD_TYPE_ID, 6,
 			this->props.wave,
 			this->type.wave_sine,
-			this->type.wave_square),
+			this->type.wave_square,
+			this->type.wave_noise,
+			this->type.wave_impulse,
+			this->type.wave_silence),
 		PROP_MM(&f[1], this->type.prop_freq, SPA_POD_TYPE_DOUBLE,
 			this->props.freq,
 			0.0, 50000000.0),
@@ -237,15 +252,15 @@ static int impl_node_set_props(struct spa_node *node, const struct spa_props *pr
 	else
 		this->info.flags &= ~SPA_PORT_INFO_FLAG_LIVE;
 
+	update_render_func(this);
+
 	return SPA_RESULT_OK;
 }
 
-#include "render.c"
-
 static void set_timer(struct impl *this, bool enabled)
 {
 	if (this->async || this->props.live) {
-		if (enabled) {
+		if (enabled && !this->follower) {
 			if (this->props.live) {
 				uint64_t next_time = this->start_time + this->elapsed_time;
 				this->timerspec.it_value.tv_sec = next_time / SPA_NSEC_PER_SEC;
@@ -266,7 +281,7 @@ static void read_timer(struct impl *this)
 {
 	uint64_t expirations;
 
-	if (this->async || this->props.live) {
+	if ((this->async || this->props.live) && !this->follower) {
 		if (read(this->timer_source.fd, &expirations, sizeof(uint64_t)) != sizeof(uint64_t))
 			perror("read timerfd");
 	}
@@ -294,6 +309,9 @@ static int make_buffer(struct impl *this)
 		n_bytes = SPA_MIN(n_bytes, io->range.min_size);
 		if (io->range.max_size < n_bytes)
 			n_bytes = io->range.max_size;
+	} else if (this->quantum != 0) {
+		n_samples = this->quantum * this->current_format.info.raw.rate / SPA_NSEC_PER_SEC;
+		n_bytes = SPA_MIN(n_bytes, n_samples * this->bpf);
 	}
 
 	spa_log_trace(this->log, NAME " %p: dequeue buffer %d %d %d", this, b->outbuf->id,
@@ -400,6 +418,16 @@ static int impl_node_send_command(struct spa_node *node, const struct spa_comman
 
 		this->started = false;
 		set_timer(this, false);
+	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.ClockUpdate) {
+		struct spa_command_node_clock_update *cu =
+			(struct spa_command_node_clock_update *) command;
+
+		if (cu->body.change_mask.value & SPA_COMMAND_NODE_CLOCK_UPDATE_LATENCY)
+			this->quantum = cu->body.latency.value;
+		this->follower = (cu->body.flags.value &
+				  SPA_COMMAND_NODE_CLOCK_UPDATE_FLAG_SLAVE) != 0;
+		if (this->started)
+			set_timer(this, true);
 	} else
 		return SPA_RESULT_NOT_IMPLEMENTED;
 
@@ -589,7 +617,8 @@ impl_node_port_set_format(struct spa_node *node,
 		this->bpf = sizes[idx] * info.info.raw.channels;
 		this->current_format = info;
 		this->have_format = true;
-		this->render_func = sine_funcs[idx];
+		this->format_idx = idx;
+		update_render_func(this);
 	}
 
 	if (this->have_format) {
@@ -1018,6 +1047,7 @@ impl_init(const struct spa_handle_factory *factory,
 	this->node = impl_node;
 	this->clock = impl_clock;
 	reset_props(this, &this->props);
+	this->noise_state = 0x9e3779b9;
 
 	spa_list_init(&this->empty);
 
@@ -18,51 +18,56 @@
  */
 
 #include <stddef.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include <spa/type-map.h>
 #include <spa/log.h>
+#include <spa/list.h>
 #include <spa/node.h>
 #include <spa/video/format-utils.h>
+#include <spa/format-builder.h>
+#include <lib/format.h>
 #include <lib/props.h>
 
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
+#include "ffmpeg.h"
+
+#define NAME "ffmpeg-dec"
+
 #define IS_VALID_PORT(this,d,id) ((id) == 0)
 #define MAX_BUFFERS    32
 
+/* alignment of the planes and lines in the output buffers, enough for the
+ * SIMD code of the codecs */
+#define FRAME_ALIGN    64
+
+struct impl;
+
 struct buffer {
+	struct impl *impl;
 	struct spa_buffer *outbuf;
-	bool outstanding;
-	struct buffer *next;
+	bool outstanding;	/* queued for output or with the peer */
+	bool in_codec;		/* referenced by a frame of the codec */
+	struct spa_list link;
 };
 
 struct port {
 	bool have_format;
 	struct spa_video_info current_format;
-	bool have_buffers;
+	struct spa_rectangle size;
+	struct spa_fraction framerate;
 	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+	struct spa_list empty;
 	struct spa_port_info info;
 	struct spa_port_io *io;
 };
 
-struct type {
-	uint32_t node;
-	struct spa_type_media_type media_type;
-	struct spa_type_media_subtype media_subtype;
-	struct spa_type_format_video format_video;
-	struct spa_type_command_node command_node;
-};
-
-static inline void init_type(struct type *type, struct spa_type_map *map)
-{
-	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
-	spa_type_media_type_map(map, &type->media_type);
-	spa_type_media_subtype_map(map, &type->media_subtype);
-	spa_type_format_video_map(map, &type->format_video);
-	spa_type_command_node_map(map, &type->command_node);
-}
-
 struct impl {
 	struct spa_handle handle;
 	struct spa_node node;
@@ -74,12 +79,252 @@ struct impl {
 	const struct spa_node_callbacks *callbacks;
 	void *user_data;
 
+	uint8_t format_buffer[1024];
+	uint8_t params_buffer[1024];
+
 	struct port in_ports[1];
 	struct port out_ports[1];
 
+	const AVCodec *codec;
+	AVCodecContext *context;
+	AVPacket *packet;
+	AVFrame *frame;
+	bool opened;
+	bool have_frame;	/* a frame was received and waits for a buffer */
+
+	/* layout of a frame in the output buffers */
+	int width, height;
+	int linesize[4];
+	size_t offset[4];
+	size_t image_size;
+	size_t frame_size;
+	bool direct;		/* the codec can decode in the output buffers */
+
+	/* the empty list of the output port and the in_codec flags of the
+	 * buffers, the codec threads release the frames */
+	pthread_mutex_t lock;
+	struct spa_list ready;
+
 	bool started;
 };
 
+#define PROP(f,key,type,...)							\
+	SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)						\
+	SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |				\
+			SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+
+/* the data of the builder can move when it grows, look up the prop to
+ * change its flags */
+static void set_prop_flags(struct spa_pod_builder *b, struct spa_pod_frame *f, uint32_t flags)
+{
+	if (f->ref != -1)
+		SPA_POD_BUILDER_DEREF(b, f->ref, struct spa_pod_prop)->body.flags |= flags;
+}
+
+static void release_buffer(struct impl *this, struct buffer *b)
+{
+	if (!b->outstanding && !b->in_codec)
+		spa_list_append(&this->out_ports[0].empty, &b->link);
+}
+
+/* called by the codec, maybe from one of its threads, when the last
+ * reference to a frame in an output buffer is gone */
+static void release_frame(void *opaque, uint8_t *data)
+{
+	struct buffer *b = opaque;
+	struct impl *this = b->impl;
+
+	pthread_mutex_lock(&this->lock);
+	b->in_codec = false;
+	release_buffer(this, b);
+	pthread_mutex_unlock(&this->lock);
+}
+
+static struct buffer *dequeue_buffer(struct impl *this)
+{
+	struct port *port = &this->out_ports[0];
+	struct buffer *b = NULL;
+
+	pthread_mutex_lock(&this->lock);
+	if (!spa_list_is_empty(&port->empty)) {
+		b = spa_list_first(&port->empty, struct buffer, link);
+		spa_list_remove(&b->link);
+	}
+	pthread_mutex_unlock(&this->lock);
+
+	return b;
+}
+
+/* Let the codec decode in the negotiated output buffers. When the frame
+ * does not fit or all buffers are in use, the codec allocates the frame
+ * and it is copied to an output buffer later. */
+static int get_buffer(AVCodecContext *context, AVFrame *frame, int flags)
+{
+	struct impl *this = context->opaque;
+	struct buffer *b;
+	uint8_t *data;
+	int i;
+
+	if (!this->direct || !(context->codec->capabilities & AV_CODEC_CAP_DR1) ||
+	    spa_ffmpeg_pix_fmt_to_video_format(&this->type, frame->format) !=
+	    this->out_ports[0].current_format.info.raw.format ||
+	    frame->width > this->width || frame->height > this->height)
+		return avcodec_default_get_buffer2(context, frame, flags);
+
+	if ((b = dequeue_buffer(this)) == NULL)
+		return avcodec_default_get_buffer2(context, frame, flags);
+
+	b->in_codec = true;
+	data = b->outbuf->datas[0].data;
+
+	frame->buf[0] = av_buffer_create(data, this->frame_size, release_frame, b, 0);
+	if (frame->buf[0] == NULL) {
+		release_frame(b, data);
+		return AVERROR(ENOMEM);
+	}
+	for (i = 0; i < 4; i++) {
+		frame->data[i] = this->linesize[i] ? data + this->offset[i] : NULL;
+		frame->linesize[i] = this->linesize[i];
+	}
+	frame->extended_data = frame->data;
+
+	return 0;
+}
+
+static struct buffer *find_frame_buffer(struct impl *this, AVFrame *frame)
+{
+	struct port *port = &this->out_ports[0];
+	void *opaque;
+	uint32_t i;
+
+	if (frame->buf[0] == NULL || frame->buf[1] != NULL)
+		return NULL;
+
+	opaque = av_buffer_get_opaque(frame->buf[0]);
+	for (i = 0; i < port->n_buffers; i++) {
+		if (opaque == &port->buffers[i])
+			return &port->buffers[i];
+	}
+	return NULL;
+}
+
+/* compute where the planes go in the output buffers, with the padding
+ * and alignment that the codec needs to decode in them */
+static int update_layout(struct impl *this)
+{
+	struct port *port = &this->out_ports[0];
+	enum AVPixelFormat pix_fmt, saved;
+	int i, width, height, align, linesize_align[AV_NUM_DATA_POINTERS];
+	uint8_t *data[4];
+	int size;
+
+	pix_fmt = spa_ffmpeg_video_format_to_pix_fmt(&this->type,
+						     port->current_format.info.raw.format);
+	if (pix_fmt == AV_PIX_FMT_NONE)
+		return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+	width = port->size.width;
+	height = port->size.height;
+
+	saved = this->context->pix_fmt;
+	this->context->pix_fmt = pix_fmt;
+	avcodec_align_dimensions2(this->context, &width, &height, linesize_align);
+	this->context->pix_fmt = saved;
+
+	if (av_image_fill_linesizes(this->linesize, pix_fmt, width) < 0)
+		return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+	align = FRAME_ALIGN;
+	for (i = 0; i < 4; i++)
+		align = FFMAX(align, linesize_align[i]);
+	for (i = 0; i < 4; i++)
+		this->linesize[i] = FFALIGN(this->linesize[i], align);
+
+	/* without a base pointer, the planes are offsets in the buffer */
+	if ((size = av_image_fill_pointers(data, pix_fmt, height, NULL, this->linesize)) < 0)
+		return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+	for (i = 0; i < 4; i++)
+		this->offset[i] = data[i] - data[0];
+
+	this->width = width;
+	this->height = height;
+	this->image_size = size;
+	/* the codecs read and write a little past the end of the image */
+	this->frame_size = size + 16 + align - 1;
+
+	spa_log_debug(this->log, NAME " %p: layout %dx%d stride %d size %zd", this,
+		      width, height, this->linesize[0], this->frame_size);
+
+	return SPA_RESULT_OK;
+}
+
+/* give back the buffers of the frames that were not output yet */
+static void drop_frames(struct impl *this)
+{
+	struct buffer *b, *tmp;
+
+	av_frame_unref(this->frame);
+	this->have_frame = false;
+
+	pthread_mutex_lock(&this->lock);
+	spa_list_for_each_safe(b, tmp, &this->ready, link) {
+		spa_list_remove(&b->link);
+		b->outstanding = false;
+		release_buffer(this, b);
+	}
+	pthread_mutex_unlock(&this->lock);
+}
+
+static void reset_codec(struct impl *this)
+{
+	drop_frames(this);
+
+	/* drops the references of the codec on the output buffers */
+	if (this->opened) {
+		avcodec_free_context(&this->context);
+		this->context = avcodec_alloc_context3(this->codec);
+		this->opened = false;
+	}
+}
+
+static int open_codec(struct impl *this)
+{
+	struct port *port = &this->in_ports[0];
+	AVCodecContext *context = this->context;
+	int res;
+
+	if (this->opened)
+		return SPA_RESULT_OK;
+
+	if (!port->have_format || !this->out_ports[0].have_format)
+		return SPA_RESULT_NO_FORMAT;
+
+	context->opaque = this;
+	context->get_buffer2 = get_buffer;
+	context->width = port->size.width;
+	context->height = port->size.height;
+	if (port->framerate.num > 0)
+		context->framerate = (AVRational) { port->framerate.num, port->framerate.denom };
+
+	/* use a thread for each cpu, on whole frames and on slices of frames */
+	context->thread_count = 0;
+	context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+	if ((res = avcodec_open2(context, this->codec, NULL)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't open codec %s: %s", this,
+			      this->codec->name, av_err2str(res));
+		return SPA_RESULT_ERROR;
+	}
+	spa_log_debug(this->log, NAME " %p: opened %s with %d threads", this,
+		      this->codec->name, context->thread_count);
+
+	this->opened = true;
+
+	return SPA_RESULT_OK;
+}
+
 static int spa_ffmpeg_dec_node_get_props(struct spa_node *node, struct spa_props **props)
 {
 	return SPA_RESULT_NOT_IMPLEMENTED;
@@ -90,6 +335,9 @@ static int spa_ffmpeg_dec_node_set_props(struct spa_node *node, const struct spa
 	return SPA_RESULT_NOT_IMPLEMENTED;
 }
 
+static int output_frame(struct impl *this);
+static int receive_frames(struct impl *this);
+
 static int spa_ffmpeg_dec_node_send_command(struct spa_node *node, const struct spa_command *command)
 {
 	struct impl *this;
@@ -103,6 +351,19 @@ static int spa_ffmpeg_dec_node_send_command(struct spa_node *node, const struct
 		this->started = true;
 	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Pause) {
 		this->started = false;
+	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Flush) {
+		if (this->opened)
+			avcodec_flush_buffers(this->context);
+		drop_frames(this);
+	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Drain) {
+		/* decode the frames that the codec still has */
+		if (this->opened) {
+			avcodec_send_packet(this->context, NULL);
+			receive_frames(this);
+			if (output_frame(this) == SPA_RESULT_HAVE_BUFFER &&
+			    this->callbacks && this->callbacks->have_output)
+				this->callbacks->have_output(this->user_data);
+		}
 	} else
 		return SPA_RESULT_NOT_IMPLEMENTED;
 
@@ -190,27 +451,127 @@ spa_ffmpeg_dec_node_port_enum_formats(struct spa_node *node,
 				      const struct spa_format *filter,
 				      uint32_t index)
 {
-	//struct impl *this;
+	struct impl *this;
+	struct port *in_port;
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_frame f[2];
+	struct spa_format *fmt;
+	uint8_t buffer[1024];
+	uint32_t subtype, i, j;
+	int res;
 
 	if (node == NULL || format == NULL)
 		return SPA_RESULT_INVALID_ARGUMENTS;
 
-	//this = SPA_CONTAINER_OF (node, struct impl, node);
+	this = SPA_CONTAINER_OF(node, struct impl, node);
 
 	if (!IS_VALID_PORT(this, direction, port_id))
 		return SPA_RESULT_INVALID_PORT;
 
-	switch (index) {
-	case 0:
-		break;
-	default:
+	if (index > 0)
 		return SPA_RESULT_ENUM_END;
+
+	in_port = &this->in_ports[0];
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	if (direction == SPA_DIRECTION_INPUT) {
+		if ((subtype = spa_ffmpeg_codec_to_media_subtype(&this->type, this->codec->id)) == 0)
+			return SPA_RESULT_ENUM_END;
+
+		spa_pod_builder_format(&b, &f[0], this->type.format,
+			this->type.media_type.video, subtype,
+			PROP_U_MM(&f[1], this->type.format_video.size, SPA_POD_TYPE_RECTANGLE,
+				320, 240,
+				1, 1,
+				INT32_MAX, INT32_MAX),
+			PROP_U_MM(&f[1], this->type.format_video.framerate, SPA_POD_TYPE_FRACTION,
+				25, 1,
+				0, 1,
+				INT32_MAX, 1));
+	} else {
+		spa_pod_builder_push_format(&b, &f[0], this->type.format,
+					    this->type.media_type.video,
+					    this->type.media_subtype.raw);
+
+		/* the formats that the codec can make, most codecs don't say
+		 * and decode to I420 */
+		spa_pod_builder_push_prop(&b, &f[1], this->type.format_video.format,
+					  SPA_POD_PROP_RANGE_NONE);
+		if (this->codec->pix_fmts) {
+			for (i = 0, j = 0; this->codec->pix_fmts[i] != AV_PIX_FMT_NONE; i++) {
+				uint32_t id = spa_ffmpeg_pix_fmt_to_video_format(&this->type,
+								this->codec->pix_fmts[i]);
+				if (id == 0)
+					continue;
+				if (j++ == 0)
+					spa_pod_builder_id(&b, id);
+				spa_pod_builder_id(&b, id);
+			}
+			if (j == 0)
+				return SPA_RESULT_ENUM_END;
+			if (j > 1)
+				set_prop_flags(&b, &f[1], SPA_POD_PROP_RANGE_ENUM |
+					       SPA_POD_PROP_FLAG_UNSET);
+		} else {
+			spa_pod_builder_id(&b, this->type.video_format.I420);
+		}
+		spa_pod_builder_pop(&b, &f[1]);
+
+		/* the stream has the size of the input */
+		spa_pod_builder_push_prop(&b, &f[1], this->type.format_video.size,
+					  SPA_POD_PROP_RANGE_NONE);
+		if (in_port->have_format) {
+			spa_pod_builder_rectangle(&b, in_port->size.width, in_port->size.height);
+		} else {
+			spa_pod_builder_rectangle(&b, 320, 240);
+			spa_pod_builder_rectangle(&b, 1, 1);
+			spa_pod_builder_rectangle(&b, INT32_MAX, INT32_MAX);
+			set_prop_flags(&b, &f[1], SPA_POD_PROP_RANGE_MIN_MAX |
+				       SPA_POD_PROP_FLAG_UNSET);
+		}
+		spa_pod_builder_pop(&b, &f[1]);
+
+		spa_pod_builder_push_prop(&b, &f[1], this->type.format_video.framerate,
+					  SPA_POD_PROP_RANGE_NONE);
+		if (in_port->have_format) {
+			spa_pod_builder_fraction(&b, in_port->framerate.num, in_port->framerate.denom);
+		} else {
+			spa_pod_builder_fraction(&b, 25, 1);
+			spa_pod_builder_fraction(&b, 0, 1);
+			spa_pod_builder_fraction(&b, INT32_MAX, 1);
+			set_prop_flags(&b, &f[1], SPA_POD_PROP_RANGE_MIN_MAX |
+				       SPA_POD_PROP_FLAG_UNSET);
+		}
+		spa_pod_builder_pop(&b, &f[1]);
+
+		spa_pod_builder_pop(&b, &f[0]);
 	}
-	*format = NULL;
+	fmt = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_format);
+
+	spa_pod_builder_init(&b, this->format_buffer, sizeof(this->format_buffer));
+
+	if ((res = spa_format_filter(fmt, filter, &b)) != SPA_RESULT_OK)
+		return SPA_RESULT_ENUM_END;
+
+	*format = SPA_POD_BUILDER_DEREF(&b, 0, struct spa_format);
 
 	return SPA_RESULT_OK;
 }
 
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers > 0) {
+		spa_log_info(this->log, NAME " %p: clear buffers", this);
+		/* the codec can have frames in the output buffers */
+		if (port == &this->out_ports[0])
+			reset_codec(this);
+		port->n_buffers = 0;
+		spa_list_init(&port->empty);
+	}
+	return SPA_RESULT_OK;
+}
+
 static int
 spa_ffmpeg_dec_node_port_set_format(struct spa_node *node,
 				    enum spa_direction direction,
@@ -221,7 +582,7 @@ spa_ffmpeg_dec_node_port_set_format(struct spa_node *node,
 	struct impl *this;
 	struct port *port;
 
-	if (node == NULL || format == NULL)
+	if (node == NULL)
 		return SPA_RESULT_INVALID_ARGUMENTS;
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
@@ -234,22 +595,41 @@ spa_ffmpeg_dec_node_port_set_format(struct spa_node *node,
 
 	if (format == NULL) {
 		port->have_format = false;
+		clear_buffers(this, port);
+		reset_codec(this);
 		return SPA_RESULT_OK;
 	} else {
-		struct spa_video_info info = { SPA_FORMAT_MEDIA_TYPE(format),
-			SPA_FORMAT_MEDIA_SUBTYPE(format),
-		};
+		struct spa_video_info info;
+		struct spa_rectangle size;
+		struct spa_fraction framerate;
+		uint32_t subtype;
 
-		if (info.media_type != this->type.media_type.video &&
-		    info.media_subtype != this->type.media_subtype.raw)
+		if (spa_ffmpeg_parse_video_format(&this->type, format, &info,
+						  &size, &framerate) < 0)
 			return SPA_RESULT_INVALID_MEDIA_TYPE;
 
-		if (!spa_format_video_raw_parse(format, &info.info.raw, &this->type.format_video))
+		if (direction == SPA_DIRECTION_INPUT)
+			subtype = spa_ffmpeg_codec_to_media_subtype(&this->type, this->codec->id);
+		else
+			subtype = this->type.media_subtype.raw;
+
+		if (info.media_subtype != subtype)
+			return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+		if (direction == SPA_DIRECTION_OUTPUT &&
+		    spa_ffmpeg_video_format_to_pix_fmt(&this->type,
+						       info.info.raw.format) == AV_PIX_FMT_NONE)
 			return SPA_RESULT_INVALID_MEDIA_TYPE;
 
 		if (!(flags & SPA_PORT_FORMAT_FLAG_TEST_ONLY)) {
+			reset_codec(this);
 			port->current_format = info;
+			port->size = size;
+			port->framerate = framerate;
 			port->have_format = true;
+
+			if (direction == SPA_DIRECTION_OUTPUT)
+				return update_layout(this);
 		}
 	}
 	return SPA_RESULT_OK;
@@ -263,6 +643,8 @@ spa_ffmpeg_dec_node_port_get_format(struct spa_node *node,
 {
 	struct impl *this;
 	struct port *port;
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_frame f[2];
 
 	if (node == NULL || format == NULL)
 		return SPA_RESULT_INVALID_ARGUMENTS;
@@ -278,7 +660,27 @@ spa_ffmpeg_dec_node_port_get_format(struct spa_node *node,
 	if (!port->have_format)
 		return SPA_RESULT_NO_FORMAT;
 
-	*format = NULL;
+	spa_pod_builder_init(&b, this->format_buffer, sizeof(this->format_buffer));
+	if (direction == SPA_DIRECTION_INPUT)
+		spa_pod_builder_format(&b, &f[0], this->type.format,
+			this->type.media_type.video,
+			port->current_format.media_subtype,
+			PROP(&f[1], this->type.format_video.size, -SPA_POD_TYPE_RECTANGLE,
+				&port->size),
+			PROP(&f[1], this->type.format_video.framerate, -SPA_POD_TYPE_FRACTION,
+				&port->framerate));
+	else
+		spa_pod_builder_format(&b, &f[0], this->type.format,
+			this->type.media_type.video,
+			this->type.media_subtype.raw,
+			PROP(&f[1], this->type.format_video.format, SPA_POD_TYPE_ID,
+				port->current_format.info.raw.format),
+			PROP(&f[1], this->type.format_video.size, -SPA_POD_TYPE_RECTANGLE,
+				&port->size),
+			PROP(&f[1], this->type.format_video.framerate, -SPA_POD_TYPE_FRACTION,
+				&port->framerate));
+
+	*format = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_format);
 
 	return SPA_RESULT_OK;
 }
@@ -314,7 +716,49 @@ spa_ffmpeg_dec_node_port_enum_params(struct spa_node *node,
 				     uint32_t index,
 				     struct spa_param **param)
 {
-	return SPA_RESULT_NOT_IMPLEMENTED;
+	struct impl *this;
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_frame f[2];
+
+	if (node == NULL || param == NULL)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return SPA_RESULT_INVALID_PORT;
+
+	/* the input buffers are whatever upstream makes */
+	if (direction == SPA_DIRECTION_INPUT)
+		return SPA_RESULT_ENUM_END;
+
+	if (!this->out_ports[0].have_format)
+		return SPA_RESULT_NO_FORMAT;
+
+	spa_pod_builder_init(&b, this->params_buffer, sizeof(this->params_buffer));
+
+	switch (index) {
+	case 0:
+		/* the codec keeps its reference frames in the buffers, ask
+		 * for enough of them to not run out */
+		spa_pod_builder_object(&b, &f[0], 0, this->type.param_alloc_buffers.Buffers,
+			PROP(&f[1], this->type.param_alloc_buffers.size, SPA_POD_TYPE_INT,
+				this->frame_size),
+			PROP(&f[1], this->type.param_alloc_buffers.stride, SPA_POD_TYPE_INT,
+				this->linesize[0]),
+			PROP_U_MM(&f[1], this->type.param_alloc_buffers.buffers, SPA_POD_TYPE_INT,
+				16, 2, MAX_BUFFERS),
+			PROP(&f[1], this->type.param_alloc_buffers.align, SPA_POD_TYPE_INT,
+				FRAME_ALIGN));
+		break;
+
+	default:
+		return SPA_RESULT_ENUM_END;
+	}
+
+	*param = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_param);
+
+	return SPA_RESULT_OK;
 }
 
 static int
@@ -333,13 +777,63 @@ spa_ffmpeg_dec_node_port_use_buffers(struct spa_node *node,
 				     struct spa_buffer **buffers,
 				     uint32_t n_buffers)
 {
+	struct impl *this;
+	struct port *port;
+	uint32_t i;
+
 	if (node == NULL)
 		return SPA_RESULT_INVALID_ARGUMENTS;
 
-	if (!IS_VALID_PORT(node, direction, port_id))
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (!IS_VALID_PORT(this, direction, port_id))
 		return SPA_RESULT_INVALID_PORT;
 
-	return SPA_RESULT_NOT_IMPLEMENTED;
+	port =
+	    direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
+
+	if (!port->have_format)
+		return SPA_RESULT_NO_FORMAT;
+
+	if (n_buffers > MAX_BUFFERS)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	clear_buffers(this, port);
+
+	if (direction == SPA_DIRECTION_OUTPUT)
+		this->direct = true;
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+		struct spa_data *d = buffers[i]->datas;
+
+		b->impl = this;
+		b->outbuf = buffers[i];
+		b->outstanding = false;
+		b->in_codec = false;
+
+		if (d[0].data == NULL) {
+			spa_log_error(this->log, NAME " %p: invalid memory on buffer %p", this,
+				      buffers[i]);
+			return SPA_RESULT_ERROR;
+		}
+		if (direction == SPA_DIRECTION_OUTPUT) {
+			if (d[0].maxsize < this->frame_size) {
+				spa_log_error(this->log, NAME " %p: buffer %p too small (%u < %zd)",
+					      this, buffers[i], d[0].maxsize, this->frame_size);
+				return SPA_RESULT_ERROR;
+			}
+			if ((uintptr_t) d[0].data & (FRAME_ALIGN - 1))
+				this->direct = false;
+		}
+		spa_list_append(&port->empty, &b->link);
+	}
+	port->n_buffers = n_buffers;
+
+	if (direction == SPA_DIRECTION_OUTPUT && !this->direct)
+		spa_log_warn(this->log, NAME " %p: unaligned buffers, frames are copied", this);
+
+	return SPA_RESULT_OK;
 }
 
 static int
@@ -378,16 +872,175 @@ spa_ffmpeg_dec_node_port_set_io(struct spa_node *node,
 	return SPA_RESULT_OK;
 }
 
+/* put a received frame in an output buffer and queue it */
+static int queue_frame(struct impl *this, AVFrame *frame)
+{
+	struct port *port = &this->out_ports[0];
+	struct buffer *b;
+	struct spa_data *d;
+	uint8_t *data[4];
+	uint32_t i;
+
+	if (spa_ffmpeg_pix_fmt_to_video_format(&this->type, frame->format) !=
+	    port->current_format.info.raw.format ||
+	    frame->width != port->size.width || frame->height != port->size.height) {
+		spa_log_warn(this->log, NAME " %p: dropping %s %dx%d frame", this,
+			     av_get_pix_fmt_name(frame->format), frame->width, frame->height);
+		return SPA_RESULT_OK;
+	}
+
+	if ((b = find_frame_buffer(this, frame)) == NULL) {
+		/* the codec made this frame, copy it */
+		if ((b = dequeue_buffer(this)) == NULL)
+			return SPA_RESULT_OUT_OF_BUFFERS;
+
+		d = b->outbuf->datas;
+		for (i = 0; i < 4; i++)
+			data[i] = this->linesize[i] ? (uint8_t *) d[0].data + this->offset[i] : NULL;
+
+		av_image_copy(data, this->linesize, (const uint8_t **) frame->data,
+			      frame->linesize, frame->format, frame->width, frame->height);
+	}
+
+	pthread_mutex_lock(&this->lock);
+	b->outstanding = true;
+	pthread_mutex_unlock(&this->lock);
+
+	d = b->outbuf->datas;
+	d[0].chunk->offset = 0;
+	d[0].chunk->size = this->image_size;
+	d[0].chunk->stride = this->linesize[0];
+
+	spa_list_append(&this->ready, &b->link);
+
+	return SPA_RESULT_OK;
+}
+
+/* take the decoded frames from the codec, the frame threads make them
+ * some packets after the one that completed them */
+static int receive_frames(struct impl *this)
+{
+	int res;
+
+	while (true) {
+		if (!this->have_frame) {
+			res = avcodec_receive_frame(this->context, this->frame);
+			if (res == AVERROR(EAGAIN))
+				break;
+			if (res == AVERROR_EOF) {
+				/* drained, accept new packets */
+				avcodec_flush_buffers(this->context);
+				break;
+			}
+			if (res < 0) {
+				spa_log_error(this->log, NAME " %p: decode error: %s", this,
+					      av_err2str(res));
+				return SPA_RESULT_ERROR;
+			}
+			this->have_frame = true;
+		}
+		if (queue_frame(this, this->frame) == SPA_RESULT_OUT_OF_BUFFERS)
+			break;
+
+		av_frame_unref(this->frame);
+		this->have_frame = false;
+	}
+	return SPA_RESULT_OK;
+}
+
+static int output_frame(struct impl *this)
+{
+	struct spa_port_io *output = this->out_ports[0].io;
+	struct buffer *b;
+
+	if (output == NULL || output->status == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_HAVE_BUFFER;
+
+	if (spa_list_is_empty(&this->ready))
+		return SPA_RESULT_NEED_BUFFER;
+
+	b = spa_list_first(&this->ready, struct buffer, link);
+	spa_list_remove(&b->link);
+
+	output->buffer_id = b->outbuf->id;
+	output->status = SPA_RESULT_HAVE_BUFFER;
+
+	return SPA_RESULT_HAVE_BUFFER;
+}
+
 static int spa_ffmpeg_dec_node_process_input(struct spa_node *node)
 {
-	return SPA_RESULT_INVALID_PORT;
+	struct impl *this;
+	struct port *in_port;
+	struct spa_port_io *input, *output;
+	struct spa_data *d;
+	int res;
+
+	if (node == NULL)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	in_port = &this->in_ports[0];
+	input = in_port->io;
+	output = this->out_ports[0].io;
+	if (input == NULL || output == NULL)
+		return SPA_RESULT_WRONG_STATE;
+
+	if (output->status == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_HAVE_BUFFER;
+
+	if (input->status != SPA_RESULT_HAVE_BUFFER || input->buffer_id >= in_port->n_buffers)
+		return output_frame(this);
+
+	if ((res = open_codec(this)) < 0)
+		return res;
+
+	d = in_port->buffers[input->buffer_id].outbuf->datas;
+
+	/* not refcounted, the codec copies the packet and we can give the
+	 * buffer back right away */
+	this->packet->data = SPA_MEMBER(d[0].data, d[0].chunk->offset, uint8_t);
+	this->packet->size = d[0].chunk->size;
+
+	res = avcodec_send_packet(this->context, this->packet);
+	if (res != AVERROR(EAGAIN)) {
+		if (res < 0)
+			spa_log_warn(this->log, NAME " %p: dropping packet: %s", this,
+				     av_err2str(res));
+		input->status = SPA_RESULT_NEED_BUFFER;
+	}
+
+	if ((res = receive_frames(this)) < 0)
+		return res;
+
+	return output_frame(this);
+}
+
+static void recycle_buffer(struct impl *this, uint32_t id)
+{
+	struct port *port = &this->out_ports[0];
+	struct buffer *b = &port->buffers[id];
+
+	if (!b->outstanding) {
+		spa_log_warn(this->log, NAME " %p: buffer %d not outstanding", this, id);
+		return;
+	}
+
+	pthread_mutex_lock(&this->lock);
+	b->outstanding = false;
+	release_buffer(this, b);
+	pthread_mutex_unlock(&this->lock);
+
+	spa_log_trace(this->log, NAME " %p: recycle buffer %d", this, id);
 }
 
 static int spa_ffmpeg_dec_node_process_output(struct spa_node *node)
 {
 	struct impl *this;
 	struct port *port;
-	struct spa_port_io *output;
+	struct spa_port_io *input, *output;
+	int res;
 
 	if (node == NULL)
 		return SPA_RESULT_INVALID_ARGUMENTS;
@@ -395,29 +1048,70 @@ static int spa_ffmpeg_dec_node_process_output(struct spa_node *node)
 	this = SPA_CONTAINER_OF(node, struct impl, node);
 
 	port = &this->out_ports[0];
-
-	if ((output = port->io) == NULL)
-		return SPA_RESULT_ERROR;
+	output = port->io;
+	input = this->in_ports[0].io;
+	if (output == NULL || input == NULL)
+		return SPA_RESULT_WRONG_STATE;
 
 	if (!port->have_format) {
 		output->status = SPA_RESULT_NO_FORMAT;
 		return SPA_RESULT_ERROR;
 	}
-	output->status = SPA_RESULT_OK;
 
-	return SPA_RESULT_OK;
+	if (output->status == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_HAVE_BUFFER;
+
+	if (output->buffer_id < port->n_buffers) {
+		recycle_buffer(this, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	/* frames that were waiting for a buffer */
+	if (this->opened && (res = receive_frames(this)) < 0)
+		return res;
+
+	if (output_frame(this) == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_HAVE_BUFFER;
+
+	input->range = output->range;
+	input->status = SPA_RESULT_NEED_BUFFER;
+
+	return SPA_RESULT_NEED_BUFFER;
 }
 
 static int
 spa_ffmpeg_dec_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
 {
+	struct impl *this;
+	struct port *port;
+
 	if (node == NULL)
 		return SPA_RESULT_INVALID_ARGUMENTS;
 
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
 	if (port_id != 0)
 		return SPA_RESULT_INVALID_PORT;
 
-	return SPA_RESULT_NOT_IMPLEMENTED;
+	port = &this->out_ports[0];
+
+	if (port->n_buffers == 0)
+		return SPA_RESULT_NO_BUFFERS;
+
+	if (buffer_id >= port->n_buffers)
+		return SPA_RESULT_INVALID_BUFFER_ID;
+
+	recycle_buffer(this, buffer_id);
+
+	/* a frame that waited for a buffer can go out now */
+	if (this->opened && this->have_frame) {
+		receive_frames(this);
+		if (output_frame(this) == SPA_RESULT_HAVE_BUFFER &&
+		    this->callbacks && this->callbacks->have_output)
+			this->callbacks->have_output(this->user_data);
+	}
+
+	return SPA_RESULT_OK;
 }
 
 static int
@@ -474,8 +1168,26 @@ spa_ffmpeg_dec_get_interface(struct spa_handle *handle, uint32_t interface_id, v
 	return SPA_RESULT_OK;
 }
 
-int
-spa_ffmpeg_dec_init(struct spa_handle *handle,
+static int spa_ffmpeg_dec_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+
+	if (handle == NULL)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	this = (struct impl *) handle;
+
+	avcodec_free_context(&this->context);
+	av_packet_free(&this->packet);
+	av_frame_free(&this->frame);
+	pthread_mutex_destroy(&this->lock);
+
+	return SPA_RESULT_OK;
+}
+
+static int
+spa_ffmpeg_dec_init(const struct spa_handle_factory *factory,
+		    struct spa_handle *handle,
 		    const struct spa_dict *info,
 		    const struct spa_support *support,
 		    uint32_t n_support)
@@ -483,7 +1195,11 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	struct impl *this;
 	uint32_t i;
 
+	if (factory == NULL || handle == NULL)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
 	handle->get_interface = spa_ffmpeg_dec_get_interface;
+	handle->clear = spa_ffmpeg_dec_clear;
 
 	this = (struct impl *) handle;
 
@@ -499,10 +1215,60 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	}
 	init_type(&this->type, this->map);
 
+	/* the factory is named after the codec, ffdec_<codec> */
+	if ((this->codec = avcodec_find_decoder_by_name(factory->name + 6)) == NULL) {
+		spa_log_error(this->log, NAME " %p: no decoder for %s", this, factory->name);
+		return SPA_RESULT_ERROR;
+	}
+	this->context = avcodec_alloc_context3(this->codec);
+	this->packet = av_packet_alloc();
+	this->frame = av_frame_alloc();
+	if (this->context == NULL || this->packet == NULL || this->frame == NULL) {
+		avcodec_free_context(&this->context);
+		av_packet_free(&this->packet);
+		av_frame_free(&this->frame);
+		return SPA_RESULT_NO_MEMORY;
+	}
+	pthread_mutex_init(&this->lock, NULL);
+
 	this->node = ffmpeg_dec_node;
 
+	spa_list_init(&this->ready);
+	spa_list_init(&this->in_ports[0].empty);
+	spa_list_init(&this->out_ports[0].empty);
+
 	this->in_ports[0].info.flags = 0;
-	this->out_ports[0].info.flags = 0;
+	this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
 
 	return SPA_RESULT_OK;
 }
+
+static const struct spa_interface_info ffmpeg_dec_interfaces[] = {
+	{SPA_TYPE__Node, },
+};
+
+static int
+spa_ffmpeg_dec_enum_interface_info(const struct spa_handle_factory *factory,
+				   const struct spa_interface_info **info,
+				   uint32_t index)
+{
+	if (factory == NULL || info == NULL)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	if (index >= SPA_N_ELEMENTS(ffmpeg_dec_interfaces))
+		return SPA_RESULT_ENUM_END;
+
+	*info = &ffmpeg_dec_interfaces[index];
+
+	return SPA_RESULT_OK;
+}
+
+/* the name is filled in for each codec when the factories are enumerated */
+struct spa_handle_factory spa_ffmpeg_dec_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	NULL,
+	NULL,
+	sizeof(struct impl),
+	spa_ffmpeg_dec_init,
+	spa_ffmpeg_dec_enum_interface_info,
+};
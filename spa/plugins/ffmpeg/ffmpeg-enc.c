@@ -18,55 +18,50 @@
  */
 
 #include <stddef.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include <spa/log.h>
 #include <spa/type-map.h>
+#include <spa/list.h>
 #include <spa/node.h>
 #include <spa/video/format-utils.h>
+#include <spa/format-builder.h>
+#include <lib/format.h>
 #include <lib/props.h>
 
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+
+#include "ffmpeg.h"
+
+#define NAME "ffmpeg-enc"
+
 #define IS_VALID_PORT(this,d,id) ((id) == 0)
 #define MAX_BUFFERS    32
 
+struct impl;
+
 struct buffer {
-	struct spa_buffer buffer;
-	struct spa_meta metas[1];
-	struct spa_meta_header header;
-	struct spa_data datas[1];
-	struct spa_buffer *imported;
+	struct impl *impl;
+	struct spa_buffer *outbuf;
 	bool outstanding;
-	struct buffer *next;
+	struct spa_list link;
 };
 
 struct port {
 	bool have_format;
 	struct spa_video_info current_format;
-	bool have_buffers;
+	struct spa_rectangle size;
+	struct spa_fraction framerate;
 	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+	struct spa_list empty;
 	struct spa_port_info info;
 	struct spa_port_io *io;
 };
 
-struct type {
-	uint32_t node;
-	struct spa_type_media_type media_type;
-	struct spa_type_media_subtype media_subtype;
-	struct spa_type_format_video format_video;
-	struct spa_type_command_node command_node;
-};
-
-static inline void init_type(struct type *type, struct spa_type_map *map)
-{
-	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
-	spa_type_media_type_map(map, &type->media_type);
-	spa_type_media_subtype_map(map, &type->media_subtype);
-	spa_type_format_video_map(map, &type->format_video);
-	spa_type_command_node_map(map, &type->command_node);
-}
-
 struct impl {
 	struct spa_handle handle;
 	struct spa_node node;
@@ -78,12 +73,148 @@ struct impl {
 	const struct spa_node_callbacks *callbacks;
 	void *user_data;
 
+	uint8_t format_buffer[1024];
+	uint8_t params_buffer[1024];
+
 	struct port in_ports[1];
 	struct port out_ports[1];
 
+	const AVCodec *codec;
+	AVCodecContext *context;
+	AVPacket *packet;
+	AVFrame *frame;
+	bool opened;
+	bool have_packet;	/* a packet was received and waits for a buffer */
+	int64_t n_frames;
+
+	/* the input buffers that the codec no longer uses, the codec threads
+	 * release the frames */
+	pthread_mutex_t lock;
+	struct spa_list released;
+	uint32_t n_held;
+
+	struct spa_list ready;
+
 	bool started;
 };
 
+#define PROP(f,key,type,...)							\
+	SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)						\
+	SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |				\
+			SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+
+/* the data of the builder can move when it grows, look up the prop to
+ * change its flags */
+static void set_prop_flags(struct spa_pod_builder *b, struct spa_pod_frame *f, uint32_t flags)
+{
+	if (f->ref != -1)
+		SPA_POD_BUILDER_DEREF(b, f->ref, struct spa_pod_prop)->body.flags |= flags;
+}
+
+/* called by the codec, maybe from one of its threads, when the last
+ * reference to a frame in an input buffer is gone */
+static void release_input(void *opaque, uint8_t *data)
+{
+	struct buffer *b = opaque;
+	struct impl *this = b->impl;
+
+	pthread_mutex_lock(&this->lock);
+	spa_list_append(&this->released, &b->link);
+	pthread_mutex_unlock(&this->lock);
+}
+
+/* give the released input buffers back to the peer, from the data thread */
+static void reuse_input_buffers(struct impl *this)
+{
+	struct buffer *b;
+
+	while (true) {
+		pthread_mutex_lock(&this->lock);
+		if (spa_list_is_empty(&this->released)) {
+			pthread_mutex_unlock(&this->lock);
+			break;
+		}
+		b = spa_list_first(&this->released, struct buffer, link);
+		spa_list_remove(&b->link);
+		this->n_held--;
+		pthread_mutex_unlock(&this->lock);
+
+		this->callbacks->reuse_buffer(this->user_data, 0, b->outbuf->id);
+	}
+}
+
+static void drop_packets(struct impl *this)
+{
+	struct buffer *b, *tmp;
+
+	av_packet_unref(this->packet);
+	this->have_packet = false;
+
+	spa_list_for_each_safe(b, tmp, &this->ready, link) {
+		spa_list_remove(&b->link);
+		b->outstanding = false;
+		spa_list_append(&this->out_ports[0].empty, &b->link);
+	}
+}
+
+/* drops the references of the codec on the input buffers */
+static void close_codec(struct impl *this)
+{
+	if (this->opened) {
+		avcodec_free_context(&this->context);
+		this->context = avcodec_alloc_context3(this->codec);
+		this->opened = false;
+	}
+	this->n_frames = 0;
+}
+
+static void reset_codec(struct impl *this)
+{
+	drop_packets(this);
+	close_codec(this);
+}
+
+static int open_codec(struct impl *this)
+{
+	struct port *port = &this->in_ports[0];
+	AVCodecContext *context = this->context;
+	int res;
+
+	if (this->opened)
+		return SPA_RESULT_OK;
+
+	if (!port->have_format || !this->out_ports[0].have_format)
+		return SPA_RESULT_NO_FORMAT;
+
+	context->pix_fmt = spa_ffmpeg_video_format_to_pix_fmt(&this->type,
+						port->current_format.info.raw.format);
+	context->width = port->size.width;
+	context->height = port->size.height;
+	if (port->framerate.num > 0) {
+		context->framerate = (AVRational) { port->framerate.num, port->framerate.denom };
+		context->time_base = (AVRational) { port->framerate.denom, port->framerate.num };
+	} else {
+		context->time_base = (AVRational) { 1, 25 };
+	}
+
+	/* use a thread for each cpu, on whole frames and on slices of frames */
+	context->thread_count = 0;
+	context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+	if ((res = avcodec_open2(context, this->codec, NULL)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't open codec %s: %s", this,
+			      this->codec->name, av_err2str(res));
+		return SPA_RESULT_ERROR;
+	}
+	spa_log_debug(this->log, NAME " %p: opened %s with %d threads", this,
+		      this->codec->name, context->thread_count);
+
+	this->opened = true;
+
+	return SPA_RESULT_OK;
+}
+
 static int spa_ffmpeg_enc_node_get_props(struct spa_node *node, struct spa_props **props)
 {
 	return SPA_RESULT_NOT_IMPLEMENTED;
@@ -94,6 +225,9 @@ static int spa_ffmpeg_enc_node_set_props(struct spa_node *node, const struct spa
 	return SPA_RESULT_NOT_IMPLEMENTED;
 }
 
+static int output_packet(struct impl *this);
+static int receive_packets(struct impl *this);
+
 static int spa_ffmpeg_enc_node_send_command(struct spa_node *node, const struct spa_command *command)
 {
 	struct impl *this;
@@ -107,6 +241,18 @@ static int spa_ffmpeg_enc_node_send_command(struct spa_node *node, const struct
 		this->started = true;
 	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Pause) {
 		this->started = false;
+	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Flush) {
+		/* most encoders can't flush, start again */
+		reset_codec(this);
+	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Drain) {
+		/* encode the frames that the codec still has */
+		if (this->opened) {
+			avcodec_send_frame(this->context, NULL);
+			receive_packets(this);
+			if (output_packet(this) == SPA_RESULT_HAVE_BUFFER &&
+			    this->callbacks && this->callbacks->have_output)
+				this->callbacks->have_output(this->user_data);
+		}
 	} else
 		return SPA_RESULT_NOT_IMPLEMENTED;
 
@@ -179,8 +325,7 @@ spa_ffmpeg_enc_node_add_port(struct spa_node *node, enum spa_direction direction
 }
 
 static int
-spa_ffmpeg_enc_node_remove_port(struct spa_node *node,
-				enum spa_direction direction, uint32_t port_id)
+spa_ffmpeg_enc_node_remove_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
 {
 	return SPA_RESULT_NOT_IMPLEMENTED;
 }
@@ -190,29 +335,123 @@ spa_ffmpeg_enc_node_port_enum_formats(struct spa_node *node,
 				      enum spa_direction direction,
 				      uint32_t port_id,
 				      struct spa_format **format,
-				      const struct spa_format *filter, uint32_t index)
+				      const struct spa_format *filter,
+				      uint32_t index)
 {
-	//struct impl *this;
-	//struct port *port;
+	struct impl *this;
+	struct port *in_port;
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_frame f[2];
+	struct spa_format *fmt;
+	uint8_t buffer[1024];
+	uint32_t subtype, i, j;
+	int res;
 
 	if (node == NULL || format == NULL)
 		return SPA_RESULT_INVALID_ARGUMENTS;
 
-	//this = SPA_CONTAINER_OF (node, struct impl, node);
+	this = SPA_CONTAINER_OF(node, struct impl, node);
 
 	if (!IS_VALID_PORT(this, direction, port_id))
 		return SPA_RESULT_INVALID_PORT;
 
-	//port = direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
-
-	switch (index) {
-	case 0:
-		break;
-	default:
+	if (index > 0)
 		return SPA_RESULT_ENUM_END;
+
+	in_port = &this->in_ports[0];
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	if (direction == SPA_DIRECTION_INPUT) {
+		if (this->codec->pix_fmts == NULL)
+			return SPA_RESULT_ENUM_END;
+
+		spa_pod_builder_push_format(&b, &f[0], this->type.format,
+					    this->type.media_type.video,
+					    this->type.media_subtype.raw);
+
+		/* the formats that the codec takes */
+		spa_pod_builder_push_prop(&b, &f[1], this->type.format_video.format,
+					  SPA_POD_PROP_RANGE_NONE);
+		for (i = 0, j = 0; this->codec->pix_fmts[i] != AV_PIX_FMT_NONE; i++) {
+			uint32_t id = spa_ffmpeg_pix_fmt_to_video_format(&this->type,
+							this->codec->pix_fmts[i]);
+			if (id == 0)
+				continue;
+			if (j++ == 0)
+				spa_pod_builder_id(&b, id);
+			spa_pod_builder_id(&b, id);
+		}
+		if (j == 0)
+			return SPA_RESULT_ENUM_END;
+		if (j > 1)
+			set_prop_flags(&b, &f[1], SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+		spa_pod_builder_pop(&b, &f[1]);
+
+		spa_pod_builder_push_prop(&b, &f[1], this->type.format_video.size,
+					  SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET);
+		spa_pod_builder_rectangle(&b, 320, 240);
+		spa_pod_builder_rectangle(&b, 1, 1);
+		spa_pod_builder_rectangle(&b, INT32_MAX, INT32_MAX);
+		spa_pod_builder_pop(&b, &f[1]);
+
+		spa_pod_builder_push_prop(&b, &f[1], this->type.format_video.framerate,
+					  SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET);
+		spa_pod_builder_fraction(&b, 25, 1);
+		spa_pod_builder_fraction(&b, 0, 1);
+		spa_pod_builder_fraction(&b, INT32_MAX, 1);
+		spa_pod_builder_pop(&b, &f[1]);
+
+		spa_pod_builder_pop(&b, &f[0]);
+	} else {
+		if ((subtype = spa_ffmpeg_codec_to_media_subtype(&this->type, this->codec->id)) == 0)
+			return SPA_RESULT_ENUM_END;
+
+		/* the stream has the size of the input */
+		if (in_port->have_format)
+			spa_pod_builder_format(&b, &f[0], this->type.format,
+				this->type.media_type.video, subtype,
+				PROP(&f[1], this->type.format_video.size, -SPA_POD_TYPE_RECTANGLE,
+					&in_port->size),
+				PROP(&f[1], this->type.format_video.framerate, -SPA_POD_TYPE_FRACTION,
+					&in_port->framerate));
+		else
+			spa_pod_builder_format(&b, &f[0], this->type.format,
+				this->type.media_type.video, subtype,
+				PROP_U_MM(&f[1], this->type.format_video.size, SPA_POD_TYPE_RECTANGLE,
+					320, 240,
+					1, 1,
+					INT32_MAX, INT32_MAX),
+				PROP_U_MM(&f[1], this->type.format_video.framerate, SPA_POD_TYPE_FRACTION,
+					25, 1,
+					0, 1,
+					INT32_MAX, 1));
 	}
-	*format = NULL;
+	fmt = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_format);
 
+	spa_pod_builder_init(&b, this->format_buffer, sizeof(this->format_buffer));
+
+	if ((res = spa_format_filter(fmt, filter, &b)) != SPA_RESULT_OK)
+		return SPA_RESULT_ENUM_END;
+
+	*format = SPA_POD_BUILDER_DEREF(&b, 0, struct spa_format);
+
+	return SPA_RESULT_OK;
+}
+
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers > 0) {
+		spa_log_info(this->log, NAME " %p: clear buffers", this);
+		/* the codec can have frames in the input buffers */
+		reset_codec(this);
+		if (port == &this->in_ports[0]) {
+			spa_list_init(&this->released);
+			this->n_held = 0;
+		}
+		port->n_buffers = 0;
+		spa_list_init(&port->empty);
+	}
 	return SPA_RESULT_OK;
 }
 
@@ -220,12 +459,13 @@ static int
 spa_ffmpeg_enc_node_port_set_format(struct spa_node *node,
 				    enum spa_direction direction,
 				    uint32_t port_id,
-				    uint32_t flags, const struct spa_format *format)
+				    uint32_t flags,
+				    const struct spa_format *format)
 {
 	struct impl *this;
 	struct port *port;
 
-	if (node == NULL || format == NULL)
+	if (node == NULL)
 		return SPA_RESULT_INVALID_ARGUMENTS;
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
@@ -238,21 +478,37 @@ spa_ffmpeg_enc_node_port_set_format(struct spa_node *node,
 
 	if (format == NULL) {
 		port->have_format = false;
+		clear_buffers(this, port);
+		reset_codec(this);
 		return SPA_RESULT_OK;
 	} else {
-		struct spa_video_info info = { SPA_FORMAT_MEDIA_TYPE(format),
-			SPA_FORMAT_MEDIA_SUBTYPE(format),
-		};
+		struct spa_video_info info;
+		struct spa_rectangle size;
+		struct spa_fraction framerate;
+		uint32_t subtype;
 
-		if (info.media_type != this->type.media_type.video &&
-		    info.media_subtype != this->type.media_subtype.raw)
+		if (spa_ffmpeg_parse_video_format(&this->type, format, &info,
+						  &size, &framerate) < 0)
 			return SPA_RESULT_INVALID_MEDIA_TYPE;
 
-		if (!spa_format_video_raw_parse(format, &info.info.raw, &this->type.format_video))
+		if (direction == SPA_DIRECTION_INPUT)
+			subtype = this->type.media_subtype.raw;
+		else
+			subtype = spa_ffmpeg_codec_to_media_subtype(&this->type, this->codec->id);
+
+		if (info.media_subtype != subtype)
+			return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+		if (direction == SPA_DIRECTION_INPUT &&
+		    spa_ffmpeg_video_format_to_pix_fmt(&this->type,
+						       info.info.raw.format) == AV_PIX_FMT_NONE)
 			return SPA_RESULT_INVALID_MEDIA_TYPE;
 
 		if (!(flags & SPA_PORT_FORMAT_FLAG_TEST_ONLY)) {
+			reset_codec(this);
 			port->current_format = info;
+			port->size = size;
+			port->framerate = framerate;
 			port->have_format = true;
 		}
 	}
@@ -262,10 +518,13 @@ spa_ffmpeg_enc_node_port_set_format(struct spa_node *node,
 static int
 spa_ffmpeg_enc_node_port_get_format(struct spa_node *node,
 				    enum spa_direction direction,
-				    uint32_t port_id, const struct spa_format **format)
+				    uint32_t port_id,
+				    const struct spa_format **format)
 {
 	struct impl *this;
 	struct port *port;
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_frame f[2];
 
 	if (node == NULL || format == NULL)
 		return SPA_RESULT_INVALID_ARGUMENTS;
@@ -281,7 +540,27 @@ spa_ffmpeg_enc_node_port_get_format(struct spa_node *node,
 	if (!port->have_format)
 		return SPA_RESULT_NO_FORMAT;
 
-	*format = NULL;
+	spa_pod_builder_init(&b, this->format_buffer, sizeof(this->format_buffer));
+	if (direction == SPA_DIRECTION_INPUT)
+		spa_pod_builder_format(&b, &f[0], this->type.format,
+			this->type.media_type.video,
+			this->type.media_subtype.raw,
+			PROP(&f[1], this->type.format_video.format, SPA_POD_TYPE_ID,
+				port->current_format.info.raw.format),
+			PROP(&f[1], this->type.format_video.size, -SPA_POD_TYPE_RECTANGLE,
+				&port->size),
+			PROP(&f[1], this->type.format_video.framerate, -SPA_POD_TYPE_FRACTION,
+				&port->framerate));
+	else
+		spa_pod_builder_format(&b, &f[0], this->type.format,
+			this->type.media_type.video,
+			port->current_format.media_subtype,
+			PROP(&f[1], this->type.format_video.size, -SPA_POD_TYPE_RECTANGLE,
+				&port->size),
+			PROP(&f[1], this->type.format_video.framerate, -SPA_POD_TYPE_FRACTION,
+				&port->framerate));
+
+	*format = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_format);
 
 	return SPA_RESULT_OK;
 }
@@ -289,7 +568,8 @@ spa_ffmpeg_enc_node_port_get_format(struct spa_node *node,
 static int
 spa_ffmpeg_enc_node_port_get_info(struct spa_node *node,
 				  enum spa_direction direction,
-				  uint32_t port_id, const struct spa_port_info **info)
+				  uint32_t port_id,
+				  const struct spa_port_info **info)
 {
 	struct impl *this;
 	struct port *port;
@@ -312,15 +592,67 @@ spa_ffmpeg_enc_node_port_get_info(struct spa_node *node,
 static int
 spa_ffmpeg_enc_node_port_enum_params(struct spa_node *node,
 				     enum spa_direction direction,
-				     uint32_t port_id, uint32_t index, struct spa_param **param)
+				     uint32_t port_id,
+				     uint32_t index,
+				     struct spa_param **param)
 {
-	return SPA_RESULT_NOT_IMPLEMENTED;
+	struct impl *this;
+	struct port *in_port;
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_frame f[2];
+	int size;
+
+	if (node == NULL || param == NULL)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return SPA_RESULT_INVALID_PORT;
+
+	/* the input buffers are whatever upstream makes */
+	if (direction == SPA_DIRECTION_INPUT)
+		return SPA_RESULT_ENUM_END;
+
+	in_port = &this->in_ports[0];
+	if (!in_port->have_format || !this->out_ports[0].have_format)
+		return SPA_RESULT_NO_FORMAT;
+
+	/* a packet is never bigger than the raw frame and some headers */
+	size = av_image_get_buffer_size(spa_ffmpeg_video_format_to_pix_fmt(&this->type,
+						in_port->current_format.info.raw.format),
+					in_port->size.width, in_port->size.height, 1);
+	size += AV_INPUT_BUFFER_MIN_SIZE;
+
+	spa_pod_builder_init(&b, this->params_buffer, sizeof(this->params_buffer));
+
+	switch (index) {
+	case 0:
+		spa_pod_builder_object(&b, &f[0], 0, this->type.param_alloc_buffers.Buffers,
+			PROP(&f[1], this->type.param_alloc_buffers.size, SPA_POD_TYPE_INT,
+				size),
+			PROP(&f[1], this->type.param_alloc_buffers.stride, SPA_POD_TYPE_INT,
+				0),
+			PROP_U_MM(&f[1], this->type.param_alloc_buffers.buffers, SPA_POD_TYPE_INT,
+				8, 2, MAX_BUFFERS),
+			PROP(&f[1], this->type.param_alloc_buffers.align, SPA_POD_TYPE_INT,
+				16));
+		break;
+
+	default:
+		return SPA_RESULT_ENUM_END;
+	}
+
+	*param = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_param);
+
+	return SPA_RESULT_OK;
 }
 
 static int
 spa_ffmpeg_enc_node_port_set_param(struct spa_node *node,
 				   enum spa_direction direction,
-				   uint32_t port_id, const struct spa_param *param)
+				   uint32_t port_id,
+				   const struct spa_param *param)
 {
 	return SPA_RESULT_NOT_IMPLEMENTED;
 }
@@ -329,15 +661,50 @@ static int
 spa_ffmpeg_enc_node_port_use_buffers(struct spa_node *node,
 				     enum spa_direction direction,
 				     uint32_t port_id,
-				     struct spa_buffer **buffers, uint32_t n_buffers)
+				     struct spa_buffer **buffers,
+				     uint32_t n_buffers)
 {
+	struct impl *this;
+	struct port *port;
+	uint32_t i;
+
 	if (node == NULL)
 		return SPA_RESULT_INVALID_ARGUMENTS;
 
-	if (!IS_VALID_PORT(node, direction, port_id))
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (!IS_VALID_PORT(this, direction, port_id))
 		return SPA_RESULT_INVALID_PORT;
 
-	return SPA_RESULT_NOT_IMPLEMENTED;
+	port =
+	    direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
+
+	if (!port->have_format)
+		return SPA_RESULT_NO_FORMAT;
+
+	if (n_buffers > MAX_BUFFERS)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	clear_buffers(this, port);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+		struct spa_data *d = buffers[i]->datas;
+
+		b->impl = this;
+		b->outbuf = buffers[i];
+		b->outstanding = false;
+
+		if (d[0].data == NULL) {
+			spa_log_error(this->log, NAME " %p: invalid memory on buffer %p", this,
+				      buffers[i]);
+			return SPA_RESULT_ERROR;
+		}
+		spa_list_append(&port->empty, &b->link);
+	}
+	port->n_buffers = n_buffers;
+
+	return SPA_RESULT_OK;
 }
 
 static int
@@ -355,7 +722,8 @@ spa_ffmpeg_enc_node_port_alloc_buffers(struct spa_node *node,
 static int
 spa_ffmpeg_enc_node_port_set_io(struct spa_node *node,
 				enum spa_direction direction,
-				uint32_t port_id, struct spa_port_io *io)
+				uint32_t port_id,
+				struct spa_port_io *io)
 {
 	struct impl *this;
 	struct port *port;
@@ -375,56 +743,299 @@ spa_ffmpeg_enc_node_port_set_io(struct spa_node *node,
 	return SPA_RESULT_OK;
 }
 
-static int
-spa_ffmpeg_enc_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+/* copy a received packet in an output buffer and queue it */
+static int queue_packet(struct impl *this, AVPacket *packet)
 {
-	if (node == NULL)
-		return SPA_RESULT_INVALID_ARGUMENTS;
+	struct port *port = &this->out_ports[0];
+	struct buffer *b;
+	struct spa_data *d;
 
-	if (port_id != 0)
-		return SPA_RESULT_INVALID_PORT;
+	if (spa_list_is_empty(&port->empty))
+		return SPA_RESULT_OUT_OF_BUFFERS;
 
-	return SPA_RESULT_NOT_IMPLEMENTED;
+	b = spa_list_first(&port->empty, struct buffer, link);
+	d = b->outbuf->datas;
+
+	if (packet->size > d[0].maxsize) {
+		spa_log_warn(this->log, NAME " %p: dropping packet of %d bytes", this,
+			     packet->size);
+		return SPA_RESULT_OK;
+	}
+	spa_list_remove(&b->link);
+	b->outstanding = true;
+
+	memcpy(d[0].data, packet->data, packet->size);
+	d[0].chunk->offset = 0;
+	d[0].chunk->size = packet->size;
+	d[0].chunk->stride = 0;
+
+	spa_list_append(&this->ready, &b->link);
+
+	return SPA_RESULT_OK;
 }
 
-static int
-spa_ffmpeg_enc_node_port_send_command(struct spa_node *node,
-				      enum spa_direction direction,
-				      uint32_t port_id, const struct spa_command *command)
+/* take the encoded packets from the codec, the frame threads make them
+ * some frames after the one that completed them */
+static int receive_packets(struct impl *this)
 {
-	return SPA_RESULT_NOT_IMPLEMENTED;
+	int res;
+
+	while (true) {
+		if (!this->have_packet) {
+			res = avcodec_receive_packet(this->context, this->packet);
+			if (res == AVERROR(EAGAIN))
+				break;
+			if (res == AVERROR_EOF) {
+				/* drained, the codec needs to start again but the
+				 * packets that are ready still go out */
+				close_codec(this);
+				break;
+			}
+			if (res < 0) {
+				spa_log_error(this->log, NAME " %p: encode error: %s", this,
+					      av_err2str(res));
+				return SPA_RESULT_ERROR;
+			}
+			this->have_packet = true;
+		}
+		if (queue_packet(this, this->packet) == SPA_RESULT_OUT_OF_BUFFERS)
+			break;
+
+		av_packet_unref(this->packet);
+		this->have_packet = false;
+	}
+	return SPA_RESULT_OK;
+}
+
+static int output_packet(struct impl *this)
+{
+	struct spa_port_io *output = this->out_ports[0].io;
+	struct buffer *b;
+
+	if (output == NULL || output->status == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_HAVE_BUFFER;
+
+	if (spa_list_is_empty(&this->ready))
+		return SPA_RESULT_NEED_BUFFER;
+
+	b = spa_list_first(&this->ready, struct buffer, link);
+	spa_list_remove(&b->link);
+
+	output->buffer_id = b->outbuf->id;
+	output->status = SPA_RESULT_HAVE_BUFFER;
+
+	return SPA_RESULT_HAVE_BUFFER;
+}
+
+/* Point the frame at the planes of an input buffer. The codec keeps a
+ * reference to the frames it still needs and the buffer goes back to the
+ * peer when the last one is gone. */
+static int wrap_frame(struct impl *this, AVFrame *frame, struct buffer *b)
+{
+	struct port *port = &this->in_ports[0];
+	struct spa_data *d = b->outbuf->datas;
+	uint8_t *data = SPA_MEMBER(d[0].data, d[0].chunk->offset, uint8_t);
+	int i, size, stride = d[0].chunk->stride;
+
+	frame->format = this->context->pix_fmt;
+	frame->width = port->size.width;
+	frame->height = port->size.height;
+	frame->pts = this->n_frames++;
+
+	if (av_image_fill_linesizes(frame->linesize, frame->format, frame->width) < 0)
+		return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+	/* the other planes are padded like the first one */
+	if (stride > frame->linesize[0]) {
+		for (i = 1; i < 4; i++)
+			frame->linesize[i] = frame->linesize[i] * stride / frame->linesize[0];
+		frame->linesize[0] = stride;
+	}
+	size = av_image_fill_pointers(frame->data, frame->format, frame->height, data,
+				      frame->linesize);
+	if (size < 0 || size > d[0].chunk->size) {
+		spa_log_warn(this->log, NAME " %p: buffer %d too small (%u < %d)", this,
+			     b->outbuf->id, d[0].chunk->size, size);
+		return SPA_RESULT_ERROR;
+	}
+	frame->extended_data = frame->data;
+
+	/* without a way to give the buffer back later or when the peer would
+	 * run out of buffers, the codec copies the frame */
+	if (this->callbacks == NULL || this->callbacks->reuse_buffer == NULL ||
+	    this->n_held + 1 >= port->n_buffers)
+		return SPA_RESULT_OK;
+
+	if ((frame->buf[0] = av_buffer_create(data, size, release_input, b,
+					      AV_BUFFER_FLAG_READONLY)) == NULL)
+		return SPA_RESULT_NO_MEMORY;
+
+	pthread_mutex_lock(&this->lock);
+	this->n_held++;
+	pthread_mutex_unlock(&this->lock);
+
+	return SPA_RESULT_OK;
 }
 
 static int spa_ffmpeg_enc_node_process_input(struct spa_node *node)
 {
-	return SPA_RESULT_INVALID_PORT;
+	struct impl *this;
+	struct port *in_port;
+	struct spa_port_io *input, *output;
+	int res;
+
+	if (node == NULL)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	in_port = &this->in_ports[0];
+	input = in_port->io;
+	output = this->out_ports[0].io;
+	if (input == NULL || output == NULL)
+		return SPA_RESULT_WRONG_STATE;
+
+	reuse_input_buffers(this);
+
+	if (output->status == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_HAVE_BUFFER;
+
+	/* the codec can't take a frame before its packets are out */
+	if (this->have_packet ||
+	    input->status != SPA_RESULT_HAVE_BUFFER || input->buffer_id >= in_port->n_buffers)
+		return output_packet(this);
+
+	if ((res = open_codec(this)) < 0)
+		return res;
+
+	if ((res = wrap_frame(this, this->frame, &in_port->buffers[input->buffer_id])) < 0) {
+		input->status = SPA_RESULT_NEED_BUFFER;
+		return res;
+	}
+
+	res = avcodec_send_frame(this->context, this->frame);
+	if (res < 0)
+		spa_log_warn(this->log, NAME " %p: dropping frame: %s", this, av_err2str(res));
+
+	/* the codec has its own reference now or copied the frame */
+	if (this->frame->buf[0] != NULL)
+		input->buffer_id = SPA_ID_INVALID;
+	av_frame_unref(this->frame);
+	input->status = SPA_RESULT_NEED_BUFFER;
+
+	if ((res = receive_packets(this)) < 0)
+		return res;
+
+	reuse_input_buffers(this);
+
+	return output_packet(this);
+}
+
+static void recycle_buffer(struct impl *this, uint32_t id)
+{
+	struct port *port = &this->out_ports[0];
+	struct buffer *b = &port->buffers[id];
+
+	if (!b->outstanding) {
+		spa_log_warn(this->log, NAME " %p: buffer %d not outstanding", this, id);
+		return;
+	}
+
+	spa_list_append(&port->empty, &b->link);
+	b->outstanding = false;
+	spa_log_trace(this->log, NAME " %p: recycle buffer %d", this, id);
 }
 
 static int spa_ffmpeg_enc_node_process_output(struct spa_node *node)
 {
 	struct impl *this;
 	struct port *port;
-	struct spa_port_io *output;
+	struct spa_port_io *input, *output;
+	int res;
 
 	if (node == NULL)
 		return SPA_RESULT_INVALID_ARGUMENTS;
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
 
-	if ((output = this->out_ports[0].io) == NULL)
-		return SPA_RESULT_OK;
-
 	port = &this->out_ports[0];
+	output = port->io;
+	input = this->in_ports[0].io;
+	if (output == NULL || input == NULL)
+		return SPA_RESULT_WRONG_STATE;
 
 	if (!port->have_format) {
 		output->status = SPA_RESULT_NO_FORMAT;
 		return SPA_RESULT_ERROR;
 	}
-	output->status = SPA_RESULT_OK;
+
+	reuse_input_buffers(this);
+
+	if (output->status == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_HAVE_BUFFER;
+
+	if (output->buffer_id < port->n_buffers) {
+		recycle_buffer(this, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	/* packets that were waiting for a buffer */
+	if (this->opened && (res = receive_packets(this)) < 0)
+		return res;
+
+	if (output_packet(this) == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_HAVE_BUFFER;
+
+	input->range = output->range;
+	input->status = SPA_RESULT_NEED_BUFFER;
+
+	return SPA_RESULT_NEED_BUFFER;
+}
+
+static int
+spa_ffmpeg_enc_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *this;
+	struct port *port;
+
+	if (node == NULL)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (port_id != 0)
+		return SPA_RESULT_INVALID_PORT;
+
+	port = &this->out_ports[0];
+
+	if (port->n_buffers == 0)
+		return SPA_RESULT_NO_BUFFERS;
+
+	if (buffer_id >= port->n_buffers)
+		return SPA_RESULT_INVALID_BUFFER_ID;
+
+	recycle_buffer(this, buffer_id);
+
+	/* a packet that waited for a buffer can go out now */
+	if (this->opened && this->have_packet) {
+		receive_packets(this);
+		if (output_packet(this) == SPA_RESULT_HAVE_BUFFER &&
+		    this->callbacks && this->callbacks->have_output)
+			this->callbacks->have_output(this->user_data);
+	}
 
 	return SPA_RESULT_OK;
 }
 
+static int
+spa_ffmpeg_enc_node_port_send_command(struct spa_node *node,
+				      enum spa_direction direction,
+				      uint32_t port_id,
+				      const struct spa_command *command)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
 static const struct spa_node ffmpeg_enc_node = {
 	SPA_VERSION_NODE,
 	NULL,
@@ -469,15 +1080,38 @@ spa_ffmpeg_enc_get_interface(struct spa_handle *handle, uint32_t interface_id, v
 	return SPA_RESULT_OK;
 }
 
-int
-spa_ffmpeg_enc_init(struct spa_handle *handle,
+static int spa_ffmpeg_enc_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+
+	if (handle == NULL)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	this = (struct impl *) handle;
+
+	avcodec_free_context(&this->context);
+	av_packet_free(&this->packet);
+	av_frame_free(&this->frame);
+	pthread_mutex_destroy(&this->lock);
+
+	return SPA_RESULT_OK;
+}
+
+static int
+spa_ffmpeg_enc_init(const struct spa_handle_factory *factory,
+		    struct spa_handle *handle,
 		    const struct spa_dict *info,
-		    const struct spa_support *support, uint32_t n_support)
+		    const struct spa_support *support,
+		    uint32_t n_support)
 {
 	struct impl *this;
 	uint32_t i;
 
+	if (factory == NULL || handle == NULL)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
 	handle->get_interface = spa_ffmpeg_enc_get_interface;
+	handle->clear = spa_ffmpeg_enc_clear;
 
 	this = (struct impl *) handle;
 
@@ -491,11 +1125,63 @@ spa_ffmpeg_enc_init(struct spa_handle *handle,
 		spa_log_error(this->log, "a type-map is needed");
 		return SPA_RESULT_ERROR;
 	}
+	init_type(&this->type, this->map);
+
+	/* the factory is named after the codec, ffenc_<codec> */
+	if ((this->codec = avcodec_find_encoder_by_name(factory->name + 6)) == NULL) {
+		spa_log_error(this->log, NAME " %p: no encoder for %s", this, factory->name);
+		return SPA_RESULT_ERROR;
+	}
+	this->context = avcodec_alloc_context3(this->codec);
+	this->packet = av_packet_alloc();
+	this->frame = av_frame_alloc();
+	if (this->context == NULL || this->packet == NULL || this->frame == NULL) {
+		avcodec_free_context(&this->context);
+		av_packet_free(&this->packet);
+		av_frame_free(&this->frame);
+		return SPA_RESULT_NO_MEMORY;
+	}
+	pthread_mutex_init(&this->lock, NULL);
 
 	this->node = ffmpeg_enc_node;
 
-	this->in_ports[0].info.flags = 0;
-	this->out_ports[0].info.flags = 0;
+	spa_list_init(&this->released);
+	spa_list_init(&this->ready);
+	spa_list_init(&this->in_ports[0].empty);
+	spa_list_init(&this->out_ports[0].empty);
+
+	this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+	this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
 
 	return SPA_RESULT_OK;
 }
+
+static const struct spa_interface_info ffmpeg_enc_interfaces[] = {
+	{SPA_TYPE__Node, },
+};
+
+static int
+spa_ffmpeg_enc_enum_interface_info(const struct spa_handle_factory *factory,
+				   const struct spa_interface_info **info,
+				   uint32_t index)
+{
+	if (factory == NULL || info == NULL)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	if (index >= SPA_N_ELEMENTS(ffmpeg_enc_interfaces))
+		return SPA_RESULT_ENUM_END;
+
+	*info = &ffmpeg_enc_interfaces[index];
+
+	return SPA_RESULT_OK;
+}
+
+/* the name is filled in for each codec when the factories are enumerated */
+struct spa_handle_factory spa_ffmpeg_enc_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	NULL,
+	NULL,
+	sizeof(struct impl),
+	spa_ffmpeg_enc_init,
+	spa_ffmpeg_enc_enum_interface_info,
+};
@@ -25,89 +25,171 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 
-int spa_ffmpeg_dec_init(struct spa_handle *handle, const struct spa_dict *info,
-			const struct spa_support *support, uint32_t n_support);
-int spa_ffmpeg_enc_init(struct spa_handle *handle, const struct spa_dict *info,
-			const struct spa_support *support, uint32_t n_support);
-
-static int
-ffmpeg_dec_init(const struct spa_handle_factory *factory,
-		struct spa_handle *handle,
-		const struct spa_dict *info,
-		const struct spa_support *support,
-		uint32_t n_support)
+#include "ffmpeg.h"
+
+struct codec_info {
+	enum AVCodecID id;
+	off_t media_subtype_offset;
+};
+
+#define SUBTYPE(s)	offsetof(struct type, media_subtype_video.s)
+
+static const struct codec_info codec_info[] = {
+	{ AV_CODEC_ID_H264, SUBTYPE(h264) },
+	{ AV_CODEC_ID_MJPEG, SUBTYPE(mjpg) },
+	{ AV_CODEC_ID_DVVIDEO, SUBTYPE(dv) },
+	{ AV_CODEC_ID_H263, SUBTYPE(h263) },
+	{ AV_CODEC_ID_MPEG1VIDEO, SUBTYPE(mpeg1) },
+	{ AV_CODEC_ID_MPEG2VIDEO, SUBTYPE(mpeg2) },
+	{ AV_CODEC_ID_MPEG4, SUBTYPE(mpeg4) },
+	{ AV_CODEC_ID_VC1, SUBTYPE(vc1) },
+	{ AV_CODEC_ID_VP8, SUBTYPE(vp8) },
+	{ AV_CODEC_ID_VP9, SUBTYPE(vp9) },
+};
+
+struct pix_fmt_info {
+	enum AVPixelFormat pix_fmt;
+	off_t format_offset;
+};
+
+#define FORMAT(f)	offsetof(struct type, video_format.f)
+
+/* the first entry of a video format is used to go back to a pixel format */
+static const struct pix_fmt_info pix_fmt_info[] = {
+	{ AV_PIX_FMT_YUV420P, FORMAT(I420) },
+	{ AV_PIX_FMT_YUVJ420P, FORMAT(I420) },
+	{ AV_PIX_FMT_YUYV422, FORMAT(YUY2) },
+	{ AV_PIX_FMT_UYVY422, FORMAT(UYVY) },
+	{ AV_PIX_FMT_YUV422P, FORMAT(Y42B) },
+	{ AV_PIX_FMT_YUVJ422P, FORMAT(Y42B) },
+	{ AV_PIX_FMT_YUV444P, FORMAT(Y444) },
+	{ AV_PIX_FMT_YUVJ444P, FORMAT(Y444) },
+	{ AV_PIX_FMT_YUV411P, FORMAT(Y41B) },
+	{ AV_PIX_FMT_YUV410P, FORMAT(YUV9) },
+	{ AV_PIX_FMT_NV12, FORMAT(NV12) },
+	{ AV_PIX_FMT_NV21, FORMAT(NV21) },
+	{ AV_PIX_FMT_GRAY8, FORMAT(GRAY8) },
+	{ AV_PIX_FMT_RGB24, FORMAT(RGB) },
+	{ AV_PIX_FMT_BGR24, FORMAT(BGR) },
+	{ AV_PIX_FMT_RGBA, FORMAT(RGBA) },
+	{ AV_PIX_FMT_BGRA, FORMAT(BGRA) },
+	{ AV_PIX_FMT_ARGB, FORMAT(ARGB) },
+	{ AV_PIX_FMT_ABGR, FORMAT(ABGR) },
+	{ AV_PIX_FMT_RGB0, FORMAT(RGBx) },
+	{ AV_PIX_FMT_BGR0, FORMAT(BGRx) },
+	{ AV_PIX_FMT_0RGB, FORMAT(xRGB) },
+	{ AV_PIX_FMT_0BGR, FORMAT(xBGR) },
+};
+
+uint32_t spa_ffmpeg_codec_to_media_subtype(struct type *type, enum AVCodecID id)
 {
-	if (factory == NULL || handle == NULL)
-		return SPA_RESULT_INVALID_ARGUMENTS;
+	int i;
 
-	return spa_ffmpeg_dec_init(handle, info, support, n_support);
+	for (i = 0; i < SPA_N_ELEMENTS(codec_info); i++) {
+		if (codec_info[i].id == id)
+			return *SPA_MEMBER(type, codec_info[i].media_subtype_offset, uint32_t);
+	}
+	return 0;
 }
 
-static int
-ffmpeg_enc_init(const struct spa_handle_factory *factory,
-		struct spa_handle *handle,
-		const struct spa_dict *info,
-		const struct spa_support *support,
-		uint32_t n_support)
+uint32_t spa_ffmpeg_pix_fmt_to_video_format(struct type *type, enum AVPixelFormat pix_fmt)
 {
-	if (factory == NULL || handle == NULL)
-		return SPA_RESULT_INVALID_ARGUMENTS;
+	int i;
 
-	return spa_ffmpeg_enc_init(handle, info, support, n_support);
+	for (i = 0; i < SPA_N_ELEMENTS(pix_fmt_info); i++) {
+		if (pix_fmt_info[i].pix_fmt == pix_fmt)
+			return *SPA_MEMBER(type, pix_fmt_info[i].format_offset, uint32_t);
+	}
+	return 0;
 }
 
-static const struct spa_interface_info ffmpeg_interfaces[] = {
-	{SPA_TYPE__Node, },
-};
-
-static int
-ffmpeg_enum_interface_info(const struct spa_handle_factory *factory,
-			   const struct spa_interface_info **info,
-			   uint32_t index)
+enum AVPixelFormat spa_ffmpeg_video_format_to_pix_fmt(struct type *type, uint32_t format)
 {
-	if (factory == NULL || info == NULL)
-		return SPA_RESULT_INVALID_ARGUMENTS;
-
-	if (index >= 1)
-		return SPA_RESULT_ENUM_END;
+	int i;
 
-	*info = &ffmpeg_interfaces[index];
+	for (i = 0; i < SPA_N_ELEMENTS(pix_fmt_info); i++) {
+		if (*SPA_MEMBER(type, pix_fmt_info[i].format_offset, uint32_t) == format)
+			return pix_fmt_info[i].pix_fmt;
+	}
+	return AV_PIX_FMT_NONE;
+}
 
+int spa_ffmpeg_parse_video_format(struct type *type, const struct spa_format *format,
+				  struct spa_video_info *info,
+				  struct spa_rectangle *size, struct spa_fraction *framerate)
+{
+	info->media_type = SPA_FORMAT_MEDIA_TYPE(format);
+	info->media_subtype = SPA_FORMAT_MEDIA_SUBTYPE(format);
+
+	if (info->media_type != type->media_type.video)
+		return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+	if (info->media_subtype == type->media_subtype.raw) {
+		if (!spa_format_video_raw_parse(format, &info->info.raw, &type->format_video))
+			return SPA_RESULT_INVALID_MEDIA_TYPE;
+		*size = info->info.raw.size;
+		*framerate = info->info.raw.framerate;
+	} else if (info->media_subtype == type->media_subtype_video.h264) {
+		if (!spa_format_video_h264_parse(format, &info->info.h264, &type->format_video))
+			return SPA_RESULT_INVALID_MEDIA_TYPE;
+		*size = info->info.h264.size;
+		*framerate = info->info.h264.framerate;
+	} else {
+		/* the other encoded formats only have a size and framerate, like mjpg */
+		if (!spa_format_video_mjpg_parse(format, &info->info.mjpg, &type->format_video))
+			return SPA_RESULT_INVALID_MEDIA_TYPE;
+		*size = info->info.mjpg.size;
+		*framerate = info->info.mjpg.framerate;
+	}
 	return SPA_RESULT_OK;
 }
 
+/* ffmpeg 4.0 iterates the codecs with av_codec_iterate() and registers
+ * them itself, av_codec_next() and av_register_all() are gone in 5.0 */
+static const AVCodec *next_codec(void **state)
+{
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 10, 100)
+	return av_codec_iterate(state);
+#else
+	return *state = av_codec_next(*state);
+#endif
+}
+
 int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t index)
 {
 	static const AVCodec *c = NULL;
+	static void *state = NULL;
 	static int ci = 0;
-	static struct spa_handle_factory f;
 	static char name[128];
+	struct spa_handle_factory *f;
 
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
 	av_register_all();
+#endif
 
 	if (index == 0) {
-		c = av_codec_next(NULL);
+		state = NULL;
+		c = next_codec(&state);
 		ci = 0;
 	}
 	while (index > ci && c) {
-		c = av_codec_next(c);
+		c = next_codec(&state);
 		ci++;
 	}
 	if (c == NULL)
 		return SPA_RESULT_ENUM_END;
 
+	/* the node looks up its codec again with the name of the factory */
 	if (av_codec_is_encoder(c)) {
 		snprintf(name, 128, "ffenc_%s", c->name);
-		f.init = ffmpeg_enc_init;
+		f = &spa_ffmpeg_enc_factory;
 	} else {
 		snprintf(name, 128, "ffdec_%s", c->name);
-		f.init = ffmpeg_dec_init;
+		f = &spa_ffmpeg_dec_factory;
 	}
-	f.name = name;
-	f.info = NULL;
-	f.enum_interface_info = ffmpeg_enum_interface_info;
+	f->name = name;
 
-	*factory = &f;
+	*factory = f;
 
 	return SPA_RESULT_OK;
 }
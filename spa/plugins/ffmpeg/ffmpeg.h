@@ -0,0 +1,75 @@
+/* Spa FFMpeg support
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_FFMPEG_H__
+#define __SPA_FFMPEG_H__
+
+#include <spa/type-map.h>
+#include <spa/node.h>
+#include <spa/param-alloc.h>
+#include <spa/video/format-utils.h>
+
+#include <libavcodec/avcodec.h>
+
+struct type {
+	uint32_t node;
+	uint32_t format;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_video media_subtype_video;
+	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
+	struct spa_type_command_node command_node;
+	struct spa_type_param_alloc_buffers param_alloc_buffers;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_media_subtype_video_map(map, &type->media_subtype_video);
+	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
+	spa_type_command_node_map(map, &type->command_node);
+	spa_type_param_alloc_buffers_map(map, &type->param_alloc_buffers);
+}
+
+/* the media subtype of the encoded video of a codec, 0 when it has none */
+uint32_t spa_ffmpeg_codec_to_media_subtype(struct type *type, enum AVCodecID id);
+
+/* the video format of a pixel format, 0 when it has none. Pixel formats
+ * that only differ in their color range map to the same video format. */
+uint32_t spa_ffmpeg_pix_fmt_to_video_format(struct type *type, enum AVPixelFormat pix_fmt);
+enum AVPixelFormat spa_ffmpeg_video_format_to_pix_fmt(struct type *type, uint32_t format);
+
+/* parse the size and framerate of a raw or encoded video format */
+int spa_ffmpeg_parse_video_format(struct type *type, const struct spa_format *format,
+				  struct spa_video_info *info,
+				  struct spa_rectangle *size, struct spa_fraction *framerate);
+
+extern struct spa_handle_factory spa_ffmpeg_dec_factory;
+extern struct spa_handle_factory spa_ffmpeg_enc_factory;
+
+#endif /* __SPA_FFMPEG_H__ */
@@ -22,11 +22,17 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/eventfd.h>
+#include <sys/syscall.h>
 
 #include <spa/type-map.h>
 #include <spa/clock.h>
 #include <spa/log.h>
+#include <spa/log-binary.h>
 #include <spa/loop.h>
 #include <spa/node.h>
 #include <spa/param-alloc.h>
@@ -40,15 +46,48 @@
 
 #define TRACE_BUFFER (16*1024)
 
+#define BINARY_RING	(256*1024)
+#define MAX_RECORD	1024
+#define MAX_STRING	256
+#define MAX_STRINGS	1024		/* file, function and format strings per thread */
+#define STRING_DATA	(64*1024)
+
 struct type {
 	uint32_t log;
+	uint32_t log_binary;
 };
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
 	type->log = spa_type_map_get_id(map, SPA_TYPE__Log);
+	type->log_binary = spa_type_map_get_id(map, SPA_TYPE__LogBinary);
 }
 
+/* a copy of a file, function or format string */
+struct ring_string {
+	uint64_t ptr;			/* the pointer in the records */
+	uint32_t offset;		/* offset of the copy in string_data */
+	uint32_t len;			/* length of the copy with the nul byte */
+};
+
+/* the binary messages of one thread, written only by that thread */
+struct ring {
+	struct ring *next;
+	uint32_t tid;
+	uint32_t dropped;
+	struct spa_ringbuffer rb;
+	uint8_t data[BINARY_RING];
+
+	/* the strings of the records are copied the first time they are
+	 * logged, the code they point to can be unloaded before the dump.
+	 * n_strings is read by the dump. */
+	uint32_t string_hash[2 * MAX_STRINGS];	/* index + 1 in strings, 0 when free */
+	struct ring_string strings[MAX_STRINGS];
+	uint32_t n_strings;
+	uint32_t string_used;
+	char string_data[STRING_DATA];
+};
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_log log;
@@ -61,8 +100,225 @@ struct impl {
 
 	bool have_source;
 	struct spa_source source;
+
+	bool have_binary;
+	struct spa_log_binary binary;
+	char *binary_file;
+	uint32_t serial;
+	struct ring *rings;
+	pthread_mutex_t dump_lock;
 };
 
+static uint32_t logger_serial;
+
+static __thread uint32_t thread_serial;
+static __thread struct ring *thread_ring;
+
+static struct ring *get_ring(struct impl *impl)
+{
+	struct ring *r;
+	uint32_t tid;
+
+	if (SPA_LIKELY(thread_serial == impl->serial))
+		return thread_ring;
+
+	tid = syscall(SYS_gettid);
+
+	/* when this thread logs to more than one logger */
+	for (r = __atomic_load_n(&impl->rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+		if (r->tid == tid)
+			goto done;
+	}
+
+	if ((r = calloc(1, sizeof(struct ring))) == NULL)
+		return NULL;
+
+	r->tid = tid;
+	spa_ringbuffer_init(&r->rb, BINARY_RING);
+
+	r->next = __atomic_load_n(&impl->rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&impl->rings, &r->next, r, false,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+      done:
+	thread_ring = r;
+	thread_serial = impl->serial;
+	return r;
+}
+
+static uint64_t *push_string(uint64_t *p, uint64_t *end, const char *str)
+{
+	size_t len, n;
+
+	if (str == NULL)
+		str = "(null)";
+
+	len = strnlen(str, MAX_STRING - 1) + 1;
+	n = SPA_ROUND_UP_N(len, 8) / 8;
+	if (p + 1 + n > end)
+		return NULL;
+
+	p[0] = len;
+	p[n] = 0;
+	memcpy(&p[1], str, len - 1);
+	((char *) &p[1])[len - 1] = '\0';
+
+	return p + 1 + n;
+}
+
+/* keep a copy of a string of a record in the ring. A string is only copied
+ * once per thread, the pointer is looked up in a hash the next times. When
+ * there is no more room the string is not kept and the decoder prints the
+ * pointer. */
+static void intern_string(struct ring *r, const char *str)
+{
+	uint64_t ptr = (uintptr_t) str;
+	struct ring_string *rs;
+	uint32_t i, idx, len;
+
+	if (str == NULL)
+		return;
+
+	for (i = (ptr >> 3) & (2 * MAX_STRINGS - 1); (idx = r->string_hash[i]);
+	     i = (i + 1) & (2 * MAX_STRINGS - 1)) {
+		if (r->strings[idx - 1].ptr == ptr)
+			return;
+	}
+
+	len = strlen(str) + 1;
+	if (r->n_strings == MAX_STRINGS || r->string_used + len > STRING_DATA)
+		return;
+
+	rs = &r->strings[r->n_strings];
+	rs->ptr = ptr;
+	rs->offset = r->string_used;
+	rs->len = len;
+	memcpy(&r->string_data[rs->offset], str, len);
+	r->string_used += len;
+
+	r->string_hash[i] = r->n_strings + 1;
+	__atomic_store_n(&r->n_strings, r->n_strings + 1, __ATOMIC_RELEASE);
+}
+
+/* store the pointers and the arguments of the message in the ring of the
+ * thread. This does not format anything and does not block, messages are
+ * dropped when the ring is full. */
+static void
+log_binary(struct impl *impl,
+	   enum spa_log_level level,
+	   const char *file,
+	   int line,
+	   const char *func,
+	   const char *fmt,
+	   va_list args)
+{
+	uint64_t buffer[MAX_RECORD / sizeof(uint64_t)];
+	struct spa_log_binary_record *rec = (struct spa_log_binary_record *) buffer;
+	uint64_t *p = (uint64_t *) (rec + 1), *end = buffer + SPA_N_ELEMENTS(buffer), *next;
+	struct spa_log_binary_spec spec;
+	struct timespec now;
+	struct ring *r;
+	const char *f = fmt;
+	uint32_t n_args = 0, index, size;
+	int32_t filled;
+	int err = errno;
+
+	if ((r = get_ring(impl)) == NULL)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	while (spa_log_binary_next_spec(f, &spec)) {
+		union { double d; uint64_t u; } val;
+
+		f = spec.end;
+
+		if (spec.star_width) {
+			if (p >= end)
+				break;
+			*p++ = va_arg(args, int);
+			n_args++;
+		}
+		if (spec.star_precision) {
+			if (p >= end)
+				break;
+			*p++ = va_arg(args, int);
+			n_args++;
+		}
+		if (spec.arg == SPA_LOG_BINARY_ARG_NONE)
+			continue;
+		if (p >= end)
+			break;
+
+		switch (spec.arg) {
+		case SPA_LOG_BINARY_ARG_INT:
+			*p++ = va_arg(args, int);
+			break;
+		case SPA_LOG_BINARY_ARG_LONG:
+			*p++ = va_arg(args, long);
+			break;
+		case SPA_LOG_BINARY_ARG_LONG_LONG:
+			*p++ = va_arg(args, long long);
+			break;
+		case SPA_LOG_BINARY_ARG_SIZE:
+			*p++ = va_arg(args, size_t);
+			break;
+		case SPA_LOG_BINARY_ARG_INTMAX:
+			*p++ = va_arg(args, intmax_t);
+			break;
+		case SPA_LOG_BINARY_ARG_PTRDIFF:
+			*p++ = va_arg(args, ptrdiff_t);
+			break;
+		case SPA_LOG_BINARY_ARG_DOUBLE:
+			val.d = va_arg(args, double);
+			*p++ = val.u;
+			break;
+		case SPA_LOG_BINARY_ARG_LONG_DOUBLE:
+			val.d = va_arg(args, long double);
+			*p++ = val.u;
+			break;
+		case SPA_LOG_BINARY_ARG_POINTER:
+			*p++ = (uintptr_t) va_arg(args, void *);
+			break;
+		case SPA_LOG_BINARY_ARG_STRING:
+			if ((next = push_string(p, end, va_arg(args, const char *))) == NULL)
+				goto done;
+			p = next;
+			break;
+		case SPA_LOG_BINARY_ARG_ERRNO:
+			if ((next = push_string(p, end, strerror(err))) == NULL)
+				goto done;
+			p = next;
+			break;
+		default:
+			break;
+		}
+		n_args++;
+	}
+      done:
+
+	size = (uint8_t *) p - (uint8_t *) buffer;
+	rec->size = size;
+	rec->level = level;
+	rec->line = line;
+	rec->n_args = n_args;
+	rec->time = SPA_TIMESPEC_TO_TIME(&now);
+	rec->file = (uintptr_t) file;
+	rec->func = (uintptr_t) func;
+	rec->fmt = (uintptr_t) fmt;
+
+	intern_string(r, file);
+	intern_string(r, func);
+	intern_string(r, fmt);
+
+	filled = spa_ringbuffer_get_write_index(&r->rb, &index);
+	if (filled < 0 || filled + size > r->rb.size) {
+		__atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	spa_ringbuffer_write_data(&r->rb, r->data, index & r->rb.mask, rec, size);
+	spa_ringbuffer_write_update(&r->rb, index + size);
+}
+
 static void
 impl_log_logv(struct spa_log *log,
 	      enum spa_log_level level,
@@ -78,6 +334,11 @@ impl_log_logv(struct spa_log *log,
 	int size;
 	bool do_trace;
 
+	if (impl->have_binary && level >= SPA_LOG_LEVEL_DEBUG) {
+		log_binary(impl, level, file, line, func, fmt, args);
+		return;
+	}
+
 	if ((do_trace = (level == SPA_LOG_LEVEL_TRACE && impl->have_source)))
 		level++;
 
@@ -143,6 +404,154 @@ static void on_trace_event(struct spa_source *source)
         }
 }
 
+static int write_all(int fd, const void *data, size_t size)
+{
+	const uint8_t *p = data;
+
+	while (size > 0) {
+		ssize_t res = write(fd, p, size);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return SPA_RESULT_ERRNO;
+		}
+		p += res;
+		size -= res;
+	}
+	return SPA_RESULT_OK;
+}
+
+/* a set of the string pointers in the dumped records */
+struct strings {
+	uint64_t *ptrs;
+	uint32_t size;
+	uint32_t n_ptrs;
+};
+
+/* add a pointer to the set, false when it was already in the set or when
+ * there is no memory */
+static bool strings_add(struct strings *s, uint64_t ptr)
+{
+	uint32_t i;
+
+	if (ptr == 0)
+		return false;
+
+	if (s->n_ptrs * 2 >= s->size) {
+		struct strings n = { NULL, s->size ? s->size * 2 : 256, 0 };
+
+		if ((n.ptrs = calloc(n.size, sizeof(uint64_t))) == NULL)
+			return false;
+		for (i = 0; i < s->size; i++)
+			strings_add(&n, s->ptrs[i]);
+		free(s->ptrs);
+		*s = n;
+	}
+	for (i = (ptr >> 3) & (s->size - 1); s->ptrs[i]; i = (i + 1) & (s->size - 1)) {
+		if (s->ptrs[i] == ptr)
+			return false;
+	}
+	s->ptrs[i] = ptr;
+	s->n_ptrs++;
+	return true;
+}
+
+static int dump_ring(struct impl *impl, struct ring *r, int fd)
+{
+	struct spa_log_binary_chunk chunk;
+	struct spa_log_binary_thread thread;
+	uint32_t index;
+	int32_t avail;
+	uint8_t *data;
+	int res;
+
+	avail = spa_ringbuffer_get_read_index(&r->rb, &index);
+	thread.tid = r->tid;
+	thread.dropped = __atomic_exchange_n(&r->dropped, 0, __ATOMIC_RELAXED);
+
+	if (avail <= 0 && thread.dropped == 0)
+		return SPA_RESULT_OK;
+
+	avail = SPA_MAX(avail, 0);
+	if ((data = malloc(avail + 1)) == NULL)
+		return SPA_RESULT_NO_MEMORY;
+
+	spa_ringbuffer_read_data(&r->rb, r->data, index & r->rb.mask, data, avail);
+	spa_ringbuffer_read_update(&r->rb, index + avail);
+
+	chunk.type = SPA_LOG_BINARY_CHUNK_THREAD;
+	chunk.size = sizeof(thread) + avail;
+
+	if ((res = write_all(fd, &chunk, sizeof(chunk))) == SPA_RESULT_OK &&
+	    (res = write_all(fd, &thread, sizeof(thread))) == SPA_RESULT_OK)
+		res = write_all(fd, data, avail);
+
+	free(data);
+	return res;
+}
+
+/* write the copies of the strings of a ring that were not written yet in
+ * this dump. The same pointer can be in the rings of more threads. */
+static int dump_strings(struct ring *r, struct strings *strings, int fd)
+{
+	struct spa_log_binary_chunk chunk;
+	static const uint8_t zero[8] = { 0, };
+	uint32_t i, n_strings;
+	int res = SPA_RESULT_OK;
+
+	n_strings = __atomic_load_n(&r->n_strings, __ATOMIC_ACQUIRE);
+
+	for (i = 0; i < n_strings && res == SPA_RESULT_OK; i++) {
+		uint64_t ptr = r->strings[i].ptr;
+		const char *str = &r->string_data[r->strings[i].offset];
+		size_t len = r->strings[i].len;
+
+		if (!strings_add(strings, ptr))
+			continue;
+
+		chunk.type = SPA_LOG_BINARY_CHUNK_STRING;
+		chunk.size = sizeof(uint64_t) + SPA_ROUND_UP_N(len, 8);
+
+		if ((res = write_all(fd, &chunk, sizeof(chunk))) == SPA_RESULT_OK &&
+		    (res = write_all(fd, &ptr, sizeof(uint64_t))) == SPA_RESULT_OK &&
+		    (res = write_all(fd, str, len)) == SPA_RESULT_OK)
+			res = write_all(fd, zero, SPA_ROUND_UP_N(len, 8) - len);
+	}
+	return res;
+}
+
+static int impl_log_binary_dump(struct spa_log_binary *binary, int fd)
+{
+	struct impl *impl = SPA_CONTAINER_OF(binary, struct impl, binary);
+	struct spa_log_binary_header header = { SPA_LOG_BINARY_MAGIC, SPA_LOG_BINARY_VERSION, };
+	struct strings strings = { NULL, };
+	struct ring *r;
+	int res;
+
+	pthread_mutex_lock(&impl->dump_lock);
+
+	if ((res = write_all(fd, &header, sizeof(header))) != SPA_RESULT_OK)
+		goto done;
+
+	for (r = __atomic_load_n(&impl->rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+		if ((res = dump_ring(impl, r, fd)) != SPA_RESULT_OK)
+			goto done;
+		if ((res = dump_strings(r, &strings, fd)) != SPA_RESULT_OK)
+			goto done;
+	}
+
+      done:
+	pthread_mutex_unlock(&impl->dump_lock);
+	free(strings.ptrs);
+
+	return res;
+}
+
+static const struct spa_log_binary impl_log_binary = {
+	SPA_VERSION_LOG_BINARY,
+	impl_log_binary_dump,
+};
+
 static const struct spa_log impl_log = {
 	SPA_VERSION_LOG,
 	NULL,
@@ -162,6 +571,8 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id,
 
 	if (interface_id == this->type.log)
 		*interface = &this->log;
+	else if (interface_id == this->type.log_binary && this->have_binary)
+		*interface = &this->binary;
 	else
 		return SPA_RESULT_UNKNOWN_INTERFACE;
 
@@ -181,6 +592,25 @@ static int impl_clear(struct spa_handle *handle)
 		close(this->source.fd);
 		this->have_source = false;
 	}
+	if (this->have_binary) {
+		struct ring *r;
+		int fd;
+
+		if (this->binary_file) {
+			if ((fd = open(this->binary_file,
+				       O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) >= 0) {
+				impl_log_binary_dump(&this->binary, fd);
+				close(fd);
+			}
+			free(this->binary_file);
+		}
+		while ((r = this->rings)) {
+			this->rings = r->next;
+			free(r);
+		}
+		pthread_mutex_destroy(&this->dump_lock);
+		this->have_binary = false;
+	}
 	return SPA_RESULT_OK;
 }
 
@@ -194,6 +624,7 @@ impl_init(const struct spa_handle_factory *factory,
 	struct impl *this;
 	uint32_t i;
 	struct spa_loop *loop = NULL;
+	const char *str;
 
 	spa_return_val_if_fail(factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 	spa_return_val_if_fail(handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
@@ -217,6 +648,14 @@ impl_init(const struct spa_handle_factory *factory,
 	}
 	init_type(&this->type, this->map);
 
+	if (info && (str = spa_dict_lookup(info, SPA_LOG_BINARY_KEY_FILE))) {
+		this->binary = impl_log_binary;
+		this->binary_file = *str ? strdup(str) : NULL;
+		this->serial = __atomic_add_fetch(&logger_serial, 1, __ATOMIC_RELAXED);
+		pthread_mutex_init(&this->dump_lock, NULL);
+		this->have_binary = true;
+	}
+
 	if (loop) {
 		this->source.func = on_trace_event;
 		this->source.data = this;
@@ -99,6 +99,7 @@ struct impl {
 
 	struct spa_source timer_source;
 	struct itimerspec timerspec;
+	bool follower;			/* scheduled by the graph, no timer */
 
 	struct spa_port_info info;
 	uint8_t params_buffer[1024];
@@ -200,7 +201,7 @@ static int fill_buffer(struct impl *this, struct buffer *b)
 static void set_timer(struct impl *this, bool enabled)
 {
 	if ((this->callbacks && this->callbacks->have_output) || this->props.live) {
-		if (enabled) {
+		if (enabled && !this->follower) {
 			if (this->props.live) {
 				uint64_t next_time = this->start_time + this->elapsed_time;
 				this->timerspec.it_value.tv_sec = next_time / SPA_NSEC_PER_SEC;
@@ -221,7 +222,7 @@ static inline void read_timer(struct impl *this)
 {
 	uint64_t expirations;
 
-	if ((this->callbacks && this->callbacks->have_output) || this->props.live) {
+	if (((this->callbacks && this->callbacks->have_output) || this->props.live) && !this->follower) {
 		if (read(this->timer_source.fd, &expirations, sizeof(uint64_t)) != sizeof(uint64_t))
 			perror("read timerfd");
 	}
@@ -325,6 +326,13 @@ static int impl_node_send_command(struct spa_node *node, const struct spa_comman
 
 		this->started = false;
 		set_timer(this, false);
+	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.ClockUpdate) {
+		struct spa_command_node_clock_update *cu =
+			(struct spa_command_node_clock_update *) command;
+		this->follower = (cu->body.flags.value &
+				  SPA_COMMAND_NODE_CLOCK_UPDATE_FLAG_SLAVE) != 0;
+		if (this->started)
+			set_timer(this, true);
 	} else
 		return SPA_RESULT_NOT_IMPLEMENTED;
 
@@ -716,8 +724,8 @@ static int impl_node_process_output(struct spa_node *node)
 		this->io->buffer_id = SPA_ID_INVALID;
 	}
 
-	if ((this->callbacks == NULL || this->callbacks->have_output == NULL) &&
-			(io->status == SPA_RESULT_NEED_BUFFER))
+	if ((this->callbacks == NULL || this->callbacks->have_output == NULL ||
+	     this->follower) && (io->status == SPA_RESULT_NEED_BUFFER))
 		return make_buffer(this);
 	else
 		return SPA_RESULT_OK;
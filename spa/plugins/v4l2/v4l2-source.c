@@ -33,6 +33,7 @@
 #include <spa/param-alloc.h>
 #include <spa/type-map.h>
 #include <spa/format-builder.h>
+#include <lib/arena.h>
 #include <lib/debug.h>
 #include <lib/props.h>
 
@@ -120,7 +121,7 @@ struct port {
 
 	bool have_format;
 	struct spa_video_info current_format;
-	uint8_t format_buffer[1024];
+	struct spa_pod_arena format_arena;
 
 	int fd;
 	bool opened;
@@ -551,8 +552,7 @@ static int impl_node_port_get_format(struct spa_node *node,
 	if (!state->have_format)
 		return SPA_RESULT_NO_FORMAT;
 
-	b.data = state->format_buffer;
-	b.size = sizeof(state->format_buffer);
+	spa_pod_arena_builder(&state->format_arena, &b);
 
 	spa_pod_builder_push_format(&b, &f[0], this->type.format,
 			state->current_format.media_type,
@@ -921,6 +921,14 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id,
 
 static int impl_clear(struct spa_handle *handle)
 {
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = (struct impl *) handle;
+
+	spa_pod_arena_clear(&this->out_ports[0].format_arena);
+
 	return SPA_RESULT_OK;
 }
 
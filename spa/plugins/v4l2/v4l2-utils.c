@@ -532,7 +532,7 @@ spa_v4l2_enum_format(struct impl *this,
 	struct spa_pod_frame f[2];
 	struct spa_pod_prop *prop;
 	struct spa_pod_builder b = { NULL, };
-	uint32_t media_type, media_subtype, video_format;
+	uint32_t media_type, media_subtype, video_format, framerate_range;
 
 	if (spa_v4l2_open(this) < 0)
 		return SPA_RESULT_ERROR;
@@ -675,7 +675,7 @@ spa_v4l2_enum_format(struct impl *this,
 	media_subtype = *SPA_MEMBER(&this->type, info->media_subtype_offset, uint32_t);
 	video_format = *SPA_MEMBER(&this->type, info->format_offset, uint32_t);
 
-	spa_pod_builder_init(&b, state->format_buffer, sizeof(state->format_buffer));
+	spa_pod_arena_builder(&state->format_arena, &b);
 	spa_pod_builder_push_format(&b, &f[0], this->type.format, media_type, media_subtype);
 
 	if (media_subtype == this->type.media_subtype.raw) {
@@ -690,7 +690,7 @@ spa_v4l2_enum_format(struct impl *this,
 	spa_pod_builder_push_prop(&b, &f[1], this->type.format_video.framerate,
 				  SPA_POD_PROP_RANGE_NONE | SPA_POD_PROP_FLAG_UNSET);
 
-	prop = SPA_POD_BUILDER_DEREF(&b, f[1].ref, struct spa_pod_prop);
+	framerate_range = SPA_POD_PROP_RANGE_NONE;
 	n_fractions = 0;
 
 	state->frmival.index = 0;
@@ -745,7 +745,7 @@ spa_v4l2_enum_format(struct impl *this,
 	      have_framerate:
 
 		if (state->frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
-			prop->body.flags |= SPA_POD_PROP_RANGE_ENUM;
+			framerate_range = SPA_POD_PROP_RANGE_ENUM;
 			if (n_fractions == 0)
 				spa_pod_builder_fraction(&b,
 							 state->frmival.discrete.denominator,
@@ -766,9 +766,9 @@ spa_v4l2_enum_format(struct impl *this,
 						 state->frmival.stepwise.max.numerator);
 
 			if (state->frmival.type == V4L2_FRMIVAL_TYPE_CONTINUOUS) {
-				prop->body.flags |= SPA_POD_PROP_RANGE_MIN_MAX;
+				framerate_range = SPA_POD_PROP_RANGE_MIN_MAX;
 			} else {
-				prop->body.flags |= SPA_POD_PROP_RANGE_STEP;
+				framerate_range = SPA_POD_PROP_RANGE_STEP;
 				spa_pod_builder_fraction(&b,
 							 state->frmival.stepwise.step.denominator,
 							 state->frmival.stepwise.step.numerator);
@@ -777,9 +777,16 @@ spa_v4l2_enum_format(struct impl *this,
 		}
 		n_fractions++;
 	}
-	if (n_fractions <= 1) {
+	if (f[1].ref == -1)
+		return SPA_RESULT_NO_MEMORY;
+
+	/* the builder can have moved the data while adding the framerates */
+	prop = SPA_POD_BUILDER_DEREF(&b, f[1].ref, struct spa_pod_prop);
+	if (n_fractions <= 1)
 		prop->body.flags &= ~(SPA_POD_PROP_RANGE_MASK | SPA_POD_PROP_FLAG_UNSET);
-	}
+	else
+		prop->body.flags |= framerate_range;
+
 	spa_pod_builder_pop(&b, &f[1]);
 	spa_pod_builder_pop(&b, &f[0]);
 
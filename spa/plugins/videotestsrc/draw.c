@@ -65,14 +65,21 @@ static Pixel colors[N_COLORS] = {
 
 typedef struct _DrawingData DrawingData;
 
-typedef void (*DrawPixelFunc) (DrawingData * dd, int x, Pixel * pixel);
+/* fill \a length pixels of line \a y with \a color */
+typedef void (*FillSpanFunc) (DrawingData * dd, int y, int x, int length, const Pixel * color);
+/* fill \a length pixels of line \a y with the gray levels in \a values */
+typedef void (*FillGrayFunc) (DrawingData * dd, int y, int x, int length, const uint8_t * values);
 
 struct _DrawingData {
-	char *line;
+	uint8_t *planes[MAX_PLANES];
+	int strides[MAX_PLANES];
+	int vsub[MAX_PLANES];	/* log2 of the vertical subsampling of the plane */
+	int n_planes;
 	int width;
 	int height;
-	int stride;
-	DrawPixelFunc draw_pixel;
+	FillSpanFunc fill_span;
+	FillGrayFunc fill_gray;
+	uint32_t *random;
 };
 
 static inline void update_yuv(Pixel * pixel)
@@ -108,155 +115,367 @@ static void init_colors(void)
 	}
 }
 
-static void draw_pixel_rgb(DrawingData * dd, int x, Pixel * color)
+static inline uint8_t *plane_line(DrawingData * dd, int plane, int y)
 {
-	dd->line[3 * x + 0] = color->R;
-	dd->line[3 * x + 1] = color->G;
-	dd->line[3 * x + 2] = color->B;
+	return dd->planes[plane] + (y >> dd->vsub[plane]) * dd->strides[plane];
 }
 
-static void draw_pixel_uyvy(DrawingData * dd, int x, Pixel * color)
+static void fill_span_rgb(DrawingData * dd, int y, int x, int length, const Pixel * color)
 {
-	if (x & 1) {
-		/* odd pixel */
-		dd->line[2 * (x - 1) + 3] = color->Y;
-	} else {
-		/* even pixel */
-		dd->line[2 * x + 0] = color->U;
-		dd->line[2 * x + 1] = color->Y;
-		dd->line[2 * x + 2] = color->V;
+	uint8_t *p = plane_line(dd, 0, y) + 3 * x;
+	int i;
+
+	for (i = 0; i < length; i++, p += 3) {
+		p[0] = color->R;
+		p[1] = color->G;
+		p[2] = color->B;
+	}
+}
+
+static void fill_gray_rgb(DrawingData * dd, int y, int x, int length, const uint8_t * values)
+{
+	uint8_t *p = plane_line(dd, 0, y) + 3 * x;
+	int i;
+
+	for (i = 0; i < length; i++, p += 3)
+		p[0] = p[1] = p[2] = values[i];
+}
+
+static void fill_span_uyvy(DrawingData * dd, int y, int x, int length, const Pixel * color)
+{
+	uint8_t *line = plane_line(dd, 0, y);
+	int i;
+
+	for (i = x; i < x + length; i++) {
+		if (i & 1) {
+			/* odd pixel */
+			line[2 * i + 1] = color->Y;
+		} else {
+			/* even pixel */
+			line[2 * i + 0] = color->U;
+			line[2 * i + 1] = color->Y;
+			line[2 * i + 2] = color->V;
+		}
+	}
+}
+
+static void fill_gray_uyvy(DrawingData * dd, int y, int x, int length, const uint8_t * values)
+{
+	uint8_t *line = plane_line(dd, 0, y);
+	int i;
+
+	for (i = 0; i < length; i++) {
+		line[2 * (x + i) + 1] = values[i];
+		line[2 * ((x + i) & ~1)] = 128;
+		line[2 * ((x + i) & ~1) + 2] = 128;
+	}
+}
+
+/* chroma samples covered by the pixels [x, x + length) */
+#define CHROMA_START(x)		((x) >> 1)
+#define CHROMA_END(x,length)	(((x) + (length) + 1) >> 1)
+
+static void fill_span_i420(DrawingData * dd, int y, int x, int length, const Pixel * color)
+{
+	int c0 = CHROMA_START(x), c1 = CHROMA_END(x, length);
+
+	memset(plane_line(dd, 0, y) + x, color->Y, length);
+	memset(plane_line(dd, 1, y) + c0, color->U, c1 - c0);
+	memset(plane_line(dd, 2, y) + c0, color->V, c1 - c0);
+}
+
+static void fill_gray_i420(DrawingData * dd, int y, int x, int length, const uint8_t * values)
+{
+	int c0 = CHROMA_START(x), c1 = CHROMA_END(x, length);
+
+	memcpy(plane_line(dd, 0, y) + x, values, length);
+	memset(plane_line(dd, 1, y) + c0, 128, c1 - c0);
+	memset(plane_line(dd, 2, y) + c0, 128, c1 - c0);
+}
+
+static void fill_span_nv12(DrawingData * dd, int y, int x, int length, const Pixel * color)
+{
+	uint8_t *uv = plane_line(dd, 1, y);
+	int i;
+
+	memset(plane_line(dd, 0, y) + x, color->Y, length);
+	for (i = CHROMA_START(x); i < CHROMA_END(x, length); i++) {
+		uv[2 * i + 0] = color->U;
+		uv[2 * i + 1] = color->V;
 	}
 }
 
-static int drawing_data_init(DrawingData * dd, struct impl *this, char *data)
+static void fill_gray_nv12(DrawingData * dd, int y, int x, int length, const uint8_t * values)
+{
+	int c0 = CHROMA_START(x), c1 = CHROMA_END(x, length);
+
+	memcpy(plane_line(dd, 0, y) + x, values, length);
+	memset(plane_line(dd, 1, y) + 2 * c0, 128, 2 * (c1 - c0));
+}
+
+/* Compute the layout of a frame. The planes follow each other in the
+ * buffer, the stride of the first plane is the stride of the buffer. */
+static int setup_layout(struct impl *this, uint32_t format, const struct spa_rectangle *size)
+{
+	int width = size->width, height = size->height;
+	int cwidth = (width + 1) / 2, cheight = (height + 1) / 2;
+	int heights[MAX_PLANES];
+	size_t offset = 0;
+	uint32_t i;
+
+	if (format == this->type.video_format.RGB) {
+		this->n_planes = 1;
+		this->strides[0] = SPA_ROUND_UP_N(3 * width, 4);
+		heights[0] = height;
+	} else if (format == this->type.video_format.UYVY) {
+		this->n_planes = 1;
+		this->strides[0] = SPA_ROUND_UP_N(2 * width, 4);
+		heights[0] = height;
+	} else if (format == this->type.video_format.I420) {
+		this->n_planes = 3;
+		this->strides[0] = SPA_ROUND_UP_N(width, 4);
+		this->strides[1] = this->strides[2] = SPA_ROUND_UP_N(cwidth, 4);
+		heights[0] = height;
+		heights[1] = heights[2] = cheight;
+	} else if (format == this->type.video_format.NV12) {
+		this->n_planes = 2;
+		this->strides[0] = SPA_ROUND_UP_N(width, 4);
+		this->strides[1] = SPA_ROUND_UP_N(2 * cwidth, 4);
+		heights[0] = height;
+		heights[1] = cheight;
+	} else
+		return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+	for (i = 0; i < this->n_planes; i++) {
+		this->offsets[i] = offset;
+		offset += (size_t) this->strides[i] * heights[i];
+	}
+	this->stride = this->strides[0];
+	this->size = offset;
+
+	return SPA_RESULT_OK;
+}
+
+static int drawing_data_init(DrawingData * dd, struct impl *this, uint8_t *data)
 {
 	struct spa_video_info *format = &this->current_format;
 	struct spa_rectangle *size = &format->info.raw.size;
+	uint32_t i;
 
 	if ((format->media_type != this->type.media_type.video) ||
 	    (format->media_subtype != this->type.media_subtype.raw))
 		return SPA_RESULT_NOT_IMPLEMENTED;
 
 	if (format->info.raw.format == this->type.video_format.RGB) {
-		dd->draw_pixel = draw_pixel_rgb;
+		dd->fill_span = fill_span_rgb;
+		dd->fill_gray = fill_gray_rgb;
 	} else if (format->info.raw.format == this->type.video_format.UYVY) {
-		dd->draw_pixel = draw_pixel_uyvy;
+		dd->fill_span = fill_span_uyvy;
+		dd->fill_gray = fill_gray_uyvy;
+	} else if (format->info.raw.format == this->type.video_format.I420) {
+		dd->fill_span = fill_span_i420;
+		dd->fill_gray = fill_gray_i420;
+	} else if (format->info.raw.format == this->type.video_format.NV12) {
+		dd->fill_span = fill_span_nv12;
+		dd->fill_gray = fill_gray_nv12;
 	} else
 		return SPA_RESULT_NOT_IMPLEMENTED;
 
-	dd->line = data;
+	dd->n_planes = this->n_planes;
+	for (i = 0; i < this->n_planes; i++) {
+		dd->planes[i] = data + this->offsets[i];
+		dd->strides[i] = this->strides[i];
+		dd->vsub[i] = i > 0 && this->n_planes > 1 ? 1 : 0;
+	}
 	dd->width = size->width;
 	dd->height = size->height;
-	dd->stride = this->stride;
+	dd->random = &this->random_state;
 
 	return SPA_RESULT_OK;
 }
 
-static inline void draw_pixels(DrawingData * dd, int offset, Color color, int length)
+static inline void draw_pixels(DrawingData * dd, int y, int offset, Color color, int length)
+{
+	dd->fill_span(dd, y, offset, length, &colors[color]);
+}
+
+/* copy line \a y to the next \a n_lines - 1 lines */
+static void copy_lines(DrawingData * dd, int y, int n_lines)
 {
-	int x;
+	int i, p;
+
+	for (p = 0; p < dd->n_planes; p++) {
+		int first = y >> dd->vsub[p];
+		int last = (y + n_lines - 1) >> dd->vsub[p];
+		uint8_t *src = dd->planes[p] + first * dd->strides[p];
 
-	for (x = offset; x < offset + length; x++) {
-		dd->draw_pixel(dd, x, &colors[color]);
+		for (i = first + 1; i <= last; i++)
+			memcpy(dd->planes[p] + i * dd->strides[p], src, dd->strides[p]);
 	}
 }
 
-static inline void next_line(DrawingData * dd)
+/* xorshift32, much cheaper than rand() for every pixel */
+static inline uint32_t next_random(DrawingData * dd)
 {
-	dd->line += dd->stride;
+	uint32_t x = *dd->random;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return *dd->random = x;
 }
 
-static void draw_smpte_snow(DrawingData * dd)
+static void draw_snow_span(DrawingData * dd, int y, int x, int length)
+{
+	uint8_t values[256];
+	int i, n;
+
+	for (; length > 0; x += n, length -= n) {
+		n = SPA_MIN(length, (int) sizeof(values));
+
+		for (i = 0; i < n; i += sizeof(uint32_t)) {
+			uint32_t r = next_random(dd);
+			memcpy(&values[i], &r, sizeof(uint32_t));
+		}
+		dd->fill_gray(dd, y, x, n, values);
+	}
+}
+
+/* start of the snow area on the last rows of the SMPTE pattern */
+#define SMPTE_SNOW_X(w)	(3 * ((w) / 6) + 3 * ((w) / 12))
+
+/* Draw the SMPTE bars. Each band of identical lines is drawn once and
+ * then copied to the other lines of the band. The snow area is left
+ * black, it is filled by draw_smpte_snow(). */
+static void draw_smpte(DrawingData * dd)
 {
 	int h, w;
 	int y1, y2;
-	int i, j;
+	int j, x;
 
 	w = dd->width;
 	h = dd->height;
 	y1 = 2 * h / 3;
 	y2 = 3 * h / 4;
 
-	for (i = 0; i < y1; i++) {
+	if (y1 > 0) {
 		for (j = 0; j < 7; j++) {
 			int x1 = j * w / 7;
 			int x2 = (j + 1) * w / 7;
-			draw_pixels(dd, x1, j, x2 - x1);
+			draw_pixels(dd, 0, x1, j, x2 - x1);
 		}
-		next_line(dd);
+		copy_lines(dd, 0, y1);
 	}
 
-	for (i = y1; i < y2; i++) {
+	if (y2 > y1) {
 		for (j = 0; j < 7; j++) {
 			int x1 = j * w / 7;
 			int x2 = (j + 1) * w / 7;
 			Color c = (j & 1) ? BLACK : BLUE - j;
 
-			draw_pixels(dd, x1, c, x2 - x1);
+			draw_pixels(dd, y1, x1, c, x2 - x1);
 		}
-		next_line(dd);
+		copy_lines(dd, y1, y2 - y1);
 	}
 
-	for (i = y2; i < h; i++) {
-		int x = 0;
+	if (h > y2) {
+		x = 0;
 
 		/* negative I */
-		draw_pixels(dd, x, NEG_I, w / 6);
+		draw_pixels(dd, y2, x, NEG_I, w / 6);
 		x += w / 6;
 
 		/* white */
-		draw_pixels(dd, x, WHITE, w / 6);
+		draw_pixels(dd, y2, x, WHITE, w / 6);
 		x += w / 6;
 
 		/* positive Q */
-		draw_pixels(dd, x, POS_Q, w / 6);
+		draw_pixels(dd, y2, x, POS_Q, w / 6);
 		x += w / 6;
 
 		/* pluge */
-		draw_pixels(dd, x, DARK_BLACK, w / 12);
+		draw_pixels(dd, y2, x, DARK_BLACK, w / 12);
 		x += w / 12;
-		draw_pixels(dd, x, BLACK, w / 12);
+		draw_pixels(dd, y2, x, BLACK, w / 12);
 		x += w / 12;
-		draw_pixels(dd, x, LIGHT_BLACK, w / 12);
+		draw_pixels(dd, y2, x, LIGHT_BLACK, w / 12);
 		x += w / 12;
 
-		/* war of the ants (a.k.a. snow) */
-		for (j = x; j < w; j++) {
-			Pixel p;
-			unsigned char r = rand();
+		/* room for the snow */
+		draw_pixels(dd, y2, x, BLACK, w - x);
 
-			p.R = r;
-			p.G = r;
-			p.B = r;
-			update_yuv(&p);
-			dd->draw_pixel(dd, j, &p);
-		}
-
-		next_line(dd);
+		copy_lines(dd, y2, h - y2);
 	}
 }
 
+/* war of the ants (a.k.a. snow) in the bottom right corner of the bars */
+static void draw_smpte_snow(DrawingData * dd)
+{
+	int y, x = SMPTE_SNOW_X(dd->width);
+
+	for (y = 3 * dd->height / 4; y < dd->height; y++)
+		draw_snow_span(dd, y, x, dd->width - x);
+}
+
 static void draw_snow(DrawingData * dd)
 {
-	int x, y;
-
-	for (y = 0; y < dd->height; y++) {
-		for (x = 0; x < dd->width; x++) {
-			Pixel p;
-			unsigned char r = rand();
-
-			p.R = r;
-			p.G = r;
-			p.B = r;
-			update_yuv(&p);
-			dd->draw_pixel(dd, x, &p);
-		}
+	int y;
+
+	for (y = 0; y < dd->height; y++)
+		draw_snow_span(dd, y, 0, dd->width);
+}
+
+/* Draw \a value as a stripe of 64 cells starting at line \a y, white for a
+ * 1 bit and black for a 0 bit, most significant bit on the left. */
+static void draw_bits(DrawingData * dd, int y, int n_lines, uint64_t value)
+{
+	int i;
+
+	for (i = 0; i < 64; i++) {
+		int x1 = i * dd->width / 64;
+		int x2 = (i + 1) * dd->width / 64;
+
+		draw_pixels(dd, y, x1, (value >> (63 - i)) & 1 ? WHITE : BLACK, x2 - x1);
+	}
+	copy_lines(dd, y, n_lines);
+}
 
-		next_line(dd);
+/* Draw the frame counter and the timestamp of the frame over the top of
+ * the bars so that they can be recovered from the pixels at the other end
+ * of the pipeline, after encoding even. Each value is a stripe of 64 cells
+ * of at least 2 lines, a width of at least 64 pixels is needed to decode
+ * them. */
+static void draw_counter(DrawingData * dd, uint64_t count, uint64_t pts)
+{
+	int n_lines = SPA_MIN(SPA_MAX((dd->height / 16) & ~1, 2), dd->height / 2);
+
+	if (n_lines == 0)
+		return;
+
+	draw_bits(dd, 0, n_lines, count);
+	draw_bits(dd, n_lines, n_lines, pts);
+}
+
+/* The bars are the same for every frame, render them once in the cache
+ * and copy the complete frame after that. */
+static void draw_smpte_cached(struct impl *this, DrawingData * dd, uint8_t *data)
+{
+	if (this->cache == NULL) {
+		draw_smpte(dd);
+		return;
 	}
+	if (!this->cache_valid) {
+		DrawingData cd;
+
+		drawing_data_init(&cd, this, this->cache);
+		draw_smpte(&cd);
+		this->cache_valid = true;
+	}
+	memcpy(data, this->cache, this->size);
 }
 
-static int draw(struct impl *this, char *data)
+static int draw(struct impl *this, uint8_t *data)
 {
 	DrawingData dd;
 	int res;
@@ -269,11 +488,17 @@ static int draw(struct impl *this, char *data)
 		return res;
 
 	pattern = this->props.pattern;
-	if (pattern == this->type.pattern_smpte_snow)
+	if (pattern == this->type.pattern_smpte_snow) {
+		draw_smpte_cached(this, &dd, data);
 		draw_smpte_snow(&dd);
-	else if (pattern == this->type.pattern_snow)
+	} else if (pattern == this->type.pattern_snow) {
 		draw_snow(&dd);
-	else
+	} else if (pattern == this->type.pattern_smpte) {
+		draw_smpte_cached(this, &dd, data);
+	} else if (pattern == this->type.pattern_counter) {
+		draw_smpte_cached(this, &dd, data);
+		draw_counter(&dd, this->frame_count, this->start_time + this->elapsed_time);
+	} else
 		return SPA_RESULT_NOT_IMPLEMENTED;
 
 	return SPA_RESULT_OK;
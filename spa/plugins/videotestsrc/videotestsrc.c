@@ -19,6 +19,7 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
@@ -51,6 +52,8 @@ struct type {
 	uint32_t prop_pattern;
 	uint32_t pattern_smpte_snow;
 	uint32_t pattern_snow;
+	uint32_t pattern_smpte;
+	uint32_t pattern_counter;
 	struct spa_type_meta meta;
 	struct spa_type_data data;
 	struct spa_type_media_type media_type;
@@ -73,6 +76,8 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	type->prop_pattern = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType);
 	type->pattern_smpte_snow = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType ":smpte-snow");
 	type->pattern_snow = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType ":snow");
+	type->pattern_smpte = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType ":smpte");
+	type->pattern_counter = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType ":counter");
 	spa_type_meta_map(map, &type->meta);
 	spa_type_data_map(map, &type->data);
 	spa_type_media_type_map(map, &type->media_type);
@@ -92,6 +97,7 @@ struct props {
 
 #define MAX_BUFFERS 16
 #define MAX_PORTS 1
+#define MAX_PLANES 3
 
 struct buffer {
 	struct spa_buffer *outbuf;
@@ -127,8 +133,15 @@ struct impl {
 	bool have_format;
 	struct spa_video_info current_format;
 	uint8_t format_buffer[1024];
-	size_t bpp;
 	int stride;
+	uint32_t n_planes;
+	int strides[MAX_PLANES];
+	size_t offsets[MAX_PLANES];
+	size_t size;
+
+	uint8_t *cache;
+	bool cache_valid;
+	uint32_t random_state;
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
@@ -181,10 +194,12 @@ static int impl_node_get_props(struct spa_node *node, struct spa_props **props)
 	spa_pod_builder_props(&b, &f[0], this->type.props,
 		PROP(&f[1], this->type.prop_live, SPA_POD_TYPE_BOOL,
 			this->props.live),
-		PROP_EN(&f[1], this->type.prop_pattern, SPA_POD_TYPE_ID, 3,
+		PROP_EN(&f[1], this->type.prop_pattern, SPA_POD_TYPE_ID, 5,
 			this->props.pattern,
 			this->type.pattern_smpte_snow,
-			this->type.pattern_snow));
+			this->type.pattern_snow,
+			this->type.pattern_smpte,
+			this->type.pattern_counter));
 
 	*props = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_props);
 
@@ -270,7 +285,7 @@ static int make_buffer(struct impl *this)
 	spa_list_remove(&b->link);
 	b->outstanding = true;
 
-	n_bytes = b->outbuf->datas[0].maxsize;
+	n_bytes = this->size;
 
 	spa_log_trace(this->log, NAME " %p: dequeue buffer %d", this, b->outbuf->id);
 
@@ -453,10 +468,12 @@ impl_node_port_enum_formats(struct spa_node *node,
 		spa_pod_builder_format(&b, &f[0], this->type.format,
 			this->type.media_type.video,
 			this->type.media_subtype.raw,
-			PROP_U_EN(&f[1], this->type.format_video.format, SPA_POD_TYPE_ID, 3,
+			PROP_U_EN(&f[1], this->type.format_video.format, SPA_POD_TYPE_ID, 5,
 				this->type.video_format.RGB,
 				this->type.video_format.RGB,
-				this->type.video_format.UYVY),
+				this->type.video_format.UYVY,
+				this->type.video_format.I420,
+				this->type.video_format.NV12),
 			PROP_U_MM(&f[1], this->type.format_video.size, SPA_POD_TYPE_RECTANGLE,
 				320, 240,
 				1, 1,
@@ -523,20 +540,16 @@ impl_node_port_set_format(struct spa_node *node,
 		if (!spa_format_video_raw_parse(format, &info.info.raw, &this->type.format_video))
 			return SPA_RESULT_INVALID_MEDIA_TYPE;
 
-		if (info.info.raw.format == this->type.video_format.RGB)
-			this->bpp = 3;
-		else if (info.info.raw.format == this->type.video_format.UYVY)
-			this->bpp = 2;
-		else
+		if (setup_layout(this, info.info.raw.format, &info.info.raw.size) != SPA_RESULT_OK)
 			return SPA_RESULT_INVALID_MEDIA_TYPE;
 
 		this->current_format = info;
 		this->have_format = true;
-	}
 
-	if (this->have_format) {
-		struct spa_video_info_raw *raw_info = &this->current_format.info.raw;
-		this->stride = SPA_ROUND_UP_N(this->bpp * raw_info->size.width, 4);
+		/* without a cache the bars are drawn for each frame */
+		free(this->cache);
+		this->cache = malloc(this->size);
+		this->cache_valid = false;
 	}
 
 	return SPA_RESULT_OK;
@@ -619,20 +632,17 @@ impl_node_port_enum_params(struct spa_node *node,
 	spa_pod_builder_init(&b, this->params_buffer, sizeof(this->params_buffer));
 
 	switch (index) {
-	case 0: {
-		struct spa_video_info_raw *raw_info = &this->current_format.info.raw;
-
+	case 0:
 		spa_pod_builder_object(&b, &f[0], 0, this->type.param_alloc_buffers.Buffers,
 			PROP(&f[1], this->type.param_alloc_buffers.size, SPA_POD_TYPE_INT,
-				this->stride * raw_info->size.height),
+				this->size),
 			PROP(&f[1], this->type.param_alloc_buffers.stride, SPA_POD_TYPE_INT,
 				this->stride),
 			PROP_U_MM(&f[1], this->type.param_alloc_buffers.buffers, SPA_POD_TYPE_INT,
 				2, 1, 32),
 			PROP(&f[1], this->type.param_alloc_buffers.align, SPA_POD_TYPE_INT,
 				16));
-			break;
-	}
+		break;
 	case 1:
 		spa_pod_builder_object(&b, &f[0], 0, this->type.param_alloc_meta_enable.MetaEnable,
 			PROP(&f[1], this->type.param_alloc_meta_enable.type, SPA_POD_TYPE_ID,
@@ -696,6 +706,11 @@ impl_node_port_use_buffers(struct spa_node *node,
 				      buffers[i]);
 			return SPA_RESULT_ERROR;
 		}
+		if (d[0].data != NULL && d[0].maxsize < this->size) {
+			spa_log_error(this->log, NAME " %p: buffer %p too small (%u < %zd)", this,
+				      buffers[i], d[0].maxsize, this->size);
+			return SPA_RESULT_ERROR;
+		}
 		spa_list_append(&this->empty, &b->link);
 	}
 	this->n_buffers = n_buffers;
@@ -925,6 +940,9 @@ static int impl_clear(struct spa_handle *handle)
 		spa_loop_remove_source(this->data_loop, &this->timer_source);
 	close(this->timer_source.fd);
 
+	free(this->cache);
+	this->cache = NULL;
+
 	return SPA_RESULT_OK;
 }
 
@@ -963,6 +981,7 @@ impl_init(const struct spa_handle_factory *factory,
 	this->node = impl_node;
 	this->clock = impl_clock;
 	reset_props(this, &this->props);
+	this->random_state = 0x9e3779b9;
 
 	spa_list_init(&this->empty);
 
@@ -0,0 +1,352 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure the throughput of the audiomixer and volume plugins for the
+ * formats and channel counts they support. The nodes are driven directly
+ * with process_input() on buffers of QUANTUM frames.
+ *
+ *   bench-audio [--json] [--quick] <libspa-audiomixer.so> <libspa-volume.so>
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+
+#include <spa/node.h>
+#include <spa/log-impl.h>
+#include <spa/type-map-impl.h>
+#include <spa/audio/format-utils.h>
+#include <spa/format-builder.h>
+
+#include <tests/bench.h>
+
+#define QUANTUM		1024
+#define MAX_INPUTS	16
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+static SPA_LOG_IMPL(default_log);
+
+struct type {
+	uint32_t node;
+	uint32_t format;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+}
+
+struct buffer {
+	struct spa_buffer buffer;
+	struct spa_data datas[1];
+	struct spa_chunk chunks[1];
+};
+
+struct data {
+	struct bench bench;
+	struct type type;
+	struct spa_support support[2];
+	uint32_t n_support;
+
+	struct spa_handle *handle;
+	struct spa_node *node;
+
+	struct spa_port_io in_io[MAX_INPUTS];
+	struct spa_port_io out_io;
+	struct buffer in_buffers[MAX_INPUTS];
+	struct buffer out_buffer;
+};
+
+static void init_buffer(struct data *data, struct buffer *b, size_t size)
+{
+	b->buffer.id = 0;
+	b->buffer.n_metas = 0;
+	b->buffer.metas = NULL;
+	b->buffer.n_datas = 1;
+	b->buffer.datas = b->datas;
+
+	b->datas[0].type = data->type.data.MemPtr;
+	b->datas[0].flags = 0;
+	b->datas[0].fd = -1;
+	b->datas[0].mapoffset = 0;
+	b->datas[0].maxsize = size;
+	b->datas[0].data = calloc(1, size);
+	b->datas[0].chunk = &b->chunks[0];
+	b->datas[0].chunk->offset = 0;
+	b->datas[0].chunk->size = size;
+	b->datas[0].chunk->stride = 0;
+}
+
+static void clear_buffer(struct buffer *b)
+{
+	free(b->datas[0].data);
+}
+
+static int make_node(struct data *data, const char *lib, const char *name)
+{
+	spa_handle_factory_enum_func_t enum_func;
+	const struct spa_handle_factory *factory;
+	void *hnd, *iface;
+	uint32_t i;
+	int res;
+
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		fprintf(stderr, "can't load %s: %s\n", lib, dlerror());
+		return SPA_RESULT_ERROR;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		fprintf(stderr, "can't find enum function\n");
+		return SPA_RESULT_ERROR;
+	}
+
+	for (i = 0; (res = enum_func(&factory, i)) == SPA_RESULT_OK; i++) {
+		if (strcmp(factory->name, name))
+			continue;
+
+		data->handle = calloc(1, factory->size);
+		if ((res = spa_handle_factory_init(factory, data->handle, NULL,
+						   data->support, data->n_support)) < 0) {
+			fprintf(stderr, "can't make factory instance: %d\n", res);
+			return res;
+		}
+		if ((res = spa_handle_get_interface(data->handle, data->type.node, &iface)) < 0) {
+			fprintf(stderr, "can't get interface %d\n", res);
+			return res;
+		}
+		data->node = iface;
+		return SPA_RESULT_OK;
+	}
+	fprintf(stderr, "can't find factory %s\n", name);
+	return SPA_RESULT_ERROR;
+}
+
+static void destroy_node(struct data *data)
+{
+	spa_handle_clear(data->handle);
+	free(data->handle);
+}
+
+static struct spa_format *
+make_format(struct data *data, struct spa_pod_builder *b, uint32_t format, uint32_t channels)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], data->type.format,
+		data->type.media_type.audio,
+		data->type.media_subtype.raw,
+		SPA_POD_PROP(&f[1], data->type.format_audio.format, 0, SPA_POD_TYPE_ID, 1,
+			format),
+		SPA_POD_PROP(&f[1], data->type.format_audio.layout, 0, SPA_POD_TYPE_INT, 1,
+			SPA_AUDIO_LAYOUT_INTERLEAVED),
+		SPA_POD_PROP(&f[1], data->type.format_audio.rate, 0, SPA_POD_TYPE_INT, 1,
+			48000),
+		SPA_POD_PROP(&f[1], data->type.format_audio.channels, 0, SPA_POD_TYPE_INT, 1,
+			channels));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+static int setup_port(struct data *data, enum spa_direction direction, uint32_t port_id,
+		      struct spa_format *format, struct spa_port_io *io, struct buffer *b,
+		      size_t size)
+{
+	struct spa_buffer *buffers[1] = { &b->buffer };
+	int res;
+
+	*io = SPA_PORT_IO_INIT;
+	if ((res = spa_node_port_set_io(data->node, direction, port_id, io)) < 0 ||
+	    (res = spa_node_port_set_format(data->node, direction, port_id, 0, format)) < 0)
+		return res;
+
+	init_buffer(data, b, size);
+	return spa_node_port_use_buffers(data->node, direction, port_id, buffers, 1);
+}
+
+/* Mix n_inputs buffers in one output buffer for every cycle */
+static int bench_mixer(struct data *data, const char *lib, const char *format_name,
+		       uint32_t format, size_t sample_size, uint32_t channels, uint32_t n_inputs)
+{
+	struct bench_result r = { "mixer", };
+	struct spa_pod_builder b = { NULL, };
+	struct spa_format *fmt;
+	uint8_t buffer[256];
+	size_t size = QUANTUM * sample_size * channels;
+	uint64_t i, start, cycles;
+	char params[64];
+	uint32_t j;
+	int res;
+
+	if ((res = make_node(data, lib, "audiomixer")) < 0)
+		return res;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	fmt = make_format(data, &b, format, channels);
+
+	for (j = 0; j < n_inputs; j++) {
+		if ((res = spa_node_add_port(data->node, SPA_DIRECTION_INPUT, j)) < 0 ||
+		    (res = setup_port(data, SPA_DIRECTION_INPUT, j, fmt,
+				      &data->in_io[j], &data->in_buffers[j], size)) < 0)
+			goto error;
+	}
+	if ((res = setup_port(data, SPA_DIRECTION_OUTPUT, 0, fmt,
+			      &data->out_io, &data->out_buffer, size)) < 0)
+		goto error;
+
+	cycles = bench_iterations(&data->bench, 400000 / (channels * n_inputs));
+	start = bench_now();
+	for (i = 0; i < cycles; i++) {
+		for (j = 0; j < n_inputs; j++) {
+			data->in_io[j].status = SPA_RESULT_HAVE_BUFFER;
+			data->in_io[j].buffer_id = 0;
+		}
+		if ((res = spa_node_process_input(data->node)) != SPA_RESULT_HAVE_BUFFER)
+			goto error;
+
+		data->out_io.status = SPA_RESULT_NEED_BUFFER;
+		spa_node_port_reuse_buffer(data->node, 0, data->out_io.buffer_id);
+		data->out_io.buffer_id = SPA_ID_INVALID;
+	}
+	r.elapsed = bench_now() - start;
+
+	snprintf(params, sizeof(params), "format=%s,channels=%u,inputs=%u",
+		 format_name, channels, n_inputs);
+	r.params = params;
+	r.n_ops = cycles;
+	r.bytes = cycles * size * n_inputs;
+	bench_report(&data->bench, &r);
+
+	res = SPA_RESULT_OK;
+      error:
+	if (res < 0 || res == SPA_RESULT_NEED_BUFFER)
+		fprintf(stderr, "mixer %s %u: error %d\n", format_name, channels, res);
+	for (j = 0; j < n_inputs; j++)
+		clear_buffer(&data->in_buffers[j]);
+	clear_buffer(&data->out_buffer);
+	destroy_node(data);
+	return res;
+}
+
+/* Apply the volume to one buffer for every cycle */
+static int bench_volume(struct data *data, const char *lib, const char *format_name,
+			uint32_t format, size_t sample_size, uint32_t channels)
+{
+	struct bench_result r = { "volume", };
+	struct spa_pod_builder b = { NULL, };
+	struct spa_format *fmt;
+	uint8_t buffer[256];
+	size_t size = QUANTUM * sample_size * channels;
+	uint64_t i, start, cycles;
+	char params[64];
+	int res;
+
+	if ((res = make_node(data, lib, "volume")) < 0)
+		return res;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	fmt = make_format(data, &b, format, channels);
+
+	if ((res = setup_port(data, SPA_DIRECTION_INPUT, 0, fmt,
+			      &data->in_io[0], &data->in_buffers[0], size)) < 0 ||
+	    (res = setup_port(data, SPA_DIRECTION_OUTPUT, 0, fmt,
+			      &data->out_io, &data->out_buffer, size)) < 0)
+		goto error;
+
+	cycles = bench_iterations(&data->bench, 400000 / channels);
+	start = bench_now();
+	for (i = 0; i < cycles; i++) {
+		data->in_io[0].status = SPA_RESULT_HAVE_BUFFER;
+		data->in_io[0].buffer_id = 0;
+
+		if ((res = spa_node_process_input(data->node)) != SPA_RESULT_HAVE_BUFFER)
+			goto error;
+
+		data->out_io.status = SPA_RESULT_NEED_BUFFER;
+		spa_node_port_reuse_buffer(data->node, 0, data->out_io.buffer_id);
+		data->out_io.buffer_id = SPA_ID_INVALID;
+	}
+	r.elapsed = bench_now() - start;
+
+	snprintf(params, sizeof(params), "format=%s,channels=%u", format_name, channels);
+	r.params = params;
+	r.n_ops = cycles;
+	r.bytes = cycles * size;
+	bench_report(&data->bench, &r);
+
+	res = SPA_RESULT_OK;
+      error:
+	if (res < 0 || res == SPA_RESULT_NEED_BUFFER)
+		fprintf(stderr, "volume %s %u: error %d\n", format_name, channels, res);
+	clear_buffer(&data->in_buffers[0]);
+	clear_buffer(&data->out_buffer);
+	destroy_node(data);
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t channels[] = { 1, 2, 8 };
+	static const uint32_t inputs[] = { 2, 8 };
+	struct data data = { { NULL, }, };
+	const char *mixer_lib, *volume_lib;
+	uint32_t i, j;
+	int arg;
+
+	arg = bench_init(&data.bench, "audio", argc, argv);
+	if (argc - arg < 2) {
+		fprintf(stderr, "usage: %s [--json] [--quick] <audiomixer lib> <volume lib>\n",
+			argv[0]);
+		return 1;
+	}
+	mixer_lib = argv[arg];
+	volume_lib = argv[arg + 1];
+
+	default_log.log.level = SPA_LOG_LEVEL_WARN;
+
+	data.support[0] = SPA_SUPPORT_INIT(SPA_TYPE__TypeMap, &default_map.map);
+	data.support[1] = SPA_SUPPORT_INIT(SPA_TYPE__Log, &default_log.log);
+	data.n_support = 2;
+	init_type(&data.type, &default_map.map);
+
+	for (i = 0; i < SPA_N_ELEMENTS(channels); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(inputs); j++) {
+			bench_mixer(&data, mixer_lib, "S16", data.type.audio_format.S16,
+				    sizeof(int16_t), channels[i], inputs[j]);
+			bench_mixer(&data, mixer_lib, "F32", data.type.audio_format.F32,
+				    sizeof(float), channels[i], inputs[j]);
+		}
+	}
+	for (i = 0; i < SPA_N_ELEMENTS(channels); i++)
+		bench_volume(&data, volume_lib, "S16", data.type.audio_format.S16,
+			     sizeof(int16_t), channels[i]);
+
+	return bench_finish(&data.bench);
+}
@@ -0,0 +1,222 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure the throughput of the sample format and channel mixing kernels
+ * of the audioconvert plugin. Every operation converts QUANTUM frames, like
+ * the plugin does for a graph cycle. The SIMD kernels that the cpu supports
+ * are compared with the plain C kernels and must give the same result.
+ *
+ *   bench-audioconvert [--json] [--quick]
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <tests/bench.h>
+
+#include "fmt-ops.h"
+#include "channelmix.h"
+
+#define QUANTUM		1024
+#define MAX_CHANNELS	8
+
+static const char *fmt_names[] = {
+	[FMT_S16] = "s16",
+	[FMT_S24] = "s24",
+	[FMT_S24_32] = "s24_32",
+	[FMT_S32] = "s32",
+	[FMT_F32] = "f32",
+	[FMT_F64] = "f64",
+};
+
+struct conversion {
+	enum fmt src_fmt;
+	bool src_planar;
+	enum fmt dst_fmt;
+	bool dst_planar;
+};
+
+/* fill the pointers to the planes or to the interleaved samples */
+static void *alloc_samples(bool planar, uint32_t channels, uint32_t size, void *ptrs[])
+{
+	uint8_t *mem = calloc(channels, QUANTUM * size);
+	uint32_t i;
+
+	for (i = 0; i < (planar ? channels : 1); i++)
+		ptrs[i] = mem + i * QUANTUM * size;
+	return mem;
+}
+
+static int bench_convert(struct bench *b, const struct conversion *c, uint32_t channels)
+{
+	static const char *kernels[] = { "c", "sse2" };
+	const struct fmt_ops *ops[2];
+	void *src[MAX_CHANNELS], *dst[MAX_CHANNELS], *smem, *dmem, *check;
+	uint32_t i, k, src_size, dst_size;
+	uint64_t j, start, cycles;
+	char params[128];
+
+	ops[0] = fmt_ops_find(c->src_fmt, c->src_planar, c->dst_fmt, c->dst_planar, channels, 0);
+	ops[1] = fmt_ops_find(c->src_fmt, c->src_planar, c->dst_fmt, c->dst_planar, channels,
+			      FMT_OPS_CPU_SSE2);
+	if (ops[0] == NULL)
+		return SPA_RESULT_NOT_IMPLEMENTED;
+
+	src_size = fmt_ops_sample_size(c->src_fmt);
+	dst_size = fmt_ops_sample_size(c->dst_fmt);
+
+	smem = alloc_samples(c->src_planar, channels, src_size, src);
+	dmem = alloc_samples(c->dst_planar, channels, dst_size, dst);
+	check = malloc(channels * QUANTUM * dst_size);
+
+	/* a sine wave in the source format, made from floats */
+	if (c->src_fmt != FMT_F32 || c->src_planar) {
+		const struct fmt_ops *pack;
+		float *f[MAX_CHANNELS];
+		void *fmem = alloc_samples(true, channels, sizeof(float), (void **) f);
+
+		for (i = 0; i < channels * QUANTUM; i++)
+			f[0][i] = sin(i * 0.01) * 1.1;
+		pack = fmt_ops_find(FMT_F32, true, c->src_fmt, c->src_planar, channels, 0);
+		pack->func(src, (const void **) f, channels, QUANTUM);
+		free(fmem);
+	} else {
+		for (i = 0; i < channels * QUANTUM; i++)
+			((float *) src[0])[i] = sin(i * 0.01) * 1.1;
+	}
+
+	for (k = 0; k < 2; k++) {
+		struct bench_result r = { "convert", };
+
+		/* no SIMD kernel for this conversion */
+		if (k > 0 && (ops[k] == ops[0] || ops[k] == NULL))
+			break;
+
+		ops[k]->func(dst, (const void **) src, channels, QUANTUM);
+		if (k == 0)
+			memcpy(check, dmem, channels * QUANTUM * dst_size);
+		else if (memcmp(check, dmem, channels * QUANTUM * dst_size) != 0)
+			fprintf(stderr, "%s kernel differs for %s%s -> %s%s\n", kernels[k],
+				fmt_names[c->src_fmt], c->src_planar ? "d" : "",
+				fmt_names[c->dst_fmt], c->dst_planar ? "d" : "");
+
+		cycles = bench_iterations(b, 200000 / channels);
+		start = bench_now();
+		for (j = 0; j < cycles; j++)
+			ops[k]->func(dst, (const void **) src, channels, QUANTUM);
+		r.elapsed = bench_now() - start;
+
+		snprintf(params, sizeof(params), "kernel=%s,src=%s%s,dst=%s%s,channels=%u",
+			 kernels[k], fmt_names[c->src_fmt], c->src_planar ? "d" : "",
+			 fmt_names[c->dst_fmt], c->dst_planar ? "d" : "", channels);
+		r.params = params;
+		r.n_ops = cycles;
+		r.bytes = cycles * channels * QUANTUM * src_size;
+		bench_report(b, &r);
+	}
+
+	free(smem);
+	free(dmem);
+	free(check);
+
+	return SPA_RESULT_OK;
+}
+
+static int bench_mix(struct bench *b, uint32_t n_src, uint32_t n_dst)
+{
+	static const struct kernel {
+		const char *name;
+		uint32_t cpu_flags;
+	} kernels[] = {
+		{ "c", 0 },
+		{ "sse", CHANNELMIX_CPU_SSE },
+	};
+	float *src[MAX_CHANNELS], *dst[MAX_CHANNELS], *smem, *dmem;
+	struct channelmix mix;
+	uint32_t i, k;
+	uint64_t j, start, cycles;
+	char params[128];
+
+	smem = alloc_samples(true, n_src, sizeof(float), (void **) src);
+	dmem = alloc_samples(true, n_dst, sizeof(float), (void **) dst);
+	for (i = 0; i < n_src * QUANTUM; i++)
+		src[0][i] = sin(i * 0.01);
+
+	for (k = 0; k < SPA_N_ELEMENTS(kernels); k++) {
+		struct bench_result r = { "channelmix", };
+
+		channelmix_init(&mix, n_src, n_dst, NULL, kernels[k].cpu_flags);
+		/* the kernel is not available on this cpu */
+		if (mix.cpu_flags != kernels[k].cpu_flags)
+			continue;
+
+		cycles = bench_iterations(b, 200000 / (n_src * n_dst));
+		start = bench_now();
+		for (j = 0; j < cycles; j++)
+			channelmix_process(&mix, dst, (const float **) src, QUANTUM);
+		r.elapsed = bench_now() - start;
+
+		snprintf(params, sizeof(params), "kernel=%s,src=%u,dst=%u",
+			 kernels[k].name, n_src, n_dst);
+		r.params = params;
+		r.n_ops = cycles;
+		r.bytes = cycles * n_src * QUANTUM * sizeof(float);
+		bench_report(b, &r);
+	}
+
+	free(smem);
+	free(dmem);
+
+	return SPA_RESULT_OK;
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct conversion conversions[] = {
+		{ FMT_S16, false, FMT_F32, false },
+		{ FMT_F32, false, FMT_S16, false },
+		{ FMT_S16, false, FMT_F32, true },
+		{ FMT_F32, true, FMT_S16, false },
+		{ FMT_F32, false, FMT_F32, true },
+		{ FMT_F32, true, FMT_F32, false },
+		{ FMT_S24, false, FMT_F32, true },
+		{ FMT_F32, true, FMT_S24, false },
+		{ FMT_S32, false, FMT_F32, true },
+		{ FMT_F32, true, FMT_S32, false },
+	};
+	static const uint32_t channels[] = { 1, 2, 6 };
+	static const uint32_t mixes[][2] = {
+		{ 1, 2 }, { 2, 1 }, { 6, 2 }, { 8, 2 },
+	};
+	struct bench b;
+	uint32_t i, j;
+
+	bench_init(&b, "audioconvert", argc, argv);
+
+	for (i = 0; i < SPA_N_ELEMENTS(conversions); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(channels); j++)
+			bench_convert(&b, &conversions[i], channels[j]);
+	}
+	for (i = 0; i < SPA_N_ELEMENTS(mixes); i++)
+		bench_mix(&b, mixes[i][0], mixes[i][1]);
+
+	return bench_finish(&b);
+}
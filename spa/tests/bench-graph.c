@@ -0,0 +1,255 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure the overhead of the graph scheduler that is used by the core.
+ *
+ * The nodes of the graphs don't touch any data, they only update the io
+ * areas, so the results are the cost of scheduling one cycle of the graph
+ * by pulling from the sink.
+ *
+ *  chain:  source -> filter -> ... -> sink
+ *  fanin:  n sources -> sink with n inputs
+ *  tree:   a binary tree of filters with 2 inputs, sources as leaves
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <spa/node.h>
+#include <spa/graph.h>
+#include <spa/graph-scheduler3.h>
+
+#include <tests/bench.h>
+
+#define MAX_INPUTS	64
+#define MAX_NODES	1024
+
+struct node {
+	struct spa_node node;
+	struct spa_graph_node gnode;
+
+	uint32_t n_inputs;
+	struct spa_graph_port in[MAX_INPUTS];
+	struct spa_port_io *in_io[MAX_INPUTS];
+
+	bool has_output;
+	struct spa_graph_port out;
+	struct spa_port_io out_io;
+
+	uint64_t count;
+};
+
+struct graph {
+	struct spa_graph graph;
+	struct node *nodes;
+	uint32_t n_nodes;
+	struct node *sink;
+};
+
+static int node_process_input(struct spa_node *node)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+	uint32_t i;
+
+	for (i = 0; i < n->n_inputs; i++)
+		n->in_io[i]->status = SPA_RESULT_NEED_BUFFER;
+	n->count++;
+
+	if (!n->has_output)
+		return SPA_RESULT_NEED_BUFFER;
+
+	n->out_io.buffer_id = 0;
+	n->out_io.status = SPA_RESULT_HAVE_BUFFER;
+	return SPA_RESULT_HAVE_BUFFER;
+}
+
+static int node_process_output(struct spa_node *node)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+	uint32_t i;
+
+	if (n->out_io.status == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_HAVE_BUFFER;
+
+	if (n->n_inputs == 0) {
+		n->count++;
+		n->out_io.buffer_id = 0;
+		n->out_io.status = SPA_RESULT_HAVE_BUFFER;
+		return SPA_RESULT_HAVE_BUFFER;
+	}
+	for (i = 0; i < n->n_inputs; i++)
+		n->in_io[i]->status = SPA_RESULT_NEED_BUFFER;
+
+	return SPA_RESULT_NEED_BUFFER;
+}
+
+static const struct spa_node node_impl = {
+	SPA_VERSION_NODE,
+	.process_input = node_process_input,
+	.process_output = node_process_output,
+};
+
+static struct node *graph_add_node(struct graph *g, bool has_output)
+{
+	struct node *n = &g->nodes[g->n_nodes++];
+
+	n->node = node_impl;
+	n->has_output = has_output;
+	n->n_inputs = 0;
+	n->count = 0;
+
+	spa_graph_node_init(&n->gnode);
+	spa_graph_node_set_implementation(&n->gnode, &n->node);
+	spa_graph_node_add(&g->graph, &n->gnode);
+
+	if (has_output) {
+		n->out_io = SPA_PORT_IO_INIT;
+		n->out_io.status = SPA_RESULT_NEED_BUFFER;
+		spa_graph_port_init(&n->out, SPA_DIRECTION_OUTPUT, 0, 0, &n->out_io);
+		spa_graph_port_add(&n->gnode, &n->out);
+	}
+	return n;
+}
+
+static void graph_link(struct node *out, struct node *in)
+{
+	uint32_t id = in->n_inputs++;
+
+	in->in_io[id] = &out->out_io;
+	spa_graph_port_init(&in->in[id], SPA_DIRECTION_INPUT, id, 0, &out->out_io);
+	spa_graph_port_add(&in->gnode, &in->in[id]);
+	spa_graph_port_link(&out->out, &in->in[id]);
+}
+
+static void graph_init(struct graph *g)
+{
+	spa_graph_init(&g->graph);
+	spa_graph_set_callbacks(&g->graph, &spa_graph_impl_default, NULL);
+	g->nodes = calloc(MAX_NODES, sizeof(struct node));
+	g->n_nodes = 0;
+}
+
+static void graph_clear(struct graph *g)
+{
+	free(g->nodes);
+}
+
+static void make_chain(struct graph *g, uint32_t n_nodes)
+{
+	struct node *prev, *n;
+	uint32_t i;
+
+	prev = graph_add_node(g, true);
+	for (i = 2; i < n_nodes; i++) {
+		n = graph_add_node(g, true);
+		graph_link(prev, n);
+		prev = n;
+	}
+	g->sink = graph_add_node(g, false);
+	graph_link(prev, g->sink);
+}
+
+static void make_fanin(struct graph *g, uint32_t n_nodes)
+{
+	uint32_t i;
+
+	g->sink = graph_add_node(g, false);
+	for (i = 1; i < n_nodes; i++)
+		graph_link(graph_add_node(g, true), g->sink);
+}
+
+static struct node *make_subtree(struct graph *g, uint32_t depth)
+{
+	struct node *n = graph_add_node(g, true);
+
+	if (depth > 0) {
+		graph_link(make_subtree(g, depth - 1), n);
+		graph_link(make_subtree(g, depth - 1), n);
+	}
+	return n;
+}
+
+static void make_tree(struct graph *g, uint32_t depth)
+{
+	g->sink = graph_add_node(g, false);
+	graph_link(make_subtree(g, depth - 1), g->sink);
+}
+
+static void run(struct bench *b, const char *name, const char *params,
+		struct graph *g, uint64_t cycles)
+{
+	struct bench_result r = { name, params, cycles, };
+	uint64_t i, start;
+	uint32_t j;
+
+	/* warm up */
+	for (i = 0; i < 1000; i++)
+		spa_graph_need_input(&g->graph, &g->sink->gnode);
+
+	start = bench_now();
+	for (i = 0; i < cycles; i++)
+		spa_graph_need_input(&g->graph, &g->sink->gnode);
+	r.elapsed = bench_now() - start;
+
+	for (j = 0; j < g->n_nodes; j++) {
+		if (g->nodes[j].count != cycles + 1000) {
+			fprintf(stderr, "%s %s: node %u processed %" PRIu64 " times, expected %" PRIu64 "\n",
+				name, params, j, g->nodes[j].count, cycles + 1000);
+			exit(1);
+		}
+	}
+	bench_report(b, &r);
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t sizes[] = { 2, 8, 32, 64 };
+	static const uint32_t depths[] = { 2, 4, 6, 8 };
+	struct bench b;
+	struct graph g;
+	char params[64];
+	uint64_t cycles;
+	uint32_t i;
+
+	bench_init(&b, "graph", argc, argv);
+	cycles = bench_iterations(&b, 200000);
+
+	for (i = 0; i < SPA_N_ELEMENTS(sizes); i++) {
+		graph_init(&g);
+		make_chain(&g, sizes[i]);
+		snprintf(params, sizeof(params), "nodes=%u", g.n_nodes);
+		run(&b, "chain", params, &g, cycles);
+		graph_clear(&g);
+	}
+	for (i = 0; i < SPA_N_ELEMENTS(sizes); i++) {
+		graph_init(&g);
+		make_fanin(&g, sizes[i] + 1);
+		snprintf(params, sizeof(params), "nodes=%u", g.n_nodes);
+		run(&b, "fanin", params, &g, cycles);
+		graph_clear(&g);
+	}
+	for (i = 0; i < SPA_N_ELEMENTS(depths); i++) {
+		graph_init(&g);
+		make_tree(&g, depths[i]);
+		snprintf(params, sizeof(params), "nodes=%u,depth=%u", g.n_nodes, depths[i]);
+		run(&b, "tree", params, &g, cycles / (1 << (depths[i] / 2)));
+		graph_clear(&g);
+	}
+	return bench_finish(&b);
+}
@@ -0,0 +1,175 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure how fast messages shaped like a node info with a growing
+ * number of properties are built and parsed. The parser validates the
+ * complete message, the iterator only checks the outer struct. */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <spa/pod-builder.h>
+#include <spa/pod-iter.h>
+#include <spa/pod-parser.h>
+
+#include <tests/bench.h>
+
+#define DEFAULT_ITERATIONS	200000
+#define MAX_ITEMS		256
+
+static uint32_t build_message(uint8_t *buffer, uint32_t size, uint32_t n_items)
+{
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, size);
+	struct spa_pod_frame f;
+	char key[32];
+	uint32_t i;
+
+	spa_pod_builder_add(&b,
+			    SPA_POD_TYPE_STRUCT, &f,
+			    SPA_POD_TYPE_INT, 1,
+			    SPA_POD_TYPE_LONG, (int64_t) 0xff,
+			    SPA_POD_TYPE_STRING, "node",
+			    SPA_POD_TYPE_INT, n_items, 0);
+
+	for (i = 0; i < n_items; i++) {
+		snprintf(key, sizeof(key), "key.%u", i);
+		spa_pod_builder_add(&b,
+				    SPA_POD_TYPE_STRING, key,
+				    SPA_POD_TYPE_STRING, "value", 0);
+	}
+	spa_pod_builder_add(&b,
+			    SPA_POD_TYPE_INT, 42,
+			    -SPA_POD_TYPE_STRUCT, &f, 0);
+
+	return b.offset;
+}
+
+static uint32_t parse_iter(void *data, uint32_t size)
+{
+	struct spa_pod_iter it;
+	uint32_t id, n_items, i, last;
+	uint64_t change_mask;
+	const char *name, *key, *value;
+
+	if (!spa_pod_iter_struct(&it, data, size) ||
+	    !spa_pod_iter_get(&it,
+			      SPA_POD_TYPE_INT, &id,
+			      SPA_POD_TYPE_LONG, &change_mask,
+			      SPA_POD_TYPE_STRING, &name,
+			      SPA_POD_TYPE_INT, &n_items, 0))
+		return 0;
+
+	for (i = 0; i < n_items; i++) {
+		if (!spa_pod_iter_get(&it,
+				      SPA_POD_TYPE_STRING, &key,
+				      SPA_POD_TYPE_STRING, &value, 0))
+			return 0;
+	}
+	if (!spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &last, 0))
+		return 0;
+
+	return last;
+}
+
+static uint32_t parse_parser(void *data, uint32_t size)
+{
+	struct spa_pod_parser parser;
+	uint32_t offsets[SPA_POD_PARSER_MAX_FIELDS(16384)];
+	uint32_t id, n_items, i, last;
+	uint64_t change_mask;
+	const char *name, *key, *value;
+
+	if (!spa_pod_parser_init(&parser, data, size, offsets, SPA_N_ELEMENTS(offsets)) ||
+	    !spa_pod_parser_get(&parser,
+				SPA_POD_TYPE_INT, &id,
+				SPA_POD_TYPE_LONG, &change_mask,
+				SPA_POD_TYPE_STRING, &name,
+				SPA_POD_TYPE_INT, &n_items, 0))
+		return 0;
+
+	for (i = 0; i < n_items; i++) {
+		if (!spa_pod_parser_get(&parser,
+					SPA_POD_TYPE_STRING, &key,
+					SPA_POD_TYPE_STRING, &value, 0))
+			return 0;
+	}
+	if (!spa_pod_parser_get(&parser, SPA_POD_TYPE_INT, &last, 0))
+		return 0;
+
+	return last;
+}
+
+static void run_build(struct bench *b, const char *params,
+		      uint8_t *buffer, uint32_t n_items, uint64_t iterations)
+{
+	struct bench_result r = { "build", params, iterations, };
+	uint64_t i, start, bytes = 0;
+
+	start = bench_now();
+	for (i = 0; i < iterations; i++)
+		bytes += build_message(buffer, 16384, n_items);
+	r.elapsed = bench_now() - start;
+	r.bytes = bytes;
+
+	bench_report(b, &r);
+}
+
+static void run_parse(struct bench *b, const char *name, const char *params,
+		      uint32_t (*func) (void *data, uint32_t size),
+		      void *data, uint32_t size, uint64_t iterations)
+{
+	struct bench_result r = { name, params, iterations, };
+	uint64_t i, start, res = 0;
+
+	start = bench_now();
+	for (i = 0; i < iterations; i++)
+		res += func(data, size);
+	r.elapsed = bench_now() - start;
+	r.bytes = size * iterations;
+
+	if (res != 42u * iterations) {
+		fprintf(stderr, "%s: parse failed\n", name);
+		exit(1);
+	}
+	bench_report(b, &r);
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t n_items[] = { 0, 4, 32, MAX_ITEMS };
+	uint8_t buffer[16384];
+	struct bench b;
+	uint64_t iterations;
+	uint32_t i, size;
+	char params[64];
+
+	bench_init(&b, "pod", argc, argv);
+	iterations = bench_iterations(&b, DEFAULT_ITERATIONS);
+
+	for (i = 0; i < SPA_N_ELEMENTS(n_items); i++) {
+		size = build_message(buffer, sizeof(buffer), n_items[i]);
+		snprintf(params, sizeof(params), "items=%u,size=%u", n_items[i], size);
+
+		run_build(&b, params, buffer, n_items[i], iterations);
+		run_parse(&b, "iter", params, parse_iter, buffer, size, iterations);
+		run_parse(&b, "parser", params, parse_parser, buffer, size, iterations);
+	}
+	return bench_finish(&b);
+}
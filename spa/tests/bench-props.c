@@ -0,0 +1,456 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include <spa/type-map.h>
+#include <spa/type-map-impl.h>
+#include <spa/format-builder.h>
+#include <spa/format-utils.h>
+#include <spa/video/format-utils.h>
+#include <spa/audio/format-utils.h>
+
+#include <lib/debug.h>
+#include <lib/format.h>
+
+#include <tests/bench.h>
+
+#define DEFAULT_ITERATIONS	200000
+
+#define PROP(f,key,type,...)							\
+	SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)						\
+	SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |				\
+			SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_U_ST(f,key,type,...)						\
+	SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |				\
+			SPA_POD_PROP_RANGE_STEP,type,4,__VA_ARGS__)
+#define PROP_U_EN(f,key,type,n,...)						\
+	SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |				\
+			SPA_POD_PROP_RANGE_ENUM,type,n,__VA_ARGS__)
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+
+static struct {
+	uint32_t format;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+} type = { 0, };
+
+static inline void type_init(struct spa_type_map *map)
+{
+	type.format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_media_type_map(map, &type.media_type);
+	spa_type_media_subtype_map(map, &type.media_subtype);
+	spa_type_format_video_map(map, &type.format_video);
+	spa_type_video_format_map(map, &type.video_format);
+	spa_type_format_audio_map(map, &type.format_audio);
+	spa_type_audio_format_map(map, &type.audio_format);
+}
+
+struct test {
+	const char *name;
+	struct spa_format *format;
+	struct spa_format *filter;
+	int expected;
+};
+
+/* what v4l2 enumerates for a discrete frame size of a webcam */
+static struct spa_format *make_v4l2_discrete(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], type.format,
+		type.media_type.video, type.media_subtype.raw,
+		PROP(&f[1], type.format_video.format, SPA_POD_TYPE_ID, type.video_format.YUY2),
+		PROP(&f[1], type.format_video.size, SPA_POD_TYPE_RECTANGLE, 1280, 720),
+		PROP_U_EN(&f[1], type.format_video.framerate, SPA_POD_TYPE_FRACTION, 6,
+			30, 1,
+			30, 1, 25, 1, 20, 1, 15, 1, 10, 1));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+/* what v4l2 enumerates for a stepwise frame size of a capture card */
+static struct spa_format *make_v4l2_stepwise(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], type.format,
+		type.media_type.video, type.media_subtype.raw,
+		PROP(&f[1], type.format_video.format, SPA_POD_TYPE_ID, type.video_format.NV12),
+		PROP_U_ST(&f[1], type.format_video.size, SPA_POD_TYPE_RECTANGLE,
+			1920, 1080,
+			16, 16,
+			1920, 1080,
+			16, 8),
+		PROP_U_MM(&f[1], type.format_video.framerate, SPA_POD_TYPE_FRACTION,
+			60, 1,
+			1, 1,
+			60, 1));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+/* what a video sink accepts */
+static struct spa_format *make_video_filter(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], type.format,
+		type.media_type.video, type.media_subtype.raw,
+		PROP_U_EN(&f[1], type.format_video.format, SPA_POD_TYPE_ID, 5,
+			type.video_format.I420,
+			type.video_format.I420,
+			type.video_format.YUY2,
+			type.video_format.NV12,
+			type.video_format.RGB),
+		PROP_U_MM(&f[1], type.format_video.size, SPA_POD_TYPE_RECTANGLE,
+			640, 480,
+			1, 1,
+			4096, 4096),
+		PROP_U_MM(&f[1], type.format_video.framerate, SPA_POD_TYPE_FRACTION,
+			25, 1,
+			0, 1,
+			120, 1));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+/* a video filter with a size that needs to be a multiple of 8 */
+static struct spa_format *make_video_step_filter(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], type.format,
+		type.media_type.video, type.media_subtype.raw,
+		PROP_U_EN(&f[1], type.format_video.format, SPA_POD_TYPE_ID, 3,
+			type.video_format.NV12,
+			type.video_format.NV12,
+			type.video_format.YUY2),
+		PROP_U_ST(&f[1], type.format_video.size, SPA_POD_TYPE_RECTANGLE,
+			1280, 720,
+			8, 8,
+			1280, 720,
+			8, 8),
+		PROP_U_EN(&f[1], type.format_video.framerate, SPA_POD_TYPE_FRACTION, 3,
+			30, 1,
+			30, 1, 60, 1));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+/* a filter with a size outside of the device size */
+static struct spa_format *make_video_small_filter(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], type.format,
+		type.media_type.video, type.media_subtype.raw,
+		PROP_U_MM(&f[1], type.format_video.size, SPA_POD_TYPE_RECTANGLE,
+			640, 480,
+			1, 1,
+			1024, 576));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+/* what alsa enumerates for a typical sound card */
+static struct spa_format *make_alsa(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], type.format,
+		type.media_type.audio, type.media_subtype.raw,
+		PROP_U_EN(&f[1], type.format_audio.format, SPA_POD_TYPE_ID, 5,
+			type.audio_format.S16,
+			type.audio_format.S16,
+			type.audio_format.S24,
+			type.audio_format.S32,
+			type.audio_format.F32),
+		PROP_U_MM(&f[1], type.format_audio.rate, SPA_POD_TYPE_INT,
+			44100,
+			8000,
+			192000),
+		PROP_U_MM(&f[1], type.format_audio.channels, SPA_POD_TYPE_INT,
+			2,
+			1,
+			8));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+/* what an audio client asks for */
+static struct spa_format *make_audio_filter(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], type.format,
+		type.media_type.audio, type.media_subtype.raw,
+		PROP_U_EN(&f[1], type.format_audio.format, SPA_POD_TYPE_ID, 3,
+			type.audio_format.F32,
+			type.audio_format.F32,
+			type.audio_format.S16),
+		PROP_U_EN(&f[1], type.format_audio.rate, SPA_POD_TYPE_INT, 3,
+			48000,
+			44100, 48000),
+		PROP(&f[1], type.format_audio.channels, SPA_POD_TYPE_INT, 2));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+#define WIDE_PROPS	24
+
+/* a format with many properties, the filter has them in the same or in
+ * reverse order */
+static struct spa_format *make_wide(struct spa_pod_builder *b, bool filter, bool reverse)
+{
+	struct spa_pod_frame f[2];
+	int i, key;
+
+	spa_pod_builder_push_format(b, &f[0], type.format,
+				    type.media_type.video, type.media_subtype.raw);
+	for (i = 0; i < WIDE_PROPS; i++) {
+		key = 0x1000 + (reverse ? WIDE_PROPS - 1 - i : i);
+		spa_pod_builder_push_prop(b, &f[1], key,
+					  SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET);
+		spa_pod_builder_int(b, 10);
+		spa_pod_builder_int(b, filter ? 5 : 0);
+		spa_pod_builder_int(b, filter ? 100 : 50);
+		spa_pod_builder_pop(b, &f[1]);
+	}
+	spa_pod_builder_pop(b, &f[0]);
+
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+static struct spa_format *make_wide_format(struct spa_pod_builder *b)
+{
+	return make_wide(b, false, false);
+}
+
+static struct spa_format *make_wide_filter(struct spa_pod_builder *b)
+{
+	return make_wide(b, true, false);
+}
+
+static struct spa_format *make_wide_reverse_filter(struct spa_pod_builder *b)
+{
+	return make_wide(b, true, true);
+}
+
+static struct spa_format *build(struct spa_format *(*func) (struct spa_pod_builder *b))
+{
+	uint8_t buffer[4096];
+	struct spa_pod_builder b = { NULL, };
+	struct spa_format *format, *copy;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	format = func(&b);
+
+	copy = malloc(SPA_POD_SIZE(format));
+	memcpy(copy, format, SPA_POD_SIZE(format));
+	return copy;
+}
+
+static void check_step(void)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = { NULL, };
+	struct spa_format *format, *filter, *result;
+	struct spa_pod_prop *p;
+	struct spa_rectangle *r;
+	int res;
+
+	format = build(make_v4l2_stepwise);
+	filter = build(make_video_step_filter);
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	res = spa_format_filter(format, filter, &b);
+	assert(res == SPA_RESULT_OK);
+
+	result = SPA_MEMBER(buffer, 0, struct spa_format);
+
+	/* 16x16-1920x1080 step 16x8 with 8x8-1280x720 step 8x8 */
+	p = spa_format_find_prop(result, type.format_video.size);
+	assert(p != NULL);
+	assert((p->body.flags & SPA_POD_PROP_RANGE_MASK) == SPA_POD_PROP_RANGE_STEP);
+	r = SPA_POD_BODY(&p->body.value);
+	assert(r[1].width == 16 && r[1].height == 16);
+	assert(r[2].width == 1280 && r[2].height == 720);
+	assert(r[3].width == 16 && r[3].height == 8);
+
+	free(format);
+	free(filter);
+}
+
+#define FLOAT_KEY	0x2000
+
+/* a framerate grid of 5/2 and a float grid of 0.25 */
+static struct spa_format *make_fine_step(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], type.format,
+		type.media_type.video, type.media_subtype.raw,
+		PROP_U_ST(&f[1], type.format_video.framerate, SPA_POD_TYPE_FRACTION,
+			30, 1,
+			5, 2,
+			60, 1,
+			5, 2),
+		PROP_U_ST(&f[1], FLOAT_KEY, SPA_POD_TYPE_FLOAT,
+			1.0,
+			0.5,
+			10.0,
+			0.25));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+/* a framerate grid of 10/3 and a float grid of 0.1 */
+static struct spa_format *make_coarse_step(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], type.format,
+		type.media_type.video, type.media_subtype.raw,
+		PROP_U_ST(&f[1], type.format_video.framerate, SPA_POD_TYPE_FRACTION,
+			30, 1,
+			0, 1,
+			30, 1,
+			10, 3),
+		PROP_U_ST(&f[1], FLOAT_KEY, SPA_POD_TYPE_FLOAT,
+			1.0,
+			0.0,
+			8.0,
+			0.1));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+static void check_fraction_float_step(void)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = { NULL, };
+	struct spa_format *format, *filter, *result;
+	struct spa_pod_prop *p;
+	struct spa_fraction *fr;
+	float *fl;
+	int res;
+
+	format = build(make_fine_step);
+	filter = build(make_coarse_step);
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	res = spa_format_filter(format, filter, &b);
+	assert(res == SPA_RESULT_OK);
+
+	result = SPA_MEMBER(buffer, 0, struct spa_format);
+
+	/* 5/2-60/1 step 5/2 with 0/1-30/1 step 10/3 */
+	p = spa_format_find_prop(result, type.format_video.framerate);
+	assert(p != NULL);
+	assert((p->body.flags & SPA_POD_PROP_RANGE_MASK) == SPA_POD_PROP_RANGE_STEP);
+	fr = SPA_POD_BODY(&p->body.value);
+	assert(fr[0].num == 30 && fr[0].denom == 1);
+	assert(fr[1].num == 10 && fr[1].denom == 1);
+	assert(fr[2].num == 30 && fr[2].denom == 1);
+	assert(fr[3].num == 10 && fr[3].denom == 1);
+
+	/* 0.5-10.0 step 0.25 with 0.0-8.0 step 0.1 */
+	p = spa_format_find_prop(result, FLOAT_KEY);
+	assert(p != NULL);
+	assert((p->body.flags & SPA_POD_PROP_RANGE_MASK) == SPA_POD_PROP_RANGE_STEP);
+	fl = SPA_POD_BODY(&p->body.value);
+	assert(fl[0] == 1.0f);
+	assert(fl[1] == 0.5f);
+	assert(fl[2] == 8.0f);
+	assert(fl[3] == 0.5f);
+
+	free(format);
+	free(filter);
+}
+
+static void run(struct bench *bench, const struct test *t, uint64_t iterations)
+{
+	struct bench_result r = { "filter", NULL, iterations, };
+	uint8_t buffer[4096];
+	struct spa_pod_builder b = { NULL, };
+	char params[64];
+	uint64_t i, start;
+	int res = 0;
+
+	start = bench_now();
+	for (i = 0; i < iterations; i++) {
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		res = spa_format_filter(t->format, t->filter, &b);
+	}
+	r.elapsed = bench_now() - start;
+
+	if (res != t->expected) {
+		fprintf(stderr, "%s: unexpected result %d != %d\n", t->name, res, t->expected);
+		exit(1);
+	}
+
+	snprintf(params, sizeof(params), "case=%s", t->name);
+	r.params = params;
+	bench_report(bench, &r);
+}
+
+int main(int argc, char *argv[])
+{
+	struct test tests[8];
+	struct bench bench;
+	uint64_t iterations;
+	int i;
+
+	type_init(&default_map.map);
+	spa_debug_set_type_map(&default_map.map);
+
+	bench_init(&bench, "props", argc, argv);
+	iterations = bench_iterations(&bench, DEFAULT_ITERATIONS);
+
+	check_step();
+	check_fraction_float_step();
+
+	tests[0] = (struct test) { "v4l2-discrete", build(make_v4l2_discrete),
+				   build(make_video_filter), SPA_RESULT_OK };
+	tests[1] = (struct test) { "v4l2-stepwise", build(make_v4l2_stepwise),
+				   build(make_video_filter), SPA_RESULT_OK };
+	tests[2] = (struct test) { "v4l2-stepwise-step", build(make_v4l2_stepwise),
+				   build(make_video_step_filter), SPA_RESULT_OK };
+	tests[3] = (struct test) { "v4l2-no-match", build(make_v4l2_discrete),
+				   build(make_video_small_filter),
+				   SPA_RESULT_INCOMPATIBLE_PROPS };
+	tests[4] = (struct test) { "alsa", build(make_alsa),
+				   build(make_audio_filter), SPA_RESULT_OK };
+	tests[5] = (struct test) { "alsa-no-filter", build(make_alsa),
+				   NULL, SPA_RESULT_OK };
+	tests[6] = (struct test) { "wide", build(make_wide_format),
+				   build(make_wide_filter), SPA_RESULT_OK };
+	tests[7] = (struct test) { "wide-reverse", build(make_wide_format),
+				   build(make_wide_reverse_filter), SPA_RESULT_OK };
+
+	for (i = 0; i < SPA_N_ELEMENTS(tests); i++)
+		run(&bench, &tests[i], iterations);
+
+	for (i = 0; i < SPA_N_ELEMENTS(tests); i++) {
+		free(tests[i].format);
+		free(tests[i].filter);
+	}
+	return bench_finish(&bench);
+}
@@ -0,0 +1,123 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure the throughput of the resampler kernels of the audioresample
+ * plugin. Every operation makes QUANTUM output frames, like the plugin
+ * does for a graph cycle. The plain C kernel is compared with the SIMD
+ * kernels that the cpu supports.
+ *
+ *   bench-resample [--json] [--quick]
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <tests/bench.h>
+
+#include "resample.h"
+
+#define QUANTUM		1024
+
+static const struct kernel {
+	const char *name;
+	uint32_t cpu_flags;
+} kernels[] = {
+	{ "c", 0 },
+	{ "sse", RESAMPLE_CPU_SSE },
+};
+
+static int bench_resample(struct bench *b, const struct kernel *k, uint32_t in_rate,
+			  uint32_t out_rate, double rate, uint32_t channels, uint32_t quality)
+{
+	struct bench_result r = { "resample", };
+	struct resample res;
+	float *src, *dst;
+	uint64_t i, start, cycles, in_frames = 0;
+	char params[128];
+	uint32_t j, max_in;
+	int result;
+
+	if ((result = resample_init(&res, channels, in_rate, out_rate, quality, k->cpu_flags)) < 0)
+		return result;
+
+	/* the kernel is not available on this cpu */
+	if (res.cpu_flags != k->cpu_flags) {
+		resample_free(&res);
+		return SPA_RESULT_NOT_IMPLEMENTED;
+	}
+	resample_update_rate(&res, rate);
+
+	max_in = resample_in_len(&res, QUANTUM) * 2 + res.n_taps;
+	src = malloc(max_in * channels * sizeof(float));
+	dst = malloc(QUANTUM * channels * sizeof(float));
+	for (j = 0; j < max_in * channels; j++)
+		src[j] = sin(j * 0.01);
+
+	cycles = bench_iterations(b, 2000000 / (channels * res.n_taps));
+	start = bench_now();
+	for (i = 0; i < cycles; i++) {
+		uint32_t in_len = resample_in_len(&res, QUANTUM), out_len = QUANTUM;
+
+		resample_process(&res, src, &in_len, dst, &out_len);
+		in_frames += in_len;
+	}
+	r.elapsed = bench_now() - start;
+
+	snprintf(params, sizeof(params), "kernel=%s,in=%u,out=%u,rate=%g,channels=%u,quality=%u",
+		 k->name, in_rate, out_rate, rate, channels, quality);
+	r.params = params;
+	r.n_ops = cycles;
+	r.bytes = in_frames * channels * sizeof(float);
+	bench_report(b, &r);
+
+	free(src);
+	free(dst);
+	resample_free(&res);
+
+	return SPA_RESULT_OK;
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t conversions[][2] = {
+		{ 44100, 48000 }, { 48000, 44100 }, { 48000, 48000 }, { 96000, 48000 },
+	};
+	static const uint32_t channels[] = { 1, 2, 8 };
+	struct bench b;
+	uint32_t i, j, k;
+
+	bench_init(&b, "resample", argc, argv);
+
+	for (k = 0; k < SPA_N_ELEMENTS(kernels); k++) {
+		for (i = 0; i < SPA_N_ELEMENTS(conversions); i++) {
+			for (j = 0; j < SPA_N_ELEMENTS(channels); j++) {
+				/* the same rates are only converted to correct drift */
+				double rate = conversions[i][0] == conversions[i][1] ? 1.0001 : 1.0;
+
+				bench_resample(&b, &kernels[k], conversions[i][0], conversions[i][1],
+					       rate, channels[j], RESAMPLE_DEFAULT_QUALITY);
+			}
+		}
+		for (i = 0; i <= RESAMPLE_MAX_QUALITY; i++)
+			bench_resample(&b, &kernels[k], 44100, 48000, 1.0, 2, i);
+	}
+	return bench_finish(&b);
+}
@@ -0,0 +1,189 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_TESTS_BENCH_H__
+#define __SPA_TESTS_BENCH_H__
+
+/* Helpers for the benchmarks that are run with `meson test --benchmark`.
+ *
+ * Results are printed as a table or, with --json, as one JSON object per
+ * run that can be stored and compared with the results of another build:
+ *
+ *   { "suite": "graph", "results": [
+ *     { "name": "chain", "params": { "nodes": 8 }, "ops": 100000,
+ *       "ns_per_op": 412.3, "ops_per_sec": 2425418.4,
+ *       "latency_ns": { "min": 380, "p50": 401, "p99": 620, "max": 9012 } } ] }
+ *
+ * latency_ns is only present when the benchmark measured individual
+ * operations, mb_per_sec only when it processed data. With --quick the
+ * number of iterations is divided by 100 to check that everything runs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <spa/defs.h>
+
+struct bench {
+	const char *suite;
+	bool json;
+	bool quick;
+	uint32_t n_results;
+};
+
+struct bench_result {
+	const char *name;	/* name of the benchmark */
+	const char *params;	/* comma separated key=value pairs or NULL */
+	uint64_t n_ops;		/* number of operations */
+	uint64_t elapsed;	/* total time in nanoseconds */
+	uint64_t bytes;		/* bytes processed or 0 */
+	bool have_latency;	/* when the fields below are set */
+	uint64_t min, p50, p99, max;
+};
+
+/** Parse the options in \a argv and return the index of the first
+ * argument that is not an option. */
+static inline int bench_init(struct bench *b, const char *suite, int argc, char *argv[])
+{
+	int i;
+
+	b->suite = suite;
+	b->json = false;
+	b->quick = false;
+	b->n_results = 0;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0)
+			b->json = true;
+		else if (strcmp(argv[i], "--quick") == 0)
+			b->quick = true;
+		else
+			break;
+	}
+	if (b->json)
+		printf("{ \"suite\": \"%s\", \"results\": [", suite);
+
+	return i;
+}
+
+static inline uint64_t bench_iterations(struct bench *b, uint64_t n)
+{
+	return b->quick ? SPA_MAX(n / 100, 1) : n;
+}
+
+static inline uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_TIME(&ts);
+}
+
+static int bench_compare_u64(const void *a, const void *b)
+{
+	uint64_t va = *(const uint64_t *) a, vb = *(const uint64_t *) b;
+
+	return va < vb ? -1 : va > vb;
+}
+
+/** Fill the latency fields of \a r from \a n_samples durations. The
+ * samples are sorted in place. */
+static inline void bench_latency(struct bench_result *r, uint64_t *samples, uint64_t n_samples)
+{
+	if (n_samples == 0)
+		return;
+
+	qsort(samples, n_samples, sizeof(uint64_t), bench_compare_u64);
+	r->have_latency = true;
+	r->min = samples[0];
+	r->p50 = samples[n_samples / 2];
+	r->p99 = samples[(n_samples * 99) / 100];
+	r->max = samples[n_samples - 1];
+}
+
+/* print the params as a JSON object, values that are not numbers are quoted */
+static inline void bench_print_params(const char *params)
+{
+	const char *p = params;
+	int n = 0;
+
+	printf("{");
+	while (p && *p) {
+		size_t len = strcspn(p, ","), klen = strcspn(p, "=");
+		const char *val;
+		char *end;
+
+		if (klen >= len) {
+			p += len + (p[len] == ',');
+			continue;
+		}
+		val = p + klen + 1;
+		strtod(val, &end);
+
+		printf("%s \"%.*s\": ", n++ ? "," : "", (int) klen, p);
+		if (end == p + len && end != val)
+			printf("%.*s", (int) (len - klen - 1), val);
+		else
+			printf("\"%.*s\"", (int) (len - klen - 1), val);
+
+		p += len + (p[len] == ',');
+	}
+	printf(" }");
+}
+
+static inline void bench_report(struct bench *b, const struct bench_result *r)
+{
+	double ns_per_op = r->n_ops ? (double) r->elapsed / r->n_ops : 0.0;
+	double ops_per_sec = r->elapsed ? r->n_ops * 1e9 / r->elapsed : 0.0;
+	double mb_per_sec = r->elapsed ? r->bytes * 1e3 / r->elapsed : 0.0;
+
+	if (b->json) {
+		printf("%s\n  { \"name\": \"%s\", \"params\": ", b->n_results ? "," : "", r->name);
+		bench_print_params(r->params);
+		printf(", \"ops\": %" PRIu64 ", \"ns_per_op\": %.1f, \"ops_per_sec\": %.1f",
+		       r->n_ops, ns_per_op, ops_per_sec);
+		if (r->bytes)
+			printf(", \"mb_per_sec\": %.1f", mb_per_sec);
+		if (r->have_latency)
+			printf(", \"latency_ns\": { \"min\": %" PRIu64 ", \"p50\": %" PRIu64
+			       ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64 " }",
+			       r->min, r->p50, r->p99, r->max);
+		printf(" }");
+	} else {
+		printf("%-12s %-32s %10.1f ns/op", r->name, r->params ? r->params : "", ns_per_op);
+		if (r->bytes)
+			printf(" %10.1f MB/s", mb_per_sec);
+		if (r->have_latency)
+			printf("  min %" PRIu64 " p50 %" PRIu64 " p99 %" PRIu64 " max %" PRIu64,
+			       r->min, r->p50, r->p99, r->max);
+		printf("\n");
+	}
+	b->n_results++;
+}
+
+static inline int bench_finish(struct bench *b)
+{
+	if (b->json)
+		printf("\n] }\n");
+	return 0;
+}
+
+#endif /* __SPA_TESTS_BENCH_H__ */
@@ -0,0 +1,144 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include <spa/type-map.h>
+#include <spa/type-map-impl.h>
+#include <spa/format-builder.h>
+#include <spa/format-utils.h>
+#include <spa/video/format-utils.h>
+
+#include <lib/arena.h>
+#include <lib/format.h>
+
+#define N_FRACTIONS	1000
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+
+static struct {
+	uint32_t format;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
+} type = { 0, };
+
+static inline void type_init(struct spa_type_map *map)
+{
+	type.format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_media_type_map(map, &type.media_type);
+	spa_type_media_subtype_map(map, &type.media_subtype);
+	spa_type_format_video_map(map, &type.format_video);
+	spa_type_video_format_map(map, &type.video_format);
+}
+
+/* build a format with many framerates like v4l2 does for a camera with many
+ * discrete frame intervals */
+static struct spa_format *build_format(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+	struct spa_pod_prop *prop;
+	int i;
+
+	spa_pod_builder_push_format(b, &f[0], type.format,
+				    type.media_type.video, type.media_subtype.raw);
+	spa_pod_builder_push_prop(b, &f[1], type.format_video.framerate,
+				  SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+	spa_pod_builder_fraction(b, 1, 1);
+	for (i = 1; i <= N_FRACTIONS; i++)
+		spa_pod_builder_fraction(b, i, 1);
+	spa_pod_builder_pop(b, &f[1]);
+	spa_pod_builder_pop(b, &f[0]);
+
+	/* the pod did not fit */
+	if (b->offset > b->size)
+		return NULL;
+
+	prop = SPA_POD_BUILDER_DEREF(b, f[1].ref, struct spa_pod_prop);
+	assert(SPA_POD_PROP_N_VALUES(prop) == N_FRACTIONS + 1);
+
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+static struct spa_format *build_filter(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], type.format,
+		type.media_type.video, type.media_subtype.raw,
+		SPA_POD_PROP(&f[1], type.format_video.framerate,
+			SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET,
+			SPA_POD_TYPE_FRACTION, 3,
+			30, 1,
+			1, 1,
+			500, 1));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t buffer[1024], filter_buffer[256];
+	struct spa_pod_builder b;
+	struct spa_pod_arena arena = SPA_POD_ARENA_INIT, result = SPA_POD_ARENA_INIT;
+	struct spa_format *format, *filter, *filtered;
+	struct spa_pod_prop *prop;
+	void *data;
+
+	type_init(&default_map.map);
+
+	/* a fixed buffer is too small */
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	assert(build_format(&b) == NULL);
+
+	spa_pod_builder_init(&b, filter_buffer, sizeof(filter_buffer));
+	filter = build_filter(&b);
+
+	/* the arena grows */
+	spa_pod_arena_builder(&arena, &b);
+	format = build_format(&b);
+	assert(format != NULL);
+	assert(b.offset <= arena.size);
+	assert(SPA_POD_SIZE(format) == b.offset);
+
+	spa_pod_arena_builder(&result, &b);
+	assert(spa_format_filter(format, filter, &b) == SPA_RESULT_OK);
+	filtered = SPA_POD_BUILDER_DEREF(&b, 0, struct spa_format);
+	prop = spa_format_find_prop(filtered, type.format_video.framerate);
+	assert(prop != NULL);
+	assert(SPA_POD_PROP_N_VALUES(prop) == 500 + 1);
+
+	/* the memory is reused */
+	data = arena.data;
+	spa_pod_arena_builder(&arena, &b);
+	assert(build_format(&b) != NULL);
+	assert(arena.data == data);
+
+	printf("format %zd bytes, filtered %zd bytes, arenas %u %u bytes\n",
+	       SPA_POD_SIZE(format), SPA_POD_SIZE(filtered), arena.size, result.size);
+
+	spa_pod_arena_clear(&arena);
+	spa_pod_arena_clear(&result);
+	assert(arena.data == NULL && arena.size == 0);
+
+	return 0;
+}
@@ -0,0 +1,484 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Encode generated frames with the ffmpeg encoder, decode the packets
+ * again and check that the frames come back. The nodes are driven
+ * directly with process_input() and process_output().
+ *
+ *   test-ffmpeg <libspa-ffmpeg.so>
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+
+#include <spa/node.h>
+#include <spa/log-impl.h>
+#include <spa/type-map-impl.h>
+#include <spa/video/format-utils.h>
+#include <spa/format-builder.h>
+
+#define WIDTH		320
+#define HEIGHT		240
+#define FRAME_SIZE	(WIDTH * HEIGHT * 3 / 2)
+#define N_FRAMES	50
+#define N_BUFFERS	8
+#define MAX_PACKET	(FRAME_SIZE + 16384)
+#define MAX_FRAME	(WIDTH * HEIGHT * 4 + 65536)
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+static SPA_LOG_IMPL(default_log);
+
+struct type {
+	uint32_t node;
+	uint32_t format;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_video media_subtype_video;
+	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
+	struct spa_type_command_node command_node;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_media_subtype_video_map(map, &type->media_subtype_video);
+	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
+	spa_type_command_node_map(map, &type->command_node);
+}
+
+struct buffer {
+	struct spa_buffer buffer;
+	struct spa_data datas[1];
+	struct spa_chunk chunks[1];
+	bool busy;
+};
+
+struct node {
+	struct data *data;
+	struct spa_handle *handle;
+	struct spa_node *node;
+
+	struct spa_port_io in_io;
+	struct spa_port_io out_io;
+	struct buffer in_buffers[N_BUFFERS];
+	struct buffer out_buffers[N_BUFFERS];
+	uint32_t n_in_buffers;
+};
+
+struct packet {
+	uint8_t *data;
+	uint32_t size;
+};
+
+struct data {
+	struct type type;
+	struct spa_support support[2];
+	uint32_t n_support;
+
+	struct node enc;
+	struct node dec;
+
+	struct packet packets[N_FRAMES * 2];
+	uint32_t n_packets;
+	uint32_t n_decoded;
+	uint64_t diff;
+};
+
+static void init_buffer(struct data *data, struct buffer *b, uint32_t id, size_t size)
+{
+	b->buffer.id = id;
+	b->buffer.n_metas = 0;
+	b->buffer.metas = NULL;
+	b->buffer.n_datas = 1;
+	b->buffer.datas = b->datas;
+
+	b->datas[0].type = data->type.data.MemPtr;
+	b->datas[0].flags = 0;
+	b->datas[0].fd = -1;
+	b->datas[0].mapoffset = 0;
+	b->datas[0].maxsize = size;
+	/* the decoder writes in the buffers when they are aligned */
+	b->datas[0].data = aligned_alloc(64, SPA_ROUND_UP_N(size, 64));
+	b->datas[0].chunk = &b->chunks[0];
+	b->datas[0].chunk->offset = 0;
+	b->datas[0].chunk->size = 0;
+	b->datas[0].chunk->stride = 0;
+	b->busy = false;
+}
+
+static void clear_buffer(struct buffer *b)
+{
+	free(b->datas[0].data);
+}
+
+static void on_reuse_buffer(void *user_data, uint32_t port_id, uint32_t buffer_id)
+{
+	struct node *n = user_data;
+
+	n->in_buffers[buffer_id].busy = false;
+}
+
+static void on_have_output(void *user_data)
+{
+}
+
+static const struct spa_node_callbacks node_callbacks = {
+	SPA_VERSION_NODE_CALLBACKS,
+	.have_output = on_have_output,
+	.reuse_buffer = on_reuse_buffer,
+};
+
+static int make_node(struct data *data, struct node *n, const char *lib, const char *name)
+{
+	spa_handle_factory_enum_func_t enum_func;
+	const struct spa_handle_factory *factory;
+	void *hnd, *iface;
+	uint32_t i;
+	int res;
+
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		fprintf(stderr, "can't load %s: %s\n", lib, dlerror());
+		return SPA_RESULT_ERROR;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		fprintf(stderr, "can't find enum function\n");
+		return SPA_RESULT_ERROR;
+	}
+
+	for (i = 0; (res = enum_func(&factory, i)) == SPA_RESULT_OK; i++) {
+		if (strcmp(factory->name, name))
+			continue;
+
+		n->data = data;
+		n->handle = calloc(1, factory->size);
+		if ((res = spa_handle_factory_init(factory, n->handle, NULL,
+						   data->support, data->n_support)) < 0) {
+			fprintf(stderr, "can't make factory instance: %d\n", res);
+			return res;
+		}
+		if ((res = spa_handle_get_interface(n->handle, data->type.node, &iface)) < 0) {
+			fprintf(stderr, "can't get interface %d\n", res);
+			return res;
+		}
+		n->node = iface;
+		return spa_node_set_callbacks(n->node, &node_callbacks, n);
+	}
+	fprintf(stderr, "can't find factory %s\n", name);
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static void destroy_node(struct node *n)
+{
+	uint32_t i;
+
+	spa_handle_clear(n->handle);
+	free(n->handle);
+
+	for (i = 0; i < N_BUFFERS; i++) {
+		clear_buffer(&n->in_buffers[i]);
+		clear_buffer(&n->out_buffers[i]);
+	}
+}
+
+static struct spa_format *
+make_raw_format(struct data *data, struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], data->type.format,
+		data->type.media_type.video,
+		data->type.media_subtype.raw,
+		SPA_POD_PROP(&f[1], data->type.format_video.format, 0, SPA_POD_TYPE_ID, 1,
+			data->type.video_format.I420),
+		SPA_POD_PROP(&f[1], data->type.format_video.size, 0, SPA_POD_TYPE_RECTANGLE, 1,
+			WIDTH, HEIGHT),
+		SPA_POD_PROP(&f[1], data->type.format_video.framerate, 0, SPA_POD_TYPE_FRACTION, 1,
+			25, 1));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+static struct spa_format *
+make_mpeg_format(struct data *data, struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(b, &f[0], data->type.format,
+		data->type.media_type.video,
+		data->type.media_subtype_video.mpeg1,
+		SPA_POD_PROP(&f[1], data->type.format_video.size, 0, SPA_POD_TYPE_RECTANGLE, 1,
+			WIDTH, HEIGHT),
+		SPA_POD_PROP(&f[1], data->type.format_video.framerate, 0, SPA_POD_TYPE_FRACTION, 1,
+			25, 1));
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+static int setup_node(struct data *data, struct node *n,
+		      struct spa_format *in_format, size_t in_size,
+		      struct spa_format *out_format, size_t out_size)
+{
+	struct spa_buffer *in_buffers[N_BUFFERS], *out_buffers[N_BUFFERS];
+	uint32_t i;
+	int res;
+
+	n->in_io = SPA_PORT_IO_INIT;
+	n->out_io = SPA_PORT_IO_INIT;
+
+	if ((res = spa_node_port_set_io(n->node, SPA_DIRECTION_INPUT, 0, &n->in_io)) < 0 ||
+	    (res = spa_node_port_set_io(n->node, SPA_DIRECTION_OUTPUT, 0, &n->out_io)) < 0 ||
+	    (res = spa_node_port_set_format(n->node, SPA_DIRECTION_INPUT, 0, 0, in_format)) < 0 ||
+	    (res = spa_node_port_set_format(n->node, SPA_DIRECTION_OUTPUT, 0, 0, out_format)) < 0)
+		return res;
+
+	for (i = 0; i < N_BUFFERS; i++) {
+		init_buffer(data, &n->in_buffers[i], i, in_size);
+		init_buffer(data, &n->out_buffers[i], i, out_size);
+		in_buffers[i] = &n->in_buffers[i].buffer;
+		out_buffers[i] = &n->out_buffers[i].buffer;
+	}
+	n->n_in_buffers = N_BUFFERS;
+
+	if ((res = spa_node_port_use_buffers(n->node, SPA_DIRECTION_INPUT, 0,
+					     in_buffers, N_BUFFERS)) < 0 ||
+	    (res = spa_node_port_use_buffers(n->node, SPA_DIRECTION_OUTPUT, 0,
+					     out_buffers, N_BUFFERS)) < 0)
+		return res;
+
+	return spa_node_send_command(n->node,
+			&SPA_COMMAND_INIT(data->type.command_node.Start));
+}
+
+static uint8_t pixel(uint32_t frame, uint32_t x, uint32_t y)
+{
+	return (x + y + frame * 4) & 0xff;
+}
+
+static void fill_frame(struct buffer *b, uint32_t frame)
+{
+	struct spa_data *d = b->datas;
+	uint8_t *p = d[0].data;
+	uint32_t x, y;
+
+	for (y = 0; y < HEIGHT; y++)
+		for (x = 0; x < WIDTH; x++)
+			p[y * WIDTH + x] = pixel(frame, x, y);
+	memset(p + WIDTH * HEIGHT, 128, WIDTH * HEIGHT / 2);
+
+	d[0].chunk->offset = 0;
+	d[0].chunk->size = FRAME_SIZE;
+	d[0].chunk->stride = WIDTH;
+}
+
+static void take_packet(struct node *n, struct buffer *b)
+{
+	struct data *data = n->data;
+	struct spa_data *d = b->datas;
+	struct packet *p;
+
+	if (data->n_packets == SPA_N_ELEMENTS(data->packets))
+		return;
+
+	p = &data->packets[data->n_packets++];
+	p->size = d[0].chunk->size;
+	p->data = malloc(p->size);
+	memcpy(p->data, SPA_MEMBER(d[0].data, d[0].chunk->offset, void), p->size);
+}
+
+/* compare the luma with the frame that was encoded, the frames come out of
+ * the decoder in the same order */
+static void take_frame(struct node *n, struct buffer *b)
+{
+	struct data *data = n->data;
+	struct spa_data *d = b->datas;
+	uint8_t *p = SPA_MEMBER(d[0].data, d[0].chunk->offset, uint8_t);
+	int stride = d[0].chunk->stride;
+	uint32_t x, y;
+
+	for (y = 0; y < HEIGHT; y++)
+		for (x = 0; x < WIDTH; x++)
+			data->diff += abs((int) p[y * stride + x] -
+					  (int) pixel(data->n_decoded, x, y));
+	data->n_decoded++;
+}
+
+/* take all the buffers that the node has ready */
+static void pull_output(struct node *n, void (*take) (struct node *n, struct buffer *b))
+{
+	while (n->out_io.status == SPA_RESULT_HAVE_BUFFER) {
+		take(n, &n->out_buffers[n->out_io.buffer_id]);
+
+		/* the node recycles the buffer in the io area */
+		n->out_io.status = SPA_RESULT_NEED_BUFFER;
+		if (spa_node_process_output(n->node) != SPA_RESULT_HAVE_BUFFER)
+			break;
+	}
+}
+
+static struct buffer *get_input_buffer(struct node *n)
+{
+	uint32_t i;
+
+	for (i = 0; i < n->n_in_buffers; i++)
+		if (!n->in_buffers[i].busy)
+			return &n->in_buffers[i];
+	return NULL;
+}
+
+/* push one input buffer and take the output it makes */
+static int push_input(struct node *n, struct buffer *b,
+		      void (*take) (struct node *n, struct buffer *b))
+{
+	int res, retry;
+
+	b->busy = true;
+	n->in_io.buffer_id = b->buffer.id;
+	n->in_io.status = SPA_RESULT_HAVE_BUFFER;
+
+	for (retry = 0; n->in_io.status == SPA_RESULT_HAVE_BUFFER && retry < 100; retry++) {
+		res = spa_node_process_input(n->node);
+		if (res != SPA_RESULT_HAVE_BUFFER && res != SPA_RESULT_NEED_BUFFER) {
+			fprintf(stderr, "process_input failed: %d\n", res);
+			return res;
+		}
+		pull_output(n, take);
+	}
+	if (n->in_io.status == SPA_RESULT_HAVE_BUFFER) {
+		fprintf(stderr, "input buffer %u not consumed\n", b->buffer.id);
+		return SPA_RESULT_ERROR;
+	}
+	/* an invalid id means that the node keeps the buffer and gives it
+	 * back with reuse_buffer */
+	if (n->in_io.buffer_id != SPA_ID_INVALID)
+		b->busy = false;
+
+	return SPA_RESULT_OK;
+}
+
+static void drain(struct data *data, struct node *n,
+		  void (*take) (struct node *n, struct buffer *b))
+{
+	spa_node_send_command(n->node, &SPA_COMMAND_INIT(data->type.command_node.Drain));
+	pull_output(n, take);
+	/* the last ones waited for a free buffer */
+	while (spa_node_process_output(n->node) == SPA_RESULT_HAVE_BUFFER)
+		pull_output(n, take);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { { 0, }, };
+	struct spa_pod_builder b = { NULL, };
+	uint8_t buffer[1024];
+	struct spa_format *raw, *mpeg;
+	struct buffer *in;
+	uint32_t i;
+	uint64_t avg;
+	int res;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <ffmpeg lib>\n", argv[0]);
+		return 1;
+	}
+
+	default_log.log.level = SPA_LOG_LEVEL_WARN;
+
+	data.support[0] = SPA_SUPPORT_INIT(SPA_TYPE__TypeMap, &default_map.map);
+	data.support[1] = SPA_SUPPORT_INIT(SPA_TYPE__Log, &default_log.log);
+	data.n_support = 2;
+	init_type(&data.type, &default_map.map);
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	raw = make_raw_format(&data, &b);
+	mpeg = make_mpeg_format(&data, &b);
+
+	/* ffmpeg can be built without the codecs */
+	if ((res = make_node(&data, &data.enc, argv[1], "ffenc_mpeg1video")) >= 0)
+		res = make_node(&data, &data.dec, argv[1], "ffdec_mpeg1video");
+	if (res == SPA_RESULT_NOT_IMPLEMENTED) {
+		fprintf(stderr, "no mpeg1video codec, skipping\n");
+		return 77;
+	}
+	if (res < 0) {
+		fprintf(stderr, "can't make nodes: %d\n", res);
+		return 1;
+	}
+	if ((res = setup_node(&data, &data.enc, raw, FRAME_SIZE, mpeg, MAX_PACKET)) < 0) {
+		fprintf(stderr, "can't make encoder: %d\n", res);
+		return 1;
+	}
+	if ((res = setup_node(&data, &data.dec, mpeg, MAX_PACKET, raw, MAX_FRAME)) < 0) {
+		fprintf(stderr, "can't make decoder: %d\n", res);
+		return 1;
+	}
+
+	for (i = 0; i < N_FRAMES; i++) {
+		if ((in = get_input_buffer(&data.enc)) == NULL) {
+			fprintf(stderr, "encoder keeps all input buffers\n");
+			return 1;
+		}
+		fill_frame(in, i);
+		if (push_input(&data.enc, in, take_packet) < 0)
+			return 1;
+	}
+	drain(&data, &data.enc, take_packet);
+
+	printf("encoded %u frames in %u packets\n", N_FRAMES, data.n_packets);
+
+	for (i = 0; i < data.n_packets; i++) {
+		struct spa_data *d;
+
+		in = &data.dec.in_buffers[0];
+		d = in->datas;
+		memcpy(d[0].data, data.packets[i].data, data.packets[i].size);
+		d[0].chunk->offset = 0;
+		d[0].chunk->size = data.packets[i].size;
+
+		if (push_input(&data.dec, in, take_frame) < 0)
+			return 1;
+		free(data.packets[i].data);
+	}
+	drain(&data, &data.dec, take_frame);
+
+	destroy_node(&data.enc);
+	destroy_node(&data.dec);
+
+	avg = data.n_decoded ? data.diff / ((uint64_t) data.n_decoded * WIDTH * HEIGHT) : 0;
+	printf("decoded %u frames, average luma difference %" PRIu64 "\n", data.n_decoded, avg);
+
+	if (data.n_decoded != N_FRAMES) {
+		fprintf(stderr, "expected %u frames\n", N_FRAMES);
+		return 1;
+	}
+	if (avg > 8) {
+		fprintf(stderr, "decoded frames differ too much\n");
+		return 1;
+	}
+	return 0;
+}
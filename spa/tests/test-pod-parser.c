@@ -0,0 +1,237 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Fuzz the pod parser with random mutations of a valid message.
+ *
+ * Every message that the parser accepts is walked completely with the
+ * unchecked SPA_POD_FOREACH macros. Run under valgrind or build with
+ * -fsanitize=address to catch reads outside of the message.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include <spa/pod-builder.h>
+#include <spa/pod-parser.h>
+
+#define DEFAULT_ITERATIONS	1000000
+
+static uint32_t sum;
+
+static void walk(struct spa_pod *pod, uint32_t depth)
+{
+	struct spa_pod *p;
+
+	assert(depth <= SPA_POD_MAX_DEPTH);
+
+	switch (pod->type) {
+	case SPA_POD_TYPE_INT:
+		sum += SPA_POD_VALUE(struct spa_pod_int, pod);
+		break;
+	case SPA_POD_TYPE_STRING:
+		sum += strlen(SPA_POD_CONTENTS(struct spa_pod_string, pod));
+		break;
+	case SPA_POD_TYPE_ARRAY:
+	{
+		struct spa_pod_array *a = (struct spa_pod_array *) pod;
+		uint8_t *e;
+
+		SPA_POD_ARRAY_BODY_FOREACH(&a->body, SPA_POD_BODY_SIZE(pod), e)
+			sum += *e;
+		break;
+	}
+	case SPA_POD_TYPE_STRUCT:
+		SPA_POD_CONTENTS_FOREACH(pod, sizeof(struct spa_pod_struct), p)
+			walk(p, depth + 1);
+		break;
+	case SPA_POD_TYPE_OBJECT:
+	{
+		struct spa_pod_object *obj = (struct spa_pod_object *) pod;
+
+		SPA_POD_OBJECT_FOREACH(obj, p)
+			walk(p, depth + 1);
+		break;
+	}
+	case SPA_POD_TYPE_PROP:
+	{
+		struct spa_pod_prop *prop = (struct spa_pod_prop *) pod;
+		uint8_t *alt;
+
+		walk(&prop->body.value, depth + 1);
+		SPA_POD_PROP_ALTERNATIVE_FOREACH(&prop->body, SPA_POD_BODY_SIZE(pod), alt)
+			sum += *alt;
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+static uint32_t build_message(uint8_t *buffer, uint32_t size)
+{
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, size);
+	struct spa_pod_frame f[4];
+	int32_t array[] = { 1, 2, 3, 4, 5 };
+
+	spa_pod_builder_add(&b,
+			    SPA_POD_TYPE_STRUCT, &f[0],
+			    SPA_POD_TYPE_STRING, "factory",
+			    SPA_POD_TYPE_ID, 12,
+			    SPA_POD_TYPE_INT, 1,
+			    SPA_POD_TYPE_INT, 2,
+			    SPA_POD_TYPE_STRING, "media.class",
+			    SPA_POD_TYPE_STRING, "Audio/Sink",
+			    SPA_POD_TYPE_STRING, "node.name",
+			    SPA_POD_TYPE_STRING, "test", 0);
+
+	spa_pod_builder_add(&b,
+			    SPA_POD_TYPE_OBJECT, &f[1], 0, 1,
+			    SPA_POD_PROP(&f[2], 1, SPA_POD_PROP_RANGE_MIN_MAX,
+					 SPA_POD_TYPE_INT, 3, 44100, 1, INT32_MAX),
+			    SPA_POD_PROP(&f[2], 2, SPA_POD_PROP_RANGE_ENUM,
+					 SPA_POD_TYPE_ID, 3, 1, 2, 3),
+			    -SPA_POD_TYPE_OBJECT, &f[1], 0);
+
+	spa_pod_builder_add(&b,
+			    SPA_POD_TYPE_STRUCT, &f[1],
+			    SPA_POD_TYPE_INT, 1,
+			    SPA_POD_TYPE_LONG, (int64_t) 2,
+			    SPA_POD_TYPE_STRUCT, &f[2],
+			    SPA_POD_TYPE_ARRAY, &f[3], SPA_POD_TYPE_INT, 5,
+			    array[0], array[1], array[2], array[3], array[4],
+			    -SPA_POD_TYPE_ARRAY, &f[3],
+			    -SPA_POD_TYPE_STRUCT, &f[2],
+			    -SPA_POD_TYPE_STRUCT, &f[1],
+			    SPA_POD_TYPE_INT, 42,
+			    -SPA_POD_TYPE_STRUCT, &f[0], 0);
+
+	return b.offset;
+}
+
+static void check_valid(uint8_t *buffer, uint32_t size)
+{
+	struct spa_pod_parser parser;
+	uint32_t offsets[SPA_POD_PARSER_MAX_FIELDS(4096)];
+	const char *factory, *key, *value;
+	uint32_t type, version, n_items, i, last;
+	struct spa_pod_object *obj;
+	struct spa_pod *s;
+
+	assert(spa_pod_validate((struct spa_pod *) buffer, size));
+	assert(spa_pod_parser_init(&parser, buffer, size, offsets, SPA_N_ELEMENTS(offsets)));
+	assert(parser.n_fields == 11);
+
+	assert(spa_pod_parser_get(&parser,
+				  SPA_POD_TYPE_STRING, &factory,
+				  SPA_POD_TYPE_ID, &type,
+				  SPA_POD_TYPE_INT, &version,
+				  SPA_POD_TYPE_INT, &n_items, 0));
+	assert(strcmp(factory, "factory") == 0);
+	assert(type == 12 && version == 1 && n_items == 2);
+	for (i = 0; i < n_items; i++)
+		assert(spa_pod_parser_get(&parser,
+					  SPA_POD_TYPE_STRING, &key,
+					  SPA_POD_TYPE_STRING, &value, 0));
+	assert(strcmp(key, "node.name") == 0 && strcmp(value, "test") == 0);
+	assert(spa_pod_parser_get(&parser,
+				  SPA_POD_TYPE_OBJECT, &obj,
+				  SPA_POD_TYPE_STRUCT, &s,
+				  SPA_POD_TYPE_INT, &last, 0));
+	assert(last == 42);
+	assert(spa_pod_parser_remaining(&parser) == 0);
+	assert(!spa_pod_parser_get(&parser, SPA_POD_TYPE_INT, &last, 0));
+
+	/* random access */
+	assert(spa_pod_parser_field(&parser, 10)->type == SPA_POD_TYPE_INT);
+	assert(spa_pod_parser_field(&parser, 11) == NULL);
+	assert(spa_pod_parser_seek(&parser, 1));
+	assert(spa_pod_parser_get(&parser, SPA_POD_TYPE_ID, &type, 0) && type == 12);
+	assert(!spa_pod_parser_seek(&parser, 12));
+
+	/* not enough room for the index */
+	assert(!spa_pod_parser_init(&parser, buffer, size, offsets, 10));
+	/* truncated */
+	for (i = 0; i < size; i++)
+		assert(!spa_pod_parser_init(&parser, buffer, i, offsets, SPA_N_ELEMENTS(offsets)));
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t buffer[4096], message[4096];
+	uint32_t offsets[SPA_POD_PARSER_MAX_FIELDS(4096)];
+	uint32_t size, i, j, accepted = 0;
+	int n_iterations;
+	unsigned int seed;
+
+	n_iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+	seed = argc > 2 ? atoi(argv[2]) : 0;
+	srand(seed);
+
+	size = build_message(buffer, sizeof(buffer));
+	check_valid(buffer, size);
+
+	for (i = 0; i < n_iterations; i++) {
+		struct spa_pod_parser parser;
+		uint32_t msize = size, n_mutations = 1 + rand() % 4;
+
+		memcpy(message, buffer, size);
+
+		for (j = 0; j < n_mutations; j++) {
+			uint32_t pos = rand() % size;
+
+			switch (rand() % 4) {
+			case 0:
+				/* flip a bit */
+				message[pos] ^= 1 << (rand() % 8);
+				break;
+			case 1:
+				/* random byte */
+				message[pos] = rand();
+				break;
+			case 2:
+				/* corrupt a size or type with an interesting value */
+			{
+				static const uint32_t values[] = {
+					0, 1, 4, 7, 8, 0x7fffffff, 0x80000000, 0xfffffff8, 0xffffffff
+				};
+				uint32_t *p = SPA_MEMBER(message, pos & ~3, uint32_t);
+				*p = values[rand() % SPA_N_ELEMENTS(values)];
+				break;
+			}
+			case 3:
+				/* truncate */
+				msize = pos;
+				break;
+			}
+		}
+
+		if (!spa_pod_parser_init(&parser, message, msize, offsets, SPA_N_ELEMENTS(offsets)))
+			continue;
+
+		accepted++;
+		for (j = 0; j < parser.n_fields; j++)
+			walk(spa_pod_parser_field(&parser, j), 1);
+	}
+
+	printf("%d iterations, %u accepted (%u)\n", n_iterations, accepted, sum);
+
+	return 0;
+}
@@ -0,0 +1,224 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Offline test of the rate matching between two devices that run on
+ * different crystals, without hardware.
+ *
+ * A source and a sink are simulated with synthetic clocks that are off
+ * by some ppm from their nominal rate and that report the start of their
+ * periods with jitter. The source fills a fifo, the resampler takes the
+ * input it needs from the fifo for every period of the sink. The rate of
+ * the resampler is steered with the rates measured by a delay-locked loop
+ * on each clock and a small correction for the fill level of the fifo.
+ *
+ * The test fails when the fifo under- or overruns, when the fill level
+ * does not stay around its target or when the measured rates are wrong.
+ *
+ *   test-resample-drift [-v]
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <spa/dll.h>
+
+#include "resample.h"
+
+#define PERIOD		256
+#define FIFO_SIZE	16384
+#define TARGET		(4 * PERIOD)
+#define DLL_BW		0.05		/* Hz */
+#define JITTER		100e-6		/* seconds */
+#define DURATION	600.0		/* seconds of simulated time */
+#define SETTLE		60.0		/* seconds before the level is checked */
+#define MAX_LEVEL_ERR	(2 * PERIOD)
+#define MAX_RATE_ERR	2.0		/* ppm */
+
+struct device {
+	uint32_t rate;		/* nominal rate */
+	double ppm;		/* error of the crystal */
+	double next;		/* time of the next period */
+	struct spa_dll dll;
+};
+
+struct scenario {
+	uint32_t in_rate;
+	double in_ppm;
+	uint32_t out_rate;
+	double out_ppm;
+	bool correct;		/* steer the rate of the resampler */
+};
+
+static bool verbose = false;
+static uint32_t seed = 1;
+
+/* deterministic jitter between -JITTER and JITTER */
+static double jitter(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return ((double) ((seed >> 8) & 0xffff) / 0x8000 - 1.0) * JITTER;
+}
+
+static void device_init(struct device *d, uint32_t rate, double ppm)
+{
+	d->rate = rate;
+	d->ppm = ppm;
+	d->next = 0.0;
+	spa_dll_init(&d->dll, DLL_BW, PERIOD, rate);
+}
+
+static double device_actual_rate(struct device *d)
+{
+	return d->rate * (1.0 + d->ppm * 1e-6);
+}
+
+/* the device reports the start of a period and schedules the next one */
+static void device_period(struct device *d)
+{
+	spa_dll_update(&d->dll, d->next + jitter());
+	d->next += PERIOD / device_actual_rate(d);
+}
+
+static double rate_error_ppm(struct device *d)
+{
+	return (spa_dll_get_rate(&d->dll) / device_actual_rate(d) - 1.0) * 1e6;
+}
+
+static int run(const struct scenario *s)
+{
+	struct device src, sink;
+	struct resample r;
+	float *fifo, out[PERIOD];
+	uint32_t level = TARGET, i, underruns = 0, overruns = 0;
+	double avg_level = TARGET, t = 0.0, min_level = FIFO_SIZE, max_level = 0.0;
+	double rate = 1.0, src_err, sink_err;
+	uint64_t phase = 0;
+	int res;
+
+	if ((res = resample_init(&r, 1, s->in_rate, s->out_rate,
+				 RESAMPLE_DEFAULT_QUALITY, RESAMPLE_CPU_SSE)) < 0)
+		return res;
+
+	fifo = calloc(FIFO_SIZE, sizeof(float));
+
+	device_init(&src, s->in_rate, s->in_ppm);
+	device_init(&sink, s->out_rate, s->out_ppm);
+	/* the devices don't start at the same time */
+	sink.next = 0.3 * PERIOD / s->out_rate;
+
+	while (t < DURATION) {
+		if (src.next <= sink.next) {
+			t = src.next;
+			device_period(&src);
+
+			if (level + PERIOD > FIFO_SIZE) {
+				overruns++;
+				continue;
+			}
+			for (i = 0; i < PERIOD; i++, phase++)
+				fifo[level + i] = sin(phase * 2.0 * M_PI * 1000.0 / s->in_rate);
+			level += PERIOD;
+		} else {
+			uint32_t in_len, out_len = PERIOD;
+
+			t = sink.next;
+			device_period(&sink);
+
+			in_len = resample_in_len(&r, PERIOD);
+			if (in_len > level) {
+				underruns++;
+				continue;
+			}
+			resample_process(&r, fifo, &in_len, out, &out_len);
+			level -= in_len;
+			memmove(fifo, &fifo[in_len], level * sizeof(float));
+
+			avg_level += (level - avg_level) * 0.01;
+			if (t > SETTLE) {
+				min_level = SPA_MIN(min_level, avg_level);
+				max_level = SPA_MAX(max_level, avg_level);
+			}
+
+			if (!s->correct)
+				continue;
+
+			/* consume the input as fast as the source makes it and
+			 * slowly move the level back to the target */
+			rate = (spa_dll_get_rate(&src.dll) / s->in_rate) /
+			       (spa_dll_get_rate(&sink.dll) / s->out_rate);
+			rate *= 1.0 + (avg_level - TARGET) * 1e-7;
+			resample_update_rate(&r, rate);
+		}
+	}
+	src_err = rate_error_ppm(&src);
+	sink_err = rate_error_ppm(&sink);
+
+	if (verbose)
+		printf("  rate %.8f, level %.0f..%.0f, src err %.3f ppm, sink err %.3f ppm\n",
+		       rate, min_level, max_level, src_err, sink_err);
+
+	res = 0;
+	if (!s->correct) {
+		/* without correction, the fifo must drift away */
+		if (underruns == 0 && overruns == 0 &&
+		    fabs(max_level - min_level) < MAX_LEVEL_ERR)
+			res = -1;
+	} else {
+		if (underruns || overruns)
+			res = -1;
+		if (min_level < TARGET - MAX_LEVEL_ERR || max_level > TARGET + MAX_LEVEL_ERR)
+			res = -1;
+		if (fabs(src_err) > MAX_RATE_ERR || fabs(sink_err) > MAX_RATE_ERR)
+			res = -1;
+	}
+	printf("%s: %u (%+.0f ppm) -> %u (%+.0f ppm)%s: %u underruns %u overruns\n",
+	       res == 0 ? "PASS" : "FAIL",
+	       s->in_rate, s->in_ppm, s->out_rate, s->out_ppm,
+	       s->correct ? "" : " uncorrected", underruns, overruns);
+
+	free(fifo);
+	resample_free(&r);
+
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct scenario scenarios[] = {
+		{ 48000,    0.0, 48000,    0.0, true },
+		{ 48000,  +80.0, 48000,  -60.0, true },
+		{ 48000, -120.0, 48000,  +40.0, true },
+		{ 44100,  -50.0, 48000,  +50.0, true },
+		{ 48000,  +30.0, 44100,  +30.0, true },
+		{ 48000,  +80.0, 48000,  -60.0, false },
+	};
+	uint32_t i;
+	int failed = 0;
+
+	if (argc > 1 && strcmp(argv[1], "-v") == 0)
+		verbose = true;
+
+	for (i = 0; i < SPA_N_ELEMENTS(scenarios); i++) {
+		if (run(&scenarios[i]) < 0)
+			failed++;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,409 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Format the messages of a binary log dump, see spa/log-binary.h.
+ *
+ * A file can contain more than one dump. The string pointers are only
+ * valid within one dump, the messages of the threads in a dump are
+ * merged and printed in order of time. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <spa/log-binary.h>
+
+struct string {
+	uint64_t ptr;
+	const char *str;
+};
+
+struct message {
+	const struct spa_log_binary_record *rec;
+	uint32_t tid;
+	uint32_t index;
+};
+
+struct dump {
+	struct string *strings;
+	uint32_t n_strings;
+	struct message *messages;
+	uint32_t n_messages;
+	uint64_t dropped;
+};
+
+static const char *levels[] = { "-", "E", "W", "I", "D", "T" };
+
+static int compare_string(const void *a, const void *b)
+{
+	const struct string *sa = a, *sb = b;
+
+	return sa->ptr < sb->ptr ? -1 : sa->ptr > sb->ptr;
+}
+
+static int compare_message(const void *a, const void *b)
+{
+	const struct message *ma = a, *mb = b;
+
+	if (ma->rec->time != mb->rec->time)
+		return ma->rec->time < mb->rec->time ? -1 : 1;
+	return ma->index < mb->index ? -1 : ma->index > mb->index;
+}
+
+static const char *lookup(struct dump *d, uint64_t ptr)
+{
+	struct string key = { ptr, }, *s;
+
+	s = bsearch(&key, d->strings, d->n_strings, sizeof(struct string), compare_string);
+	return s ? s->str : NULL;
+}
+
+/* format one conversion of the message with the arguments in args,
+ * star width and precision come first */
+static int format_spec(char *buf, size_t size, const char *spec,
+		       const struct spa_log_binary_spec *s,
+		       const uint64_t *ints, int n_ints, const uint64_t *value,
+		       const char *str)
+{
+	union { double d; uint64_t u; } val;
+
+#define FORMAT(v)								\
+	(n_ints == 2 ? snprintf(buf, size, spec, (int) ints[0], (int) ints[1], v) :	\
+	 n_ints == 1 ? snprintf(buf, size, spec, (int) ints[0], v) :			\
+		       snprintf(buf, size, spec, v))
+
+	switch (s->arg) {
+	case SPA_LOG_BINARY_ARG_INT:
+		return FORMAT((int) *value);
+	case SPA_LOG_BINARY_ARG_LONG:
+		return FORMAT((long) *value);
+	case SPA_LOG_BINARY_ARG_LONG_LONG:
+		return FORMAT((long long) *value);
+	case SPA_LOG_BINARY_ARG_SIZE:
+		return FORMAT((size_t) *value);
+	case SPA_LOG_BINARY_ARG_INTMAX:
+		return FORMAT((intmax_t) *value);
+	case SPA_LOG_BINARY_ARG_PTRDIFF:
+		return FORMAT((ptrdiff_t) *value);
+	case SPA_LOG_BINARY_ARG_DOUBLE:
+	case SPA_LOG_BINARY_ARG_LONG_DOUBLE:
+		val.u = *value;
+		return FORMAT(val.d);
+	case SPA_LOG_BINARY_ARG_POINTER:
+		if (s->end[-1] == 'n')
+			return 0;
+		return FORMAT((void *) (uintptr_t) *value);
+	case SPA_LOG_BINARY_ARG_STRING:
+	case SPA_LOG_BINARY_ARG_ERRNO:
+		return FORMAT(str);
+	default:
+		return 0;
+	}
+#undef FORMAT
+}
+
+static void print_message(struct dump *d, const struct message *m)
+{
+	const struct spa_log_binary_record *rec = m->rec;
+	const uint64_t *args = (const uint64_t *) (rec + 1);
+	const uint64_t *end = SPA_MEMBER(rec, rec->size, const uint64_t);
+	const char *fmt, *file, *func, *f, *slash;
+	struct spa_log_binary_spec s;
+	uint32_t n_args = 0;
+	char text[4096], spec[64], *p = text, *text_end = text + sizeof(text) - 1;
+
+	fmt = lookup(d, rec->fmt);
+	file = lookup(d, rec->file);
+	func = lookup(d, rec->func);
+
+	if (fmt == NULL) {
+		snprintf(text, sizeof(text), "<unknown format 0x%" PRIx64 ">", rec->fmt);
+		goto print;
+	}
+
+	for (f = fmt; p < text_end && spa_log_binary_next_spec(f, &s); f = s.end) {
+		uint64_t ints[2];
+		int n_ints = 0, len;
+		size_t spec_len;
+		const char *str = NULL;
+		const uint64_t *value = NULL;
+
+		len = SPA_MIN(s.start - f, text_end - p);
+		memcpy(p, f, len);
+		p += len;
+
+		if (s.arg == SPA_LOG_BINARY_ARG_NONE) {
+			if (s.end[-1] == '%' && s.end - s.start == 2)
+				*p++ = '%';
+			continue;
+		}
+
+		if (s.star_width && n_args < rec->n_args && args < end) {
+			ints[n_ints++] = *args++;
+			n_args++;
+		}
+		if (s.star_precision && n_args < rec->n_args && args < end) {
+			ints[n_ints++] = *args++;
+			n_args++;
+		}
+		if (n_args >= rec->n_args || args >= end ||
+		    n_ints != s.star_width + s.star_precision) {
+			f = s.start;
+			break;
+		}
+
+		value = args++;
+		if (s.arg == SPA_LOG_BINARY_ARG_STRING || s.arg == SPA_LOG_BINARY_ARG_ERRNO) {
+			str = (const char *) args;
+			args += SPA_ROUND_UP_N(*value, 8) / 8;
+			if (args > end || *value == 0 || str[*value - 1] != '\0') {
+				f = s.start;
+				break;
+			}
+		}
+		n_args++;
+
+		spec_len = SPA_MIN((size_t) (s.end - s.start), sizeof(spec) - 2);
+		memcpy(spec, s.start, spec_len);
+		spec[spec_len] = '\0';
+		if (s.arg == SPA_LOG_BINARY_ARG_LONG_DOUBLE) {
+			/* stored as a double */
+			char *l = strchr(spec, 'L');
+			if (l)
+				memmove(l, l + 1, strlen(l));
+		} else if (s.arg == SPA_LOG_BINARY_ARG_ERRNO)
+			spec[spec_len - 1] = 's';
+
+		len = format_spec(p, text_end - p + 1, spec, &s, ints, n_ints, value, str);
+		if (len > 0)
+			p += SPA_MIN(len, text_end - p);
+	}
+	/* the rest of the format, the conversions are printed as is when their
+	 * arguments did not fit in the record */
+	if (p < text_end) {
+		size_t len = SPA_MIN(strlen(f), (size_t) (text_end - p));
+		memcpy(p, f, len);
+		p += len;
+	}
+	*p = '\0';
+
+      print:
+	slash = file ? strrchr(file, '/') : NULL;
+	printf("[%s][%" PRIu64 ".%09" PRIu64 "][%u][%s:%u %s()] %s\n",
+	       rec->level < SPA_N_ELEMENTS(levels) ? levels[rec->level] : "?",
+	       (uint64_t) (rec->time / SPA_NSEC_PER_SEC), (uint64_t) (rec->time % SPA_NSEC_PER_SEC),
+	       m->tid,
+	       slash ? slash + 1 : file ? file : "?", rec->line,
+	       func ? func : "?", text);
+}
+
+static void flush_dump(struct dump *d)
+{
+	uint32_t i;
+
+	qsort(d->strings, d->n_strings, sizeof(struct string), compare_string);
+	qsort(d->messages, d->n_messages, sizeof(struct message), compare_message);
+
+	for (i = 0; i < d->n_messages; i++)
+		print_message(d, &d->messages[i]);
+
+	if (d->dropped)
+		printf("*** %" PRIu64 " messages dropped ***\n", d->dropped);
+
+	free(d->strings);
+	free(d->messages);
+	memset(d, 0, sizeof(struct dump));
+}
+
+static int add_thread(struct dump *d, const uint8_t *data, uint32_t size)
+{
+	const struct spa_log_binary_thread *thread = (const void *) data;
+	uint32_t offset;
+
+	if (size < sizeof(*thread))
+		return -1;
+
+	d->dropped += thread->dropped;
+
+	for (offset = sizeof(*thread); offset + sizeof(struct spa_log_binary_record) <= size;) {
+		const struct spa_log_binary_record *rec = (const void *) (data + offset);
+		struct message *m;
+
+		if (rec->size < sizeof(*rec) || offset + rec->size > size)
+			return -1;
+
+		if ((d->n_messages & 1023) == 0) {
+			m = realloc(d->messages, (d->n_messages + 1024) * sizeof(struct message));
+			if (m == NULL)
+				return -1;
+			d->messages = m;
+		}
+		m = &d->messages[d->n_messages];
+		m->rec = rec;
+		m->tid = thread->tid;
+		m->index = d->n_messages++;
+
+		offset += rec->size;
+	}
+	return 0;
+}
+
+static int add_string(struct dump *d, const uint8_t *data, uint32_t size)
+{
+	struct string *s;
+
+	if (size <= sizeof(uint64_t) || memchr(data + 8, 0, size - 8) == NULL)
+		return -1;
+
+	if ((d->n_strings & 255) == 0) {
+		s = realloc(d->strings, (d->n_strings + 256) * sizeof(struct string));
+		if (s == NULL)
+			return -1;
+		d->strings = s;
+	}
+	s = &d->strings[d->n_strings++];
+	memcpy(&s->ptr, data, sizeof(uint64_t));
+	s->str = (const char *) (data + sizeof(uint64_t));
+
+	return 0;
+}
+
+static int decode(const char *name, const uint8_t *data, size_t size)
+{
+	struct dump d = { NULL, };
+	size_t offset = 0;
+	bool have_header = false;
+
+	while (offset < size) {
+		const struct spa_log_binary_chunk *chunk;
+		int res = 0;
+
+		if (size - offset >= sizeof(struct spa_log_binary_header) &&
+		    memcmp(data + offset, SPA_LOG_BINARY_MAGIC, 8) == 0) {
+			const struct spa_log_binary_header *h = (const void *) (data + offset);
+
+			if (h->version != SPA_LOG_BINARY_VERSION) {
+				fprintf(stderr, "%s: unsupported version %u\n", name, h->version);
+				break;
+			}
+			if (have_header)
+				flush_dump(&d);
+			have_header = true;
+			offset += sizeof(struct spa_log_binary_header);
+			continue;
+		}
+		if (!have_header || size - offset < sizeof(struct spa_log_binary_chunk)) {
+			fprintf(stderr, "%s: not a binary log at offset %zd\n", name, offset);
+			break;
+		}
+
+		chunk = (const void *) (data + offset);
+		offset += sizeof(struct spa_log_binary_chunk);
+		if (chunk->size > size - offset) {
+			fprintf(stderr, "%s: truncated chunk at offset %zd\n", name, offset);
+			break;
+		}
+
+		switch (chunk->type) {
+		case SPA_LOG_BINARY_CHUNK_STRING:
+			res = add_string(&d, data + offset, chunk->size);
+			break;
+		case SPA_LOG_BINARY_CHUNK_THREAD:
+			res = add_thread(&d, data + offset, chunk->size);
+			break;
+		default:
+			break;
+		}
+		if (res < 0) {
+			fprintf(stderr, "%s: invalid chunk at offset %zd\n", name, offset);
+			break;
+		}
+		offset += chunk->size;
+	}
+	flush_dump(&d);
+
+	return offset == size ? 0 : -1;
+}
+
+static uint8_t *read_file(FILE *f, size_t *size)
+{
+	uint8_t *data = NULL, *tmp;
+	size_t len = 0, alloc = 0, n;
+
+	do {
+		if (len == alloc) {
+			alloc = alloc ? alloc * 2 : 65536;
+			if ((tmp = realloc(data, alloc)) == NULL) {
+				free(data);
+				return NULL;
+			}
+			data = tmp;
+		}
+		n = fread(data + len, 1, alloc - len, f);
+		len += n;
+	} while (n > 0);
+
+	*size = len;
+	return data;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, res = 0;
+
+	if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+		printf("usage: %s [FILE]...\n"
+		       "Print the messages of binary log dumps, from stdin when no FILE is given\n",
+		       argv[0]);
+		return 0;
+	}
+
+	for (i = 1; i < argc || i == 1; i++) {
+		const char *name = i < argc ? argv[i] : "-";
+		FILE *f;
+		uint8_t *data;
+		size_t size;
+
+		if (strcmp(name, "-") == 0)
+			f = stdin;
+		else if ((f = fopen(name, "r")) == NULL) {
+			fprintf(stderr, "%s: %s\n", name, strerror(errno));
+			res = 1;
+			continue;
+		}
+
+		data = read_file(f, &size);
+		if (f != stdin)
+			fclose(f);
+
+		if (data == NULL) {
+			fprintf(stderr, "%s: out of memory\n", name);
+			res = 1;
+			continue;
+		}
+		if (decode(name, data, size) < 0)
+			res = 1;
+
+		free(data);
+	}
+	return res;
+}
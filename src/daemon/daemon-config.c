@@ -89,6 +89,9 @@ void pw_daemon_config_free(struct pw_daemon_config *config)
 {
 	struct pw_command *cmd, *tmp;
 
+	if (config->idle)
+		pw_loop_destroy_source(pw_core_get_main_loop(config->core), config->idle);
+
 	spa_list_for_each_safe(cmd, tmp, &config->commands, link)
 	    pw_command_free(cmd);
 
@@ -170,6 +173,18 @@ bool pw_daemon_config_load(struct pw_daemon_config *config, char **err)
 	return pw_daemon_config_load_file(config, filename, err);
 }
 
+static bool run_command(struct pw_command *command, struct pw_core *core)
+{
+	char *err = NULL;
+
+	if (!pw_command_run(command, core, &err)) {
+		pw_log_warn("could not run command %s: %s", command->args[0], err);
+		free(err);
+		return false;
+	}
+	return true;
+}
+
 /**
  * pw_daemon_config_run_commands:
  * @config: A #struct pw_daemon_config
@@ -182,16 +197,12 @@ bool pw_daemon_config_load(struct pw_daemon_config *config, char **err)
  */
 bool pw_daemon_config_run_commands(struct pw_daemon_config *config, struct pw_core *core)
 {
-	char *err = NULL;
 	bool ret = true;
 	struct pw_command *command, *tmp;
 
 	spa_list_for_each(command, &config->commands, link) {
-		if (!pw_command_run(command, core, &err)) {
-			pw_log_warn("could not run command %s: %s", command->args[0], err);
-			free(err);
+		if (!run_command(command, core))
 			ret = false;
-		}
 	}
 
 	spa_list_for_each_safe(command, tmp, &config->commands, link)
@@ -199,3 +210,52 @@ bool pw_daemon_config_run_commands(struct pw_daemon_config *config, struct pw_co
 
 	return ret;
 }
+
+static void run_next_command(void *data)
+{
+	struct pw_daemon_config *config = data;
+	struct pw_command *command;
+
+	if (spa_list_is_empty(&config->commands)) {
+		pw_loop_enable_idle(pw_core_get_main_loop(config->core), config->idle, false);
+		config->done(config->data, config->result);
+		return;
+	}
+
+	command = spa_list_first(&config->commands, struct pw_command, link);
+	if (!run_command(command, config->core))
+		config->result = false;
+	pw_command_free(command);
+}
+
+/**
+ * pw_daemon_config_run_commands_async:
+ * @config: A #struct pw_daemon_config
+ * @core: A #struct pw_core
+ * @done: called when all commands have been run
+ * @data: data passed to @done
+ *
+ * Run the parsed commands from the main loop of @core, one command per
+ * iteration. Clients that connect to a protocol that was loaded by one of
+ * the first commands are handled while the other commands run. @done is
+ * called with %true when all commands where executed with success.
+ *
+ * The modules are still loaded one after the other on the main loop,
+ * module init modifies the core and is not thread safe.
+ *
+ * Returns: %true when the commands are scheduled, otherwise %false.
+ */
+bool pw_daemon_config_run_commands_async(struct pw_daemon_config *config, struct pw_core *core,
+					 void (*done) (void *data, bool success), void *data)
+{
+	config->core = core;
+	config->done = done;
+	config->data = data;
+	config->result = true;
+
+	config->idle = pw_loop_add_idle(pw_core_get_main_loop(core), true, run_next_command, config);
+	if (config->idle == NULL)
+		return false;
+
+	return true;
+}
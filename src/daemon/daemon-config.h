@@ -29,6 +29,12 @@ extern "C" {
 
 struct pw_daemon_config {
 	struct spa_list commands;
+
+	struct pw_core *core;
+	struct spa_source *idle;		/**< runs the commands in async mode */
+	bool result;
+	void (*done) (void *data, bool success);
+	void *data;
 };
 
 struct pw_daemon_config *
@@ -46,6 +52,10 @@ pw_daemon_config_load(struct pw_daemon_config *config, char **err);
 bool
 pw_daemon_config_run_commands(struct pw_daemon_config *config, struct pw_core *core);
 
+bool
+pw_daemon_config_run_commands_async(struct pw_daemon_config *config, struct pw_core *core,
+				    void (*done) (void *data, bool success), void *data);
+
 #ifdef __cplusplus
 }
 #endif
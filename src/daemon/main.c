@@ -18,6 +18,9 @@
  */
 
 #include <signal.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <pipewire/pipewire.h>
 #include <pipewire/core.h>
@@ -31,13 +34,47 @@ static void do_quit(void *data, int signal_number)
 	pw_main_loop_quit(loop);
 }
 
+static void do_dump(void *data, int signal_number)
+{
+	const char *file = data;
+	int fd, res;
+
+	if ((fd = open(file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0) {
+		pw_log_error("can't open %s: %m", file);
+		return;
+	}
+	if ((res = pw_log_dump(fd)) != SPA_RESULT_OK)
+		pw_log_error("can't dump binary log: %d", res);
+	close(fd);
+}
+
+struct data {
+	struct pw_main_loop *loop;
+	int res;
+};
+
+static void on_commands_done(void *_data, bool success)
+{
+	struct data *data = _data;
+
+	if (!success) {
+		pw_log_error("failed to run config commands");
+		data->res = -1;
+		pw_main_loop_quit(data->loop);
+		return;
+	}
+	pw_log_info("config commands done");
+}
+
 int main(int argc, char *argv[])
 {
 	struct pw_core *core;
 	struct pw_main_loop *loop;
+	struct data data = { NULL, 0 };
 	struct pw_daemon_config *config;
 	char *err = NULL;
 	struct pw_properties *props;
+	const char *binary_log, *str;
 
 	pw_init(&argc, &argv);
 
@@ -55,10 +92,21 @@ int main(int argc, char *argv[])
 	loop = pw_main_loop_new(props);
 	pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGINT, do_quit, loop);
 	pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGTERM, do_quit, loop);
+	if ((binary_log = getenv("PIPEWIRE_LOG_BINARY")))
+		pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGUSR1, do_dump, (void*)binary_log);
 
 	core = pw_core_new(pw_main_loop_get_loop(loop), props);
 
-	if (!pw_daemon_config_run_commands(config, core)) {
+	/* with PIPEWIRE_STARTUP=async, the commands are run from the main loop
+	 * so that clients are accepted as soon as the protocol is loaded */
+	data.loop = loop;
+	if ((str = getenv("PIPEWIRE_STARTUP")) && strcmp(str, "async") == 0) {
+		if (!pw_daemon_config_run_commands_async(config, core, on_commands_done, &data)) {
+			pw_log_error("failed to schedule config commands");
+			return -1;
+		}
+	}
+	else if (!pw_daemon_config_run_commands(config, core)) {
 		pw_log_error("failed to run config commands");
 		return -1;
 	}
@@ -67,9 +115,12 @@ int main(int argc, char *argv[])
 	pw_main_loop_run(loop);
 	pw_log_info("leave main loop");
 
+	if (binary_log)
+		do_dump((void*)binary_log, SIGUSR1);
+
 	pw_daemon_config_free(config);
 	pw_core_destroy(core);
 	pw_main_loop_destroy(loop);
 
-	return 0;
+	return data.res;
 }
@@ -0,0 +1,430 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure pw_core_find_port() in a graph with many nodes, like
+ * module-autolink does for every new port.
+ *
+ * There are 1000 sink nodes with one input port, every tenth one is a video
+ * sink, the others are audio sinks. Only the last video sink can handle the
+ * raw video of the source, the other video sinks take mjpeg. A port is
+ * looked up for the output port of the source, with path=any the core
+ * looks for a node with a common format and with path=id the node is given.
+ *
+ * With path=same-type all 1000 sinks take raw video, like the source, but
+ * only the last one takes the YUY2 of the source, the others take I420.
+ */
+
+#include <stdio.h>
+
+#include <spa/format-builder.h>
+#include <spa/format-utils.h>
+#include <spa/video/format-utils.h>
+#include <spa/video/raw-utils.h>
+#include <lib/format.h>
+
+#include <pipewire/pipewire.h>
+
+#include <tests/bench.h>
+
+#define N_NODES		1000
+
+struct type {
+	uint32_t format;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_video media_subtype_video;
+	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
+};
+
+struct node {
+	struct spa_node node;
+	struct type *type;
+	enum spa_direction direction;
+	uint32_t media_type;
+	uint32_t media_subtype;
+	uint32_t video_format;		/* 0 when the format has no video format */
+	uint8_t format_buffer[1024];
+};
+
+struct data {
+	struct pw_loop *loop;
+	struct pw_core *core;
+	struct type type;
+
+	struct pw_node *source;
+	struct pw_port *port;
+	struct pw_node *sinks[N_NODES];
+	struct pw_node *target;
+};
+
+static int node_not_implemented(struct spa_node *node)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int node_get_props(struct spa_node *node, struct spa_props **props)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int node_set_props(struct spa_node *node, const struct spa_props *props)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int node_send_command(struct spa_node *node, const struct spa_command *command)
+{
+	return SPA_RESULT_OK;
+}
+
+static int
+node_set_callbacks(struct spa_node *node, const struct spa_node_callbacks *callbacks, void *data)
+{
+	return SPA_RESULT_OK;
+}
+
+static int
+node_get_n_ports(struct spa_node *node,
+		 uint32_t *n_input_ports,
+		 uint32_t *max_input_ports,
+		 uint32_t *n_output_ports,
+		 uint32_t *max_output_ports)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+	uint32_t n_ports = n->direction == SPA_DIRECTION_INPUT ? 1 : 0;
+
+	if (n_input_ports)
+		*n_input_ports = n_ports;
+	if (max_input_ports)
+		*max_input_ports = n_ports;
+	if (n_output_ports)
+		*n_output_ports = 1 - n_ports;
+	if (max_output_ports)
+		*max_output_ports = 1 - n_ports;
+	return SPA_RESULT_OK;
+}
+
+static int
+node_get_port_ids(struct spa_node *node,
+		  uint32_t n_input_ports,
+		  uint32_t *input_ids,
+		  uint32_t n_output_ports,
+		  uint32_t *output_ids)
+{
+	if (n_input_ports > 0 && input_ids)
+		input_ids[0] = 0;
+	if (n_output_ports > 0 && output_ids)
+		output_ids[0] = 0;
+	return SPA_RESULT_OK;
+}
+
+static int node_add_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int node_remove_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+node_port_enum_formats(struct spa_node *node,
+		       enum spa_direction direction,
+		       uint32_t port_id,
+		       struct spa_format **format,
+		       const struct spa_format *filter,
+		       uint32_t index)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_frame f[2];
+	uint8_t buffer[256];
+	struct spa_format *fmt;
+	int res;
+
+	if (index > 0)
+		return SPA_RESULT_ENUM_END;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	if (n->video_format)
+		spa_pod_builder_format(&b, &f[0], n->type->format, n->media_type, n->media_subtype,
+			SPA_POD_PROP(&f[1], n->type->format_video.format, 0,
+				     SPA_POD_TYPE_ID, 1, n->video_format));
+	else
+		spa_pod_builder_format(&b, &f[0], n->type->format, n->media_type, n->media_subtype);
+	fmt = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_format);
+
+	spa_pod_builder_init(&b, n->format_buffer, sizeof(n->format_buffer));
+	if ((res = spa_format_filter(fmt, filter, &b)) != SPA_RESULT_OK)
+		return res;
+
+	*format = SPA_POD_BUILDER_DEREF(&b, 0, struct spa_format);
+
+	return SPA_RESULT_OK;
+}
+
+static int
+node_port_set_format(struct spa_node *node,
+		     enum spa_direction direction,
+		     uint32_t port_id,
+		     uint32_t flags,
+		     const struct spa_format *format)
+{
+	return SPA_RESULT_OK;
+}
+
+static int
+node_port_get_format(struct spa_node *node,
+		     enum spa_direction direction,
+		     uint32_t port_id,
+		     const struct spa_format **format)
+{
+	return SPA_RESULT_NO_FORMAT;
+}
+
+static int
+node_port_get_info(struct spa_node *node,
+		   enum spa_direction direction,
+		   uint32_t port_id,
+		   const struct spa_port_info **info)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+node_port_enum_params(struct spa_node *node,
+		      enum spa_direction direction,
+		      uint32_t port_id,
+		      uint32_t index,
+		      struct spa_param **param)
+{
+	return SPA_RESULT_ENUM_END;
+}
+
+static int
+node_port_set_param(struct spa_node *node,
+		    enum spa_direction direction,
+		    uint32_t port_id,
+		    const struct spa_param *param)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+node_port_use_buffers(struct spa_node *node,
+		      enum spa_direction direction,
+		      uint32_t port_id,
+		      struct spa_buffer **buffers,
+		      uint32_t n_buffers)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+node_port_alloc_buffers(struct spa_node *node,
+			enum spa_direction direction,
+			uint32_t port_id,
+			struct spa_param **params,
+			uint32_t n_params,
+			struct spa_buffer **buffers,
+			uint32_t *n_buffers)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+node_port_set_io(struct spa_node *node,
+		 enum spa_direction direction,
+		 uint32_t port_id,
+		 struct spa_port_io *io)
+{
+	return SPA_RESULT_OK;
+}
+
+static int node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+node_port_send_command(struct spa_node *node,
+		       enum spa_direction direction,
+		       uint32_t port_id,
+		       const struct spa_command *command)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static const struct spa_node node_impl = {
+	SPA_VERSION_NODE,
+	NULL,
+	node_get_props,
+	node_set_props,
+	node_send_command,
+	node_set_callbacks,
+	node_get_n_ports,
+	node_get_port_ids,
+	node_add_port,
+	node_remove_port,
+	node_port_enum_formats,
+	node_port_set_format,
+	node_port_get_format,
+	node_port_get_info,
+	node_port_enum_params,
+	node_port_set_param,
+	node_port_use_buffers,
+	node_port_alloc_buffers,
+	node_port_set_io,
+	node_port_reuse_buffer,
+	node_port_send_command,
+	node_not_implemented,
+	node_not_implemented,
+};
+
+static struct pw_node *make_node(struct data *d, const char *name, enum spa_direction direction,
+				 uint32_t media_type, uint32_t media_subtype, uint32_t video_format)
+{
+	struct pw_node *node;
+	struct node *n;
+
+	node = pw_node_new(d->core, name, NULL, sizeof(struct node));
+	n = pw_node_get_user_data(node);
+	n->node = node_impl;
+	n->type = &d->type;
+	n->direction = direction;
+	n->media_type = media_type;
+	n->media_subtype = media_subtype;
+	n->video_format = video_format;
+
+	pw_node_set_implementation(node, &n->node);
+	pw_node_register(node, NULL, NULL);
+
+	return node;
+}
+
+static void run(struct bench *b, struct data *d, const char *path, bool by_id, uint64_t rounds)
+{
+	char params[64];
+	struct bench_result r = { "find-port", params, rounds, };
+	uint32_t id = by_id ? pw_global_get_id(pw_node_get_global(d->target)) : SPA_ID_INVALID;
+	uint64_t i, start, t, *samples;
+	struct pw_port *port;
+	char *error = NULL;
+
+	snprintf(params, sizeof(params), "nodes=%d,path=%s", N_NODES, path);
+
+	samples = malloc(rounds * sizeof(uint64_t));
+
+	start = bench_now();
+	for (i = 0; i < rounds; i++) {
+		t = bench_now();
+		port = pw_core_find_port(d->core, d->port, id, NULL, 0, NULL, &error);
+		samples[i] = bench_now() - t;
+
+		if (port == NULL || pw_port_get_node(port) != d->target) {
+			fprintf(stderr, "wrong port found: %s\n", error ? error : "");
+			exit(1);
+		}
+	}
+	r.elapsed = bench_now() - start;
+
+	bench_latency(&r, samples, rounds);
+	bench_report(b, &r);
+	free(samples);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data d = { NULL, };
+	struct bench b;
+	uint64_t rounds;
+	uint32_t i;
+
+	pw_init(&argc, &argv);
+
+	bench_init(&b, "find-port", argc, argv);
+	rounds = bench_iterations(&b, 1000);
+
+	d.loop = pw_loop_new(NULL);
+	d.core = pw_core_new(d.loop, NULL);
+
+	{
+		struct spa_type_map *map = pw_core_get_type(d.core)->map;
+
+		d.type.format = spa_type_map_get_id(map, SPA_TYPE__Format);
+		spa_type_media_type_map(map, &d.type.media_type);
+		spa_type_media_subtype_map(map, &d.type.media_subtype);
+		spa_type_media_subtype_video_map(map, &d.type.media_subtype_video);
+		spa_type_format_video_map(map, &d.type.format_video);
+		spa_type_video_format_map(map, &d.type.video_format);
+	}
+
+	for (i = 0; i < N_NODES; i++) {
+		if ((i % 10) != 0)
+			d.sinks[i] = make_node(&d, "audio-sink", SPA_DIRECTION_INPUT,
+					       d.type.media_type.audio,
+					       d.type.media_subtype.raw, 0);
+		else if (i != N_NODES - 10)
+			d.sinks[i] = make_node(&d, "mjpeg-sink", SPA_DIRECTION_INPUT,
+					       d.type.media_type.video,
+					       d.type.media_subtype_video.mjpg, 0);
+		else
+			d.sinks[i] = d.target = make_node(&d, "video-sink", SPA_DIRECTION_INPUT,
+							  d.type.media_type.video,
+							  d.type.media_subtype.raw, 0);
+	}
+	d.source = make_node(&d, "video-source", SPA_DIRECTION_OUTPUT,
+			     d.type.media_type.video, d.type.media_subtype.raw, 0);
+	d.port = pw_node_get_free_port(d.source, PW_DIRECTION_OUTPUT);
+
+	run(&b, &d, "any", false, rounds);
+	run(&b, &d, "id", true, rounds);
+
+	pw_node_destroy(d.source);
+	for (i = 0; i < N_NODES; i++)
+		pw_node_destroy(d.sinks[i]);
+
+	/* all sinks take raw video, only the last one the format of the source */
+	for (i = 0; i < N_NODES; i++) {
+		uint32_t format = i != N_NODES - 1 ? d.type.video_format.I420 :
+						     d.type.video_format.YUY2;
+
+		d.sinks[i] = make_node(&d, "video-sink", SPA_DIRECTION_INPUT,
+				       d.type.media_type.video,
+				       d.type.media_subtype.raw, format);
+	}
+	d.target = d.sinks[N_NODES - 1];
+	d.source = make_node(&d, "video-source", SPA_DIRECTION_OUTPUT,
+			     d.type.media_type.video, d.type.media_subtype.raw,
+			     d.type.video_format.YUY2);
+	d.port = pw_node_get_free_port(d.source, PW_DIRECTION_OUTPUT);
+
+	run(&b, &d, "same-type", false, rounds);
+
+	pw_node_destroy(d.source);
+	for (i = 0; i < N_NODES; i++)
+		pw_node_destroy(d.sinks[i]);
+
+	pw_core_destroy(d.core);
+	pw_loop_destroy(d.loop);
+
+	return bench_finish(&b);
+}
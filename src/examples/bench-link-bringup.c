@@ -0,0 +1,547 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure the time to bring up many links until they are all running.
+ *
+ * The nodes complete the format, buffers and start requests
+ * asynchronously, like the client-nodes of the clients do. The requests
+ * are answered once per iteration of the main loop, so every round trip
+ * to a node costs an iteration. With topology=split one source port is
+ * linked to 200 sink nodes, with topology=mix 200 source nodes are linked
+ * to 200 ports of one sink node.
+ */
+
+#include <stdio.h>
+
+#include <spa/format-builder.h>
+#include <spa/format-utils.h>
+#include <lib/format.h>
+
+#include <pipewire/pipewire.h>
+
+#include <tests/bench.h>
+
+#define N_LINKS		200
+#define MAX_ITERATIONS	100000
+
+struct type {
+	uint32_t format;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_command_node command_node;
+};
+
+struct data;
+
+struct node {
+	struct spa_node node;
+	struct data *data;
+	const struct spa_node_callbacks *callbacks;
+	void *callbacks_data;
+
+	enum spa_direction direction;
+	uint32_t n_ports;
+	uint32_t max_ports;
+	uint32_t seq;
+
+	struct spa_port_info info;
+	bool have_format;
+	uint8_t format_buffer[1024];
+	uint8_t enum_buffer[1024];
+};
+
+struct request {
+	struct node *node;
+	uint32_t seq;
+};
+
+struct data {
+	struct pw_loop *loop;
+	struct pw_core *core;
+	struct type type;
+
+	struct request *requests;
+	uint32_t n_requests;
+	uint32_t max_requests;
+
+	struct pw_node *sources[N_LINKS];
+	uint32_t n_sources;
+	struct pw_node *sinks[N_LINKS];
+	uint32_t n_sinks;
+	struct pw_link *links[N_LINKS];
+	uint32_t n_running;
+};
+
+/* the request is answered on the next iteration of the main loop */
+static int node_async(struct node *n)
+{
+	struct data *d = n->data;
+	uint32_t seq = n->seq++;
+
+	if (d->n_requests == d->max_requests) {
+		d->max_requests = SPA_MAX(64, d->max_requests * 2);
+		d->requests = realloc(d->requests, d->max_requests * sizeof(struct request));
+	}
+	d->requests[d->n_requests].node = n;
+	d->requests[d->n_requests].seq = seq;
+	d->n_requests++;
+
+	return SPA_RESULT_RETURN_ASYNC(seq);
+}
+
+static void answer_requests(struct data *d)
+{
+	uint32_t i, n_requests = d->n_requests;
+
+	for (i = 0; i < n_requests; i++) {
+		struct node *n = d->requests[i].node;
+
+		n->callbacks->done(n->callbacks_data, d->requests[i].seq, SPA_RESULT_OK);
+	}
+	d->n_requests -= n_requests;
+	memmove(d->requests, &d->requests[n_requests], d->n_requests * sizeof(struct request));
+}
+
+static int node_get_props(struct spa_node *node, struct spa_props **props)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int node_set_props(struct spa_node *node, const struct spa_props *props)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int node_send_command(struct spa_node *node, const struct spa_command *command)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	if (SPA_COMMAND_TYPE(command) == n->data->type.command_node.Start)
+		return node_async(n);
+
+	return SPA_RESULT_OK;
+}
+
+static int
+node_set_callbacks(struct spa_node *node, const struct spa_node_callbacks *callbacks, void *data)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	n->callbacks = callbacks;
+	n->callbacks_data = data;
+	return SPA_RESULT_OK;
+}
+
+static int
+node_get_n_ports(struct spa_node *node,
+		 uint32_t *n_input_ports,
+		 uint32_t *max_input_ports,
+		 uint32_t *n_output_ports,
+		 uint32_t *max_output_ports)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+	bool input = n->direction == SPA_DIRECTION_INPUT;
+
+	if (n_input_ports)
+		*n_input_ports = input ? n->n_ports : 0;
+	if (max_input_ports)
+		*max_input_ports = input ? n->max_ports : 0;
+	if (n_output_ports)
+		*n_output_ports = input ? 0 : n->n_ports;
+	if (max_output_ports)
+		*max_output_ports = input ? 0 : n->max_ports;
+	return SPA_RESULT_OK;
+}
+
+static int
+node_get_port_ids(struct spa_node *node,
+		  uint32_t n_input_ports,
+		  uint32_t *input_ids,
+		  uint32_t n_output_ports,
+		  uint32_t *output_ids)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+	uint32_t i;
+
+	for (i = 0; i < n->n_ports; i++) {
+		if (n->direction == SPA_DIRECTION_INPUT && i < n_input_ports && input_ids)
+			input_ids[i] = i;
+		else if (n->direction == SPA_DIRECTION_OUTPUT && i < n_output_ports && output_ids)
+			output_ids[i] = i;
+	}
+	return SPA_RESULT_OK;
+}
+
+static int node_add_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	if (direction != n->direction || n->n_ports == n->max_ports)
+		return SPA_RESULT_INVALID_PORT;
+
+	n->n_ports++;
+	return SPA_RESULT_OK;
+}
+
+static int node_remove_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+node_port_enum_formats(struct spa_node *node,
+		       enum spa_direction direction,
+		       uint32_t port_id,
+		       struct spa_format **format,
+		       const struct spa_format *filter,
+		       uint32_t index)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+	struct type *t = &n->data->type;
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_frame f[1];
+	uint8_t buffer[256];
+	struct spa_format *fmt;
+	int res;
+
+	if (index > 0)
+		return SPA_RESULT_ENUM_END;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	spa_pod_builder_format(&b, &f[0], t->format, t->media_type.audio, t->media_subtype.raw);
+	fmt = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_format);
+
+	spa_pod_builder_init(&b, n->enum_buffer, sizeof(n->enum_buffer));
+	if ((res = spa_format_filter(fmt, filter, &b)) != SPA_RESULT_OK)
+		return res;
+
+	*format = SPA_POD_BUILDER_DEREF(&b, 0, struct spa_format);
+
+	return SPA_RESULT_OK;
+}
+
+static int
+node_port_set_format(struct spa_node *node,
+		     enum spa_direction direction,
+		     uint32_t port_id,
+		     uint32_t flags,
+		     const struct spa_format *format)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	if (format == NULL) {
+		n->have_format = false;
+		return SPA_RESULT_OK;
+	}
+	if (SPA_POD_SIZE(format) > sizeof(n->format_buffer))
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	memcpy(n->format_buffer, format, SPA_POD_SIZE(format));
+	n->have_format = true;
+
+	return node_async(n);
+}
+
+static int
+node_port_get_format(struct spa_node *node,
+		     enum spa_direction direction,
+		     uint32_t port_id,
+		     const struct spa_format **format)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	if (!n->have_format)
+		return SPA_RESULT_NO_FORMAT;
+
+	*format = (const struct spa_format *) n->format_buffer;
+	return SPA_RESULT_OK;
+}
+
+static int
+node_port_get_info(struct spa_node *node,
+		   enum spa_direction direction,
+		   uint32_t port_id,
+		   const struct spa_port_info **info)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	*info = &n->info;
+	return SPA_RESULT_OK;
+}
+
+static int
+node_port_enum_params(struct spa_node *node,
+		      enum spa_direction direction,
+		      uint32_t port_id,
+		      uint32_t index,
+		      struct spa_param **param)
+{
+	return SPA_RESULT_ENUM_END;
+}
+
+static int
+node_port_set_param(struct spa_node *node,
+		    enum spa_direction direction,
+		    uint32_t port_id,
+		    const struct spa_param *param)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+node_port_use_buffers(struct spa_node *node,
+		      enum spa_direction direction,
+		      uint32_t port_id,
+		      struct spa_buffer **buffers,
+		      uint32_t n_buffers)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	if (n_buffers == 0)
+		return SPA_RESULT_OK;
+
+	return node_async(n);
+}
+
+static int
+node_port_alloc_buffers(struct spa_node *node,
+			enum spa_direction direction,
+			uint32_t port_id,
+			struct spa_param **params,
+			uint32_t n_params,
+			struct spa_buffer **buffers,
+			uint32_t *n_buffers)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+node_port_set_io(struct spa_node *node,
+		 enum spa_direction direction,
+		 uint32_t port_id,
+		 struct spa_port_io *io)
+{
+	return SPA_RESULT_OK;
+}
+
+static int node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	return SPA_RESULT_OK;
+}
+
+static int
+node_port_send_command(struct spa_node *node,
+		       enum spa_direction direction,
+		       uint32_t port_id,
+		       const struct spa_command *command)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int node_process(struct spa_node *node)
+{
+	return SPA_RESULT_OK;
+}
+
+static const struct spa_node node_impl = {
+	SPA_VERSION_NODE,
+	NULL,
+	node_get_props,
+	node_set_props,
+	node_send_command,
+	node_set_callbacks,
+	node_get_n_ports,
+	node_get_port_ids,
+	node_add_port,
+	node_remove_port,
+	node_port_enum_formats,
+	node_port_set_format,
+	node_port_get_format,
+	node_port_get_info,
+	node_port_enum_params,
+	node_port_set_param,
+	node_port_use_buffers,
+	node_port_alloc_buffers,
+	node_port_set_io,
+	node_port_reuse_buffer,
+	node_port_send_command,
+	node_process,
+	node_process,
+};
+
+static struct pw_node *make_node(struct data *d, const char *name,
+				 enum spa_direction direction, uint32_t max_ports)
+{
+	struct pw_node *node;
+	struct node *n;
+
+	node = pw_node_new(d->core, name, NULL, sizeof(struct node));
+	n = pw_node_get_user_data(node);
+	n->node = node_impl;
+	n->data = d;
+	n->direction = direction;
+	n->n_ports = max_ports == 1 ? 1 : 0;
+	n->max_ports = max_ports;
+	n->info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+
+	pw_node_set_implementation(node, &n->node);
+	pw_node_register(node, NULL, NULL);
+	pw_node_set_active(node, true);
+
+	return node;
+}
+
+static void link_state_changed(void *data, enum pw_link_state old,
+			       enum pw_link_state state, const char *error)
+{
+	struct data *d = data;
+
+	if (state == PW_LINK_STATE_RUNNING)
+		d->n_running++;
+	else if (state == PW_LINK_STATE_ERROR) {
+		fprintf(stderr, "link error: %s\n", error ? error : "");
+		exit(1);
+	}
+}
+
+static const struct pw_link_events link_events = {
+	PW_VERSION_LINK_EVENTS,
+	.state_changed = link_state_changed,
+};
+
+static void make_links(struct data *d, bool mix)
+{
+	uint32_t i;
+
+	d->n_sources = mix ? N_LINKS : 1;
+	d->n_sinks = mix ? 1 : N_LINKS;
+
+	for (i = 0; i < d->n_sources; i++)
+		d->sources[i] = make_node(d, "source", SPA_DIRECTION_OUTPUT, 1);
+	for (i = 0; i < d->n_sinks; i++)
+		d->sinks[i] = make_node(d, "sink", SPA_DIRECTION_INPUT, mix ? N_LINKS : 1);
+
+	for (i = 0; i < N_LINKS; i++) {
+		struct pw_node *source = d->sources[mix ? i : 0];
+		struct pw_node *sink = d->sinks[mix ? 0 : i];
+		struct pw_port *output, *input;
+		struct pw_link *link;
+		char *error = NULL;
+
+		output = pw_node_get_free_port(source, PW_DIRECTION_OUTPUT);
+		input = pw_node_get_free_port(sink, PW_DIRECTION_INPUT);
+
+		link = pw_link_new(d->core, output, input, NULL, NULL, &error,
+				   sizeof(struct spa_hook));
+		if (link == NULL) {
+			fprintf(stderr, "can't make link: %s\n", error);
+			exit(1);
+		}
+		pw_link_add_listener(link, pw_link_get_user_data(link), &link_events, d);
+		pw_link_register(link, NULL, NULL);
+		d->links[i] = link;
+	}
+}
+
+static void destroy_links(struct data *d)
+{
+	uint32_t i;
+
+	for (i = 0; i < N_LINKS; i++)
+		pw_link_destroy(d->links[i]);
+
+	answer_requests(d);
+	pw_loop_iterate(d->loop, 0);
+
+	for (i = 0; i < d->n_sources; i++)
+		pw_node_destroy(d->sources[i]);
+	for (i = 0; i < d->n_sinks; i++)
+		pw_node_destroy(d->sinks[i]);
+}
+
+static void run(struct bench *b, struct data *d, bool mix, uint64_t rounds)
+{
+	struct bench_result r = { "bringup",
+		mix ? "links=200,topology=mix" : "links=200,topology=split",
+		rounds * N_LINKS, };
+	uint64_t i, t, *samples;
+	uint32_t iterations;
+
+	samples = malloc(rounds * sizeof(uint64_t));
+
+	for (i = 0; i < rounds; i++) {
+		d->n_running = 0;
+
+		t = bench_now();
+		make_links(d, mix);
+
+		for (iterations = 0; d->n_running < N_LINKS; iterations++) {
+			if (iterations == MAX_ITERATIONS) {
+				fprintf(stderr, "only %u of %u links running\n",
+					d->n_running, N_LINKS);
+				exit(1);
+			}
+			answer_requests(d);
+			pw_loop_iterate(d->loop, 0);
+		}
+		samples[i] = bench_now() - t;
+		r.elapsed += samples[i];
+
+		destroy_links(d);
+	}
+
+	bench_latency(&r, samples, rounds);
+	bench_report(b, &r);
+	free(samples);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data d = { NULL, };
+	struct bench b;
+	uint64_t rounds;
+
+	pw_init(&argc, &argv);
+
+	bench_init(&b, "link-bringup", argc, argv);
+	rounds = bench_iterations(&b, 100);
+
+	d.loop = pw_loop_new(NULL);
+	d.core = pw_core_new(d.loop, NULL);
+
+	{
+		struct spa_type_map *map = pw_core_get_type(d.core)->map;
+
+		d.type.format = spa_type_map_get_id(map, SPA_TYPE__Format);
+		spa_type_media_type_map(map, &d.type.media_type);
+		spa_type_media_subtype_map(map, &d.type.media_subtype);
+		spa_type_command_node_map(map, &d.type.command_node);
+	}
+
+	pw_loop_enter(d.loop);
+	run(&b, &d, false, rounds);
+	run(&b, &d, true, rounds);
+	pw_loop_leave(d.loop);
+
+	free(d.requests);
+	pw_core_destroy(d.core);
+	pw_loop_destroy(d.loop);
+
+	return bench_finish(&b);
+}
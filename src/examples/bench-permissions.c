@@ -0,0 +1,236 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure the permission checks of module-flatpak when many sandboxed
+ * clients list the registry.
+ *
+ * The clients have the credentials of a few users and own the node
+ * globals, like the client-nodes of sandboxed applications. Every client
+ * gets the permissions of every global, like the core does when a
+ * registry is made. With path=old the owners are checked on every call
+ * like module-flatpak did before the cache, with path=owners only the
+ * owner cache is used and with path=client the permissions are also kept
+ * per client.
+ */
+
+#include <stdio.h>
+#include <sys/socket.h>
+
+#include <pipewire/pipewire.h>
+
+#include "../modules/module-flatpak/permissions.h"
+
+#include <tests/bench.h>
+
+#define N_CLIENTS	100
+#define N_GLOBALS	1000
+#define N_UIDS		4
+
+enum path {
+	PATH_OLD,
+	PATH_OWNERS,
+	PATH_CLIENT,
+};
+
+static const char *path_names[] = { "old", "owners", "client" };
+
+struct data {
+	struct pw_loop *loop;
+	struct pw_core *core;
+	struct pw_type *t;
+	struct permission_cache cache;
+	enum path path;
+
+	struct pw_client *clients[N_CLIENTS];
+	struct permission_client permissions[N_CLIENTS];
+	struct pw_global *globals[N_GLOBALS];
+	uint32_t first_client;	/* global id of the first client */
+	uint64_t visible;	/* globals that the clients can see in one round */
+};
+
+/* the check of module-flatpak before the permission cache */
+static bool
+check_global_owner(struct pw_core *core, struct pw_client *client, struct pw_global *global)
+{
+	struct pw_client *owner;
+	const struct ucred *owner_ucred, *client_ucred;
+
+	if (global == NULL)
+		return false;
+
+	owner = pw_global_get_owner(global);
+	if (owner == NULL)
+		return true;
+
+	owner_ucred = pw_client_get_ucred(owner);
+	client_ucred = pw_client_get_ucred(client);
+
+	if (owner_ucred == NULL || client_ucred == NULL)
+		return true;
+
+	return owner_ucred->uid == client_ucred->uid;
+}
+
+static uint32_t old_permission(struct data *d, struct pw_global *global, struct pw_client *client)
+{
+	if (pw_global_get_type(global) == d->t->link) {
+		struct pw_link *link = pw_global_get_object(global);
+		struct pw_port *port;
+		struct pw_node *node;
+
+		port = pw_link_get_output(link);
+		node = pw_port_get_node(port);
+		if (port && node && !check_global_owner(d->core, client, pw_node_get_global(node)))
+			 return 0;
+
+		port = pw_link_get_input(link);
+		node = pw_port_get_node(port);
+		if (port && node && !check_global_owner(d->core, client, pw_node_get_global(node)))
+			 return 0;
+	}
+	else if (!check_global_owner(d->core, client, global))
+		return 0;
+
+	return PW_PERM_RWX;
+}
+
+static uint32_t do_permission(struct pw_global *global, struct pw_client *client, void *data)
+{
+	struct data *d = data;
+	uint32_t i;
+
+	switch (d->path) {
+	case PATH_OLD:
+		return old_permission(d, global, client);
+	case PATH_OWNERS:
+		return permission_cache_get(&d->cache, global, client);
+	case PATH_CLIENT:
+		/* module-flatpak finds the client info by global id */
+		i = pw_global_get_id(pw_client_get_global(client)) - d->first_client;
+		return permission_client_get(&d->permissions[i], &d->cache, global);
+	}
+	return 0;
+}
+
+/* get the permissions of all globals for all clients, return the number
+ * of globals that were visible */
+static uint64_t enumerate(struct data *d)
+{
+	uint64_t visible = 0;
+	uint32_t i, j;
+
+	for (i = 0; i < N_CLIENTS; i++) {
+		for (j = 0; j < N_GLOBALS; j++) {
+			if (PW_PERM_IS_R(pw_global_get_permissions(d->globals[j], d->clients[i])))
+				visible++;
+		}
+	}
+	return visible;
+}
+
+static void run(struct bench *b, struct data *d, enum path path, uint64_t rounds)
+{
+	char params[128];
+	struct bench_result r = { "registry", params, rounds * N_CLIENTS * N_GLOBALS, };
+	uint64_t i, start, t, *samples, visible = 0;
+
+	snprintf(params, sizeof(params), "clients=%d,globals=%d,path=%s",
+		 N_CLIENTS, N_GLOBALS, path_names[path]);
+
+	samples = malloc(rounds * sizeof(uint64_t));
+
+	d->path = path;
+	enumerate(d);
+
+	start = bench_now();
+	for (i = 0; i < rounds; i++) {
+		t = bench_now();
+		visible += enumerate(d);
+		samples[i] = bench_now() - t;
+	}
+	r.elapsed = bench_now() - start;
+
+	if (visible != rounds * d->visible) {
+		fprintf(stderr, "unexpected number of visible globals %" PRIu64 "\n", visible);
+		exit(1);
+	}
+
+	bench_latency(&r, samples, rounds);
+	bench_report(b, &r);
+	free(samples);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data d = { NULL, };
+	struct bench b;
+	uint64_t rounds;
+	uint32_t i;
+
+	pw_init(&argc, &argv);
+
+	bench_init(&b, "permissions", argc, argv);
+	rounds = bench_iterations(&b, 100);
+
+	d.loop = pw_loop_new(NULL);
+	d.core = pw_core_new(d.loop, NULL);
+	d.t = pw_core_get_type(d.core);
+
+	permission_cache_init(&d.cache, d.core);
+	pw_core_set_permission_callback(d.core, do_permission, &d);
+
+	for (i = 0; i < N_CLIENTS; i++) {
+		struct ucred ucred = { 1000 + i, 1000 + (i % N_UIDS), 1000 + (i % N_UIDS) };
+
+		d.clients[i] = pw_client_new(d.core, &ucred, NULL, 0);
+		permission_client_init(&d.permissions[i], d.clients[i]);
+	}
+	d.first_client = pw_global_get_id(pw_client_get_global(d.clients[0]));
+	/* the nodes of the clients, every tenth one is made by the daemon. A
+	 * client sees the nodes of its own uid and the ones of the daemon. */
+	for (i = 0; i < N_GLOBALS; i++) {
+		struct pw_client *owner = (i % 10) == 0 ? NULL : d.clients[i % N_CLIENTS];
+		uint32_t j;
+
+		d.globals[i] = pw_core_add_global(d.core, owner, NULL, d.t->node, 0, NULL, NULL);
+
+		for (j = 0; j < N_CLIENTS; j++)
+			if (owner == NULL || (j % N_UIDS) == ((i % N_CLIENTS) % N_UIDS))
+				d.visible++;
+	}
+
+	run(&b, &d, PATH_OLD, rounds);
+	run(&b, &d, PATH_OWNERS, rounds);
+	run(&b, &d, PATH_CLIENT, rounds);
+
+	for (i = 0; i < N_GLOBALS; i++) {
+		permission_cache_global_removed(&d.cache, d.globals[i]);
+		pw_global_destroy(d.globals[i]);
+	}
+	for (i = 0; i < N_CLIENTS; i++) {
+		permission_client_clear(&d.permissions[i]);
+		pw_client_destroy(d.clients[i]);
+	}
+
+	permission_cache_clear(&d.cache);
+	pw_core_destroy(d.core);
+	pw_loop_destroy(d.loop);
+
+	return bench_finish(&b);
+}
@@ -0,0 +1,185 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/* Measure how many buffers pipewiresink has to copy per frame.
+ *
+ * Runs videotestsrc ! pipewiresink in provide mode, once with the
+ * allocation query of the sink answered (upstream renders in the
+ * PipeWire buffers) and once with the allocation query dropped, which
+ * forces a copy into the PipeWire buffers like before the sink proposed
+ * its pool.
+ *
+ * The stream is consumed by a pipewiresrc ! fakesink pipeline in the same
+ * process, the node of the sink is looked up with the PipeWire device
+ * provider. The benchmark is skipped when there is no PipeWire daemon.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <gst/gst.h>
+
+#include <tests/bench.h>
+
+#define DEFAULT_FRAMES	600
+#define WIDTH		1920
+#define HEIGHT		1080
+
+#define SKIP		77
+
+static GstElement *make_consumer(GstDeviceProvider *provider, const char *name)
+{
+	GstElement *consumer = NULL;
+	int i;
+
+	/* the node of the sink appears when its stream is connected */
+	for (i = 0; i < 50 && consumer == NULL; i++) {
+		GList *devices, *l;
+
+		devices = gst_device_provider_get_devices(provider);
+		for (l = devices; l; l = l->next) {
+			GstDevice *dev = l->data;
+			gchar *dev_name = gst_device_get_display_name(dev);
+
+			if (consumer == NULL && g_strcmp0(dev_name, name) == 0) {
+				GstElement *src, *sink;
+
+				consumer = gst_pipeline_new("consumer");
+				src = gst_device_create_element(dev, "src");
+				sink = gst_element_factory_make("fakesink", "sink");
+				g_object_set(sink, "sync", FALSE, NULL);
+				gst_bin_add_many(GST_BIN(consumer), src, sink, NULL);
+				gst_element_link(src, sink);
+			}
+			g_free(dev_name);
+		}
+		g_list_free_full(devices, gst_object_unref);
+
+		if (consumer == NULL)
+			g_usleep(100 * 1000);
+	}
+	return consumer;
+}
+
+static int run(struct bench *b, GstDeviceProvider *provider, const char *mode, const char *convert,
+	       int n_frames)
+{
+	GstElement *pipeline, *sink, *consumer;
+	GstBus *bus;
+	GstMessage *msg;
+	GError *error = NULL;
+	guint64 copied = 0;
+	uint64_t start, elapsed;
+	char *desc, *name, params[128];
+	struct bench_result r = { "sink-copies", params, };
+	int res = SKIP;
+
+	name = g_strdup_printf("bench-sink-copies-%d-%s", getpid(), mode);
+	desc = g_strdup_printf("videotestsrc num-buffers=%d ! "
+			       "video/x-raw,format=I420,width=%d,height=%d ! %s"
+			       "pipewiresink name=sink mode=provide client-name=%s",
+			       n_frames, WIDTH, HEIGHT, convert, name);
+	pipeline = gst_parse_launch(desc, &error);
+	g_free(desc);
+	if (pipeline == NULL) {
+		fprintf(stderr, "can't create pipeline: %s\n", error->message);
+		g_clear_error(&error);
+		g_free(name);
+		return SKIP;
+	}
+	sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+	bus = gst_element_get_bus(pipeline);
+
+	if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+		fprintf(stderr, "%s: can't start the sink, is the daemon running?\n", mode);
+		goto done;
+	}
+	if ((consumer = make_consumer(provider, name)) == NULL) {
+		fprintf(stderr, "%s: node %s not found\n", mode, name);
+		goto done;
+	}
+
+	start = bench_now();
+	gst_element_set_state(consumer, GST_STATE_PLAYING);
+
+	msg = gst_bus_timed_pop_filtered(bus, 30 * GST_SECOND,
+					 GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+	elapsed = bench_now() - start;
+
+	if (msg == NULL) {
+		fprintf(stderr, "%s: timeout\n", mode);
+	} else if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+		gst_message_parse_error(msg, &error, NULL);
+		fprintf(stderr, "%s: error: %s\n", mode, error->message);
+		g_clear_error(&error);
+		res = 1;
+	} else {
+		g_object_get(sink, "copied-buffers", &copied, NULL);
+
+		snprintf(params, sizeof(params), "mode=%s,frames=%d,copies_per_frame=%.2f",
+			 mode, n_frames, (double) copied / n_frames);
+		r.n_ops = n_frames;
+		r.elapsed = elapsed;
+		r.bytes = (uint64_t) n_frames * WIDTH * HEIGHT * 3 / 2;
+		bench_report(b, &r);
+		res = 0;
+	}
+	if (msg)
+		gst_message_unref(msg);
+
+	gst_element_set_state(consumer, GST_STATE_NULL);
+	gst_object_unref(consumer);
+
+      done:
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(bus);
+	gst_object_unref(sink);
+	gst_object_unref(pipeline);
+	g_free(name);
+
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	GstDeviceProvider *provider;
+	struct bench b;
+	int n_frames, res;
+
+	gst_init(&argc, &argv);
+
+	bench_init(&b, "sink-copies", argc, argv);
+	n_frames = bench_iterations(&b, DEFAULT_FRAMES);
+
+	provider = gst_device_provider_factory_get_by_name("pipewiredeviceprovider");
+	if (provider == NULL) {
+		fprintf(stderr, "no pipewire device provider\n");
+		bench_finish(&b);
+		return SKIP;
+	}
+
+	res = run(&b, provider, "copy", "identity drop-allocation=true ! ", n_frames);
+	if (res == 0)
+		res = run(&b, provider, "zero-copy", "", n_frames);
+
+	gst_object_unref(provider);
+	bench_finish(&b);
+
+	return res;
+}
@@ -0,0 +1,197 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure the round trip of one cycle over the client-node transport.
+ *
+ * The server side writes a PROCESS_INPUT message in the shared memory
+ * ringbuffer and wakes up the client, the client reads the message,
+ * answers with HAVE_OUTPUT and wakes up the server again. This is what
+ * happens for every cycle of a client node, without the rest of the
+ * daemon. The client runs in a thread and maps the transport from the
+ * memfd like a remote client does.
+ *
+ * The wakeup is done with a pair of eventfds, like module-client-node,
+ * or with a socketpair.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include <pipewire/pipewire.h>
+#include <extensions/client-node.h>
+
+#include "../modules/module-client-node/transport.h"
+
+#include <tests/bench.h>
+
+struct data {
+	struct pw_client_node_transport *server;
+	struct pw_client_node_transport *client;
+	bool socket;
+	int fds[2];		/* server -> client, client -> server */
+	int sockets[2];
+	uint64_t cycles;
+};
+
+static void do_signal(struct data *d, int fd)
+{
+	uint64_t cmd = 1;
+
+	if (write(fd, &cmd, d->socket ? 1 : sizeof(uint64_t)) < 0)
+		fprintf(stderr, "write failed: %s\n", strerror(errno));
+}
+
+static void do_wait(struct data *d, int fd)
+{
+	uint64_t cmd;
+
+	if (read(fd, &cmd, d->socket ? 1 : sizeof(uint64_t)) < 0)
+		fprintf(stderr, "read failed: %s\n", strerror(errno));
+}
+
+static int
+handle_messages(struct pw_client_node_transport *trans, uint32_t expected)
+{
+	struct pw_client_node_message message;
+	int n = 0;
+
+	while (pw_client_node_transport_next_message(trans, &message) == SPA_RESULT_OK) {
+		struct pw_client_node_message *msg = alloca(SPA_POD_SIZE(&message));
+		pw_client_node_transport_parse_message(trans, msg);
+		if (PW_CLIENT_NODE_MESSAGE_TYPE(msg) != expected)
+			return -1;
+		n++;
+	}
+	return n;
+}
+
+static void *client_thread(void *user_data)
+{
+	struct data *d = user_data;
+	int in = d->socket ? d->sockets[1] : d->fds[0];
+	int out = d->socket ? d->sockets[1] : d->fds[1];
+	uint64_t i;
+
+	for (i = 0; i < d->cycles; i++) {
+		do_wait(d, in);
+		if (handle_messages(d->client, PW_CLIENT_NODE_MESSAGE_PROCESS_INPUT) != 1) {
+			fprintf(stderr, "client: unexpected message\n");
+			exit(1);
+		}
+		d->client->outputs[0].buffer_id = d->client->inputs[0].buffer_id;
+		d->client->outputs[0].status = SPA_RESULT_HAVE_BUFFER;
+
+		pw_client_node_transport_add_message(d->client,
+			&PW_CLIENT_NODE_MESSAGE_INIT(PW_CLIENT_NODE_MESSAGE_HAVE_OUTPUT));
+		do_signal(d, out);
+	}
+	return NULL;
+}
+
+static void run(struct bench *b, struct data *d, uint64_t cycles)
+{
+	struct bench_result r = { "roundtrip", d->socket ? "wakeup=socket" : "wakeup=eventfd",
+				  cycles, };
+	int in = d->socket ? d->sockets[0] : d->fds[1];
+	int out = d->socket ? d->sockets[0] : d->fds[0];
+	uint64_t i, start, t, *samples;
+	pthread_t thread;
+
+	samples = malloc(cycles * sizeof(uint64_t));
+	d->cycles = cycles;
+
+	pthread_create(&thread, NULL, client_thread, d);
+
+	start = bench_now();
+	for (i = 0; i < cycles; i++) {
+		t = bench_now();
+		d->server->inputs[0].buffer_id = i & 7;
+		d->server->inputs[0].status = SPA_RESULT_HAVE_BUFFER;
+
+		pw_client_node_transport_add_message(d->server,
+			&PW_CLIENT_NODE_MESSAGE_INIT(PW_CLIENT_NODE_MESSAGE_PROCESS_INPUT));
+		do_signal(d, out);
+
+		do_wait(d, in);
+		if (handle_messages(d->server, PW_CLIENT_NODE_MESSAGE_HAVE_OUTPUT) != 1 ||
+		    d->server->outputs[0].buffer_id != (i & 7)) {
+			fprintf(stderr, "server: unexpected message\n");
+			exit(1);
+		}
+		samples[i] = bench_now() - t;
+	}
+	r.elapsed = bench_now() - start;
+
+	pthread_join(thread, NULL);
+
+	bench_latency(&r, samples, cycles);
+	bench_report(b, &r);
+	free(samples);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pw_client_node_transport_info info;
+	struct bench b;
+	struct data d = { NULL, };
+	uint64_t cycles;
+
+	pw_init(&argc, &argv);
+
+	bench_init(&b, "transport", argc, argv);
+	cycles = bench_iterations(&b, 100000);
+
+	d.server = pw_client_node_transport_new(1, 1);
+	if (d.server == NULL ||
+	    pw_client_node_transport_get_info(d.server, &info) != SPA_RESULT_OK) {
+		fprintf(stderr, "can't create transport\n");
+		return 1;
+	}
+	info.memfd = dup(info.memfd);
+	d.client = pw_client_node_transport_new_from_info(&info);
+	if (d.client == NULL) {
+		fprintf(stderr, "can't map transport\n");
+		return 1;
+	}
+
+	d.fds[0] = eventfd(0, EFD_CLOEXEC);
+	d.fds[1] = eventfd(0, EFD_CLOEXEC);
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, d.sockets) < 0) {
+		fprintf(stderr, "can't create sockets: %s\n", strerror(errno));
+		return 1;
+	}
+
+	d.socket = false;
+	run(&b, &d, cycles);
+	d.socket = true;
+	run(&b, &d, cycles);
+
+	close(d.fds[0]);
+	close(d.fds[1]);
+	close(d.sockets[0]);
+	close(d.sockets[1]);
+	pw_client_node_transport_destroy(d.client);
+	pw_client_node_transport_destroy(d.server);
+
+	return bench_finish(&b);
+}
@@ -0,0 +1,579 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Link two sources to the same input port of a sink and check that the
+ * sink receives the sum of the samples of both sources.
+ *
+ * The sources produce F32 samples of 0.25 and 0.5, in every cycle of the
+ * core the sink must see 0.75 in a buffer of its own port.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include <spa/format-builder.h>
+#include <spa/format-utils.h>
+#include <spa/audio/format-utils.h>
+#include <spa/audio/raw-utils.h>
+#include <lib/format.h>
+
+#include <pipewire/pipewire.h>
+
+#define N_SOURCES	2
+#define N_CYCLES	16
+#define MAX_BUFFERS	64
+#define MAX_ITERATIONS	1000
+
+#define PROP(f,key,type,...)							\
+	SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+
+struct type {
+	uint32_t format;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+};
+
+struct data;
+
+struct node {
+	struct spa_node node;
+	struct data *data;
+	const struct spa_node_callbacks *callbacks;
+	void *callbacks_data;
+
+	enum spa_direction direction;
+	float value;
+
+	struct spa_port_info info;
+	bool have_format;
+	uint8_t format_buffer[1024];
+	uint8_t enum_buffer[1024];
+
+	struct spa_port_io *io;
+	struct spa_buffer *buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+	uint32_t next;
+};
+
+struct data {
+	struct pw_loop *loop;
+	struct pw_core *core;
+	struct spa_loop *data_loop;
+	struct type type;
+
+	struct pw_node *sources[N_SOURCES];
+	struct pw_node *sink;
+	struct pw_link *links[N_SOURCES];
+	uint32_t n_running;
+
+	uint32_t n_mixed;
+	uint32_t n_errors;
+};
+
+static int node_get_props(struct spa_node *node, struct spa_props **props)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int node_set_props(struct spa_node *node, const struct spa_props *props)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int node_send_command(struct spa_node *node, const struct spa_command *command)
+{
+	return SPA_RESULT_OK;
+}
+
+static int
+node_set_callbacks(struct spa_node *node, const struct spa_node_callbacks *callbacks, void *data)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	n->callbacks = callbacks;
+	n->callbacks_data = data;
+	return SPA_RESULT_OK;
+}
+
+static int
+node_get_n_ports(struct spa_node *node,
+		 uint32_t *n_input_ports,
+		 uint32_t *max_input_ports,
+		 uint32_t *n_output_ports,
+		 uint32_t *max_output_ports)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+	bool input = n->direction == SPA_DIRECTION_INPUT;
+
+	if (n_input_ports)
+		*n_input_ports = input ? 1 : 0;
+	if (max_input_ports)
+		*max_input_ports = input ? 1 : 0;
+	if (n_output_ports)
+		*n_output_ports = input ? 0 : 1;
+	if (max_output_ports)
+		*max_output_ports = input ? 0 : 1;
+	return SPA_RESULT_OK;
+}
+
+static int
+node_get_port_ids(struct spa_node *node,
+		  uint32_t n_input_ports,
+		  uint32_t *input_ids,
+		  uint32_t n_output_ports,
+		  uint32_t *output_ids)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	if (n->direction == SPA_DIRECTION_INPUT && n_input_ports > 0 && input_ids)
+		input_ids[0] = 0;
+	else if (n->direction == SPA_DIRECTION_OUTPUT && n_output_ports > 0 && output_ids)
+		output_ids[0] = 0;
+	return SPA_RESULT_OK;
+}
+
+static int node_add_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int node_remove_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+node_port_enum_formats(struct spa_node *node,
+		       enum spa_direction direction,
+		       uint32_t port_id,
+		       struct spa_format **format,
+		       const struct spa_format *filter,
+		       uint32_t index)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+	struct type *t = &n->data->type;
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_frame f[2];
+	uint8_t buffer[256];
+	struct spa_format *fmt;
+	int res;
+
+	if (index > 0)
+		return SPA_RESULT_ENUM_END;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	spa_pod_builder_format(&b, &f[0], t->format,
+		t->media_type.audio, t->media_subtype.raw,
+		PROP(&f[1], t->format_audio.format, SPA_POD_TYPE_ID, t->audio_format.F32),
+		PROP(&f[1], t->format_audio.layout, SPA_POD_TYPE_INT, SPA_AUDIO_LAYOUT_INTERLEAVED),
+		PROP(&f[1], t->format_audio.rate, SPA_POD_TYPE_INT, 44100),
+		PROP(&f[1], t->format_audio.channels, SPA_POD_TYPE_INT, 1));
+	fmt = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_format);
+
+	spa_pod_builder_init(&b, n->enum_buffer, sizeof(n->enum_buffer));
+	if ((res = spa_format_filter(fmt, filter, &b)) != SPA_RESULT_OK)
+		return res;
+
+	*format = SPA_POD_BUILDER_DEREF(&b, 0, struct spa_format);
+
+	return SPA_RESULT_OK;
+}
+
+static int
+node_port_set_format(struct spa_node *node,
+		     enum spa_direction direction,
+		     uint32_t port_id,
+		     uint32_t flags,
+		     const struct spa_format *format)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	if (format == NULL) {
+		n->have_format = false;
+		return SPA_RESULT_OK;
+	}
+	if (SPA_POD_SIZE(format) > sizeof(n->format_buffer))
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	memcpy(n->format_buffer, format, SPA_POD_SIZE(format));
+	n->have_format = true;
+
+	return SPA_RESULT_OK;
+}
+
+static int
+node_port_get_format(struct spa_node *node,
+		     enum spa_direction direction,
+		     uint32_t port_id,
+		     const struct spa_format **format)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	if (!n->have_format)
+		return SPA_RESULT_NO_FORMAT;
+
+	*format = (const struct spa_format *) n->format_buffer;
+	return SPA_RESULT_OK;
+}
+
+static int
+node_port_get_info(struct spa_node *node,
+		   enum spa_direction direction,
+		   uint32_t port_id,
+		   const struct spa_port_info **info)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	*info = &n->info;
+	return SPA_RESULT_OK;
+}
+
+static int
+node_port_enum_params(struct spa_node *node,
+		      enum spa_direction direction,
+		      uint32_t port_id,
+		      uint32_t index,
+		      struct spa_param **param)
+{
+	return SPA_RESULT_ENUM_END;
+}
+
+static int
+node_port_set_param(struct spa_node *node,
+		    enum spa_direction direction,
+		    uint32_t port_id,
+		    const struct spa_param *param)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+node_port_use_buffers(struct spa_node *node,
+		      enum spa_direction direction,
+		      uint32_t port_id,
+		      struct spa_buffer **buffers,
+		      uint32_t n_buffers)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+	uint32_t i;
+
+	if (n_buffers > MAX_BUFFERS)
+		return SPA_RESULT_INVALID_ARGUMENTS;
+
+	for (i = 0; i < n_buffers; i++)
+		n->buffers[i] = buffers[i];
+	n->n_buffers = n_buffers;
+	n->next = 0;
+
+	return SPA_RESULT_OK;
+}
+
+static int
+node_port_alloc_buffers(struct spa_node *node,
+			enum spa_direction direction,
+			uint32_t port_id,
+			struct spa_param **params,
+			uint32_t n_params,
+			struct spa_buffer **buffers,
+			uint32_t *n_buffers)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int
+node_port_set_io(struct spa_node *node,
+		 enum spa_direction direction,
+		 uint32_t port_id,
+		 struct spa_port_io *io)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+
+	n->io = io;
+	return SPA_RESULT_OK;
+}
+
+static int node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	return SPA_RESULT_OK;
+}
+
+static int
+node_port_send_command(struct spa_node *node,
+		       enum spa_direction direction,
+		       uint32_t port_id,
+		       const struct spa_command *command)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+/* the sink checks the mixed samples and gives the buffer back */
+static int node_process_input(struct spa_node *node)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+	struct data *d = n->data;
+	struct spa_port_io *io = n->io;
+	struct spa_data *sd;
+	float *samples;
+	uint32_t i, n_samples;
+
+	if (io == NULL || io->status != SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_NEED_BUFFER;
+
+	if (io->buffer_id >= n->n_buffers) {
+		fprintf(stderr, "buffer %u not of the sink port\n", io->buffer_id);
+		d->n_errors++;
+		goto done;
+	}
+
+	sd = &n->buffers[io->buffer_id]->datas[0];
+	samples = SPA_MEMBER(sd->data, sd->chunk->offset, float);
+	n_samples = sd->chunk->size / sizeof(float);
+
+	if (n_samples == 0)
+		d->n_errors++;
+
+	for (i = 0; i < n_samples; i++) {
+		if (fabsf(samples[i] - 0.75f) > 1e-6f) {
+			fprintf(stderr, "sample %u: %f != 0.75\n", i, samples[i]);
+			d->n_errors++;
+			break;
+		}
+	}
+	d->n_mixed++;
+
+      done:
+	io->status = SPA_RESULT_NEED_BUFFER;
+	return SPA_RESULT_NEED_BUFFER;
+}
+
+/* the sources fill a buffer with their value */
+static int node_process_output(struct spa_node *node)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node);
+	struct spa_port_io *io = n->io;
+	struct spa_data *sd;
+	float *samples;
+	uint32_t i, id, n_samples;
+
+	if (io == NULL || n->n_buffers == 0)
+		return SPA_RESULT_ERROR;
+
+	if (io->status == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_HAVE_BUFFER;
+
+	id = n->next++ % n->n_buffers;
+	sd = &n->buffers[id]->datas[0];
+	samples = sd->data;
+	n_samples = sd->maxsize / sizeof(float);
+
+	for (i = 0; i < n_samples; i++)
+		samples[i] = n->value;
+
+	sd->chunk->offset = 0;
+	sd->chunk->size = n_samples * sizeof(float);
+	sd->chunk->stride = sizeof(float);
+
+	io->buffer_id = id;
+	io->status = SPA_RESULT_HAVE_BUFFER;
+
+	return SPA_RESULT_HAVE_BUFFER;
+}
+
+static const struct spa_node node_impl = {
+	SPA_VERSION_NODE,
+	NULL,
+	node_get_props,
+	node_set_props,
+	node_send_command,
+	node_set_callbacks,
+	node_get_n_ports,
+	node_get_port_ids,
+	node_add_port,
+	node_remove_port,
+	node_port_enum_formats,
+	node_port_set_format,
+	node_port_get_format,
+	node_port_get_info,
+	node_port_enum_params,
+	node_port_set_param,
+	node_port_use_buffers,
+	node_port_alloc_buffers,
+	node_port_set_io,
+	node_port_reuse_buffer,
+	node_port_send_command,
+	node_process_input,
+	node_process_output,
+};
+
+static struct pw_node *make_node(struct data *d, const char *name,
+				 enum spa_direction direction, float value)
+{
+	struct pw_node *node;
+	struct node *n;
+
+	node = pw_node_new(d->core, name, NULL, sizeof(struct node));
+	n = pw_node_get_user_data(node);
+	n->node = node_impl;
+	n->data = d;
+	n->direction = direction;
+	n->value = value;
+	n->info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+
+	pw_node_set_implementation(node, &n->node);
+	pw_node_register(node, NULL, NULL);
+	pw_node_set_active(node, true);
+
+	return node;
+}
+
+static void link_state_changed(void *data, enum pw_link_state old,
+			       enum pw_link_state state, const char *error)
+{
+	struct data *d = data;
+
+	if (state == PW_LINK_STATE_RUNNING)
+		d->n_running++;
+	else if (state == PW_LINK_STATE_ERROR) {
+		fprintf(stderr, "link error: %s\n", error ? error : "");
+		exit(1);
+	}
+}
+
+static const struct pw_link_events link_events = {
+	PW_VERSION_LINK_EVENTS,
+	.state_changed = link_state_changed,
+};
+
+static void make_link(struct data *d, uint32_t index)
+{
+	struct pw_port *output, *input;
+	struct pw_link *link;
+	char *error = NULL;
+	uint32_t iterations;
+
+	output = pw_node_get_free_port(d->sources[index], PW_DIRECTION_OUTPUT);
+	/* the port of the sink is reused when it can mix */
+	input = pw_node_get_free_port(d->sink, PW_DIRECTION_INPUT);
+	if (output == NULL || input == NULL) {
+		fprintf(stderr, "no free port for link %u\n", index);
+		exit(1);
+	}
+
+	link = pw_link_new(d->core, output, input, NULL, NULL, &error,
+			   sizeof(struct spa_hook));
+	if (link == NULL) {
+		fprintf(stderr, "can't make link: %s\n", error);
+		exit(1);
+	}
+	pw_link_add_listener(link, pw_link_get_user_data(link), &link_events, d);
+	pw_link_register(link, NULL, NULL);
+	d->links[index] = link;
+
+	for (iterations = 0; d->n_running <= index; iterations++) {
+		if (iterations == MAX_ITERATIONS) {
+			fprintf(stderr, "link %u not running\n", index);
+			exit(1);
+		}
+		pw_loop_iterate(d->loop, 0);
+	}
+}
+
+static int
+do_get_mixed(struct spa_loop *loop,
+	     bool async, uint32_t seq, size_t size, const void *data, void *user_data)
+{
+	struct data *d = user_data;
+	return d->n_mixed;
+}
+
+/* the core starts the cycles of the sink from the data loop */
+static void wait_cycles(struct data *d)
+{
+	uint32_t iterations;
+
+	for (iterations = 0; iterations < MAX_ITERATIONS; iterations++) {
+		if (spa_loop_invoke(d->data_loop, do_get_mixed, 0, 0, NULL, true, d) >= N_CYCLES)
+			break;
+		pw_loop_iterate(d->loop, 10);
+	}
+}
+
+static struct spa_loop *find_data_loop(struct pw_core *core)
+{
+	const struct spa_support *support;
+	uint32_t i, n_support;
+
+	support = pw_core_get_support(core, &n_support);
+	for (i = 0; i < n_support; i++) {
+		if (strcmp(support[i].type, SPA_TYPE_LOOP__DataLoop) == 0)
+			return support[i].data;
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data d = { NULL, };
+	uint32_t i;
+
+	pw_init(&argc, &argv);
+
+	d.loop = pw_loop_new(NULL);
+	d.core = pw_core_new(d.loop, NULL);
+	d.data_loop = find_data_loop(d.core);
+
+	{
+		struct spa_type_map *map = pw_core_get_type(d.core)->map;
+
+		d.type.format = spa_type_map_get_id(map, SPA_TYPE__Format);
+		spa_type_media_type_map(map, &d.type.media_type);
+		spa_type_media_subtype_map(map, &d.type.media_subtype);
+		spa_type_format_audio_map(map, &d.type.format_audio);
+		spa_type_audio_format_map(map, &d.type.audio_format);
+	}
+
+	pw_loop_enter(d.loop);
+
+	d.sink = make_node(&d, "sink", SPA_DIRECTION_INPUT, 0.0);
+	for (i = 0; i < N_SOURCES; i++) {
+		d.sources[i] = make_node(&d, "source", SPA_DIRECTION_OUTPUT, 0.25 * (i + 1));
+		make_link(&d, i);
+	}
+
+	wait_cycles(&d);
+
+	for (i = 0; i < N_SOURCES; i++)
+		pw_link_destroy(d.links[i]);
+
+	printf("mixed %u of %u cycles, %u errors\n", d.n_mixed, N_CYCLES, d.n_errors);
+	pw_loop_iterate(d.loop, 0);
+
+	for (i = 0; i < N_SOURCES; i++)
+		pw_node_destroy(d.sources[i]);
+	pw_node_destroy(d.sink);
+
+	pw_loop_leave(d.loop);
+
+	pw_core_destroy(d.core);
+	pw_loop_destroy(d.loop);
+
+	return d.n_mixed >= N_CYCLES && d.n_errors == 0 ? 0 : 1;
+}
@@ -115,6 +115,8 @@ enum pw_client_node_message_type {
 	PW_CLIENT_NODE_MESSAGE_REUSE_BUFFER,
 	PW_CLIENT_NODE_MESSAGE_PROCESS_INPUT,
 	PW_CLIENT_NODE_MESSAGE_PROCESS_OUTPUT,
+	PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS,
+	PW_CLIENT_NODE_MESSAGE_PROCESS,
 };
 
 struct pw_client_node_message_body {
@@ -154,6 +156,65 @@ struct pw_client_node_message_reuse_buffer {
 		SPA_POD_INT_INIT(port_id),						\
 		SPA_POD_INT_INIT(buffer_id))
 
+struct pw_client_node_message_reuse_buffers_body {
+	struct spa_pod_int type		SPA_ALIGNED(8);
+	struct spa_pod_int port_id	SPA_ALIGNED(8);
+	struct spa_pod_array buffer_ids	SPA_ALIGNED(8);
+	/* array of uint32_t buffer ids follows */
+};
+
+/** Reuse a batch of buffers on a port with one message */
+struct pw_client_node_message_reuse_buffers {
+	struct spa_pod_struct pod;
+	struct pw_client_node_message_reuse_buffers_body body;
+};
+
+#define PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_INIT(port_id,n_ids)				\
+	PW_CLIENT_NODE_MESSAGE_INIT_VA(struct pw_client_node_message_reuse_buffers,	\
+		sizeof(struct pw_client_node_message_reuse_buffers_body) +		\
+			(n_ids) * sizeof(uint32_t),					\
+		PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS,					\
+		SPA_POD_INT_INIT(port_id),						\
+		{ { sizeof(struct spa_pod_array_body) + (n_ids) * sizeof(uint32_t),	\
+		    SPA_POD_TYPE_ARRAY },						\
+		  { { sizeof(uint32_t), SPA_POD_TYPE_INT } } })
+
+/** Check that the array of buffer ids fits in the message. The size of the
+ * array comes from the peer, check this before using the ids. */
+#define PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_IS_VALID(m)					\
+	(SPA_POD_SIZE(m) >= sizeof(struct pw_client_node_message_reuse_buffers) &&	\
+	 (m)->body.buffer_ids.pod.size >= sizeof(struct spa_pod_array_body) &&		\
+	 (m)->body.buffer_ids.body.child.size == sizeof(uint32_t) &&			\
+	 (m)->body.buffer_ids.pod.size <= SPA_POD_SIZE(m) - sizeof(struct spa_pod) -	\
+		offsetof(struct pw_client_node_message_reuse_buffers, body.buffer_ids))
+
+#define PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_N_IDS(m)					\
+	(((m)->body.buffer_ids.pod.size - sizeof(struct spa_pod_array_body)) / sizeof(uint32_t))
+#define PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_IDS(m)					\
+	SPA_MEMBER(&(m)->body.buffer_ids, sizeof(struct spa_pod_array), uint32_t)
+
+#define PW_CLIENT_NODE_PROCESS_INPUT	(1 << 0)	/**< new input is in the transport */
+#define PW_CLIENT_NODE_PROCESS_OUTPUT	(1 << 1)	/**< output is needed */
+
+struct pw_client_node_message_process_body {
+	struct spa_pod_int type		SPA_ALIGNED(8);
+	struct spa_pod_int flags	SPA_ALIGNED(8);
+};
+
+/** Process input and/or output of a node with one message. The server
+ * sends this once per cycle with the flags of everything that was
+ * requested in the cycle. */
+struct pw_client_node_message_process {
+	struct spa_pod_struct pod;
+	struct pw_client_node_message_process_body body;
+};
+
+#define PW_CLIENT_NODE_MESSAGE_PROCESS_INIT(flags)					\
+	PW_CLIENT_NODE_MESSAGE_INIT_VA(struct pw_client_node_message_process,		\
+		sizeof(struct pw_client_node_message_process_body),			\
+		PW_CLIENT_NODE_MESSAGE_PROCESS,						\
+		SPA_POD_INT_INIT(flags))
+
 
 /** information about a buffer */
 struct pw_client_node_buffer {
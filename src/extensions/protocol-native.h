@@ -25,6 +25,7 @@ extern "C" {
 #endif
 
 #include <spa/defs.h>
+#include <spa/pod-parser.h>
 #include <spa/props.h>
 #include <spa/format.h>
 #include <spa/param-alloc.h>
@@ -34,7 +35,7 @@ extern "C" {
 #define PW_TYPE_PROTOCOL_NATIVE_BASE	PW_TYPE_PROTOCOL__Native ":"
 
 struct pw_protocol_native_demarshal {
-	bool (*func) (void *object, void *data, size_t size);
+	bool (*func) (void *object, struct spa_pod_parser *parser);
 
 #define PW_PROTOCOL_NATIVE_REMAP	(1<<0)
 #define PW_PROTOCOL_NATIVE_PERM_W	(1<<1)
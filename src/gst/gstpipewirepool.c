@@ -21,7 +21,11 @@
 #include "config.h"
 #endif
 
+#include <unistd.h>
+
 #include <gst/gst.h>
+#include <gst/allocators/gstfdmemory.h>
+#include <gst/allocators/gstdmabuf.h>
 
 #include "gstpipewirepool.h"
 
@@ -40,6 +44,8 @@ enum
 
 static guint pool_signals[LAST_SIGNAL] = { 0 };
 
+static GQuark pool_data_quark;
+
 GstPipeWirePool *
 gst_pipewire_pool_new (void)
 {
@@ -79,6 +85,249 @@ gst_pipewire_pool_remove_buffer (GstPipeWirePool *pool, GstBuffer *buffer)
   return res;
 }
 
+void
+gst_pipewire_pool_set_caps (GstPipeWirePool *pool, GstCaps *caps)
+{
+  g_return_if_fail (GST_IS_PIPEWIRE_POOL (pool));
+
+  pool->add_video_meta = caps && gst_video_info_from_caps (&pool->video_info, caps);
+}
+
+static void
+pool_data_destroy (gpointer user_data)
+{
+  GstPipeWirePoolData *data = user_data;
+
+  if (data->owner)
+    gst_object_unref (data->owner);
+  g_slice_free (GstPipeWirePoolData, data);
+}
+
+/**
+ * gst_pipewire_pool_import_buffer:
+ * @pool: a #GstPipeWirePool
+ * @id: the PipeWire buffer id
+ * @b: the PipeWire buffer
+ * @owner: (allow-none): object to keep alive while the buffer exists
+ *
+ * Wrap @b in a new #GstBuffer and index it in @pool under @id. The memory
+ * of @b is wrapped with the dmabuf, fd or wrapped allocator depending on
+ * its type and the video metadata is added once so that the buffer can be
+ * reused for each frame without further allocations.
+ *
+ * Returns: (transfer full): the #GstBuffer for @id
+ */
+GstBuffer *
+gst_pipewire_pool_import_buffer (GstPipeWirePool *pool, guint id,
+    struct spa_buffer *b, gpointer owner)
+{
+  GstPipeWirePoolData *data;
+  GstBuffer *buf;
+  struct pw_type *t = pool->t;
+  guint i;
+
+  g_return_val_if_fail (GST_IS_PIPEWIRE_POOL (pool), NULL);
+  g_return_val_if_fail (t != NULL, NULL);
+
+  buf = gst_buffer_new ();
+
+  data = g_slice_new0 (GstPipeWirePoolData);
+  data->pool = pool;
+  data->owner = owner ? gst_object_ref (owner) : NULL;
+  data->id = id;
+  data->b = b;
+  data->buf = buf;
+  data->header = spa_buffer_find_meta (b, t->meta.Header);
+  data->crop = spa_buffer_find_meta (b, t->meta.VideoCrop);
+  data->link.data = buf;
+
+  for (i = 0; i < b->n_datas; i++) {
+    struct spa_data *d = &b->datas[i];
+    GstMemory *gmem = NULL;
+
+    if (d->type == t->data.DmaBuf) {
+      gmem = gst_dmabuf_allocator_alloc (pool->dmabuf_allocator, dup (d->fd),
+                d->mapoffset + d->maxsize);
+      gst_memory_resize (gmem, d->chunk->offset + d->mapoffset, d->chunk->size);
+      data->offset = d->mapoffset;
+    }
+    else if (d->type == t->data.MemFd) {
+      gmem = gst_fd_allocator_alloc (pool->fd_allocator, dup (d->fd),
+                d->mapoffset + d->maxsize, GST_FD_MEMORY_FLAG_NONE);
+      gst_memory_resize (gmem, d->chunk->offset + d->mapoffset, d->chunk->size);
+      data->offset = d->mapoffset;
+    }
+    else if (d->type == t->data.MemPtr) {
+      gmem = gst_memory_new_wrapped (0, d->data, d->maxsize, d->chunk->offset + d->mapoffset,
+                d->chunk->size, NULL, NULL);
+      data->offset = 0;
+    }
+    if (gmem)
+      gst_buffer_append_memory (buf, gmem);
+  }
+
+  /* the metadata stays on the buffer when it is released to the pool */
+  if (pool->add_video_meta && b->n_datas == 1) {
+    GstVideoInfo *info = &pool->video_info;
+    GstVideoMeta *vmeta;
+
+    vmeta = gst_buffer_add_video_meta_full (buf, GST_VIDEO_FRAME_FLAG_NONE,
+        GST_VIDEO_INFO_FORMAT (info),
+        GST_VIDEO_INFO_WIDTH (info),
+        GST_VIDEO_INFO_HEIGHT (info),
+        GST_VIDEO_INFO_N_PLANES (info),
+        info->offset, info->stride);
+    GST_META_FLAG_SET (vmeta, GST_META_FLAG_POOLED);
+  }
+  if (data->crop) {
+    GstVideoCropMeta *crop = gst_buffer_add_video_crop_meta (buf);
+    GST_META_FLAG_SET (crop, GST_META_FLAG_POOLED);
+  }
+
+  data->flags = GST_BUFFER_FLAGS (buf);
+  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (buf),
+                             pool_data_quark,
+                             data,
+                             pool_data_destroy);
+
+  GST_OBJECT_LOCK (pool);
+  if (id >= pool->buffers->len)
+    g_ptr_array_set_size (pool->buffers, id + 1);
+  g_ptr_array_index (pool->buffers, id) = buf;
+  GST_OBJECT_UNLOCK (pool);
+
+  return buf;
+}
+
+/**
+ * gst_pipewire_pool_get_buffer:
+ * @pool: a #GstPipeWirePool
+ * @id: the PipeWire buffer id
+ *
+ * Returns: (transfer none): the #GstBuffer for @id or %NULL
+ */
+GstBuffer *
+gst_pipewire_pool_get_buffer (GstPipeWirePool *pool, guint id)
+{
+  g_return_val_if_fail (GST_IS_PIPEWIRE_POOL (pool), NULL);
+
+  if (id >= pool->buffers->len)
+    return NULL;
+
+  return g_ptr_array_index (pool->buffers, id);
+}
+
+/**
+ * gst_pipewire_pool_clear_buffer:
+ * @pool: a #GstPipeWirePool
+ * @id: the PipeWire buffer id
+ *
+ * Remove the #GstBuffer for @id from the index of @pool. The buffer
+ * itself is freed when its last reference is dropped.
+ */
+void
+gst_pipewire_pool_clear_buffer (GstPipeWirePool *pool, guint id)
+{
+  g_return_if_fail (GST_IS_PIPEWIRE_POOL (pool));
+
+  GST_OBJECT_LOCK (pool);
+  if (id < pool->buffers->len)
+    g_ptr_array_index (pool->buffers, id) = NULL;
+  GST_OBJECT_UNLOCK (pool);
+}
+
+GstPipeWirePoolData *
+gst_pipewire_pool_get_data (GstBuffer *buffer)
+{
+  return gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer), pool_data_quark);
+}
+
+/**
+ * gst_pipewire_pool_sync_from_spa:
+ * @data: a #GstPipeWirePoolData
+ *
+ * Update the timestamps, memory regions and metadata of the #GstBuffer
+ * from the PipeWire buffer after it was filled.
+ */
+void
+gst_pipewire_pool_sync_from_spa (GstPipeWirePoolData *data)
+{
+  GstBuffer *buf = data->buf;
+  struct spa_meta_header *h = data->header;
+  guint i;
+
+  if (h) {
+    GST_LOG ("pts %" G_GUINT64_FORMAT ", dts_offset %"G_GUINT64_FORMAT, h->pts, h->dts_offset);
+
+    if (GST_CLOCK_TIME_IS_VALID (h->pts)) {
+      GST_BUFFER_PTS (buf) = h->pts;
+      if (GST_BUFFER_PTS (buf) + h->dts_offset > 0)
+        GST_BUFFER_DTS (buf) = GST_BUFFER_PTS (buf) + h->dts_offset;
+    }
+    GST_BUFFER_OFFSET (buf) = h->seq;
+  }
+  for (i = 0; i < data->b->n_datas; i++) {
+    struct spa_data *d = &data->b->datas[i];
+    GstMemory *mem = gst_buffer_peek_memory (buf, i);
+    mem->offset = d->chunk->offset + data->offset;
+    mem->size = d->chunk->size;
+  }
+  if (data->crop) {
+    GstVideoCropMeta *crop = gst_buffer_get_video_crop_meta (buf);
+
+    if (crop) {
+      crop->x = data->crop->x;
+      crop->y = data->crop->y;
+      crop->width = data->crop->width;
+      crop->height = data->crop->height;
+    }
+  }
+  if (data->pool->add_video_meta &&
+      GST_VIDEO_INFO_N_PLANES (&data->pool->video_info) == 1 &&
+      data->b->n_datas == 1 && data->b->datas[0].chunk->stride > 0) {
+    GstVideoMeta *vmeta = gst_buffer_get_video_meta (buf);
+
+    if (vmeta)
+      vmeta->stride[0] = data->b->datas[0].chunk->stride;
+  }
+}
+
+/**
+ * gst_pipewire_pool_sync_to_spa:
+ * @data: a #GstPipeWirePoolData
+ *
+ * Update the PipeWire buffer from the timestamps, memory regions and
+ * metadata of the #GstBuffer before it is sent.
+ */
+void
+gst_pipewire_pool_sync_to_spa (GstPipeWirePoolData *data)
+{
+  GstBuffer *buf = data->buf;
+  guint i;
+
+  if (data->header) {
+    data->header->seq = GST_BUFFER_OFFSET (buf);
+    data->header->pts = GST_BUFFER_PTS (buf);
+    data->header->dts_offset = GST_BUFFER_DTS (buf);
+  }
+  for (i = 0; i < data->b->n_datas; i++) {
+    struct spa_data *d = &data->b->datas[i];
+    GstMemory *mem = gst_buffer_peek_memory (buf, i);
+    d->chunk->offset = mem->offset - data->offset;
+    d->chunk->size = mem->size;
+  }
+  if (data->crop) {
+    GstVideoCropMeta *crop = gst_buffer_get_video_crop_meta (buf);
+
+    if (crop) {
+      data->crop->x = crop->x;
+      data->crop->y = crop->y;
+      data->crop->width = crop->width;
+      data->crop->height = crop->height;
+    }
+  }
+}
+
 static GstFlowReturn
 acquire_buffer (GstBufferPool * pool, GstBuffer ** buffer,
         GstBufferPoolAcquireParams * params)
@@ -132,6 +381,13 @@ release_buffer (GstBufferPool * pool, GstBuffer *buffer)
   GST_OBJECT_UNLOCK (pool);
 }
 
+static const gchar **
+get_options (GstBufferPool * pool)
+{
+  static const gchar *options[] = { GST_BUFFER_POOL_OPTION_VIDEO_META, NULL };
+  return options;
+}
+
 static gboolean
 do_start (GstBufferPool * pool)
 {
@@ -146,6 +402,11 @@ gst_pipewire_pool_finalize (GObject * object)
 
   GST_DEBUG_OBJECT (pool, "finalize");
 
+  g_ptr_array_unref (pool->buffers);
+  g_object_unref (pool->fd_allocator);
+  g_object_unref (pool->dmabuf_allocator);
+  g_cond_clear (&pool->cond);
+
   G_OBJECT_CLASS (gst_pipewire_pool_parent_class)->finalize (object);
 }
 
@@ -157,6 +418,7 @@ gst_pipewire_pool_class_init (GstPipeWirePoolClass * klass)
 
   gobject_class->finalize = gst_pipewire_pool_finalize;
 
+  bufferpool_class->get_options = get_options;
   bufferpool_class->start = do_start;
   bufferpool_class->flush_start = flush_start;
   bufferpool_class->acquire_buffer = acquire_buffer;
@@ -168,6 +430,8 @@ gst_pipewire_pool_class_init (GstPipeWirePoolClass * klass)
 
   GST_DEBUG_CATEGORY_INIT (gst_pipewire_pool_debug_category, "pipewirepool", 0,
       "debug category for pipewirepool object");
+
+  pool_data_quark = g_quark_from_static_string ("GstPipeWirePoolDataQuark");
 }
 
 static void
@@ -175,4 +439,7 @@ gst_pipewire_pool_init (GstPipeWirePool * pool)
 {
   g_cond_init (&pool->cond);
   g_queue_init (&pool->available);
+  pool->buffers = g_ptr_array_new ();
+  pool->fd_allocator = gst_fd_allocator_new ();
+  pool->dmabuf_allocator = gst_dmabuf_allocator_new ();
 }
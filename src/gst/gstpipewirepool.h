@@ -21,7 +21,9 @@
 #define __GST_PIPEWIRE_POOL_H__
 
 #include <gst/gst.h>
+#include <gst/video/video.h>
 
+#include <spa/buffer.h>
 #include <pipewire/pipewire.h>
 
 G_BEGIN_DECLS
@@ -41,11 +43,39 @@ G_BEGIN_DECLS
 
 typedef struct _GstPipeWirePool GstPipeWirePool;
 typedef struct _GstPipeWirePoolClass GstPipeWirePoolClass;
+typedef struct _GstPipeWirePoolData GstPipeWirePoolData;
+
+/**
+ * GstPipeWirePoolData:
+ *
+ * Data attached to each #GstBuffer that wraps a PipeWire buffer.
+ */
+struct _GstPipeWirePoolData {
+  GstPipeWirePool *pool;
+  gpointer owner;
+  guint id;
+  struct spa_buffer *b;
+  struct spa_meta_header *header;
+  struct spa_meta_video_crop *crop;
+  guint flags;
+  goffset offset;
+  GstBuffer *buf;
+  gboolean outstanding;
+  GList link;
+};
 
 struct _GstPipeWirePool {
   GstBufferPool parent;
 
   struct pw_stream *stream;
+  struct pw_type *t;
+
+  GstAllocator *fd_allocator;
+  GstAllocator *dmabuf_allocator;
+  gboolean add_video_meta;
+  GstVideoInfo video_info;
+
+  GPtrArray *buffers;
   GQueue available;
   GCond cond;
 };
@@ -61,6 +91,17 @@ GstPipeWirePool *  gst_pipewire_pool_new           (void);
 gboolean        gst_pipewire_pool_add_buffer    (GstPipeWirePool *pool, GstBuffer *buffer);
 gboolean        gst_pipewire_pool_remove_buffer (GstPipeWirePool *pool, GstBuffer *buffer);
 
+void            gst_pipewire_pool_set_caps      (GstPipeWirePool *pool, GstCaps *caps);
+
+GstBuffer *     gst_pipewire_pool_import_buffer (GstPipeWirePool *pool, guint id,
+                                                 struct spa_buffer *b, gpointer owner);
+GstBuffer *     gst_pipewire_pool_get_buffer    (GstPipeWirePool *pool, guint id);
+void            gst_pipewire_pool_clear_buffer  (GstPipeWirePool *pool, guint id);
+
+GstPipeWirePoolData * gst_pipewire_pool_get_data (GstBuffer *buffer);
+void            gst_pipewire_pool_sync_from_spa (GstPipeWirePoolData *data);
+void            gst_pipewire_pool_sync_to_spa   (GstPipeWirePoolData *data);
+
 G_END_DECLS
 
 #endif /* __GST_PIPEWIRE_POOL_H__ */
@@ -40,19 +40,17 @@
 #include <unistd.h>
 
 #include <gio/gunixfdmessage.h>
-#include <gst/allocators/gstfdmemory.h>
 #include <gst/video/video.h>
 
 #include <spa/buffer.h>
 
 #include "gstpipewireformat.h"
 
-static GQuark process_mem_data_quark;
-
 GST_DEBUG_CATEGORY_STATIC (pipewire_sink_debug);
 #define GST_CAT_DEFAULT pipewire_sink_debug
 
 #define DEFAULT_PROP_MODE GST_PIPEWIRE_SINK_MODE_DEFAULT
+#define DEFAULT_MIN_BUFFERS 8
 
 enum
 {
@@ -60,7 +58,8 @@ enum
   PROP_PATH,
   PROP_CLIENT_NAME,
   PROP_STREAM_PROPERTIES,
-  PROP_MODE
+  PROP_MODE,
+  PROP_COPIED_BUFFERS,
 };
 
 GType
@@ -126,10 +125,8 @@ gst_pipewire_sink_finalize (GObject * object)
 
   if (pwsink->properties)
     gst_structure_free (pwsink->properties);
-  g_object_unref (pwsink->allocator);
   g_free (pwsink->path);
   g_free (pwsink->client_name);
-  g_hash_table_unref (pwsink->buf_ids);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -138,8 +135,34 @@ static gboolean
 gst_pipewire_sink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
 {
   GstPipeWireSink *pwsink = GST_PIPEWIRE_SINK (bsink);
+  GstBufferPool *pool = GST_BUFFER_POOL_CAST (pwsink->pool);
+  GstCaps *caps;
+  gboolean need_pool;
+  GstVideoInfo info;
+  guint size = 0;
+
+  gst_query_parse_allocation (query, &caps, &need_pool);
+
+  if (caps && gst_video_info_from_caps (&info, caps))
+    size = GST_VIDEO_INFO_SIZE (&info);
+
+  /* configure the pool with the upstream caps so that the PipeWire buffers
+   * are negotiated with the right size and upstream can render into
+   * them directly */
+  if (need_pool && caps && !gst_buffer_pool_is_active (pool)) {
+    GstStructure *config;
+
+    config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_set_params (config, caps, size, DEFAULT_MIN_BUFFERS, 0);
+    gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+    if (!gst_buffer_pool_set_config (pool, config))
+      GST_WARNING_OBJECT (pwsink, "failed to configure pool");
+  }
+  GST_DEBUG_OBJECT (pwsink, "propose pool %p, size %u", pool, size);
+
+  gst_query_add_allocation_pool (query, pool, size, DEFAULT_MIN_BUFFERS, 0);
+  gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
 
-  gst_query_add_allocation_pool (query, GST_BUFFER_POOL_CAST (pwsink->pool), 0, 0, 0);
   return TRUE;
 }
 
@@ -195,6 +218,16 @@ gst_pipewire_sink_class_init (GstPipeWireSinkClass * klass)
                                                         G_PARAM_READWRITE |
                                                         G_PARAM_STATIC_STRINGS));
 
+   g_object_class_install_property (gobject_class,
+                                    PROP_COPIED_BUFFERS,
+                                    g_param_spec_uint64 ("copied-buffers",
+                                                         "Copied buffers",
+                                                         "Number of rendered buffers that had to be "
+                                                         "copied into a PipeWire buffer",
+                                                         0, G_MAXUINT64, 0,
+                                                         G_PARAM_READABLE |
+                                                         G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state = gst_pipewire_sink_change_state;
 
   gst_element_class_set_static_metadata (gstelement_class,
@@ -213,8 +246,6 @@ gst_pipewire_sink_class_init (GstPipeWireSinkClass * klass)
 
   GST_DEBUG_CATEGORY_INIT (pipewire_sink_debug, "pipewiresink", 0,
       "PipeWire Sink");
-
-  process_mem_data_quark = g_quark_from_static_string ("GstPipeWireSinkProcessMemQuark");
 }
 
 
@@ -290,22 +321,19 @@ pool_activated (GstPipeWirePool *pool, GstPipeWireSink *sink)
 static void
 gst_pipewire_sink_init (GstPipeWireSink * sink)
 {
-  sink->allocator = gst_fd_allocator_new ();
   sink->pool =  gst_pipewire_pool_new ();
   sink->client_name = pw_get_client_name();
   sink->mode = DEFAULT_PROP_MODE;
 
   g_signal_connect (sink->pool, "activated", G_CALLBACK (pool_activated), sink);
 
-  sink->buf_ids = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
-      (GDestroyNotify) gst_buffer_unref);
-
   g_queue_init (&sink->queue);
 
   sink->loop = pw_loop_new (NULL);
   sink->main_loop = pw_thread_loop_new (sink->loop, "pipewire-sink-loop");
   sink->core = pw_core_new (sink->loop, NULL);
   sink->type = pw_core_get_type (sink->core);
+  sink->pool->t = sink->type;
   GST_DEBUG ("loop %p %p", sink->loop, sink->main_loop);
 }
 
@@ -409,30 +437,16 @@ gst_pipewire_sink_get_property (GObject * object, guint prop_id,
       g_value_set_enum (value, pwsink->mode);
       break;
 
+    case PROP_COPIED_BUFFERS:
+      g_value_set_uint64 (value, pwsink->copied_buffers);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
 }
 
-typedef struct {
-  GstPipeWireSink *sink;
-  guint id;
-  struct spa_buffer *buf;
-  struct spa_meta_header *header;
-  guint flags;
-  goffset offset;
-} ProcessMemData;
-
-static void
-process_mem_data_destroy (gpointer user_data)
-{
-  ProcessMemData *data = user_data;
-
-  gst_object_unref (data->sink);
-  g_slice_free (ProcessMemData, data);
-}
-
 static void
 on_add_buffer (void     *_data,
                uint32_t  id)
@@ -440,9 +454,6 @@ on_add_buffer (void     *_data,
   GstPipeWireSink *pwsink = _data;
   struct spa_buffer *b;
   GstBuffer *buf;
-  uint32_t i;
-  ProcessMemData data;
-  struct pw_type *t = pwsink->type;
 
   GST_LOG_OBJECT (pwsink, "add buffer");
 
@@ -451,40 +462,8 @@ on_add_buffer (void     *_data,
     return;
   }
 
-  buf = gst_buffer_new ();
-
-  data.sink = gst_object_ref (pwsink);
-  data.id = id;
-  data.buf = b;
-  data.header = spa_buffer_find_meta (b, t->meta.Header);
-
-  for (i = 0; i < b->n_datas; i++) {
-    struct spa_data *d = &b->datas[i];
-    GstMemory *gmem = NULL;
-
-    if (d->type == t->data.MemFd ||
-        d->type == t->data.DmaBuf) {
-      gmem = gst_fd_allocator_alloc (pwsink->allocator, dup (d->fd),
-                d->mapoffset + d->maxsize, GST_FD_MEMORY_FLAG_NONE);
-      gst_memory_resize (gmem, d->chunk->offset + d->mapoffset, d->chunk->size);
-      data.offset = d->mapoffset;
-    }
-    else if (d->type == t->data.MemPtr) {
-      gmem = gst_memory_new_wrapped (0, d->data, d->maxsize, d->chunk->offset,
-                                     d->chunk->size, NULL, NULL);
-      data.offset = 0;
-    }
-    if (gmem)
-      gst_buffer_append_memory (buf, gmem);
-  }
-  data.flags = GST_BUFFER_FLAGS (buf);
-  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (buf),
-                             process_mem_data_quark,
-                             g_slice_dup (ProcessMemData, &data),
-                             process_mem_data_destroy);
-
+  buf = gst_pipewire_pool_import_buffer (pwsink->pool, id, b, pwsink);
   gst_pipewire_pool_add_buffer (pwsink->pool, buf);
-  g_hash_table_insert (pwsink->buf_ids, GINT_TO_POINTER (id), buf);
 
   pw_thread_loop_signal (pwsink->main_loop, FALSE);
 }
@@ -497,14 +476,14 @@ on_remove_buffer (void     *data,
   GstBuffer *buf;
 
   GST_LOG_OBJECT (pwsink, "remove buffer");
-  buf = g_hash_table_lookup (pwsink->buf_ids, GINT_TO_POINTER (id));
+  buf = gst_pipewire_pool_get_buffer (pwsink->pool, id);
   if (buf) {
     GST_MINI_OBJECT_CAST (buf)->dispose = NULL;
-    if (!gst_pipewire_pool_remove_buffer (pwsink->pool, buf))
-      gst_buffer_ref (buf);
+    if (gst_pipewire_pool_remove_buffer (pwsink->pool, buf))
+      gst_buffer_unref (buf);
     if (g_queue_remove (&pwsink->queue, buf))
       gst_buffer_unref (buf);
-    g_hash_table_remove (pwsink->buf_ids, GINT_TO_POINTER (id));
+    gst_pipewire_pool_clear_buffer (pwsink->pool, id);
   }
 }
 
@@ -520,7 +499,7 @@ on_new_buffer (void     *data,
     GST_LOG_OBJECT (pwsink, "no stream");
     return;
   }
-  buf = g_hash_table_lookup (pwsink->buf_ids, GINT_TO_POINTER (id));
+  buf = gst_pipewire_pool_get_buffer (pwsink->pool, id);
 
   if (buf) {
     gst_buffer_unref (buf);
@@ -532,9 +511,8 @@ static void
 do_send_buffer (GstPipeWireSink *pwsink)
 {
   GstBuffer *buffer;
-  ProcessMemData *data;
+  GstPipeWirePoolData *data;
   gboolean res;
-  guint i;
 
   buffer = g_queue_pop_head (&pwsink->queue);
   if (buffer == NULL) {
@@ -542,20 +520,8 @@ do_send_buffer (GstPipeWireSink *pwsink)
     return;
   }
 
-  data = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer),
-                                    process_mem_data_quark);
-
-  if (data->header) {
-    data->header->seq = GST_BUFFER_OFFSET (buffer);
-    data->header->pts = GST_BUFFER_PTS (buffer);
-    data->header->dts_offset = GST_BUFFER_DTS (buffer);
-  }
-  for (i = 0; i < data->buf->n_datas; i++) {
-    struct spa_data *d = &data->buf->datas[i];
-    GstMemory *mem = gst_buffer_peek_memory (buffer, i);
-    d->chunk->offset = mem->offset - data->offset;
-    d->chunk->size = mem->size;
-  }
+  data = gst_pipewire_pool_get_data (buffer);
+  gst_pipewire_pool_sync_to_spa (data);
 
   if (!(res = pw_stream_send_buffer (pwsink->stream, data->id))) {
     g_warning ("can't send buffer");
@@ -618,6 +584,7 @@ gst_pipewire_sink_setcaps (GstBaseSink * bsink, GstCaps * caps)
   pwsink = GST_PIPEWIRE_SINK (bsink);
 
   possible = gst_caps_to_format_all (caps, pwsink->type->map);
+  gst_pipewire_pool_set_caps (pwsink->pool, caps);
 
   pw_thread_loop_lock (pwsink->main_loop);
   state = pw_stream_get_state (pwsink->stream, &error);
@@ -698,7 +665,11 @@ gst_pipewire_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
     gst_buffer_extract (buffer, 0, info.data, info.size);
     gst_buffer_unmap (b, &info);
     gst_buffer_resize (b, 0, gst_buffer_get_size (buffer));
+    gst_buffer_copy_into (b, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
     buffer = b;
+    pwsink->copied_buffers++;
+    GST_LOG_OBJECT (pwsink, "copied buffer, %" G_GUINT64_FORMAT " copies",
+        pwsink->copied_buffers);
   } else {
     gst_buffer_ref (buffer);
   }
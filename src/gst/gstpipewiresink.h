@@ -88,14 +88,13 @@ struct _GstPipeWireSink {
   struct pw_stream *stream;
   struct spa_hook stream_listener;
 
-  GstAllocator *allocator;
   GstStructure *properties;
   GstPipeWireSinkMode mode;
 
   GstPipeWirePool *pool;
-  GHashTable *buf_ids;
   GQueue queue;
   guint need_ready;
+  guint64 copied_buffers;
 };
 
 struct _GstPipeWireSinkClass {
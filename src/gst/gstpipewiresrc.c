@@ -42,15 +42,12 @@
 
 #include <gio/gunixfdmessage.h>
 #include <gst/net/gstnetclientclock.h>
-#include <gst/allocators/gstfdmemory.h>
 #include <gst/video/video.h>
 
 #include <spa/buffer.h>
 
 #include "gstpipewireclock.h"
 
-static GQuark process_mem_data_quark;
-
 GST_DEBUG_CATEGORY_STATIC (pipewire_src_debug);
 #define GST_CAT_DEFAULT pipewire_src_debug
 
@@ -180,11 +177,55 @@ clock_disabled:
   }
 }
 
+static void
+queue_push (GstPipeWireSrc *pwsrc, GstBuffer *buf)
+{
+  GstPipeWirePoolData *data = gst_pipewire_pool_get_data (buf);
+
+  /* buffers from the pool carry their own queue link */
+  if (data && data->buf == buf)
+    g_queue_push_tail_link (&pwsrc->queue, &data->link);
+  else
+    g_queue_push_tail (&pwsrc->queue, buf);
+}
+
+static GstBuffer *
+queue_pop (GstPipeWireSrc *pwsrc)
+{
+  GList *link;
+  GstBuffer *buf;
+  GstPipeWirePoolData *data;
+
+  if ((link = g_queue_pop_head_link (&pwsrc->queue)) == NULL)
+    return NULL;
+
+  buf = link->data;
+  data = gst_pipewire_pool_get_data (buf);
+  if (data == NULL || &data->link != link)
+    g_list_free_1 (link);
+
+  return buf;
+}
+
 static void
 clear_queue (GstPipeWireSrc *pwsrc)
 {
-  g_queue_foreach (&pwsrc->queue, (GFunc) gst_mini_object_unref, NULL);
-  g_queue_clear (&pwsrc->queue);
+  GstBuffer *buf;
+
+  while ((buf = queue_pop (pwsrc)))
+    gst_buffer_unref (buf);
+}
+
+static void
+flush_recycle (GstPipeWireSrc *pwsrc)
+{
+  if (pwsrc->n_recycle == 0)
+    return;
+
+  GST_LOG_OBJECT (pwsrc, "recycle %u buffers", pwsrc->n_recycle);
+  if (pwsrc->stream)
+    pw_stream_recycle_buffers (pwsrc->stream, pwsrc->recycle_ids, pwsrc->n_recycle);
+  pwsrc->n_recycle = 0;
 }
 
 static void
@@ -204,12 +245,11 @@ gst_pipewire_src_finalize (GObject * object)
 
   if (pwsrc->properties)
     gst_structure_free (pwsrc->properties);
-  g_object_unref (pwsrc->fd_allocator);
+  gst_object_unref (pwsrc->pool);
   if (pwsrc->clock)
     gst_object_unref (pwsrc->clock);
   g_free (pwsrc->path);
   g_free (pwsrc->client_name);
-  g_hash_table_unref (pwsrc->buf_ids);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -288,8 +328,6 @@ gst_pipewire_src_class_init (GstPipeWireSrcClass * klass)
 
   GST_DEBUG_CATEGORY_INIT (pipewire_src_debug, "pipewiresrc", 0,
       "PipeWire Source");
-
-  process_mem_data_quark = g_quark_from_static_string ("GstPipeWireSrcProcessMemQuark");
 }
 
 static void
@@ -304,51 +342,41 @@ gst_pipewire_src_init (GstPipeWireSrc * src)
 
   g_queue_init (&src->queue);
 
-  src->fd_allocator = gst_fd_allocator_new ();
   src->client_name = pw_get_client_name ();
-  src->buf_ids = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) gst_buffer_unref);
 
   src->loop = pw_loop_new (NULL);
   src->main_loop = pw_thread_loop_new (src->loop, "pipewire-main-loop");
   src->core = pw_core_new (src->loop, NULL);
   src->type = pw_core_get_type (src->core);
-  GST_DEBUG ("loop %p, mainloop %p", src->loop, src->main_loop);
-
-}
 
-typedef struct {
-  GstPipeWireSrc *src;
-  guint id;
-  struct spa_buffer *buf;
-  struct spa_meta_header *header;
-  guint flags;
-  goffset offset;
-} ProcessMemData;
-
-static void
-process_mem_data_destroy (gpointer user_data)
-{
-  ProcessMemData *data = user_data;
+  src->pool = gst_pipewire_pool_new ();
+  src->pool->t = src->type;
+  GST_DEBUG ("loop %p, mainloop %p", src->loop, src->main_loop);
 
-  gst_object_unref (data->src);
-  g_slice_free (ProcessMemData, data);
 }
 
 static gboolean
 buffer_recycle (GstMiniObject *obj)
 {
-  ProcessMemData *data;
+  GstPipeWirePoolData *data;
   GstPipeWireSrc *src;
 
   gst_mini_object_ref (obj);
-  data = gst_mini_object_get_qdata (obj,
-                                    process_mem_data_quark);
+  data = gst_pipewire_pool_get_data (GST_BUFFER_CAST (obj));
   GST_BUFFER_FLAGS (obj) = data->flags;
-  src = data->src;
+  data->outstanding = FALSE;
+  src = data->owner;
 
   GST_LOG_OBJECT (obj, "recycle buffer");
+  /* collect the ids and recycle them in one batch on the next process
+   * callback or from the streaming thread. When we have no buffers queued
+   * the server might be waiting for this one, give it back now. */
   pw_thread_loop_lock (src->main_loop);
-  pw_stream_recycle_buffer (src->stream, data->id);
+  src->recycle_ids[src->n_recycle++] = data->id;
+  if (src->n_recycle == G_N_ELEMENTS (src->recycle_ids) ||
+      g_queue_is_empty (&src->queue))
+    flush_recycle (src);
+  pw_thread_loop_signal (src->main_loop, FALSE);
   pw_thread_loop_unlock (src->main_loop);
 
   return FALSE;
@@ -360,10 +388,6 @@ on_add_buffer (void *_data, guint id)
   GstPipeWireSrc *pwsrc = _data;
   struct spa_buffer *b;
   GstBuffer *buf;
-  uint32_t i;
-  ProcessMemData data;
-  struct pw_core *core = pwsrc->core;
-  struct pw_type *t = pw_core_get_type(core);
 
   GST_LOG_OBJECT (pwsrc, "add buffer");
 
@@ -372,39 +396,8 @@ on_add_buffer (void *_data, guint id)
     return;
   }
 
-  buf = gst_buffer_new ();
+  buf = gst_pipewire_pool_import_buffer (pwsrc->pool, id, b, pwsrc);
   GST_MINI_OBJECT_CAST (buf)->dispose = buffer_recycle;
-
-  data.src = gst_object_ref (pwsrc);
-  data.id = id;
-  data.buf = b;
-  data.header = spa_buffer_find_meta (b, t->meta.Header);
-
-  for (i = 0; i < b->n_datas; i++) {
-    struct spa_data *d = &b->datas[i];
-    GstMemory *gmem = NULL;
-
-    if (d->type == t->data.MemFd || d->type == t->data.DmaBuf) {
-      gmem = gst_fd_allocator_alloc (pwsrc->fd_allocator, dup (d->fd),
-                d->mapoffset + d->maxsize, GST_FD_MEMORY_FLAG_NONE);
-      gst_memory_resize (gmem, d->chunk->offset + d->mapoffset, d->chunk->size);
-      data.offset = d->mapoffset;
-    }
-    else if (d->type == t->data.MemPtr) {
-      gmem = gst_memory_new_wrapped (0, d->data, d->maxsize, d->chunk->offset + d->mapoffset,
-                d->chunk->size, NULL, NULL);
-      data.offset = 0;
-    }
-    if (gmem)
-      gst_buffer_append_memory (buf, gmem);
-  }
-  data.flags = GST_BUFFER_FLAGS (buf);
-  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (buf),
-                             process_mem_data_quark,
-                             g_slice_dup (ProcessMemData, &data),
-                             process_mem_data_destroy);
-
-  g_hash_table_insert (pwsrc->buf_ids, GINT_TO_POINTER (id), buf);
 }
 
 static void
@@ -415,23 +408,27 @@ on_remove_buffer (void *data,
   GstBuffer *buf;
 
   GST_LOG_OBJECT (pwsrc, "remove buffer");
-  buf = g_hash_table_lookup (pwsrc->buf_ids, GINT_TO_POINTER (id));
+  buf = gst_pipewire_pool_get_buffer (pwsrc->pool, id);
   if (buf) {
+    GstPipeWirePoolData *d = gst_pipewire_pool_get_data (buf);
     GList *walk;
 
     GST_MINI_OBJECT_CAST (buf)->dispose = NULL;
+    gst_pipewire_pool_clear_buffer (pwsrc->pool, id);
 
     walk = pwsrc->queue.head;
     while (walk) {
       GList *next = walk->next;
 
       if (walk->data == buf) {
-        gst_buffer_unref (buf);
-        g_queue_delete_link (&pwsrc->queue, walk);
+        g_queue_unlink (&pwsrc->queue, walk);
+        d->outstanding = FALSE;
       }
       walk = next;
     }
-    g_hash_table_remove (pwsrc->buf_ids, GINT_TO_POINTER (id));
+    /* buffers still used downstream are freed when they are released */
+    if (!d->outstanding)
+      gst_buffer_unref (buf);
   }
 }
 
@@ -441,43 +438,28 @@ on_new_buffer (void *_data,
 {
   GstPipeWireSrc *pwsrc = _data;
   GstBuffer *buf;
-  ProcessMemData *data;
-  struct spa_meta_header *h;
-  guint i;
 
-  buf = g_hash_table_lookup (pwsrc->buf_ids, GINT_TO_POINTER (id));
+  buf = gst_pipewire_pool_get_buffer (pwsrc->pool, id);
   if (buf == NULL) {
     g_warning ("unknown buffer %d", id);
     return;
   }
   GST_LOG_OBJECT (pwsrc, "got new buffer %p", buf);
 
-  data = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buf),
-                                  process_mem_data_quark);
-  h = data->header;
-  if (h) {
-    GST_INFO ("pts %" G_GUINT64_FORMAT ", dts_offset %"G_GUINT64_FORMAT, h->pts, h->dts_offset);
+  /* give back the buffers released since the last cycle */
+  flush_recycle (pwsrc);
 
-    if (GST_CLOCK_TIME_IS_VALID (h->pts)) {
-      GST_BUFFER_PTS (buf) = h->pts;
-      if (GST_BUFFER_PTS (buf) + h->dts_offset > 0)
-        GST_BUFFER_DTS (buf) = GST_BUFFER_PTS (buf) + h->dts_offset;
-    }
-    GST_BUFFER_OFFSET (buf) = h->seq;
-  }
-  for (i = 0; i < data->buf->n_datas; i++) {
-    struct spa_data *d = &data->buf->datas[i];
-    GstMemory *mem = gst_buffer_peek_memory (buf, i);
-    mem->offset = d->chunk->offset + data->offset;
-    mem->size = d->chunk->size;
-  }
+  gst_pipewire_pool_sync_from_spa (gst_pipewire_pool_get_data (buf));
 
-  if (pwsrc->always_copy)
+  /* the reference of an idle buffer is passed downstream and given
+   * back in buffer_recycle() */
+  if (pwsrc->always_copy) {
     buf = gst_buffer_copy_deep (buf);
-  else
-    gst_buffer_ref (buf);
+    pw_stream_recycle_buffer (pwsrc->stream, id);
+  } else
+    gst_pipewire_pool_get_data (buf)->outstanding = TRUE;
 
-  g_queue_push_tail (&pwsrc->queue, buf);
+  queue_push (pwsrc, buf);
 
   pw_thread_loop_signal (pwsrc->main_loop, FALSE);
   return;
@@ -751,10 +733,12 @@ on_format_changed (void              *data,
   caps = gst_caps_from_format (format, t->map);
   GST_DEBUG_OBJECT (pwsrc, "we got format %" GST_PTR_FORMAT, caps);
   res = gst_base_src_set_caps (GST_BASE_SRC (pwsrc), caps);
+  if (res)
+    gst_pipewire_pool_set_caps (pwsrc->pool, caps);
   gst_caps_unref (caps);
 
   if (res) {
-    struct spa_param *params[2];
+    struct spa_param *params[3];
     struct spa_pod_builder b = { NULL };
     uint8_t buffer[512];
     struct spa_pod_frame f[2];
@@ -772,8 +756,13 @@ on_format_changed (void              *data,
         PROP    (&f[1], t->param_alloc_meta_enable.size, SPA_POD_TYPE_INT, sizeof (struct spa_meta_header)));
     params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, struct spa_param);
 
+    spa_pod_builder_object (&b, &f[0], 0, t->param_alloc_meta_enable.MetaEnable,
+        PROP    (&f[1], t->param_alloc_meta_enable.type, SPA_POD_TYPE_ID, t->meta.VideoCrop),
+        PROP    (&f[1], t->param_alloc_meta_enable.size, SPA_POD_TYPE_INT, sizeof (struct spa_meta_video_crop)));
+    params[2] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, struct spa_param);
+
     GST_DEBUG_OBJECT (pwsrc, "doing finish format");
-    pw_stream_finish_format (pwsrc->stream, SPA_RESULT_OK, params, 2);
+    pw_stream_finish_format (pwsrc->stream, SPA_RESULT_OK, params, 3);
   } else {
     GST_WARNING_OBJECT (pwsrc, "finish format with error");
     pw_stream_finish_format (pwsrc->stream, SPA_RESULT_INVALID_MEDIA_TYPE, NULL, 0);
@@ -906,7 +895,9 @@ gst_pipewire_src_create (GstPushSrc * psrc, GstBuffer ** buffer)
     if (state != PW_STREAM_STATE_STREAMING)
       goto streaming_stopped;
 
-    *buffer = g_queue_pop_head (&pwsrc->queue);
+    flush_recycle (pwsrc);
+
+    *buffer = queue_pop (pwsrc);
     GST_DEBUG ("popped buffer %p", *buffer);
     if (*buffer != NULL)
       break;
@@ -969,6 +960,7 @@ gst_pipewire_src_stop (GstBaseSrc * basesrc)
 
   pw_thread_loop_lock (pwsrc->main_loop);
   clear_queue (pwsrc);
+  flush_recycle (pwsrc);
   pw_thread_loop_unlock (pwsrc->main_loop);
 
   return TRUE;
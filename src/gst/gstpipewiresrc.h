@@ -25,6 +25,8 @@
 
 #include <pipewire/pipewire.h>
 
+#include "gstpipewirepool.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_PIPEWIRE_SRC \
@@ -75,11 +77,12 @@ struct _GstPipeWireSrc {
   struct pw_stream *stream;
   struct spa_hook stream_listener;
 
-  GstAllocator *fd_allocator;
   GstStructure *properties;
 
-  GHashTable *buf_ids;
+  GstPipeWirePool *pool;
   GQueue queue;
+  guint32 recycle_ids[64];
+  guint n_recycle;
   GstClock *clock;
 };
 
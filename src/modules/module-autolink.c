@@ -28,6 +28,18 @@
 #include "pipewire/link.h"
 #include "pipewire/log.h"
 #include "pipewire/module.h"
+#include "pipewire/pipewire.h"
+#include "pipewire/type.h"
+#include "modules/spa/spa-node.h"
+
+#include <spa/format-utils.h>
+#include <spa/format-builder.h>
+#include <spa/audio/format-utils.h>
+
+/* marks the converters that are inserted by this module */
+#define PROP_CONVERT	"autolink.convert"
+/* the channel matrix of the converter, taken from the node */
+#define PROP_MATRIX	"audioconvert.matrix"
 
 struct impl {
 	struct pw_core *core;
@@ -35,6 +47,10 @@ struct impl {
 	struct pw_module *module;
 	struct pw_properties *properties;
 
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+
 	struct spa_hook core_listener;
 	struct spa_hook module_listener;
 
@@ -57,6 +73,11 @@ struct link_data {
 	struct node_info *node_info;
 	struct pw_link *link;
 	struct spa_hook link_listener;
+
+	/* the converter between the ports and the link on its other side */
+	struct pw_node *convert;
+	struct link_data *peer;
+	struct spa_source *destroy_convert;	/* destroys the converter after an error */
 };
 
 static struct node_info *find_node_info(struct impl *impl, struct pw_node *node)
@@ -79,19 +100,58 @@ static void link_data_remove(struct link_data *data)
 	}
 }
 
+static void link_data_clear_convert(struct link_data *data)
+{
+	if (data->peer) {
+		data->peer->convert = NULL;
+		data->peer->peer = NULL;
+	}
+	data->convert = NULL;
+	data->peer = NULL;
+}
+
 static void node_info_free(struct node_info *info)
 {
-	struct link_data *ld, *t;
+	struct link_data *ld;
 
 	spa_list_remove(&info->l);
 	spa_hook_remove(&info->node_listener);
-	spa_list_for_each_safe(ld, t, &info->links, l)
+
+	/* destroying a converter also destroys the link on its other side */
+	while (!spa_list_is_empty(&info->links)) {
+		struct pw_node *convert;
+
+		ld = spa_list_first(&info->links, struct link_data, l);
+		convert = ld->convert;
+
+		link_data_clear_convert(ld);
 		link_data_remove(ld);
+		if (convert)
+			pw_node_destroy(convert);
+	}
 	free(info);
 }
 
 static void try_link_port(struct pw_node *node, struct pw_port *port, struct node_info *info);
 
+/* the converter can't be destroyed from the link callbacks, the link is
+ * still in use by the caller */
+static void on_destroy_convert(void *data)
+{
+	struct link_data *ld = data;
+	struct pw_loop *loop = pw_core_get_main_loop(pw_link_get_core(ld->link));
+	struct pw_node *convert = ld->convert;
+
+	pw_loop_destroy_source(loop, ld->destroy_convert);
+	ld->destroy_convert = NULL;
+
+	if (convert) {
+		pw_log_debug("link %p: destroy converter %p", ld->link, convert);
+		link_data_clear_convert(ld);
+		pw_node_destroy(convert);
+	}
+}
+
 static void
 link_port_unlinked(void *data, struct pw_port *port)
 {
@@ -125,6 +185,9 @@ link_state_changed(void *data, enum pw_link_state old, enum pw_link_state state,
 		if (owner)
 			pw_resource_error(pw_client_get_core_resource(owner), SPA_RESULT_ERROR, error);
 
+		if (ld->convert && ld->destroy_convert == NULL)
+			ld->destroy_convert = pw_loop_add_idle(pw_core_get_main_loop(impl->core),
+							       true, on_destroy_convert, ld);
 		break;
 	}
 
@@ -146,16 +209,229 @@ link_destroy(void *data)
 {
 	struct link_data *ld = data;
 	pw_log_debug("module %p: link %p destroyed", ld->node_info->impl, ld->link);
-	link_data_remove(ld);
+
+	if (ld->convert) {
+		/* the converter can only go when the link is off its ports */
+		spa_list_remove(&ld->l);
+		ld->node_info = NULL;
+	} else
+		link_data_remove(ld);
+}
+
+static void
+link_free(void *data)
+{
+	struct link_data *ld = data;
+	struct pw_node *convert = ld->convert;
+
+	spa_hook_remove(&ld->link_listener);
+
+	if (ld->destroy_convert) {
+		pw_loop_destroy_source(pw_core_get_main_loop(pw_link_get_core(ld->link)),
+				       ld->destroy_convert);
+		ld->destroy_convert = NULL;
+	}
+	if (convert) {
+		link_data_clear_convert(ld);
+		pw_node_destroy(convert);
+	}
 }
 
 static const struct pw_link_events link_events = {
 	PW_VERSION_LINK_EVENTS,
 	.destroy = link_destroy,
+	.free = link_free,
 	.port_unlinked = link_port_unlinked,
 	.state_changed = link_state_changed,
 };
 
+static bool is_audio_port(struct impl *impl, struct pw_port *port)
+{
+	struct spa_node *node = pw_node_get_implementation(pw_port_get_node(port));
+	struct spa_format *format;
+
+	if (spa_node_port_enum_formats(node, pw_port_get_direction(port), pw_port_get_id(port),
+				       &format, NULL, 0) != SPA_RESULT_OK)
+		return false;
+
+	return SPA_FORMAT_MEDIA_TYPE(format) == impl->media_type.audio &&
+	       SPA_FORMAT_MEDIA_SUBTYPE(format) == impl->media_subtype.raw;
+}
+
+/* audioconvert does not convert the rate, check if a format of output has
+ * a rate that a format of input accepts */
+static bool have_common_rate(struct impl *impl, struct pw_port *output, struct pw_port *input)
+{
+	struct spa_node *in_node = pw_node_get_implementation(pw_port_get_node(input));
+	struct spa_node *out_node = pw_node_get_implementation(pw_port_get_node(output));
+	struct spa_format *format;
+	struct spa_pod_prop *rate;
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_frame f;
+	uint8_t buffer[1024];
+	uint32_t i;
+
+	for (i = 0;; i++) {
+		if (spa_node_port_enum_formats(in_node, pw_port_get_direction(input),
+					       pw_port_get_id(input), &format, NULL, i) < 0)
+			return false;
+
+		if ((rate = spa_format_find_prop(format, impl->format_audio.rate)) == NULL ||
+		    SPA_POD_SIZE(rate) > sizeof(buffer) - sizeof(struct spa_format))
+			return true;
+
+		/* a filter with only the rate of the input format */
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		spa_pod_builder_push_format(&b, &f, impl->t->spa_format,
+					    SPA_FORMAT_MEDIA_TYPE(format),
+					    SPA_FORMAT_MEDIA_SUBTYPE(format));
+		spa_pod_builder_raw_padded(&b, rate, SPA_POD_SIZE(rate));
+		spa_pod_builder_pop(&b, &f);
+
+		if (spa_node_port_enum_formats(out_node, pw_port_get_direction(output),
+					       pw_port_get_id(output), &format,
+					       SPA_POD_BUILDER_DEREF(&b, 0, struct spa_format),
+					       0) == SPA_RESULT_OK)
+			return true;
+	}
+}
+
+struct find_data {
+	struct impl *impl;
+	struct pw_port *port;
+	struct pw_port *target;
+};
+
+static bool find_audio_port(void *data, struct pw_global *global)
+{
+	struct find_data *d = data;
+	struct impl *impl = d->impl;
+	struct pw_node *node;
+	struct pw_port *p;
+
+	if (pw_global_get_type(global) != impl->t->node)
+		return true;
+
+	node = pw_global_get_object(global);
+	if (node == pw_port_get_node(d->port) ||
+	    pw_properties_get(pw_node_get_properties(node), PROP_CONVERT))
+		return true;
+
+	p = pw_node_get_free_port(node, pw_direction_reverse(pw_port_get_direction(d->port)));
+	if (p == NULL || !is_audio_port(impl, p))
+		return true;
+
+	if (pw_port_get_direction(p) == PW_DIRECTION_OUTPUT ?
+	    !have_common_rate(impl, p, d->port) : !have_common_rate(impl, d->port, p))
+		return true;
+
+	d->target = p;
+	return false;
+}
+
+/* Find an audio port when no port has a compatible format, the formats
+ * are then converted */
+static struct pw_port *find_convert_port(struct impl *impl, struct pw_port *port)
+{
+	struct find_data data = { impl, port, NULL };
+
+	if (!is_audio_port(impl, port))
+		return NULL;
+
+	pw_core_for_each_global(impl->core, find_audio_port, &data);
+
+	return data.target;
+}
+
+static bool need_convert(struct impl *impl, struct pw_port *output, struct pw_port *input)
+{
+	char *error = NULL;
+
+	if (pw_core_find_format(impl->core, output, input, NULL, 0, NULL, &error) != NULL)
+		return false;
+
+	free(error);
+
+	return is_audio_port(impl, output) && is_audio_port(impl, input) &&
+	       have_common_rate(impl, output, input);
+}
+
+static struct link_data *
+make_link(struct impl *impl, struct node_info *info, struct pw_port *output,
+	  struct pw_port *input, char **error)
+{
+	struct pw_link *link;
+	struct link_data *ld;
+
+	link = pw_link_new(impl->core,
+			   output, input,
+			   NULL, NULL,
+			   error,
+			   sizeof(struct link_data));
+	if (link == NULL)
+		return NULL;
+
+	ld = pw_link_get_user_data(link);
+	ld->link = link;
+	ld->node_info = info;
+	pw_link_add_listener(link, &ld->link_listener, &link_events, ld);
+
+	spa_list_append(&info->links, &ld->l);
+	pw_link_register(link, NULL, pw_module_get_global(impl->module));
+
+	return ld;
+}
+
+/* Link the ports through an audioconvert node. The converter is destroyed
+ * with either of its links. */
+static int
+link_convert(struct impl *impl, struct node_info *info, struct pw_port *output,
+	     struct pw_port *input, char **error)
+{
+	const struct pw_properties *node_props = pw_node_get_properties(info->node);
+	struct pw_properties *props;
+	struct pw_node *convert;
+	struct pw_port *conv_in, *conv_out;
+	struct link_data *l1, *l2;
+	const char *str;
+
+	props = pw_properties_new(PROP_CONVERT, "1", NULL);
+	if ((str = pw_properties_get(node_props, PROP_MATRIX)))
+		pw_properties_set(props, PROP_MATRIX, str);
+
+	convert = pw_spa_node_load(impl->core, NULL, pw_module_get_global(impl->module),
+				   "audioconvert/libspa-audioconvert", "audioconvert",
+				   "audioconvert", props, 0);
+	if (convert == NULL) {
+		asprintf(error, "can't load audioconvert");
+		return SPA_RESULT_ERROR;
+	}
+
+	conv_in = pw_node_get_free_port(convert, PW_DIRECTION_INPUT);
+	conv_out = pw_node_get_free_port(convert, PW_DIRECTION_OUTPUT);
+	if (conv_in == NULL || conv_out == NULL) {
+		asprintf(error, "no audioconvert ports");
+		goto error;
+	}
+
+	if ((l1 = make_link(impl, info, output, conv_in, error)) == NULL)
+		goto error;
+	if ((l2 = make_link(impl, info, conv_out, input, error)) == NULL)
+		goto error;
+
+	l1->convert = l2->convert = convert;
+	l1->peer = l2;
+	l2->peer = l1;
+
+	pw_log_debug("module %p: converting with node %p", impl, convert);
+
+	return SPA_RESULT_OK;
+
+      error:
+	pw_node_destroy(convert);
+	return SPA_RESULT_ERROR;
+}
+
 static void try_link_port(struct pw_node *node, struct pw_port *port, struct node_info *info)
 {
 	struct impl *impl = info->impl;
@@ -163,9 +439,7 @@ static void try_link_port(struct pw_node *node, struct pw_port *port, struct nod
 	const char *str;
 	uint32_t path_id;
 	char *error = NULL;
-	struct pw_link *link;
 	struct pw_port *target;
-	struct link_data *ld;
 
 	props = pw_node_get_properties(node);
 
@@ -184,6 +458,11 @@ static void try_link_port(struct pw_node *node, struct pw_port *port, struct nod
 	pw_log_debug("module %p: try to find and link to node '%d'", impl, path_id);
 
 	target = pw_core_find_port(impl->core, port, path_id, NULL, 0, NULL, &error);
+	if (target == NULL && path_id == SPA_ID_INVALID &&
+	    (target = find_convert_port(impl, port)) != NULL) {
+		free(error);
+		error = NULL;
+	}
 	if (target == NULL)
 		goto error;
 
@@ -193,22 +472,12 @@ static void try_link_port(struct pw_node *node, struct pw_port *port, struct nod
 		port = tmp;
 	}
 
-	link = pw_link_new(impl->core,
-			   port, target,
-			   NULL, NULL,
-			   &error,
-			   sizeof(struct link_data));
-	if (link == NULL)
+	if (need_convert(impl, port, target)) {
+		if (link_convert(impl, info, port, target, &error) < 0)
+			goto error;
+	} else if (make_link(impl, info, port, target, &error) == NULL)
 		goto error;
 
-	ld = pw_link_get_user_data(link);
-	ld->link = link;
-	ld->node_info = info;
-	pw_link_add_listener(link, &ld->link_listener, &link_events, ld);
-
-	spa_list_append(&info->links, &ld->l);
-	pw_link_register(link, NULL, pw_module_get_global(impl->module));
-
 	return;
 
       error:
@@ -351,6 +620,10 @@ static bool module_init(struct pw_module *module, struct pw_properties *properti
 	impl->module = module;
 	impl->properties = properties;
 
+	spa_type_media_type_map(impl->t->map, &impl->media_type);
+	spa_type_media_subtype_map(impl->t->map, &impl->media_subtype);
+	spa_type_format_audio_map(impl->t->map, &impl->format_audio);
+
 	spa_list_init(&impl->node_list);
 
 	pw_core_add_listener(core, &impl->core_listener, &core_events, impl);
@@ -29,6 +29,7 @@
 #include <sys/eventfd.h>
 
 #include "spa/node.h"
+#include "spa/probe.h"
 #include "spa/format-builder.h"
 #include "spa/lib/format.h"
 
@@ -36,6 +37,7 @@
 #include "pipewire/interfaces.h"
 
 #include "pipewire/core.h"
+#include "pipewire/private.h"
 #include "modules/spa/spa-node.h"
 #include "client-node.h"
 #include "transport.h"
@@ -59,6 +61,10 @@
 
 #define CHECK_PORT_BUFFER(this,b,p)      (b < p->n_buffers)
 
+#define PORT_MASK_WORDS(n)		(((n) + 31) / 32)
+#define PORT_MASK_SET(m,p,v)		((v) ? ((m)[(p) / 32] |= (1u << ((p) & 31))) : \
+					       ((m)[(p) / 32] &= ~(1u << ((p) & 31))))
+
 struct proxy_buffer {
 	struct spa_buffer *outbuf;
 	struct spa_buffer buffer;
@@ -81,6 +87,9 @@ struct proxy_port {
 
 	uint32_t n_buffers;
 	struct proxy_buffer buffers[MAX_BUFFERS];
+
+	uint32_t n_reuse;		/* buffers to recycle in this cycle */
+	uint32_t reuse[MAX_BUFFERS];
 };
 
 struct proxy {
@@ -107,6 +116,17 @@ struct proxy {
 	struct proxy_port in_ports[MAX_INPUTS];
 	struct proxy_port out_ports[MAX_OUTPUTS];
 
+	/* ports with an io area, only those are copied to the transport */
+	uint32_t in_active[PORT_MASK_WORDS(MAX_INPUTS)];
+	uint32_t out_active[PORT_MASK_WORDS(MAX_OUTPUTS)];
+
+	/* the messages of a cycle are sent with one wakeup, before the
+	 * data loop goes back to sleep */
+	struct spa_hook loop_hook;
+	bool have_hook;
+	uint32_t process_flags;
+	bool reuse_pending;
+
 	uint8_t format_buffer[1024];
 	uint32_t seq;
 };
@@ -157,6 +177,76 @@ static inline void do_flush(struct proxy *this)
 
 }
 
+static inline int next_active_port(const uint32_t *mask, uint32_t max, uint32_t port_id)
+{
+	while (port_id < max) {
+		uint32_t bits = mask[port_id / 32] >> (port_id & 31);
+		if (bits)
+			return port_id + __builtin_ctz(bits);
+		port_id = (port_id | 31) + 1;
+	}
+	return -1;
+}
+
+#define for_each_active_port(mask,max,i)						\
+	for ((i) = next_active_port(mask, max, 0); (i) >= 0;				\
+	     (i) = next_active_port(mask, max, (i) + 1))
+
+static void flush_reuse(struct proxy *this, uint32_t port_id, struct proxy_port *port)
+{
+	struct impl *impl = this->impl;
+	struct {
+		struct pw_client_node_message_reuse_buffers rb;
+		uint32_t ids[MAX_BUFFERS];
+	} msg;
+
+	if (port->n_reuse == 1) {
+		struct pw_client_node_message_reuse_buffer rb =
+			PW_CLIENT_NODE_MESSAGE_REUSE_BUFFER_INIT(port_id, port->reuse[0]);
+		pw_client_node_transport_add_message(impl->transport,
+				(struct pw_client_node_message *) &rb);
+	} else {
+		msg.rb = PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_INIT(port_id, port->n_reuse);
+		memcpy(msg.ids, port->reuse, port->n_reuse * sizeof(uint32_t));
+		pw_client_node_transport_add_message(impl->transport,
+				(struct pw_client_node_message *) &msg);
+	}
+	port->n_reuse = 0;
+}
+
+/* called from the data loop before it goes to sleep, this is after all
+ * nodes of the cycle were scheduled */
+static void loop_before(void *data)
+{
+	struct proxy *this = data;
+	struct impl *impl = this->impl;
+	uint32_t i;
+
+	if (this->process_flags == 0 && !this->reuse_pending)
+		return;
+
+	if (this->reuse_pending) {
+		for (i = 0; i < MAX_OUTPUTS; i++) {
+			if (this->out_ports[i].n_reuse > 0)
+				flush_reuse(this, i, &this->out_ports[i]);
+		}
+		this->reuse_pending = false;
+	}
+	if (this->process_flags) {
+		struct pw_client_node_message_process p =
+			PW_CLIENT_NODE_MESSAGE_PROCESS_INIT(this->process_flags);
+		pw_client_node_transport_add_message(impl->transport,
+				(struct pw_client_node_message *) &p);
+		this->process_flags = 0;
+	}
+	do_flush(this);
+}
+
+static const struct spa_loop_control_hooks loop_hooks = {
+	SPA_VERSION_LOOP_CONTROL_HOOKS,
+	.before = loop_before,
+};
+
 static int spa_proxy_node_send_command(struct spa_node *node, const struct spa_command *command)
 {
 	struct proxy *this;
@@ -347,6 +437,13 @@ static void do_uninit_port(struct proxy *this, enum spa_direction direction, uin
 	}
 	clear_port(this, port, direction, port_id);
 	port->valid = false;
+	port->io = NULL;
+	port->n_reuse = 0;
+
+	if (direction == SPA_DIRECTION_INPUT)
+		PORT_MASK_SET(this->in_active, port_id, false);
+	else
+		PORT_MASK_SET(this->out_active, port_id, false);
 }
 
 static int
@@ -560,6 +657,11 @@ spa_proxy_node_port_set_io(struct spa_node *node,
 	    direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
 	port->io = io;
 
+	if (direction == SPA_DIRECTION_INPUT)
+		PORT_MASK_SET(this->in_active, port_id, io != NULL);
+	else
+		PORT_MASK_SET(this->out_active, port_id, io != NULL);
+
 	return SPA_RESULT_OK;
 }
 
@@ -705,22 +807,24 @@ static int
 spa_proxy_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
 {
 	struct proxy *this;
-	struct impl *impl;
+	struct proxy_port *port;
 
 	if (node == NULL)
 		return SPA_RESULT_INVALID_ARGUMENTS;
 
 	this = SPA_CONTAINER_OF(node, struct proxy, node);
-	impl = this->impl;
 
 	if (!CHECK_OUT_PORT(this, SPA_DIRECTION_OUTPUT, port_id))
 		return SPA_RESULT_INVALID_PORT;
 
 	spa_log_trace(this->log, "reuse buffer %d", buffer_id);
-	{
-		struct pw_client_node_message_reuse_buffer rb = PW_CLIENT_NODE_MESSAGE_REUSE_BUFFER_INIT(port_id, buffer_id);
-		pw_client_node_transport_add_message(impl->transport, (struct pw_client_node_message *) &rb);
-	}
+	SPA_PROBE(pipewire, buffer_reuse, this, port_id, buffer_id);
+
+	port = &this->out_ports[port_id];
+	if (port->n_reuse == MAX_BUFFERS)
+		flush_reuse(this, port_id, port);
+	port->reuse[port->n_reuse++] = buffer_id;
+	this->reuse_pending = true;
 
 	return SPA_RESULT_OK;
 }
@@ -753,20 +857,15 @@ static int spa_proxy_node_process_input(struct spa_node *node)
 	this = SPA_CONTAINER_OF(node, struct proxy, node);
 	impl = this->impl;
 
-	for (i = 0; i < MAX_INPUTS; i++) {
+	for_each_active_port(this->in_active, MAX_INPUTS, i) {
 		struct spa_port_io *io = this->in_ports[i].io;
 
-		if (!io)
-			continue;
-
 		pw_log_trace("%d %d", io->status, io->buffer_id);
 
 		impl->transport->inputs[i] = *io;
 		io->status = SPA_RESULT_NEED_BUFFER;
 	}
-	pw_client_node_transport_add_message(impl->transport,
-			       &PW_CLIENT_NODE_MESSAGE_INIT(PW_CLIENT_NODE_MESSAGE_PROCESS_INPUT));
-	do_flush(this);
+	this->process_flags |= PW_CLIENT_NODE_PROCESS_INPUT;
 
 	if (this->callbacks->need_input)
 		return SPA_RESULT_OK;
@@ -783,12 +882,9 @@ static int spa_proxy_node_process_output(struct spa_node *node)
 	this = SPA_CONTAINER_OF(node, struct proxy, node);
 	impl = this->impl;
 
-	for (i = 0; i < MAX_OUTPUTS; i++) {
+	for_each_active_port(this->out_active, MAX_OUTPUTS, i) {
 		struct spa_port_io *io = this->out_ports[i].io, tmp;
 
-		if (!io)
-			continue;
-
 		tmp = impl->transport->outputs[i];
 		io->status = SPA_RESULT_NEED_BUFFER;
 		impl->transport->outputs[i] = *io;
@@ -802,9 +898,7 @@ static int spa_proxy_node_process_output(struct spa_node *node)
 				impl->transport->outputs[i].buffer_id);
 	}
 
-	pw_client_node_transport_add_message(impl->transport,
-			       &PW_CLIENT_NODE_MESSAGE_INIT(PW_CLIENT_NODE_MESSAGE_PROCESS_OUTPUT));
-	do_flush(this);
+	this->process_flags |= PW_CLIENT_NODE_PROCESS_OUTPUT;
 	return res;
 }
 
@@ -814,12 +908,9 @@ static int handle_node_message(struct proxy *this, struct pw_client_node_message
 	int i;
 
 	if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_HAVE_OUTPUT) {
-		for (i = 0; i < MAX_OUTPUTS; i++) {
+		for_each_active_port(this->out_active, MAX_OUTPUTS, i) {
 			struct spa_port_io *io = this->out_ports[i].io;
 
-			if (!io)
-				continue;
-
 			*io = impl->transport->outputs[i];
 			pw_log_trace("%d %d", io->status, io->buffer_id);
 		}
@@ -831,6 +922,21 @@ static int handle_node_message(struct proxy *this, struct pw_client_node_message
 		    (struct pw_client_node_message_reuse_buffer *) message;
 		this->callbacks->reuse_buffer(this->callbacks_data, p->body.port_id.value,
 					     p->body.buffer_id.value);
+	} else if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS) {
+		struct pw_client_node_message_reuse_buffers *p =
+		    (struct pw_client_node_message_reuse_buffers *) message;
+		uint32_t *ids = PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_IDS(p);
+		uint32_t n_ids;
+
+		if (!PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_IS_VALID(p)) {
+			pw_log_warn("client-node %p: invalid reuse buffers message", this);
+			return SPA_RESULT_INVALID_ARGUMENTS;
+		}
+		n_ids = PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_N_IDS(p);
+
+		for (i = 0; i < n_ids; i++)
+			this->callbacks->reuse_buffer(this->callbacks_data, p->body.port_id.value,
+						     ids[i]);
 	}
 	return SPA_RESULT_OK;
 }
@@ -884,6 +990,16 @@ client_node_port_update(void *data,
 
 	remove = (change_mask == 0);
 
+	if (change_mask & PW_CLIENT_NODE_PORT_UPDATE_POSSIBLE_FORMATS) {
+		struct pw_port *port = pw_node_find_port(impl->this.node, direction, port_id);
+		/* a new port can have different formats than the port of an
+		 * earlier node with the same name and properties */
+		if (port)
+			pw_port_formats_changed(port);
+		else
+			pw_core_clear_format_cache(impl->core, impl->this.node, direction, port_id);
+	}
+
 	if (remove) {
 		do_uninit_port(this, direction, port_id);
 	} else {
@@ -1006,6 +1122,32 @@ proxy_init(struct proxy *this,
 	return SPA_RESULT_RETURN_ASYNC(this->seq++);
 }
 
+static int
+do_add_hook(struct spa_loop *loop,
+	    bool async, uint32_t seq, size_t size, const void *data, void *user_data)
+{
+	struct impl *impl = user_data;
+	struct proxy *this = &impl->proxy;
+
+	pw_loop_add_hook(impl->core->data_loop, &this->loop_hook, &loop_hooks, this);
+	this->have_hook = true;
+	return SPA_RESULT_OK;
+}
+
+static int
+do_remove_hook(struct spa_loop *loop,
+	       bool async, uint32_t seq, size_t size, const void *data, void *user_data)
+{
+	struct impl *impl = user_data;
+	struct proxy *this = &impl->proxy;
+
+	if (this->have_hook) {
+		spa_hook_remove(&this->loop_hook);
+		this->have_hook = false;
+	}
+	return SPA_RESULT_OK;
+}
+
 static int client_node_get_fds(struct pw_client_node *node, int *readfd, int *writefd)
 {
 	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
@@ -1030,6 +1172,7 @@ static int client_node_get_fds(struct pw_client_node *node, int *readfd, int *wr
 #endif
 
 		spa_loop_add_source(impl->proxy.data_loop, &impl->proxy.data_source);
+		spa_loop_invoke(impl->proxy.data_loop, do_add_hook, 1, 0, NULL, true, impl);
 		pw_log_debug("client-node %p: add data fd %d", node, impl->proxy.data_source.fd);
 	}
 	*readfd = impl->other_fds[0];
@@ -1085,8 +1228,10 @@ static void client_node_resource_destroy(void *data)
 
 	impl->proxy.resource = this->resource = NULL;
 
-	if (proxy->data_source.fd != -1)
+	if (proxy->data_source.fd != -1) {
 		spa_loop_remove_source(proxy->data_loop, &proxy->data_source);
+		spa_loop_invoke(proxy->data_loop, do_remove_hook, 1, 0, NULL, true, impl);
+	}
 
 	pw_node_destroy(this->node);
 }
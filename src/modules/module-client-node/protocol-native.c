@@ -141,83 +141,73 @@ static void client_node_marshal_destroy(void *object)
 	pw_protocol_native_end_proxy(proxy, b);
 }
 
-static bool client_node_demarshal_set_props(void *object, void *data, size_t size)
+static bool client_node_demarshal_set_props(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	uint32_t seq;
 	const struct spa_props *props = NULL;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      -SPA_POD_TYPE_OBJECT, &props, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &seq,
+				-SPA_POD_TYPE_OBJECT, &props, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, set_props, seq, props);
 	return true;
 }
 
-static bool client_node_demarshal_event_event(void *object, void *data, size_t size)
+static bool client_node_demarshal_event_event(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	const struct spa_event *event;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_OBJECT, &event, 0))
+	if (!spa_pod_parser_get(parser, SPA_POD_TYPE_OBJECT, &event, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, event, event);
 	return true;
 }
 
-static bool client_node_demarshal_add_port(void *object, void *data, size_t size)
+static bool client_node_demarshal_add_port(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	int32_t seq, direction, port_id;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      SPA_POD_TYPE_INT, &direction, SPA_POD_TYPE_INT, &port_id, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &seq,
+				SPA_POD_TYPE_INT, &direction, SPA_POD_TYPE_INT, &port_id, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, add_port, seq, direction, port_id);
 	return true;
 }
 
-static bool client_node_demarshal_remove_port(void *object, void *data, size_t size)
+static bool client_node_demarshal_remove_port(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	int32_t seq, direction, port_id;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      SPA_POD_TYPE_INT, &direction, SPA_POD_TYPE_INT, &port_id, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &seq,
+				SPA_POD_TYPE_INT, &direction, SPA_POD_TYPE_INT, &port_id, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, remove_port, seq, direction, port_id);
 	return true;
 }
 
-static bool client_node_demarshal_set_format(void *object, void *data, size_t size)
+static bool client_node_demarshal_set_format(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	uint32_t seq, direction, port_id, flags;
 	const struct spa_format *format = NULL;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      SPA_POD_TYPE_INT, &direction,
-			      SPA_POD_TYPE_INT, &port_id,
-			      SPA_POD_TYPE_INT, &flags,
-			      -SPA_POD_TYPE_OBJECT, &format, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &seq,
+				SPA_POD_TYPE_INT, &direction,
+				SPA_POD_TYPE_INT, &port_id,
+				SPA_POD_TYPE_INT, &flags,
+				-SPA_POD_TYPE_OBJECT, &format, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, set_format, seq, direction, port_id,
@@ -225,41 +215,37 @@ static bool client_node_demarshal_set_format(void *object, void *data, size_t si
 	return true;
 }
 
-static bool client_node_demarshal_set_param(void *object, void *data, size_t size)
+static bool client_node_demarshal_set_param(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	uint32_t seq, direction, port_id;
 	const struct spa_param *param = NULL;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      SPA_POD_TYPE_INT, &direction,
-			      SPA_POD_TYPE_INT, &port_id,
-			      -SPA_POD_TYPE_OBJECT, &param, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &seq,
+				SPA_POD_TYPE_INT, &direction,
+				SPA_POD_TYPE_INT, &port_id,
+				-SPA_POD_TYPE_OBJECT, &param, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, set_param, seq, direction, port_id, param);
 	return true;
 }
 
-static bool client_node_demarshal_add_mem(void *object, void *data, size_t size)
+static bool client_node_demarshal_add_mem(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	uint32_t direction, port_id, mem_id, type, memfd_idx, flags, offset, sz;
 	int memfd;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &direction,
-			      SPA_POD_TYPE_INT, &port_id,
-			      SPA_POD_TYPE_INT, &mem_id,
-			      SPA_POD_TYPE_ID, &type,
-			      SPA_POD_TYPE_INT, &memfd_idx,
-			      SPA_POD_TYPE_INT, &flags,
-			      SPA_POD_TYPE_INT, &offset, SPA_POD_TYPE_INT, &sz, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &direction,
+				SPA_POD_TYPE_INT, &port_id,
+				SPA_POD_TYPE_INT, &mem_id,
+				SPA_POD_TYPE_ID, &type,
+				SPA_POD_TYPE_INT, &memfd_idx,
+				SPA_POD_TYPE_INT, &flags,
+				SPA_POD_TYPE_INT, &offset, SPA_POD_TYPE_INT, &sz, 0))
 		return false;
 
 	memfd = pw_protocol_native_get_proxy_fd(proxy, memfd_idx);
@@ -272,55 +258,59 @@ static bool client_node_demarshal_add_mem(void *object, void *data, size_t size)
 	return true;
 }
 
-static bool client_node_demarshal_use_buffers(void *object, void *data, size_t size)
+static bool client_node_demarshal_use_buffers(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	uint32_t seq, direction, port_id, n_buffers, data_id;
 	struct pw_client_node_buffer *buffers;
 	int i, j;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      SPA_POD_TYPE_INT, &direction,
-			      SPA_POD_TYPE_INT, &port_id, SPA_POD_TYPE_INT, &n_buffers, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &seq,
+				SPA_POD_TYPE_INT, &direction,
+				SPA_POD_TYPE_INT, &port_id, SPA_POD_TYPE_INT, &n_buffers, 0))
 		return false;
 
+	if (n_buffers > spa_pod_parser_remaining(parser) / 6)
+		return false;
 	buffers = alloca(sizeof(struct pw_client_node_buffer) * n_buffers);
 	for (i = 0; i < n_buffers; i++) {
 		struct spa_buffer *buf = buffers[i].buffer = alloca(sizeof(struct spa_buffer));
 
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_INT, &buffers[i].mem_id,
-				      SPA_POD_TYPE_INT, &buffers[i].offset,
-				      SPA_POD_TYPE_INT, &buffers[i].size,
-				      SPA_POD_TYPE_INT, &buf->id,
-				      SPA_POD_TYPE_INT, &buf->n_metas, 0))
+		if (!spa_pod_parser_get(parser,
+					SPA_POD_TYPE_INT, &buffers[i].mem_id,
+					SPA_POD_TYPE_INT, &buffers[i].offset,
+					SPA_POD_TYPE_INT, &buffers[i].size,
+					SPA_POD_TYPE_INT, &buf->id,
+					SPA_POD_TYPE_INT, &buf->n_metas, 0))
 			return false;
 
+		if (buf->n_metas > spa_pod_parser_remaining(parser) / 2)
+			return false;
 		buf->metas = alloca(sizeof(struct spa_meta) * buf->n_metas);
 		for (j = 0; j < buf->n_metas; j++) {
 			struct spa_meta *m = &buf->metas[j];
 
-			if (!spa_pod_iter_get(&it,
-					      SPA_POD_TYPE_ID, &m->type,
-					      SPA_POD_TYPE_INT, &m->size, 0))
+			if (!spa_pod_parser_get(parser,
+						SPA_POD_TYPE_ID, &m->type,
+						SPA_POD_TYPE_INT, &m->size, 0))
 				return false;
 		}
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &buf->n_datas, 0))
+		if (!spa_pod_parser_get(parser, SPA_POD_TYPE_INT, &buf->n_datas, 0))
 			return false;
 
+		if (buf->n_datas > spa_pod_parser_remaining(parser) / 5)
+			return false;
 		buf->datas = alloca(sizeof(struct spa_data) * buf->n_datas);
 		for (j = 0; j < buf->n_datas; j++) {
 			struct spa_data *d = &buf->datas[j];
 
-			if (!spa_pod_iter_get(&it,
-					      SPA_POD_TYPE_ID, &d->type,
-					      SPA_POD_TYPE_INT, &data_id,
-					      SPA_POD_TYPE_INT, &d->flags,
-					      SPA_POD_TYPE_INT, &d->mapoffset,
-					      SPA_POD_TYPE_INT, &d->maxsize, 0))
+			if (!spa_pod_parser_get(parser,
+						SPA_POD_TYPE_ID, &d->type,
+						SPA_POD_TYPE_INT, &data_id,
+						SPA_POD_TYPE_INT, &d->flags,
+						SPA_POD_TYPE_INT, &d->mapoffset,
+						SPA_POD_TYPE_INT, &d->maxsize, 0))
 				return false;
 
 			d->data = SPA_UINT32_TO_PTR(data_id);
@@ -333,33 +323,29 @@ static bool client_node_demarshal_use_buffers(void *object, void *data, size_t s
 	return true;
 }
 
-static bool client_node_demarshal_node_command(void *object, void *data, size_t size)
+static bool client_node_demarshal_node_command(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	const struct spa_command *command;
 	uint32_t seq;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &seq, SPA_POD_TYPE_OBJECT, &command, 0))
+	if (!spa_pod_parser_get(parser, SPA_POD_TYPE_INT, &seq, SPA_POD_TYPE_OBJECT, &command, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, node_command, seq, command);
 	return true;
 }
 
-static bool client_node_demarshal_port_command(void *object, void *data, size_t size)
+static bool client_node_demarshal_port_command(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	const struct spa_command *command;
 	uint32_t direction, port_id;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &direction,
-			      SPA_POD_TYPE_INT, &port_id,
-			      SPA_POD_TYPE_OBJECT, &command, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &direction,
+				SPA_POD_TYPE_INT, &port_id,
+				SPA_POD_TYPE_OBJECT, &command, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, port_command, direction,
@@ -368,23 +354,21 @@ static bool client_node_demarshal_port_command(void *object, void *data, size_t
 	return true;
 }
 
-static bool client_node_demarshal_transport(void *object, void *data, size_t size)
+static bool client_node_demarshal_transport(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	uint32_t node_id, ridx, widx, memfd_idx;
 	int readfd, writefd;
 	struct pw_client_node_transport_info info;
 	struct pw_client_node_transport *transport;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &node_id,
-			      SPA_POD_TYPE_INT, &ridx,
-			      SPA_POD_TYPE_INT, &widx,
-			      SPA_POD_TYPE_INT, &memfd_idx,
-			      SPA_POD_TYPE_INT, &info.offset,
-			      SPA_POD_TYPE_INT, &info.size, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &node_id,
+				SPA_POD_TYPE_INT, &ridx,
+				SPA_POD_TYPE_INT, &widx,
+				SPA_POD_TYPE_INT, &memfd_idx,
+				SPA_POD_TYPE_INT, &info.offset,
+				SPA_POD_TYPE_INT, &info.size, 0))
 		return false;
 
 	readfd = pw_protocol_native_get_proxy_fd(proxy, ridx);
@@ -644,34 +628,30 @@ static void client_node_marshal_transport(void *object, uint32_t node_id, int re
 }
 
 
-static bool client_node_demarshal_done(void *object, void *data, size_t size)
+static bool client_node_demarshal_done(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
 	uint32_t seq, res;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      SPA_POD_TYPE_INT, &res, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &seq,
+				SPA_POD_TYPE_INT, &res, 0))
 		return false;
 
 	pw_resource_do(resource, struct pw_client_node_proxy_methods, done, seq, res);
 	return true;
 }
 
-static bool client_node_demarshal_update(void *object, void *data, size_t size)
+static bool client_node_demarshal_update(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
 	uint32_t change_mask, max_input_ports, max_output_ports;
 	const struct spa_props *props;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &change_mask,
-			      SPA_POD_TYPE_INT, &max_input_ports,
-			      SPA_POD_TYPE_INT, &max_output_ports, -SPA_POD_TYPE_OBJECT, &props, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &change_mask,
+				SPA_POD_TYPE_INT, &max_input_ports,
+				SPA_POD_TYPE_INT, &max_output_ports, -SPA_POD_TYPE_OBJECT, &props, 0))
 		return false;
 
 	pw_resource_do(resource, struct pw_client_node_proxy_methods, update, change_mask,
@@ -681,38 +661,40 @@ static bool client_node_demarshal_update(void *object, void *data, size_t size)
 	return true;
 }
 
-static bool client_node_demarshal_port_update(void *object, void *data, size_t size)
+static bool client_node_demarshal_port_update(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
 	uint32_t i, direction, port_id, change_mask, n_possible_formats, n_params;
 	const struct spa_param **params = NULL;
 	const struct spa_format **possible_formats = NULL, *format = NULL;
 	struct spa_port_info info, *infop = NULL;
 	struct spa_pod *ipod;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &direction,
-			      SPA_POD_TYPE_INT, &port_id,
-			      SPA_POD_TYPE_INT, &change_mask,
-			      SPA_POD_TYPE_INT, &n_possible_formats, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &direction,
+				SPA_POD_TYPE_INT, &port_id,
+				SPA_POD_TYPE_INT, &change_mask,
+				SPA_POD_TYPE_INT, &n_possible_formats, 0))
 		return false;
 
+	if (n_possible_formats > spa_pod_parser_remaining(parser))
+		return false;
 	possible_formats = alloca(n_possible_formats * sizeof(struct spa_format *));
 	for (i = 0; i < n_possible_formats; i++)
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_OBJECT, &possible_formats[i], 0))
+		if (!spa_pod_parser_get(parser, SPA_POD_TYPE_OBJECT, &possible_formats[i], 0))
 			return false;
 
-	if (!spa_pod_iter_get(&it, -SPA_POD_TYPE_OBJECT, &format, SPA_POD_TYPE_INT, &n_params, 0))
+	if (!spa_pod_parser_get(parser, -SPA_POD_TYPE_OBJECT, &format, SPA_POD_TYPE_INT, &n_params, 0))
 		return false;
 
+	if (n_params > spa_pod_parser_remaining(parser))
+		return false;
 	params = alloca(n_params * sizeof(struct spa_param *));
 	for (i = 0; i < n_params; i++)
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_OBJECT, &params[i], 0))
+		if (!spa_pod_parser_get(parser, SPA_POD_TYPE_OBJECT, &params[i], 0))
 			return false;
 
-	if (!spa_pod_iter_get(&it, -SPA_POD_TYPE_STRUCT, &ipod, 0))
+	if (!spa_pod_parser_get(parser, -SPA_POD_TYPE_STRUCT, &ipod, 0))
 		return false;
 
 	if (ipod) {
@@ -737,27 +719,21 @@ static bool client_node_demarshal_port_update(void *object, void *data, size_t s
 	return true;
 }
 
-static bool client_node_demarshal_event_method(void *object, void *data, size_t size)
+static bool client_node_demarshal_event_method(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
 	struct spa_event *event;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_OBJECT, &event, 0))
+	if (!spa_pod_parser_get(parser, SPA_POD_TYPE_OBJECT, &event, 0))
 		return false;
 
 	pw_resource_do(resource, struct pw_client_node_proxy_methods, event, event);
 	return true;
 }
 
-static bool client_node_demarshal_destroy(void *object, void *data, size_t size)
+static bool client_node_demarshal_destroy(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
-
-	if (!spa_pod_iter_struct(&it, data, size))
-		return false;
 
 	pw_resource_do(resource, struct pw_client_node_proxy_methods, destroy);
 	return true;
@@ -21,6 +21,8 @@
 #include <errno.h>
 #include <sys/mman.h>
 
+#include <spa/probe.h>
+
 #include <pipewire/log.h>
 #include <extensions/client-node.h>
 
@@ -128,6 +130,8 @@ static int add_message(struct pw_client_node_transport *trans, struct pw_client_
 				  index & trans->output_buffer->mask, message, size);
 	spa_ringbuffer_write_update(trans->output_buffer, index + size);
 
+	SPA_PROBE(pipewire, transport_send, trans, PW_CLIENT_NODE_MESSAGE_TYPE(message), size);
+
 	return SPA_RESULT_OK;
 }
 
@@ -150,6 +154,9 @@ static int next_message(struct pw_client_node_transport *trans, struct pw_client
 
 	*message = impl->current;
 
+	SPA_PROBE(pipewire, transport_receive, trans, PW_CLIENT_NODE_MESSAGE_TYPE(message),
+		  SPA_POD_SIZE(message));
+
 	return SPA_RESULT_OK;
 }
 
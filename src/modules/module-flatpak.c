@@ -36,6 +36,8 @@
 #include "pipewire/module.h"
 #include "pipewire/utils.h"
 
+#include "module-flatpak/permissions.h"
+
 struct impl {
 	struct pw_core *core;
 	struct pw_type *type;
@@ -47,6 +49,9 @@ struct impl {
 	struct spa_hook module_listener;
 
 	struct spa_list client_list;
+	struct pw_array clients;	/**< struct client_info * by client global id */
+
+	struct permission_cache permissions;
 
 	struct spa_source *dispatch_event;
 };
@@ -58,7 +63,9 @@ struct client_info {
 	struct impl *impl;
 	struct pw_client *client;
 	struct spa_hook client_listener;
+	uint32_t id;
 	bool is_sandboxed;
+	struct permission_client permissions;
         struct spa_list resources;
 	struct resource *core_resource;
 	struct spa_list async_pending;
@@ -85,13 +92,22 @@ struct async_pending {
 
 static struct client_info *find_client_info(struct impl *impl, struct pw_client *client)
 {
+	struct pw_global *global;
 	struct client_info *info;
+	uint32_t id;
 
-	spa_list_for_each(info, &impl->client_list, link) {
-		if (info->client == client)
-			return info;
-	}
-	return NULL;
+	if ((global = pw_client_get_global(client)) == NULL)
+		return NULL;
+
+	id = pw_global_get_id(global);
+	if (!pw_array_check_index(&impl->clients, id, struct client_info *))
+		return NULL;
+
+	info = *pw_array_get_unchecked(&impl->clients, id, struct client_info *);
+	if (info == NULL || info->client != client)
+		return NULL;
+
+	return info;
 }
 
 static void close_request(struct async_pending *p)
@@ -155,6 +171,10 @@ static void client_info_free(struct client_info *cinfo)
 	spa_list_for_each_safe(r, tr, &cinfo->resources, link)
 		free_resource(r);
 
+	if (pw_array_check_index(&cinfo->impl->clients, cinfo->id, struct client_info *))
+		*pw_array_get_unchecked(&cinfo->impl->clients, cinfo->id, struct client_info *) = NULL;
+
+	permission_client_clear(&cinfo->permissions);
 	spa_hook_remove(&cinfo->client_listener);
 	spa_list_remove(&cinfo->link);
 	free(cinfo);
@@ -209,53 +229,17 @@ static bool check_sandboxed(struct client_info *cinfo, char **error)
 	return true;
 }
 
-static bool
-check_global_owner(struct pw_core *core, struct pw_client *client, struct pw_global *global)
-{
-	struct pw_client *owner;
-	const struct ucred *owner_ucred, *client_ucred;
-
-	if (global == NULL)
-		return false;
-
-	owner = pw_global_get_owner(global);
-	if (owner == NULL)
-		return true;
-
-	owner_ucred = pw_client_get_ucred(owner);
-	client_ucred = pw_client_get_ucred(client);
-
-	if (owner_ucred == NULL || client_ucred == NULL)
-		return true;
-
-	return owner_ucred->uid == client_ucred->uid;
-}
-
 static uint32_t
 do_permission(struct pw_global *global, struct pw_client *client, void *data)
 {
 	struct impl *impl = data;
+	struct client_info *cinfo;
 
-	if (pw_global_get_type(global) == impl->type->link) {
-		struct pw_link *link = pw_global_get_object(global);
-		struct pw_port *port;
-		struct pw_node *node;
-
-		port = pw_link_get_output(link);
-		node = pw_port_get_node(port);
-		/* we must be able to see both nodes */
-		if (port && node && !check_global_owner(impl->core, client, pw_node_get_global(node)))
-			 return 0;
-
-		port = pw_link_get_input(link);
-		node = pw_port_get_node(port);
-		if (port && node && !check_global_owner(impl->core, client, pw_node_get_global(node)))
-			 return 0;
-	}
-	else if (!check_global_owner(impl->core, client, global))
-		return 0;
+	/* the client is not known while its own global is added */
+	if ((cinfo = find_client_info(impl, client)) == NULL)
+		return permission_cache_get(&impl->permissions, global, client);
 
-	return PW_PERM_RWX;
+	return permission_client_get(&cinfo->permissions, &impl->permissions, global);
 }
 
 static DBusHandlerResult
@@ -498,14 +482,30 @@ core_global_added(void *data, struct pw_global *global)
 {
 	struct impl *impl = data;
 
+	/* look up the owners once, the permissions of all clients are checked
+	 * against them right after this */
+	permission_cache_global_added(&impl->permissions, global);
+
 	if (pw_global_get_type(global) == impl->type->client) {
 		struct pw_client *client = pw_global_get_object(global);
-		struct client_info *cinfo;
+		struct client_info *cinfo, **p;
+		uint32_t id = pw_global_get_id(global);
 		char *error;
 
+		if (!pw_array_check_index(&impl->clients, id, struct client_info *)) {
+			size_t len = pw_array_get_len(&impl->clients, struct client_info *);
+			size_t size = (id + 1 - len) * sizeof(struct client_info *);
+
+			if ((p = pw_array_add(&impl->clients, size)) == NULL)
+				return;
+			memset(p, 0, size);
+		}
+
 		cinfo = calloc(1, sizeof(struct client_info));
 		cinfo->impl = impl;
 		cinfo->client = client;
+		cinfo->id = id;
+		permission_client_init(&cinfo->permissions, client);
 		if (!check_sandboxed(cinfo, &error)) {
 			pw_log_warn("module %p: client %p sandbox check failed: %s", impl, client, error);
 			free(error);
@@ -516,6 +516,7 @@ core_global_added(void *data, struct pw_global *global)
 		pw_client_add_listener(client, &cinfo->client_listener, &client_events, cinfo);
 
 		spa_list_insert(impl->client_list.prev, &cinfo->link);
+		*pw_array_get_unchecked(&impl->clients, id, struct client_info *) = cinfo;
 
 		pw_log_debug("module %p: client %p added", impl, client);
 	}
@@ -526,11 +527,15 @@ core_global_removed(void *data, struct pw_global *global)
 {
 	struct impl *impl = data;
 
+	permission_cache_global_removed(&impl->permissions, global);
+
 	if (pw_global_get_type(global) == impl->type->client) {
 		struct pw_client *client = pw_global_get_object(global);
+		uint32_t id = pw_global_get_id(global);
 		struct client_info *cinfo;
 
-		if ((cinfo = find_client_info(impl, client)))
+		if (pw_array_check_index(&impl->clients, id, struct client_info *) &&
+		    (cinfo = *pw_array_get_unchecked(&impl->clients, id, struct client_info *)))
 			client_info_free(cinfo);
 
 		pw_log_debug("module %p: client %p removed", impl, client);
@@ -739,6 +744,9 @@ static void module_destroy(void *data)
 	spa_list_for_each_safe(info, t, &impl->client_list, link)
 		client_info_free(info);
 
+	pw_array_clear(&impl->clients);
+	permission_cache_clear(&impl->permissions);
+
 	pw_loop_destroy_source(pw_core_get_main_loop(impl->core), impl->dispatch_event);
 
 	if (impl->properties)
@@ -782,6 +790,8 @@ static bool module_init(struct pw_module *module, struct pw_properties *properti
 	dbus_connection_set_wakeup_main_function(impl->bus, wakeup_main, impl, NULL);
 
 	spa_list_init(&impl->client_list);
+	pw_array_init(&impl->clients, 64 * sizeof(struct client_info *));
+	permission_cache_init(&impl->permissions, core);
 
 	pw_core_add_listener(core, &impl->core_listener, &core_events, impl);
 	pw_module_add_listener(module, &impl->module_listener, &module_events, impl);
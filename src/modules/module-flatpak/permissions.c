@@ -0,0 +1,275 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <pipewire/link.h>
+#include <pipewire/log.h>
+#include <pipewire/node.h>
+#include <pipewire/port.h>
+
+#include "permissions.h"
+
+/** \cond */
+struct global_owner {
+	struct pw_global *global;	/**< the global of the entry, NULL when unused */
+	uint32_t generation;		/**< changes when the owners are looked up */
+	uint32_t serial;		/**< serial of the cache when the links were looked up */
+	bool hidden;			/**< a node of the link has no global */
+	uint32_t n_uids;		/**< number of owners, 0 when anyone can see it */
+	uid_t uids[2];			/**< the owners, a link has the owners of both nodes */
+};
+
+struct client_entry {
+	uint32_t generation;		/**< generation of the owner entry, 0 when unused */
+	uint32_t permissions;		/**< the permissions of the client */
+};
+/** \endcond */
+
+/* get the entry at index id, the array is grown with zeroed entries when
+ * needed */
+static void *ensure_index(struct pw_array *arr, uint32_t id, size_t size)
+{
+	size_t len = pw_array_get_len_s(arr, size);
+
+	if (id >= len) {
+		size_t extra = (id + 1 - len) * size;
+		void *p;
+
+		if ((p = pw_array_add(arr, extra)) == NULL)
+			return NULL;
+		memset(p, 0, extra);
+	}
+	return pw_array_get_unchecked_s(arr, id, size, void);
+}
+
+/* add the owner of a global, false when the global is gone */
+static bool add_owner(struct global_owner *o, struct pw_global *global)
+{
+	struct pw_client *owner;
+	const struct ucred *ucred;
+
+	if (global == NULL)
+		return false;
+
+	if ((owner = pw_global_get_owner(global)) == NULL ||
+	    (ucred = pw_client_get_ucred(owner)) == NULL)
+		return true;
+
+	o->uids[o->n_uids++] = ucred->uid;
+	return true;
+}
+
+/* we must be able to see the nodes on both sides of a link */
+static bool add_port_owner(struct global_owner *o, struct pw_port *port)
+{
+	struct pw_node *node;
+
+	if (port == NULL || (node = pw_port_get_node(port)) == NULL)
+		return true;
+
+	return add_owner(o, pw_node_get_global(node));
+}
+
+static void update_owner(struct permission_cache *cache, struct global_owner *o,
+			 struct pw_global *global)
+{
+	o->global = global;
+	/* 0 is never used so that new client entries are invalid */
+	if (++cache->generation == 0)
+		cache->generation++;
+	o->generation = cache->generation;
+	o->serial = cache->serial;
+	o->n_uids = 0;
+
+	if (pw_global_get_type(global) == cache->type->link) {
+		struct pw_link *link = pw_global_get_object(global);
+
+		o->hidden = !add_port_owner(o, pw_link_get_output(link)) ||
+			    !add_port_owner(o, pw_link_get_input(link));
+	} else {
+		o->hidden = !add_owner(o, global);
+	}
+}
+
+static struct global_owner *
+lookup_owner(struct permission_cache *cache, struct pw_global *global)
+{
+	struct global_owner *o;
+
+	/* the global ids are allocated from the start, the array has an entry
+	 * for all of them */
+	if ((o = ensure_index(&cache->owners, pw_global_get_id(global),
+			      sizeof(struct global_owner))) == NULL)
+		return NULL;
+
+	if (o->global != global ||
+	    (o->serial != cache->serial && pw_global_get_type(global) == cache->type->link))
+		update_owner(cache, o, global);
+
+	return o;
+}
+
+static uint32_t check_owner(struct global_owner *o, struct pw_client *client)
+{
+	const struct ucred *ucred;
+	uint32_t i;
+
+	if (o->hidden)
+		return 0;
+
+	if ((ucred = pw_client_get_ucred(client)) == NULL)
+		return PW_PERM_RWX;
+
+	for (i = 0; i < o->n_uids; i++) {
+		if (o->uids[i] != ucred->uid)
+			return 0;
+	}
+	return PW_PERM_RWX;
+}
+
+/** Initialize a permission cache
+ * \param cache the cache to initialize
+ * \param core the core of the globals
+ * \memberof permission_cache
+ */
+void permission_cache_init(struct permission_cache *cache, struct pw_core *core)
+{
+	cache->core = core;
+	cache->type = pw_core_get_type(core);
+	pw_array_init(&cache->owners, 64 * sizeof(struct global_owner));
+	cache->generation = 0;
+	cache->serial = 0;
+}
+
+/** Clear a permission cache
+ * \param cache the cache to clear
+ * \memberof permission_cache
+ */
+void permission_cache_clear(struct permission_cache *cache)
+{
+	pw_array_clear(&cache->owners);
+}
+
+/** Look up the owners of a new global
+ * \param cache a permission cache
+ * \param global the global that is added
+ *
+ * The owners are looked up once, before the permissions of the global are
+ * checked for all clients.
+ *
+ * \memberof permission_cache
+ */
+void permission_cache_global_added(struct permission_cache *cache, struct pw_global *global)
+{
+	lookup_owner(cache, global);
+}
+
+/** Forget a global
+ * \param cache a permission cache
+ * \param global the global that is removed
+ *
+ * The links that go to a node are looked up again when the node is removed.
+ *
+ * \memberof permission_cache
+ */
+void permission_cache_global_removed(struct permission_cache *cache, struct pw_global *global)
+{
+	uint32_t id = pw_global_get_id(global);
+	struct global_owner *o;
+
+	if (pw_global_get_type(global) == cache->type->node)
+		cache->serial++;
+
+	if (!pw_array_check_index(&cache->owners, id, struct global_owner))
+		return;
+
+	o = pw_array_get_unchecked(&cache->owners, id, struct global_owner);
+	if (o->global == global)
+		o->global = NULL;
+}
+
+/** Get the permissions of a client on a global
+ * \param cache a permission cache
+ * \param global a global
+ * \param client a client
+ * \return the permissions of \a client on \a global
+ * \memberof permission_cache
+ */
+uint32_t
+permission_cache_get(struct permission_cache *cache, struct pw_global *global,
+		     struct pw_client *client)
+{
+	struct global_owner *o;
+
+	if ((o = lookup_owner(cache, global)) == NULL)
+		return 0;
+
+	return check_owner(o, client);
+}
+
+/** Initialize the permissions of a client
+ * \param pc the permissions to initialize
+ * \param client the client
+ * \memberof permission_client
+ */
+void permission_client_init(struct permission_client *pc, struct pw_client *client)
+{
+	pc->client = client;
+	pw_array_init(&pc->entries, 64 * sizeof(struct client_entry));
+}
+
+/** Clear the permissions of a client
+ * \param pc the permissions to clear
+ * \memberof permission_client
+ */
+void permission_client_clear(struct permission_client *pc)
+{
+	pw_array_clear(&pc->entries);
+}
+
+/** Get the permissions of a client on a global
+ * \param pc the permissions of a client
+ * \param cache the permission cache with the owners
+ * \param global a global
+ * \return the permissions of the client on \a global
+ * \memberof permission_client
+ */
+uint32_t
+permission_client_get(struct permission_client *pc, struct permission_cache *cache,
+		      struct pw_global *global)
+{
+	struct global_owner *o;
+	struct client_entry *e;
+
+	if ((o = lookup_owner(cache, global)) == NULL)
+		return 0;
+
+	if ((e = ensure_index(&pc->entries, pw_global_get_id(global),
+			      sizeof(struct client_entry))) == NULL)
+		return check_owner(o, pc->client);
+
+	if (e->generation != o->generation) {
+		e->permissions = check_owner(o, pc->client);
+		e->generation = o->generation;
+	}
+	return e->permissions;
+}
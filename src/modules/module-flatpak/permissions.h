@@ -0,0 +1,88 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PIPEWIRE_FLATPAK_PERMISSIONS_H__
+#define __PIPEWIRE_FLATPAK_PERMISSIONS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pipewire/array.h>
+#include <pipewire/client.h>
+#include <pipewire/core.h>
+#include <pipewire/global.h>
+
+/** \class permission_cache
+ *
+ * A client can see the objects of the clients with the same uid. The
+ * permissions of a client on a global only depend on the uid of the client
+ * and on the owners of the global, for a link the owners of both nodes.
+ * The owner uids are looked up once per global and kept by global id, so
+ * that listing the registry is one compare per global.
+ *
+ * The owner of a global does not change. The entry of a global is dropped
+ * when it is removed and the links are looked up again when a node goes
+ * away. The owner entry gets a new generation every time it is looked up.
+ */
+struct permission_cache {
+	struct pw_core *core;
+	struct pw_type *type;
+	struct pw_array owners;		/**< struct global_owner by global id */
+	uint32_t generation;		/**< last generation of the owner entries */
+	uint32_t serial;		/**< changes when a node is removed */
+};
+
+/** \class permission_client
+ *
+ * The permissions of one client, kept by global id. An entry is used as
+ * long as the owner entry of the global in the permission_cache has the
+ * same generation, so it is only computed again when the global is
+ * replaced or when the nodes of a link change.
+ */
+struct permission_client {
+	struct pw_client *client;
+	struct pw_array entries;	/**< struct client_entry by global id */
+};
+
+void permission_cache_init(struct permission_cache *cache, struct pw_core *core);
+
+void permission_cache_clear(struct permission_cache *cache);
+
+void permission_cache_global_added(struct permission_cache *cache, struct pw_global *global);
+
+void permission_cache_global_removed(struct permission_cache *cache, struct pw_global *global);
+
+uint32_t
+permission_cache_get(struct permission_cache *cache, struct pw_global *global,
+		     struct pw_client *client);
+
+void permission_client_init(struct permission_client *pc, struct pw_client *client);
+
+void permission_client_clear(struct permission_client *pc);
+
+uint32_t
+permission_client_get(struct permission_client *pc, struct permission_cache *cache,
+		      struct pw_global *global);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __PIPEWIRE_FLATPAK_PERMISSIONS_H__ */
@@ -74,6 +74,7 @@ struct impl {
 	struct pw_type *t;
 	struct pw_module *module;
 	struct spa_hook module_listener;
+	struct spa_hook core_listener;
 
         struct spa_source *timer;
 
@@ -1429,7 +1430,8 @@ static int init_server(struct impl *impl, const char *name, bool promiscuous)
 	server->graph_manager = jack_graph_manager_alloc(2048);
 
 	/* engine control */
-	server->engine_control = jack_engine_control_alloc(name);
+	server->engine_control = jack_engine_control_alloc(name,
+			pw_core_get_quantum(impl->core));
 
 	for (i = 0; i < CLIENT_NUM; i++)
 		server->synchro_table[i] = JACK_SYNCHRO_INIT;
@@ -1452,11 +1454,38 @@ static int init_server(struct impl *impl, const char *name, bool promiscuous)
 	return -1;
 }
 
+/* the JACK buffer size is the graph quantum, tell the clients when it
+ * changes */
+static void core_quantum_changed(void *data, uint32_t quantum)
+{
+	struct impl *impl = data;
+	struct jack_engine_control *ctrl = impl->server.engine_control;
+
+	if (ctrl->buffer_size == quantum)
+		return;
+
+	pw_log_debug("module-jack %p: buffer size %u", impl, quantum);
+
+	ctrl->buffer_size = quantum;
+	ctrl->period_usecs = 1000000.f / ctrl->sample_rate * ctrl->buffer_size;
+	ctrl->period = ctrl->constraint = ctrl->period_usecs * 1000;
+	ctrl->computation = calc_computation(ctrl->buffer_size) * 1000;
+	jack_engine_control_reset_rolling_usecs(ctrl);
+
+	notify_clients(impl, jack_notify_BufferSizeCallback, true, "", quantum, 0);
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.quantum_changed = core_quantum_changed,
+};
+
 static void module_destroy(void *data)
 {
 	struct impl *impl = data;
 	struct link *ld, *t;
 
+	spa_hook_remove(&impl->core_listener);
 	spa_hook_remove(&impl->module_listener);
 
 	spa_list_for_each_safe(ld, t, &impl->link_list, link_link)
@@ -1512,6 +1541,7 @@ static bool module_init(struct pw_module *module, struct pw_properties *properti
 	if (init_server(impl, name, promiscuous) < 0)
 		goto error;
 
+	pw_core_add_listener(core, &impl->core_listener, &core_events, impl);
 	pw_module_add_listener(module, &impl->module_listener, &module_events, impl);
 
 	return true;
@@ -1011,7 +1011,7 @@ static inline uint64_t calc_computation(jack_nframes_t buffer_size)
 }
 
 static inline struct jack_engine_control *
-jack_engine_control_alloc(const char* name)
+jack_engine_control_alloc(const char* name, jack_nframes_t buffer_size)
 {
 	struct jack_engine_control *ctrl;
         jack_shm_info_t info;
@@ -1024,7 +1024,7 @@ jack_engine_control_alloc(const char* name)
         ctrl = (struct jack_engine_control *)jack_shm_addr(&info);
         ctrl->info = info;
 
-	ctrl->buffer_size = 128;
+	ctrl->buffer_size = buffer_size;
         ctrl->sample_rate = 48000;
 	ctrl->sync_mode = false;
 	ctrl->temporary = false;
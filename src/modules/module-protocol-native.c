@@ -62,6 +62,12 @@ struct protocol_data {
 	struct pw_properties *properties;
 };
 
+/** field offsets of the last received message */
+struct offsets {
+	uint32_t *data;
+	uint32_t size;
+};
+
 struct client {
 	struct pw_protocol_client this;
 
@@ -74,6 +80,8 @@ struct client {
         bool disconnecting;
 	bool flush_signaled;
         struct spa_source *flush_event;
+
+	struct offsets offsets;
 };
 
 struct server {
@@ -94,8 +102,26 @@ struct client_data {
 	struct spa_source *source;
 	struct pw_protocol_native_connection *connection;
 	bool busy;
+
+	struct offsets offsets;
 };
 
+/** Validate \a message and index its fields, \a offsets grows as needed */
+static bool init_parser(struct spa_pod_parser *parser, void *message, uint32_t size,
+			struct offsets *offsets)
+{
+	uint32_t max_fields = SPA_POD_PARSER_MAX_FIELDS(size);
+
+	if (max_fields > offsets->size) {
+		uint32_t *data = realloc(offsets->data, max_fields * sizeof(uint32_t));
+		if (data == NULL)
+			return false;
+		offsets->data = data;
+		offsets->size = max_fields;
+	}
+	return spa_pod_parser_init(parser, message, size, offsets->data, max_fields);
+}
+
 static void
 process_messages(struct client_data *data)
 {
@@ -105,6 +131,7 @@ process_messages(struct client_data *data)
 	uint32_t id;
 	uint32_t size;
 	void *message;
+	struct spa_pod_parser parser;
 
 	while (pw_protocol_native_connection_get_next(conn, &opcode, &id, &message, &size)) {
 		struct pw_resource *resource;
@@ -148,11 +175,15 @@ process_messages(struct client_data *data)
 			continue;
 		}
 
+		/* validate once, after this all the sizes in the message can be trusted */
+		if (!init_parser(&parser, message, size, &data->offsets))
+			goto invalid_message;
+
 		if (demarshal[opcode].flags & PW_PROTOCOL_NATIVE_REMAP)
 			if (!pw_pod_remap_data(SPA_POD_TYPE_STRUCT, message, size, &client->types))
 				goto invalid_message;
 
-		if (!demarshal[opcode].func (resource, message, size))
+		if (!demarshal[opcode].func (resource, &parser))
 			goto invalid_message;
 	}
 	return;
@@ -214,6 +245,7 @@ static void client_free(void *data)
 	spa_list_remove(&client->protocol_link);
 
 	pw_protocol_native_connection_destroy(this->connection);
+	free(this->offsets.data);
 }
 
 static const struct pw_client_events client_events = {
@@ -482,6 +514,7 @@ on_remote_data(void *data, int fd, enum spa_io mask)
                 uint32_t id;
                 uint32_t size;
                 void *message;
+		struct spa_pod_parser parser;
 
                 while (!impl->disconnecting
                        && pw_protocol_native_connection_get_next(conn, &opcode, &id, &message, &size)) {
@@ -512,6 +545,11 @@ on_remote_data(void *data, int fd, enum spa_io mask)
 				continue;
 			}
 
+			if (!init_parser(&parser, message, size, &impl->offsets)) {
+				pw_log_error("protocol-native %p: invalid message received %u for %u", this,
+					     opcode, id);
+				continue;
+			}
 			if (demarshal[opcode].flags & PW_PROTOCOL_NATIVE_REMAP) {
 				if (!pw_pod_remap_data(SPA_POD_TYPE_STRUCT, message, size, &this->types)) {
                                         pw_log_error
@@ -520,7 +558,7 @@ on_remote_data(void *data, int fd, enum spa_io mask)
 					continue;
 				}
 			}
-			if (!demarshal[opcode].func(proxy, message, size)) {
+			if (!demarshal[opcode].func(proxy, &parser)) {
 				pw_log_error ("protocol-native %p: invalid message received %u for %u", this,
 					opcode, id);
 				continue;
@@ -610,6 +648,7 @@ static void impl_destroy(struct pw_protocol_client *client)
 		pw_properties_free(impl->properties);
 
 	spa_list_remove(&client->link);
+	free(impl->offsets.data);
 	free(impl);
 }
 
@@ -345,8 +345,8 @@ static uint32_t write_pod(struct spa_pod_builder *b, uint32_t ref, const void *d
         if (ref == -1)
                 ref = b->offset;
 
-        if (b->size <= b->offset) {
-                b->size = SPA_ROUND_UP_N(b->offset + size, 4096);
+        if (ref + size > b->size) {
+                b->size = SPA_ROUND_UP_N(ref + size, 4096);
                 b->data = begin_write(&impl->this, b->size);
         }
         memcpy(b->data + ref, data, size);
@@ -177,97 +177,91 @@ core_marshal_update_types_client(void *object, uint32_t first_id, uint32_t n_typ
 	pw_protocol_native_end_proxy(proxy, b);
 }
 
-static bool core_demarshal_info(void *object, void *data, size_t size)
+static bool core_demarshal_info(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
 	struct spa_dict props;
 	struct pw_core_info info;
-	struct spa_pod_iter it;
 	int i;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &info.id,
-			      SPA_POD_TYPE_LONG, &info.change_mask,
-			      SPA_POD_TYPE_STRING, &info.user_name,
-			      SPA_POD_TYPE_STRING, &info.host_name,
-			      SPA_POD_TYPE_STRING, &info.version,
-			      SPA_POD_TYPE_STRING, &info.name,
-			      SPA_POD_TYPE_INT, &info.cookie, SPA_POD_TYPE_INT, &props.n_items, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &info.id,
+				SPA_POD_TYPE_LONG, &info.change_mask,
+				SPA_POD_TYPE_STRING, &info.user_name,
+				SPA_POD_TYPE_STRING, &info.host_name,
+				SPA_POD_TYPE_STRING, &info.version,
+				SPA_POD_TYPE_STRING, &info.name,
+				SPA_POD_TYPE_INT, &info.cookie, SPA_POD_TYPE_INT, &props.n_items, 0))
 		return false;
 
 	info.props = &props;
+	if (props.n_items > spa_pod_parser_remaining(parser) / 2)
+		return false;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
 	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
+		if (!spa_pod_parser_get(parser,
+					SPA_POD_TYPE_STRING, &props.items[i].key,
+					SPA_POD_TYPE_STRING, &props.items[i].value, 0))
 			return false;
 	}
 	pw_proxy_notify(proxy, struct pw_core_proxy_events, info, &info);
 	return true;
 }
 
-static bool core_demarshal_done(void *object, void *data, size_t size)
+static bool core_demarshal_done(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	uint32_t seq;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &seq, 0))
+	if (!spa_pod_parser_get(parser, SPA_POD_TYPE_INT, &seq, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_core_proxy_events, done, seq);
 	return true;
 }
 
-static bool core_demarshal_error(void *object, void *data, size_t size)
+static bool core_demarshal_error(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	uint32_t id, res;
 	const char *error;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &id,
-			      SPA_POD_TYPE_INT, &res, SPA_POD_TYPE_STRING, &error, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &id,
+				SPA_POD_TYPE_INT, &res, SPA_POD_TYPE_STRING, &error, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_core_proxy_events, error, id, res, error);
 	return true;
 }
 
-static bool core_demarshal_remove_id(void *object, void *data, size_t size)
+static bool core_demarshal_remove_id(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	uint32_t id;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &id, 0))
+	if (!spa_pod_parser_get(parser, SPA_POD_TYPE_INT, &id, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_core_proxy_events, remove_id, id);
 	return true;
 }
 
-static bool core_demarshal_update_types_client(void *object, void *data, size_t size)
+static bool core_demarshal_update_types_client(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	uint32_t first_id, n_types;
 	const char **types;
 	int i;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &first_id, SPA_POD_TYPE_INT, &n_types, 0))
+	if (!spa_pod_parser_get(parser, SPA_POD_TYPE_INT, &first_id, SPA_POD_TYPE_INT, &n_types, 0))
 		return false;
 
+	if (n_types > spa_pod_parser_remaining(parser))
+		return false;
 	types = alloca(n_types * sizeof(char *));
 	for (i = 0; i < n_types; i++) {
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_STRING, &types[i], 0))
+		if (!spa_pod_parser_get(parser, SPA_POD_TYPE_STRING, &types[i], 0))
 			return false;
 	}
 	pw_proxy_notify(proxy, struct pw_core_proxy_events, update_types, first_id, n_types, types);
@@ -376,52 +370,48 @@ core_marshal_update_types_server(void *object, uint32_t first_id, uint32_t n_typ
 	pw_protocol_native_end_resource(resource, b);
 }
 
-static bool core_demarshal_client_update(void *object, void *data, size_t size)
+static bool core_demarshal_client_update(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_resource *resource = object;
 	struct spa_dict props;
-	struct spa_pod_iter it;
 	uint32_t i;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &props.n_items, 0))
+	if (!spa_pod_parser_get(parser, SPA_POD_TYPE_INT, &props.n_items, 0))
 		return false;
 
+	if (props.n_items > spa_pod_parser_remaining(parser) / 2)
+		return false;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
 	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
+		if (!spa_pod_parser_get(parser,
+					SPA_POD_TYPE_STRING, &props.items[i].key,
+					SPA_POD_TYPE_STRING, &props.items[i].value, 0))
 			return false;
 	}
 	pw_resource_do(resource, struct pw_core_proxy_methods, client_update, &props);
 	return true;
 }
 
-static bool core_demarshal_sync(void *object, void *data, size_t size)
+static bool core_demarshal_sync(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
 	uint32_t seq;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &seq, 0))
+	if (!spa_pod_parser_get(parser, SPA_POD_TYPE_INT, &seq, 0))
 		return false;
 
 	pw_resource_do(resource, struct pw_core_proxy_methods, sync, seq);
 	return true;
 }
 
-static bool core_demarshal_get_registry(void *object, void *data, size_t size)
+static bool core_demarshal_get_registry(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
 	int32_t version, new_id;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &version,
-			      SPA_POD_TYPE_INT, &new_id, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &version,
+				SPA_POD_TYPE_INT, &new_id, 0))
 
 		return false;
 
@@ -429,31 +419,31 @@ static bool core_demarshal_get_registry(void *object, void *data, size_t size)
 	return true;
 }
 
-static bool core_demarshal_create_object(void *object, void *data, size_t size)
+static bool core_demarshal_create_object(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
 	uint32_t version, type, new_id, i;
 	const char *factory_name;
 	struct spa_dict props;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_STRING, &factory_name,
-			      SPA_POD_TYPE_ID, &type,
-			      SPA_POD_TYPE_INT, &version,
-			      SPA_POD_TYPE_INT, &props.n_items, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_STRING, &factory_name,
+				SPA_POD_TYPE_ID, &type,
+				SPA_POD_TYPE_INT, &version,
+				SPA_POD_TYPE_INT, &props.n_items, 0))
 		return false;
 
+	if (props.n_items > spa_pod_parser_remaining(parser) / 2)
+		return false;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
 	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
+		if (!spa_pod_parser_get(parser,
+					SPA_POD_TYPE_STRING, &props.items[i].key,
+					SPA_POD_TYPE_STRING, &props.items[i].value, 0))
 			return false;
 	}
-	if (!spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &new_id, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &new_id, 0))
 		return false;
 
 	pw_resource_do(resource, struct pw_core_proxy_methods, create_object, factory_name,
@@ -462,33 +452,33 @@ static bool core_demarshal_create_object(void *object, void *data, size_t size)
 	return true;
 }
 
-static bool core_demarshal_create_link(void *object, void *data, size_t size)
+static bool core_demarshal_create_link(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
 	uint32_t new_id, i;
 	uint32_t output_node_id, output_port_id, input_node_id, input_port_id;
 	struct spa_format *filter = NULL;
 	struct spa_dict props;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &output_node_id,
-			      SPA_POD_TYPE_INT, &output_port_id,
-			      SPA_POD_TYPE_INT, &input_node_id,
-			      SPA_POD_TYPE_INT, &input_port_id,
-			      -SPA_POD_TYPE_OBJECT, &filter,
-			      SPA_POD_TYPE_INT, &props.n_items, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &output_node_id,
+				SPA_POD_TYPE_INT, &output_port_id,
+				SPA_POD_TYPE_INT, &input_node_id,
+				SPA_POD_TYPE_INT, &input_port_id,
+				-SPA_POD_TYPE_OBJECT, &filter,
+				SPA_POD_TYPE_INT, &props.n_items, 0))
 		return false;
 
+	if (props.n_items > spa_pod_parser_remaining(parser) / 2)
+		return false;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
 	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
+		if (!spa_pod_parser_get(parser,
+					SPA_POD_TYPE_STRING, &props.items[i].key,
+					SPA_POD_TYPE_STRING, &props.items[i].value, 0))
 			return false;
 	}
-	if (!spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &new_id, 0))
+	if (!spa_pod_parser_get(parser, SPA_POD_TYPE_INT, &new_id, 0))
 		return false;
 
 	pw_resource_do(resource, struct pw_core_proxy_methods, create_link, output_node_id,
@@ -501,21 +491,21 @@ static bool core_demarshal_create_link(void *object, void *data, size_t size)
 	return true;
 }
 
-static bool core_demarshal_update_types_server(void *object, void *data, size_t size)
+static bool core_demarshal_update_types_server(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
 	uint32_t first_id, n_types;
 	const char **types;
 	int i;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &first_id, SPA_POD_TYPE_INT, &n_types, 0))
+	if (!spa_pod_parser_get(parser, SPA_POD_TYPE_INT, &first_id, SPA_POD_TYPE_INT, &n_types, 0))
 		return false;
 
+	if (n_types > spa_pod_parser_remaining(parser))
+		return false;
 	types = alloca(n_types * sizeof(char *));
 	for (i = 0; i < n_types; i++) {
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_STRING, &types[i], 0))
+		if (!spa_pod_parser_get(parser, SPA_POD_TYPE_STRING, &types[i], 0))
 			return false;
 	}
 	pw_resource_do(resource, struct pw_core_proxy_methods, update_types, first_id, n_types, types);
@@ -554,18 +544,16 @@ static void registry_marshal_global_remove(void *object, uint32_t id)
 	pw_protocol_native_end_resource(resource, b);
 }
 
-static bool registry_demarshal_bind(void *object, void *data, size_t size)
+static bool registry_demarshal_bind(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
 	uint32_t id, version, type, new_id;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &id,
-			      SPA_POD_TYPE_ID, &type,
-			      SPA_POD_TYPE_INT, &version,
-			      SPA_POD_TYPE_INT, &new_id, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &id,
+				SPA_POD_TYPE_ID, &type,
+				SPA_POD_TYPE_INT, &version,
+				SPA_POD_TYPE_INT, &new_id, 0))
 		return false;
 
 	pw_resource_do(resource, struct pw_registry_proxy_methods, bind, id, type, version, new_id);
@@ -601,29 +589,29 @@ static void module_marshal_info(void *object, struct pw_module_info *info)
 	pw_protocol_native_end_resource(resource, b);
 }
 
-static bool module_demarshal_info(void *object, void *data, size_t size)
+static bool module_demarshal_info(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	struct spa_dict props;
 	struct pw_module_info info;
 	int i;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &info.id,
-			      SPA_POD_TYPE_LONG, &info.change_mask,
-			      SPA_POD_TYPE_STRING, &info.name,
-			      SPA_POD_TYPE_STRING, &info.filename,
-			      SPA_POD_TYPE_STRING, &info.args, SPA_POD_TYPE_INT, &props.n_items, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &info.id,
+				SPA_POD_TYPE_LONG, &info.change_mask,
+				SPA_POD_TYPE_STRING, &info.name,
+				SPA_POD_TYPE_STRING, &info.filename,
+				SPA_POD_TYPE_STRING, &info.args, SPA_POD_TYPE_INT, &props.n_items, 0))
 		return false;
 
 	info.props = &props;
+	if (props.n_items > spa_pod_parser_remaining(parser) / 2)
+		return false;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
 	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
+		if (!spa_pod_parser_get(parser,
+					SPA_POD_TYPE_STRING, &props.items[i].key,
+					SPA_POD_TYPE_STRING, &props.items[i].value, 0))
 			return false;
 	}
 	pw_proxy_notify(proxy, struct pw_module_proxy_events, info, &info);
@@ -660,30 +648,30 @@ static void factory_marshal_info(void *object, struct pw_factory_info *info)
 	pw_protocol_native_end_resource(resource, b);
 }
 
-static bool factory_demarshal_info(void *object, void *data, size_t size)
+static bool factory_demarshal_info(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	struct spa_dict props;
 	struct pw_factory_info info;
 	int i;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &info.id,
-			      SPA_POD_TYPE_LONG, &info.change_mask,
-			      SPA_POD_TYPE_STRING, &info.name,
-			      SPA_POD_TYPE_ID, &info.type,
-			      SPA_POD_TYPE_INT, &info.version,
-			      SPA_POD_TYPE_INT, &props.n_items, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &info.id,
+				SPA_POD_TYPE_LONG, &info.change_mask,
+				SPA_POD_TYPE_STRING, &info.name,
+				SPA_POD_TYPE_ID, &info.type,
+				SPA_POD_TYPE_INT, &info.version,
+				SPA_POD_TYPE_INT, &props.n_items, 0))
 		return false;
 
 	info.props = &props;
+	if (props.n_items > spa_pod_parser_remaining(parser) / 2)
+		return false;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
 	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
+		if (!spa_pod_parser_get(parser,
+					SPA_POD_TYPE_STRING, &props.items[i].key,
+					SPA_POD_TYPE_STRING, &props.items[i].value, 0))
 			return false;
 	}
 	pw_proxy_notify(proxy, struct pw_factory_proxy_events, info, &info);
@@ -735,52 +723,56 @@ static void node_marshal_info(void *object, struct pw_node_info *info)
 	pw_protocol_native_end_resource(resource, b);
 }
 
-static bool node_demarshal_info(void *object, void *data, size_t size)
+static bool node_demarshal_info(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	struct spa_dict props;
 	struct pw_node_info info;
 	int i;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &info.id,
-			      SPA_POD_TYPE_LONG, &info.change_mask,
-			      SPA_POD_TYPE_STRING, &info.name,
-			      SPA_POD_TYPE_INT, &info.max_input_ports,
-			      SPA_POD_TYPE_INT, &info.n_input_ports,
-			      SPA_POD_TYPE_INT, &info.n_input_formats, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &info.id,
+				SPA_POD_TYPE_LONG, &info.change_mask,
+				SPA_POD_TYPE_STRING, &info.name,
+				SPA_POD_TYPE_INT, &info.max_input_ports,
+				SPA_POD_TYPE_INT, &info.n_input_ports,
+				SPA_POD_TYPE_INT, &info.n_input_formats, 0))
 		return false;
 
+	if (info.n_input_formats > spa_pod_parser_remaining(parser))
+		return false;
 	info.input_formats = alloca(info.n_input_formats * sizeof(struct spa_format *));
 	for (i = 0; i < info.n_input_formats; i++)
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_OBJECT, &info.input_formats[i], 0))
+		if (!spa_pod_parser_get(parser, SPA_POD_TYPE_OBJECT, &info.input_formats[i], 0))
 			return false;
 
-	if (!spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &info.max_output_ports,
-			      SPA_POD_TYPE_INT, &info.n_output_ports,
-			      SPA_POD_TYPE_INT, &info.n_output_formats, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &info.max_output_ports,
+				SPA_POD_TYPE_INT, &info.n_output_ports,
+				SPA_POD_TYPE_INT, &info.n_output_formats, 0))
 		return false;
 
+	if (info.n_output_formats > spa_pod_parser_remaining(parser))
+		return false;
 	info.output_formats = alloca(info.n_output_formats * sizeof(struct spa_format *));
 	for (i = 0; i < info.n_output_formats; i++)
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_OBJECT, &info.output_formats[i], 0))
+		if (!spa_pod_parser_get(parser, SPA_POD_TYPE_OBJECT, &info.output_formats[i], 0))
 			return false;
 
-	if (!spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &info.state,
-			      SPA_POD_TYPE_STRING, &info.error,
-			      SPA_POD_TYPE_INT, &props.n_items, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &info.state,
+				SPA_POD_TYPE_STRING, &info.error,
+				SPA_POD_TYPE_INT, &props.n_items, 0))
 		return false;
 
 	info.props = &props;
+	if (props.n_items > spa_pod_parser_remaining(parser) / 2)
+		return false;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
 	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
+		if (!spa_pod_parser_get(parser,
+					SPA_POD_TYPE_STRING, &props.items[i].key,
+					SPA_POD_TYPE_STRING, &props.items[i].value, 0))
 			return false;
 	}
 	pw_proxy_notify(proxy, struct pw_node_proxy_events, info, &info);
@@ -814,27 +806,27 @@ static void client_marshal_info(void *object, struct pw_client_info *info)
 	pw_protocol_native_end_resource(resource, b);
 }
 
-static bool client_demarshal_info(void *object, void *data, size_t size)
+static bool client_demarshal_info(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	struct spa_dict props;
 	struct pw_client_info info;
 	uint32_t i;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &info.id,
-			      SPA_POD_TYPE_LONG, &info.change_mask,
-			      SPA_POD_TYPE_INT, &props.n_items, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &info.id,
+				SPA_POD_TYPE_LONG, &info.change_mask,
+				SPA_POD_TYPE_INT, &props.n_items, 0))
 		return false;
 
 	info.props = &props;
+	if (props.n_items > spa_pod_parser_remaining(parser) / 2)
+		return false;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
 	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
+		if (!spa_pod_parser_get(parser,
+					SPA_POD_TYPE_STRING, &props.items[i].key,
+					SPA_POD_TYPE_STRING, &props.items[i].value, 0))
 			return false;
 	}
 	pw_proxy_notify(proxy, struct pw_client_proxy_events, info, &info);
@@ -873,65 +865,61 @@ static void link_marshal_info(void *object, struct pw_link_info *info)
 	pw_protocol_native_end_resource(resource, b);
 }
 
-static bool link_demarshal_info(void *object, void *data, size_t size)
+static bool link_demarshal_info(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	struct spa_dict props;
 	struct pw_link_info info = { 0, };
 	int i;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &info.id,
-			      SPA_POD_TYPE_LONG, &info.change_mask,
-			      SPA_POD_TYPE_INT, &info.output_node_id,
-			      SPA_POD_TYPE_INT, &info.output_port_id,
-			      SPA_POD_TYPE_INT, &info.input_node_id,
-			      SPA_POD_TYPE_INT, &info.input_port_id,
-			      -SPA_POD_TYPE_OBJECT, &info.format,
-			      SPA_POD_TYPE_INT, &props.n_items, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &info.id,
+				SPA_POD_TYPE_LONG, &info.change_mask,
+				SPA_POD_TYPE_INT, &info.output_node_id,
+				SPA_POD_TYPE_INT, &info.output_port_id,
+				SPA_POD_TYPE_INT, &info.input_node_id,
+				SPA_POD_TYPE_INT, &info.input_port_id,
+				-SPA_POD_TYPE_OBJECT, &info.format,
+				SPA_POD_TYPE_INT, &props.n_items, 0))
 		return false;
 
 	info.props = &props;
+	if (props.n_items > spa_pod_parser_remaining(parser) / 2)
+		return false;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
 	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
+		if (!spa_pod_parser_get(parser,
+					SPA_POD_TYPE_STRING, &props.items[i].key,
+					SPA_POD_TYPE_STRING, &props.items[i].value, 0))
 			return false;
 	}
 	pw_proxy_notify(proxy, struct pw_link_proxy_events, info, &info);
 	return true;
 }
 
-static bool registry_demarshal_global(void *object, void *data, size_t size)
+static bool registry_demarshal_global(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	uint32_t id, parent_id, permissions, type, version;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &id,
-			      SPA_POD_TYPE_INT, &parent_id,
-			      SPA_POD_TYPE_INT, &permissions,
-			      SPA_POD_TYPE_ID, &type,
-			      SPA_POD_TYPE_INT, &version, 0))
+	if (!spa_pod_parser_get(parser,
+				SPA_POD_TYPE_INT, &id,
+				SPA_POD_TYPE_INT, &parent_id,
+				SPA_POD_TYPE_INT, &permissions,
+				SPA_POD_TYPE_ID, &type,
+				SPA_POD_TYPE_INT, &version, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_registry_proxy_events, global, id, parent_id, permissions, type, version);
 	return true;
 }
 
-static bool registry_demarshal_global_remove(void *object, void *data, size_t size)
+static bool registry_demarshal_global_remove(void *object, struct spa_pod_parser *parser)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	uint32_t id;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &id, 0))
+	if (!spa_pod_parser_get(parser, SPA_POD_TYPE_INT, &id, 0))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_registry_proxy_events, global_remove, id);
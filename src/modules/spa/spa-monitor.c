@@ -55,8 +55,24 @@ struct impl {
 	void *hnd;
 
 	struct spa_list item_list;
+
+	struct spa_source *enum_idle;
+	uint32_t enum_index;
 };
 
+static struct monitor_item *find_item(struct pw_spa_monitor *this, const char *id)
+{
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
+	struct monitor_item *mitem;
+
+	spa_list_for_each(mitem, &impl->item_list, link) {
+		if (strcmp(mitem->id, id) == 0) {
+			return mitem;
+		}
+	}
+	return NULL;
+}
+
 static void add_item(struct pw_spa_monitor *this, struct spa_monitor_item *item)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
@@ -80,6 +96,13 @@ static void add_item(struct pw_spa_monitor *this, struct spa_monitor_item *item)
 			     t->monitor.factory, SPA_POD_TYPE_POINTER, &factory,
 			     t->monitor.info, SPA_POD_TYPE_STRUCT, &info, 0);
 
+	/* the item can be enumerated and announced with an event when it
+	 * appears during the enumeration */
+	if (find_item(this, id) != NULL) {
+		pw_log_debug("monitor %p: already added: \"%s\" (%s)", this, name, id);
+		return;
+	}
+
 	pw_log_debug("monitor %p: add: \"%s\" (%s)", this, name, id);
 
 	props = pw_properties_new(NULL, NULL);
@@ -127,19 +150,6 @@ static void add_item(struct pw_spa_monitor *this, struct spa_monitor_item *item)
 	spa_list_append(&impl->item_list, &mitem->link);
 }
 
-static struct monitor_item *find_item(struct pw_spa_monitor *this, const char *id)
-{
-	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
-	struct monitor_item *mitem;
-
-	spa_list_for_each(mitem, &impl->item_list, link) {
-		if (strcmp(mitem->id, id) == 0) {
-			return mitem;
-		}
-	}
-	return NULL;
-}
-
 void destroy_item(struct monitor_item *mitem)
 {
 	pw_node_destroy(mitem->node);
@@ -221,6 +231,29 @@ static const struct spa_monitor_callbacks callbacks = {
 	.event = on_monitor_event,
 };
 
+/* with PIPEWIRE_STARTUP=async, add one item in each iteration of the main
+ * loop so that clients are not blocked while a monitor with many devices
+ * starts up. The node of an item is created when it is enumerated, a
+ * client can only find and link a node that exists with its ports. */
+static void enum_next_item(void *data)
+{
+	struct impl *impl = data;
+	struct pw_spa_monitor *this = &impl->this;
+	struct spa_monitor_item *item;
+	int res;
+
+	if ((res = spa_monitor_enum_items(this->monitor, &item, impl->enum_index++)) < 0) {
+		if (res != SPA_RESULT_ENUM_END)
+			pw_log_debug("spa_monitor_enum_items: got error %d\n", res);
+
+		pw_log_debug("monitor %p: added %d items", this, impl->enum_index - 1);
+		pw_loop_destroy_source(pw_core_get_main_loop(impl->core), impl->enum_idle);
+		impl->enum_idle = NULL;
+		return;
+	}
+	add_item(this, item);
+}
+
 struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 					   struct pw_global *parent,
 					   const char *dir,
@@ -242,6 +275,7 @@ struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 	const struct spa_support *support;
 	uint32_t n_support;
 	struct pw_type *t = pw_core_get_type(core);
+	const char *str;
 
 	asprintf(&filename, "%s/%s.so", dir, lib);
 
@@ -295,9 +329,16 @@ struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 
 	spa_list_init(&impl->item_list);
 
+	spa_monitor_set_callbacks(this->monitor, &callbacks, impl);
+
+	if ((str = getenv("PIPEWIRE_STARTUP")) && strcmp(str, "async") == 0) {
+		impl->enum_idle = pw_loop_add_idle(pw_core_get_main_loop(core), true,
+						   enum_next_item, impl);
+		return this;
+	}
+
 	for (index = 0;; index++) {
 		struct spa_monitor_item *item;
-		int res;
 
 		if ((res = spa_monitor_enum_items(this->monitor, &item, index)) < 0) {
 			if (res != SPA_RESULT_ENUM_END)
@@ -306,7 +347,6 @@ struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 		}
 		add_item(this, item);
 	}
-	spa_monitor_set_callbacks(this->monitor, &callbacks, impl);
 
 	return this;
 
@@ -330,6 +370,9 @@ void pw_spa_monitor_destroy(struct pw_spa_monitor *monitor)
 
 	pw_log_debug("spa-monitor %p: destroy", impl);
 
+	if (impl->enum_idle)
+		pw_loop_destroy_source(pw_core_get_main_loop(impl->core), impl->enum_idle);
+
 	spa_list_for_each_safe(mitem, tmp, &impl->item_list, link)
 		destroy_item(mitem);
 
@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <time.h>
 #include <stdio.h>
+#include <string.h>
 
 #define spa_debug pw_log_trace
 
@@ -39,6 +40,40 @@ struct resource_data {
 	struct spa_hook resource_listener;
 };
 
+/* a port of a node with a cache key, see node_cache_key() */
+struct format_port {
+	uint64_t node_key;
+	uint32_t port_id;
+};
+
+struct format_entry {
+	struct spa_list link;		/* link in core format_cache, least recently
+					 * used first */
+	struct format_port output;
+	struct format_port input;
+	uint32_t filter_hash;
+	uint32_t n_filters;
+	void *filters;			/* copy of the filters, one after the other */
+	struct spa_format *format;
+};
+
+/* the nodes with ports in a direction and with a media type and subtype,
+ * sorted by node id. The nodes that were not looked at yet or that have no
+ * ports go in the bucket with an invalid media type and subtype */
+struct port_bucket {
+	struct spa_list link;		/* link in core port_index */
+	enum pw_direction direction;
+	uint32_t media_type;
+	uint32_t media_subtype;
+	struct spa_list nodes;
+};
+
+#define MAX_FORMAT_ENTRIES	64
+
+#define DEFAULT_QUANTUM		1024
+#define MIN_QUANTUM		64
+#define MAX_QUANTUM		8192
+
 /** \endcond */
 
 static void registry_bind(void *object, uint32_t id,
@@ -384,6 +419,14 @@ core_bind_func(struct pw_global *global,
 	return SPA_RESULT_NO_MEMORY;
 }
 
+static void on_quantum_timeout(void *data, uint64_t expirations)
+{
+	struct pw_core *core = data;
+
+	pw_log_trace("core %p: cycle", core);
+	pw_core_wake_followers(core);
+}
+
 /** Create a new core object
  *
  * \param main_loop the main loop to use
@@ -420,6 +463,10 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *pro
 
 	spa_graph_init(&this->rt.graph);
 	spa_graph_set_callbacks(&this->rt.graph, &spa_graph_impl_default, NULL);
+	spa_list_init(&this->rt.followers);
+
+	this->quantum = DEFAULT_QUANTUM;
+	this->timer = pw_loop_add_timer(this->data_loop, on_quantum_timeout, this);
 
 	spa_debug_set_type_map(this->type.map);
 
@@ -441,6 +488,8 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *pro
 	spa_list_init(&this->node_list);
 	spa_list_init(&this->factory_list);
 	spa_list_init(&this->link_list);
+	spa_list_init(&this->format_cache);
+	spa_list_init(&this->port_index);
 	spa_hook_list_init(&this->listener_list);
 
 	if ((name = pw_properties_get(properties, PW_CORE_PROP_NAME)) == NULL) {
@@ -486,6 +535,7 @@ void pw_core_destroy(struct pw_core *core)
 {
 	struct pw_global *global, *t;
 	struct pw_module *module, *tm;
+	struct port_bucket *b, *tb;
 
 	pw_log_debug("core %p: destroy", core);
 	spa_hook_list_call(&core->listener_list, struct pw_core_events, destroy);
@@ -498,6 +548,13 @@ void pw_core_destroy(struct pw_core *core)
 
 	spa_hook_list_call(&core->listener_list, struct pw_core_events, free);
 
+	pw_core_clear_format_cache(core, NULL, 0, 0);
+
+	spa_list_for_each_safe(b, tb, &core->port_index, link)
+		free(b);
+
+	pw_data_loop_stop(core->data_loop_impl);
+	pw_loop_destroy_source(core->data_loop, core->timer);
 	pw_data_loop_destroy(core->data_loop_impl);
 
 	pw_properties_free(core->properties);
@@ -550,6 +607,11 @@ struct pw_loop *pw_core_get_main_loop(struct pw_core *core)
 	return core->main_loop;
 }
 
+uint32_t pw_core_get_quantum(struct pw_core *core)
+{
+	return core->quantum;
+}
+
 const struct pw_properties *pw_core_get_properties(struct pw_core *core)
 {
 	return core->properties;
@@ -600,6 +662,205 @@ struct pw_global *pw_core_find_global(struct pw_core *core, uint32_t id)
 	return pw_map_lookup(&core->globals, id);
 }
 
+static struct port_bucket *
+find_port_bucket(struct pw_core *core, enum pw_direction direction, uint32_t media_type,
+		 uint32_t media_subtype, bool create)
+{
+	struct port_bucket *b;
+
+	spa_list_for_each(b, &core->port_index, link) {
+		if (b->direction == direction && b->media_type == media_type &&
+		    b->media_subtype == media_subtype)
+			return b;
+	}
+	if (!create)
+		return NULL;
+
+	if ((b = calloc(1, sizeof(struct port_bucket))) == NULL)
+		return NULL;
+
+	b->direction = direction;
+	b->media_type = media_type;
+	b->media_subtype = media_subtype;
+	spa_list_init(&b->nodes);
+	spa_list_insert(core->port_index.prev, &b->link);
+
+	return b;
+}
+
+/* keep the nodes in a bucket sorted by id so that a lookup finds the
+ * same node as a walk over all nodes would. Nodes are mostly added in
+ * the order of their ids, look for the place from the end. */
+static void move_node(struct pw_node *node, enum pw_direction direction, struct port_bucket *b)
+{
+	struct spa_list *l;
+
+	if (node->index[direction].bucket == b)
+		return;
+
+	if (node->index[direction].bucket)
+		spa_list_remove(&node->index[direction].link);
+	node->index[direction].bucket = b;
+	if (b == NULL)
+		return;
+
+	for (l = b->nodes.prev; l != &b->nodes; l = l->prev) {
+		struct pw_node *n = SPA_CONTAINER_OF(l, struct pw_node, index[direction].link);
+		if (n->global->id < node->global->id)
+			break;
+	}
+	spa_list_insert(l, &node->index[direction].link);
+}
+
+/** Index the ports of a node
+ *
+ * \param core a core
+ * \param node a registered node
+ * \param direction the direction of the ports
+ *
+ * Put \a node with the nodes of which the ports in \a direction were not
+ * looked at yet. The media type of the ports is looked up on the next
+ * pw_core_find_port(). Nothing is done when \a node is not indexed.
+ *
+ * \memberof pw_core
+ */
+void pw_core_index_node(struct pw_core *core, struct pw_node *node, enum pw_direction direction)
+{
+	struct port_bucket *b;
+
+	if (node->global == NULL)
+		return;
+
+	if ((b = find_port_bucket(core, direction, SPA_ID_INVALID, SPA_ID_INVALID, true)) == NULL)
+		return;
+
+	move_node(node, direction, b);
+}
+
+/** Remove a node from the port index
+ *
+ * \param core a core
+ * \param node a node
+ *
+ * \memberof pw_core
+ */
+void pw_core_unindex_node(struct pw_core *core, struct pw_node *node)
+{
+	move_node(node, PW_DIRECTION_INPUT, NULL);
+	move_node(node, PW_DIRECTION_OUTPUT, NULL);
+}
+
+/* the media type and subtype of the first possible format of a port, this
+ * is cached until the possible formats change */
+static void update_port_summary(struct pw_core *core, struct pw_port *port)
+{
+	struct spa_format *format;
+
+	if (port->have_summary)
+		return;
+
+	if (spa_node_port_enum_formats(port->node->node, port->direction, port->port_id,
+				       &format, NULL, 0) == SPA_RESULT_OK) {
+		port->media_type = SPA_FORMAT_MEDIA_TYPE(format);
+		port->media_subtype = SPA_FORMAT_MEDIA_SUBTYPE(format);
+	} else {
+		port->media_type = SPA_ID_INVALID;
+		port->media_subtype = SPA_ID_INVALID;
+	}
+	port->have_summary = true;
+}
+
+static uint32_t get_port_media_type(struct pw_core *core, struct pw_port *port)
+{
+	update_port_summary(core, port);
+	return port->media_type;
+}
+
+/* move a node that was not looked at yet to the bucket of the media type
+ * and subtype of its ports. Nodes without ports stay where they are, they
+ * can make a port of any type. */
+static void classify_node(struct pw_core *core, struct pw_node *node, enum pw_direction direction)
+{
+	struct spa_list *ports;
+	struct pw_port *port;
+	struct port_bucket *b;
+
+	ports = direction == PW_DIRECTION_INPUT ? &node->input_ports : &node->output_ports;
+	if (spa_list_is_empty(ports))
+		return;
+
+	port = spa_list_first(ports, struct pw_port, link);
+	update_port_summary(core, port);
+	if (port->media_type == SPA_ID_INVALID)
+		return;
+
+	if ((b = find_port_bucket(core, direction, port->media_type,
+				  port->media_subtype, true)) != NULL)
+		move_node(node, direction, b);
+}
+
+/* check if a node has a free port that can link with other_port */
+static struct pw_port *
+try_node_port(struct pw_core *core,
+	      struct pw_node *node,
+	      struct pw_port *other_port,
+	      struct pw_properties *props,
+	      uint32_t n_format_filters,
+	      struct spa_format **format_filters)
+{
+	struct pw_port *p, *pin, *pout;
+	char *error = NULL;
+
+	if (node->global == NULL || other_port->node == node)
+		return NULL;
+
+	pw_log_debug("node id \"%d\"", node->global->id);
+
+	p = pw_node_get_free_port(node, pw_direction_reverse(other_port->direction));
+	if (p == NULL)
+		return NULL;
+
+	if (p->direction == PW_DIRECTION_OUTPUT) {
+		pin = other_port;
+		pout = p;
+	} else {
+		pin = p;
+		pout = other_port;
+	}
+
+	if (pw_core_find_format(core,
+				pout,
+				pin,
+				props,
+				n_format_filters, format_filters, &error) == NULL) {
+		free(error);
+		return NULL;
+	}
+	return p;
+}
+
+/* try the nodes in a bucket. Making a free port can move the node to
+ * another bucket, so iterate safely. */
+static struct pw_port *
+try_bucket(struct pw_core *core,
+	   struct port_bucket *b,
+	   struct pw_port *other_port,
+	   struct pw_properties *props,
+	   uint32_t n_format_filters,
+	   struct spa_format **format_filters)
+{
+	enum pw_direction direction = b->direction;
+	struct pw_node *n, *t;
+	struct pw_port *p;
+
+	spa_list_for_each_safe(n, t, &b->nodes, index[direction].link) {
+		if ((p = try_node_port(core, n, other_port, props,
+				       n_format_filters, format_filters)) != NULL)
+			return p;
+	}
+	return NULL;
+}
+
 /** Find a port to link with
  *
  * \param core a core
@@ -611,6 +872,14 @@ struct pw_global *pw_core_find_global(struct pw_core *core, uint32_t id)
  * \param[out] error an error when something is wrong
  * \return a port that can be used to link to \a otherport or NULL on error
  *
+ * When \a id is given, a free port of the node with \a id is returned.
+ * Otherwise the nodes are indexed by the direction, the media type and the
+ * media subtype of their ports, in the order of their ids. The nodes with
+ * the media type and subtype of \a other_port are checked for a common
+ * format first, then the nodes with the same media type and another
+ * subtype and then the nodes that were not looked at yet. The media type
+ * and subtype of a port are the ones of its first possible format.
+ *
  * \memberof pw_core
  */
 struct pw_port *pw_core_find_port(struct pw_core *core,
@@ -622,66 +891,249 @@ struct pw_port *pw_core_find_port(struct pw_core *core,
 				  char **error)
 {
 	struct pw_port *best = NULL;
-	bool have_id;
-	struct pw_node *n;
-
-	have_id = id != SPA_ID_INVALID;
+	enum pw_direction direction = pw_direction_reverse(other_port->direction);
+	struct port_bucket *b, *unknown;
+	struct pw_node *n, *t;
+	struct pw_global *global;
 
-	pw_log_debug("id \"%u\", %d", id, have_id);
+	pw_log_debug("id \"%u\", %d", id, id != SPA_ID_INVALID);
 
-	spa_list_for_each(n, &core->node_list, link) {
-		if (n->global == NULL)
-			continue;
+	if (id != SPA_ID_INVALID) {
+		global = pw_core_find_global(core, id);
+		if (global && global->type == core->type.node) {
+			n = global->object;
+			if (other_port->node != n) {
+				pw_log_debug("id \"%u\" matches node %p", id, n);
+				best = pw_node_get_free_port(n, direction);
+			}
+		}
+		goto done;
+	}
 
-		if (other_port->node == n)
-			continue;
+	/* look at the nodes that changed since the last time */
+	if ((unknown = find_port_bucket(core, direction, SPA_ID_INVALID, SPA_ID_INVALID,
+					false)) != NULL) {
+		spa_list_for_each_safe(n, t, &unknown->nodes, index[direction].link)
+			classify_node(core, n, direction);
+	}
 
-		pw_log_debug("node id \"%d\"", n->global->id);
+	update_port_summary(core, other_port);
 
-		if (have_id) {
-			if (n->global->id == id) {
-				pw_log_debug("id \"%u\" matches node %p", id, n);
+	if (other_port->media_type != SPA_ID_INVALID) {
+		struct port_bucket *exact;
 
-				best =
-				    pw_node_get_free_port(n,
-							  pw_direction_reverse(other_port->
-									       direction));
-				if (best)
-					break;
-			}
-		} else {
-			struct pw_port *p, *pin, *pout;
+		exact = find_port_bucket(core, direction, other_port->media_type,
+					 other_port->media_subtype, false);
+		if (exact != NULL)
+			best = try_bucket(core, exact, other_port, props,
+					  n_format_filters, format_filters);
 
-			p = pw_node_get_free_port(n, pw_direction_reverse(other_port->direction));
-			if (p == NULL)
+		/* a node can have other subtypes after its first format */
+		spa_list_for_each(b, &core->port_index, link) {
+			if (best != NULL)
+				break;
+			if (b == exact || b == unknown || b->direction != direction ||
+			    b->media_type != other_port->media_type)
 				continue;
-
-			if (p->direction == PW_DIRECTION_OUTPUT) {
-				pin = other_port;
-				pout = p;
-			} else {
-				pin = p;
-				pout = other_port;
-			}
-
-			if (pw_core_find_format(core,
-						pout,
-						pin,
-						props,
-						n_format_filters, format_filters, error) == NULL) {
-				free(*error);
+			best = try_bucket(core, b, other_port, props,
+					  n_format_filters, format_filters);
+		}
+		if (best == NULL && unknown != NULL)
+			best = try_bucket(core, unknown, other_port, props,
+					  n_format_filters, format_filters);
+	} else {
+		/* without a media type, any node can do */
+		spa_list_for_each(b, &core->port_index, link) {
+			if (b->direction != direction)
 				continue;
-			}
-
-			best = p;
+			if ((best = try_bucket(core, b, other_port, props,
+					       n_format_filters, format_filters)) != NULL)
+				break;
 		}
 	}
+
+      done:
 	if (best == NULL) {
 		asprintf(error, "No matching Node found");
 	}
 	return best;
 }
 
+static uint32_t hash_filters(uint32_t n_format_filters, struct spa_format **format_filters)
+{
+	uint32_t i, j, hash = 2166136261u;
+
+	for (i = 0; i < n_format_filters; i++) {
+		const uint8_t *p = (const uint8_t *) format_filters[i];
+
+		for (j = 0; j < SPA_POD_SIZE(format_filters[i]); j++)
+			hash = (hash ^ p[j]) * 16777619u;
+	}
+	return hash;
+}
+
+static bool
+filters_equal(struct format_entry *e, uint32_t n_format_filters, struct spa_format **format_filters)
+{
+	uint8_t *p = e->filters;
+	uint32_t i, size;
+
+	if (e->n_filters != n_format_filters)
+		return false;
+
+	for (i = 0; i < n_format_filters; i++) {
+		size = SPA_POD_SIZE(format_filters[i]);
+		if (size != SPA_POD_SIZE((struct spa_pod *) p) || memcmp(p, format_filters[i], size) != 0)
+			return false;
+		p += SPA_ROUND_UP_N(size, 8);
+	}
+	return true;
+}
+
+static uint64_t hash_string(uint64_t hash, const char *str)
+{
+	if (str == NULL)
+		str = "";
+	do {
+		hash = (hash ^ (uint8_t) *str) * 1099511628211ull;
+	} while (*str++);
+	return hash;
+}
+
+/* nodes made by a factory with the same name and properties, like the node
+ * of a device that is created again or the nodes of a suspended device,
+ * have the same possible formats and share cached formats */
+static uint64_t node_cache_key(struct pw_node *node)
+{
+	const struct spa_dict *props = node->info.props;
+	uint64_t hash = hash_string(14695981039346656037ull, node->info.name);
+	uint32_t i;
+
+	for (i = 0; props && i < props->n_items; i++) {
+		hash = hash_string(hash, props->items[i].key);
+		hash = hash_string(hash, props->items[i].value);
+	}
+	return hash;
+}
+
+static void init_format_port(struct format_port *fp, struct pw_port *port)
+{
+	fp->node_key = node_cache_key(port->node);
+	fp->port_id = port->port_id;
+}
+
+static inline bool format_port_equal(const struct format_port *a, const struct format_port *b)
+{
+	return a->node_key == b->node_key && a->port_id == b->port_id;
+}
+
+static struct format_entry *
+find_format_entry(struct pw_core *core, struct format_port *output, struct format_port *input,
+		  uint32_t filter_hash, uint32_t n_format_filters, struct spa_format **format_filters)
+{
+	struct format_entry *e;
+
+	spa_list_for_each(e, &core->format_cache, link) {
+		if (e->filter_hash == filter_hash &&
+		    format_port_equal(&e->output, output) &&
+		    format_port_equal(&e->input, input) &&
+		    filters_equal(e, n_format_filters, format_filters)) {
+			/* move to the end, it was used most recently */
+			spa_list_remove(&e->link);
+			spa_list_insert(core->format_cache.prev, &e->link);
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static void free_format_entry(struct pw_core *core, struct format_entry *e)
+{
+	pw_log_debug("core %p: clear cached format %p", core, e->format);
+	spa_list_remove(&e->link);
+	core->n_format_cache--;
+	free(e->format);
+	free(e);
+}
+
+static struct spa_format *
+add_format_entry(struct pw_core *core, struct format_port *output, struct format_port *input,
+		 uint32_t filter_hash, uint32_t n_format_filters, struct spa_format **format_filters,
+		 const struct spa_format *format)
+{
+	struct format_entry *e;
+	uint32_t i, size = 0;
+	uint8_t *p;
+
+	for (i = 0; i < n_format_filters; i++)
+		size += SPA_ROUND_UP_N(SPA_POD_SIZE(format_filters[i]), 8);
+
+	e = calloc(1, sizeof(struct format_entry) + size);
+	if (e == NULL)
+		return NULL;
+
+	e->output = *output;
+	e->input = *input;
+	e->filter_hash = filter_hash;
+	e->n_filters = n_format_filters;
+	e->filters = p = SPA_MEMBER(e, sizeof(struct format_entry), void);
+	for (i = 0; i < n_format_filters; i++) {
+		memcpy(p, format_filters[i], SPA_POD_SIZE(format_filters[i]));
+		p += SPA_ROUND_UP_N(SPA_POD_SIZE(format_filters[i]), 8);
+	}
+	e->format = spa_format_copy(format);
+	if (e->format == NULL) {
+		free(e);
+		return NULL;
+	}
+
+	if (core->n_format_cache == MAX_FORMAT_ENTRIES)
+		free_format_entry(core, spa_list_first(&core->format_cache, struct format_entry, link));
+
+	spa_list_insert(core->format_cache.prev, &e->link);
+	core->n_format_cache++;
+
+	return e->format;
+}
+
+/** Clear cached formats
+ *
+ * \param core a core object
+ * \param node a node or NULL
+ * \param direction the direction of the port
+ * \param port_id the id of the port
+ *
+ * Remove the formats negotiated with the port of \a node from the cache
+ * of pw_core_find_format(). The formats negotiated with the ports of
+ * nodes with the same name and properties are removed as well. This needs
+ * to be called when the possible formats of the port change, see
+ * pw_port_formats_changed(). When \a node is NULL, all cached formats
+ * are removed.
+ *
+ * \memberof pw_core
+ */
+void pw_core_clear_format_cache(struct pw_core *core, struct pw_node *node,
+				enum pw_direction direction, uint32_t port_id)
+{
+	struct format_entry *e, *t;
+	struct format_port fp;
+
+	if (node == NULL) {
+		spa_list_for_each_safe(e, t, &core->format_cache, link)
+			free_format_entry(core, e);
+		return;
+	}
+
+	fp.node_key = node_cache_key(node);
+	fp.port_id = port_id;
+
+	spa_list_for_each_safe(e, t, &core->format_cache, link) {
+		if (format_port_equal(direction == PW_DIRECTION_OUTPUT ?
+				      &e->output : &e->input, &fp))
+			free_format_entry(core, e);
+	}
+}
+
 /** Find a common format between two ports
  *
  * \param core a core object
@@ -696,6 +1148,15 @@ struct pw_port *pw_core_find_port(struct pw_core *core,
  * Find a common format between the given ports. The format will
  * be restricted to a subset given with the format filters.
  *
+ * When both ports need a format, the result of enumerating the formats
+ * of the ports is cached for the port ids and the filters. The ports are
+ * identified by the name and properties of their node so that linking
+ * the same ports again, or the ports of a node that was created again,
+ * does not need to enumerate all formats again. The least recently used
+ * formats are removed when the cache is full. Cached formats are removed
+ * with pw_core_clear_format_cache() when the possible formats of a port
+ * change.
+ *
  * \memberof pw_core
  */
 struct spa_format *pw_core_find_format(struct pw_core *core,
@@ -709,7 +1170,9 @@ struct spa_format *pw_core_find_format(struct pw_core *core,
 	uint32_t out_state, in_state;
 	int res;
 	struct spa_format *filter = NULL, *format;
-	uint32_t iidx = 0, oidx = 0;
+	uint32_t iidx = 0, oidx = 0, filter_hash;
+	struct format_entry *entry;
+	struct format_port out_port, in_port;
 
 	out_state = output->state;
 	in_state = input->state;
@@ -737,6 +1200,15 @@ struct spa_format *pw_core_find_format(struct pw_core *core,
 			goto error;
 		}
 	} else if (in_state == PW_PORT_STATE_CONFIGURE && out_state == PW_PORT_STATE_CONFIGURE) {
+		filter_hash = hash_filters(n_format_filters, format_filters);
+		init_format_port(&out_port, output);
+		init_format_port(&in_port, input);
+
+		if ((entry = find_format_entry(core, &out_port, &in_port, filter_hash,
+					       n_format_filters, format_filters)) != NULL) {
+			pw_log_debug("core %p: use cached format %p", core, entry->format);
+			return entry->format;
+		}
 	      again:
 		/* both ports need a format */
 		pw_log_debug("core %p: do enum input %d", core, iidx);
@@ -766,6 +1238,12 @@ struct spa_format *pw_core_find_format(struct pw_core *core,
 			spa_debug_format(format);
 
 		spa_format_fixate(format);
+
+		if ((format = add_format_entry(core, &out_port, &in_port, filter_hash,
+					       n_format_filters, format_filters, format)) == NULL) {
+			asprintf(error, "no memory");
+			goto error;
+		}
 	} else {
 		asprintf(error, "error node state");
 		goto error;
@@ -800,3 +1278,159 @@ struct pw_factory *pw_core_find_factory(struct pw_core *core, const char *name)
 	}
 	return NULL;
 }
+
+static bool node_ends_cycle(struct pw_node *node)
+{
+	return !spa_list_is_empty(&node->input_ports) && spa_list_is_empty(&node->output_ports);
+}
+
+/* only audio nodes follow the driver, they handle the slave clock update.
+ * Other nodes, like video sources and their clients, pace themselves. */
+static bool node_is_audio(struct pw_core *core, struct pw_node *node)
+{
+	uint32_t audio = spa_type_map_get_id(core->type.map, SPA_TYPE_MEDIA_TYPE__audio);
+	struct pw_port *port;
+
+	spa_list_for_each(port, &node->input_ports, link) {
+		if (get_port_media_type(core, port) == audio)
+			return true;
+	}
+	spa_list_for_each(port, &node->output_ports, link) {
+		if (get_port_media_type(core, port) == audio)
+			return true;
+	}
+	return false;
+}
+
+static bool node_can_drive(struct pw_node *node)
+{
+	const char *str;
+
+	if ((str = pw_properties_get(node->properties, PW_NODE_PROP_DRIVER)) == NULL)
+		return false;
+	return pw_properties_parse_bool(str);
+}
+
+static int
+do_update_graph(struct spa_loop *loop,
+		bool async, uint32_t seq, size_t size, const void *data, void *user_data)
+{
+	struct pw_core *this = user_data;
+	struct pw_node *node, *t;
+
+	spa_list_for_each_safe(node, t, &this->rt.followers, rt.follower_link) {
+		spa_list_remove(&node->rt.follower_link);
+		node->rt.follower_link.next = NULL;
+	}
+	this->rt.driver = this->driver;
+
+	spa_list_for_each(node, &this->node_list, link) {
+		node->rt.follower = node->follows && node_ends_cycle(node);
+		if (node->rt.follower)
+			spa_list_append(&this->rt.followers, &node->rt.follower_link);
+	}
+	return SPA_RESULT_OK;
+}
+
+/** Update the graph quantum and driver
+ *
+ * \param core a core
+ *
+ * The quantum is the smallest latency requested by the nodes with the
+ * \ref PW_NODE_PROP_LATENCY property. The driver is a running node with
+ * \ref PW_NODE_PROP_DRIVER, a node that ends the cycle is preferred. When
+ * there is no driver, a timer on the data loop starts the cycles.
+ *
+ * The other running audio nodes are followers, they get the slave clock
+ * update. The followers that end a cycle are woken up when the driver
+ * starts a new cycle and their own requests for data are ignored. Nodes
+ * without audio ports keep scheduling themselves and the timer only runs
+ * when there are followers.
+ *
+ * \memberof pw_core
+ */
+void pw_core_update_graph(struct pw_core *core)
+{
+	struct pw_node *node, *driver = NULL;
+	uint32_t quantum = 0;
+	bool following = false, changed = false;
+
+	spa_list_for_each(node, &core->node_list, link) {
+		if (node->latency > 0 && (quantum == 0 || node->latency < quantum))
+			quantum = node->latency;
+
+		if (node->info.state != PW_NODE_STATE_RUNNING)
+			continue;
+
+		if (!node_can_drive(node) || (driver && driver == core->driver))
+			continue;
+		if (driver == NULL || node == core->driver ||
+		    (node_ends_cycle(node) && !node_ends_cycle(driver)))
+			driver = node;
+	}
+	spa_list_for_each(node, &core->node_list, link) {
+		bool follows = node->info.state == PW_NODE_STATE_RUNNING &&
+			       node != driver && node_is_audio(core, node);
+
+		changed |= follows != node->follows;
+		node->follows = follows;
+		following |= follows;
+	}
+	if (quantum == 0)
+		quantum = DEFAULT_QUANTUM;
+	quantum = SPA_CLAMP(quantum, MIN_QUANTUM, MAX_QUANTUM);
+	/* round down to a power of 2 */
+	quantum = 1u << (31 - __builtin_clz(quantum));
+
+	changed |= quantum != core->quantum || driver != core->driver;
+	if (changed)
+		pw_log_debug("core %p: quantum %u, driver %p", core, quantum, driver);
+
+	if (quantum != core->quantum) {
+		core->quantum = quantum;
+		spa_hook_list_call(&core->listener_list, struct pw_core_events,
+				   quantum_changed, quantum);
+	}
+	core->driver = driver;
+	pw_loop_invoke(core->data_loop, do_update_graph, 1, 0, NULL, true, core);
+
+	if (following && driver == NULL) {
+		if (!core->timer_running || changed) {
+			struct timespec value, interval;
+			uint64_t period = (uint64_t) quantum * SPA_NSEC_PER_SEC / PW_CORE_QUANTUM_RATE;
+
+			interval.tv_sec = period / SPA_NSEC_PER_SEC;
+			interval.tv_nsec = period % SPA_NSEC_PER_SEC;
+			value = interval;
+			pw_loop_update_timer(core->data_loop, core->timer, &value, &interval, false);
+			core->timer_running = true;
+		}
+	} else if (core->timer_running) {
+		pw_loop_update_timer(core->data_loop, core->timer, NULL, NULL, false);
+		core->timer_running = false;
+	}
+
+	if (changed) {
+		spa_list_for_each(node, &core->node_list, link) {
+			if (node->info.state == PW_NODE_STATE_RUNNING)
+				pw_node_send_clock_update(node);
+		}
+	}
+}
+
+/** Start a new cycle in the followers
+ *
+ * \param core a core
+ *
+ * Called from the data loop by the driver after it started a cycle or
+ * by the timer when there is no driver.
+ *
+ * \memberof pw_core
+ */
+void pw_core_wake_followers(struct pw_core *core)
+{
+	struct pw_node *node;
+
+	spa_list_for_each(node, &core->rt.followers, rt.follower_link)
+		spa_graph_need_input(node->rt.graph, &node->rt.node);
+}
@@ -103,6 +103,8 @@ struct pw_core_events {
 	void (*global_added) (void *data, struct pw_global *global);
 	/** a global object was removed */
 	void (*global_removed) (void *data, struct pw_global *global);
+	/** the graph quantum changed, see \ref pw_core_get_quantum() */
+	void (*quantum_changed) (void *data, uint32_t quantum);
 };
 
 /** The name of the core. Default is pipewire-<user-name>-<pid> */
@@ -151,6 +153,12 @@ const struct spa_support *pw_core_get_support(struct pw_core *core, uint32_t *n_
 /** get the core main loop */
 struct pw_loop *pw_core_get_main_loop(struct pw_core *core);
 
+/** The rate of the graph quantum */
+#define PW_CORE_QUANTUM_RATE	48000
+
+/** get the number of frames per cycle of the graph at \ref PW_CORE_QUANTUM_RATE */
+uint32_t pw_core_get_quantum(struct pw_core *core);
+
 /** iterate the globals */
 bool pw_core_for_each_global(struct pw_core *core,
 			     bool (*callback) (void *data, struct pw_global *global),
@@ -169,6 +177,10 @@ pw_core_find_format(struct pw_core *core,
 		    struct spa_format **format_filters,
 		    char **error);
 
+/** Forget the formats negotiated with a port of \a node, NULL for all nodes */
+void pw_core_clear_format_cache(struct pw_core *core, struct pw_node *node,
+				enum pw_direction direction, uint32_t port_id);
+
 /** Find a ports compatible with \a other_port and the format filters */
 struct pw_port *
 pw_core_find_port(struct pw_core *core,
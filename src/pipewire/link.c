@@ -75,28 +75,13 @@ static void pw_link_update_state(struct pw_link *link, enum pw_link_state state,
 	}
 }
 
-static void complete_ready(void *obj, void *data, int res, uint32_t id)
+/* wait for the format or buffers change in progress on a port, the change
+ * can be started by any of the links of the port */
+static void wait_port(struct impl *impl, struct pw_port *port)
 {
-	struct pw_port *port = data;
-	if (SPA_RESULT_IS_OK(res)) {
-		port->state = PW_PORT_STATE_READY;
-		pw_log_debug("port %p: state READY", port);
-	} else {
-		port->state = PW_PORT_STATE_ERROR;
-		pw_log_warn("port %p: failed to go to READY", port);
-	}
-}
-
-static void complete_paused(void *obj, void *data, int res, uint32_t id)
-{
-	struct pw_port *port = data;
-	if (SPA_RESULT_IS_OK(res)) {
-		port->state = PW_PORT_STATE_PAUSED;
-		pw_log_debug("port %p: state PAUSED", port);
-	} else {
-		port->state = PW_PORT_STATE_ERROR;
-		pw_log_warn("port %p: failed to go to PAUSED", port);
-	}
+	if (port->pending_seq != SPA_ID_INVALID)
+		pw_work_queue_add(impl->work, port->node,
+				  SPA_RESULT_RETURN_ASYNC(port->pending_seq), NULL, NULL);
 }
 
 static void complete_streaming(void *obj, void *data, int res, uint32_t id)
@@ -178,9 +163,7 @@ static int do_negotiate(struct pw_link *this, uint32_t in_state, uint32_t out_st
 			asprintf(&error, "error set output format: %d", res);
 			goto error;
 		}
-		if (SPA_RESULT_IS_ASYNC(res))
-			pw_work_queue_add(impl->work, output->node, res, complete_ready,
-					  output);
+		wait_port(impl, output);
 	}
 	if (in_state == PW_PORT_STATE_CONFIGURE) {
 		pw_log_debug("link %p: doing set format on input", this);
@@ -188,8 +171,7 @@ static int do_negotiate(struct pw_link *this, uint32_t in_state, uint32_t out_st
 			asprintf(&error, "error set input format: %d", res2);
 			goto error;
 		}
-		if (SPA_RESULT_IS_ASYNC(res2))
-			pw_work_queue_add(impl->work, input->node, res2, complete_ready, input);
+		wait_port(impl, input);
 	}
 
 
@@ -431,6 +413,65 @@ param_filter(struct pw_link *this,
 	return num;
 }
 
+/* if the port has links other than \a link */
+static bool has_other_links(struct pw_port *port, struct pw_link *link)
+{
+	struct pw_link *l;
+
+	spa_list_for_each(l, &port->links, input_link)
+		if (l != link)
+			return true;
+	return false;
+}
+
+/* give an input port that mixes its links its own buffers, the node only
+ * sees the buffers of the port and the links mix into them */
+static int alloc_mix_buffers(struct pw_link *this, uint32_t flags,
+			     struct spa_param **params, uint32_t n_params,
+			     uint32_t n_buffers, size_t minsize, ssize_t stride)
+{
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
+	struct pw_port *input = this->input;
+	struct spa_buffer **buffers;
+	struct pw_memblock mem;
+	size_t data_sizes[1];
+	ssize_t data_strides[1];
+	int res;
+
+	data_sizes[0] = (flags & SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS) ? 0 : minsize;
+	data_strides[0] = stride;
+
+	buffers = alloc_buffers(this, n_buffers, n_params, params,
+				1, data_sizes, data_strides, &mem);
+	if (buffers == NULL)
+		return SPA_RESULT_NO_MEMORY;
+
+	if (flags & SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS) {
+		if ((res = pw_port_alloc_buffers(input, params, n_params,
+						 buffers, &n_buffers)) < 0)
+			goto error;
+		input->buffer_mem = mem;
+	} else if (flags & SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS) {
+		if ((res = pw_port_use_buffers(input, buffers, n_buffers)) < 0)
+			goto error;
+		input->buffer_mem = mem;
+		input->allocated = true;
+	} else {
+		res = SPA_RESULT_ERROR;
+		goto error;
+	}
+	wait_port(impl, input);
+
+	pw_log_debug("link %p: allocated %d mix buffers %p on input port", this,
+		     input->n_buffers, input->buffers);
+	return SPA_RESULT_OK;
+
+      error:
+	free(buffers);
+	pw_memblock_free(&mem);
+	return res;
+}
+
 static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_state)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
@@ -440,14 +481,17 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 	char *error = NULL;
 	struct pw_port *input, *output;
 
-	if (in_state != PW_PORT_STATE_READY && out_state != PW_PORT_STATE_READY)
+	input = this->input;
+	output = this->output;
+
+	/* a link into an input that mixes needs buffers of its own, also when
+	 * both ports have buffers already */
+	if (in_state != PW_PORT_STATE_READY && out_state != PW_PORT_STATE_READY &&
+	    (input->mix == NULL || this->buffers != NULL || output->n_buffers == 0))
 		return SPA_RESULT_OK;
 
 	pw_link_update_state(this, PW_LINK_STATE_ALLOCATING, NULL);
 
-	input = this->input;
-	output = this->output;
-
 	pw_log_debug("link %p: doing alloc buffers %p %p", this, output->node, input->node);
 	/* find out what's possible */
 	if ((res = spa_node_port_get_info(output->node->node, output->direction, output->port_id,
@@ -497,7 +541,13 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 		in_flags &= ~SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS;
 	} else if (out_state == PW_PORT_STATE_READY && in_state > PW_PORT_STATE_READY) {
 		in_flags &= ~SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
-		out_flags &= ~SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS;
+		if (input->mix == NULL)
+			out_flags &= ~SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS;
+		else if (out_flags & SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS)
+			out_flags = SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS;
+	} else if (input->mix != NULL && out_state > PW_PORT_STATE_READY) {
+		/* the link mixes the buffers of the output */
+		out_flags = in_flags = 0;
 	} else {
 		pw_log_debug("link %p: delay allocation, state %d %d", this, in_state, out_state);
 		return SPA_RESULT_OK;
@@ -573,13 +623,29 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			}
 		}
 
+		if (input->mix != NULL) {
+			if (input->n_buffers == 0 &&
+			    (res = alloc_mix_buffers(this, iinfo->flags, params, n_params,
+						     max_buffers, minsize, stride)) < 0) {
+				asprintf(&error, "error alloc input mix buffers: %d", res);
+				goto error;
+			}
+			/* the link has its own buffers, used or allocated by
+			 * the output */
+			in_flags = 0;
+		} else if (has_other_links(input, this)) {
+			asprintf(&error, "input port is linked and can't mix the format");
+			res = SPA_RESULT_ERROR;
+			goto error;
+		}
+
 		if ((in_flags & SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS) ||
 		    (out_flags & SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS))
 			minsize = 0;
 
 		if (output->n_buffers) {
 			out_flags = 0;
-			in_flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+			in_flags = input->mix ? 0 : SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
 			this->n_buffers = output->n_buffers;
 			this->buffers = output->buffers;
 			this->buffer_owner = output;
@@ -621,8 +687,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 				asprintf(&error, "error alloc output buffers: %d", res);
 				goto error;
 			}
-			if (SPA_RESULT_IS_ASYNC(res))
-				pw_work_queue_add(impl->work, output->node, res, complete_paused, output);
+			wait_port(impl, output);
 			output->buffer_mem = this->buffer_mem;
 			this->buffer_owner = output;
 			pw_log_debug("link %p: allocated %d buffers %p from output port", this,
@@ -634,8 +699,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 				asprintf(&error, "error alloc input buffers: %d", res);
 				goto error;
 			}
-			if (SPA_RESULT_IS_ASYNC(res))
-				pw_work_queue_add(impl->work, input->node, res, complete_paused, input);
+			wait_port(impl, input);
 			input->buffer_mem = this->buffer_mem;
 			this->buffer_owner = input;
 			pw_log_debug("link %p: allocated %d buffers %p from input port", this,
@@ -643,15 +707,23 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 		}
 	}
 
-	if (in_flags & SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS) {
+	if (input->mix != NULL) {
+		/* the input uses its own buffers, the output uses the buffers
+		 * of the link when it did not allocate or have them */
+		if ((out_flags & SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS) &&
+		    (res = pw_port_use_buffers(output, this->buffers, this->n_buffers)) < 0) {
+			asprintf(&error, "error use output buffers: %d", res);
+			goto error;
+		}
+		wait_port(impl, output);
+	} else if (in_flags & SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS) {
 		pw_log_debug("link %p: using %d buffers %p on input port", this,
 			     this->n_buffers, this->buffers);
 		if ((res = pw_port_use_buffers(input, this->buffers, this->n_buffers)) < 0) {
 			asprintf(&error, "error use input buffers: %d", res);
 			goto error;
 		}
-		if (SPA_RESULT_IS_ASYNC(res))
-			pw_work_queue_add(impl->work, input->node, res, complete_paused, input);
+		wait_port(impl, input);
 	} else if (out_flags & SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS) {
 		pw_log_debug("link %p: using %d buffers %p on output port", this,
 			     this->n_buffers, this->buffers);
@@ -659,8 +731,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			asprintf(&error, "error use output buffers: %d", res);
 			goto error;
 		}
-		if (SPA_RESULT_IS_ASYNC(res))
-			pw_work_queue_add(impl->work, output->node, res, complete_paused, output);
+		wait_port(impl, output);
 	} else {
 		asprintf(&error, "no common buffer alloc found");
 		goto error;
@@ -672,49 +743,67 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 	output->buffers = NULL;
 	output->n_buffers = 0;
 	output->allocated = false;
-	input->buffers = NULL;
-	input->n_buffers = 0;
-	input->allocated = false;
+	if (!has_other_links(input, this)) {
+		input->buffers = NULL;
+		input->n_buffers = 0;
+		input->allocated = false;
+	}
 	pw_link_update_state(this, PW_LINK_STATE_ERROR, error);
 	return res;
 }
 
+/* start the node of a port. The node is started once for all its links,
+ * the links wait for a start in progress and a running node only needs the
+ * port to stream */
+static int start_port(struct impl *impl, struct pw_port *port)
+{
+	struct pw_node *node = port->node;
+	int res;
+
+	if (node->pending_start != SPA_ID_INVALID) {
+		pw_log_debug("link %p: wait for start of node %p", impl, node);
+		pw_work_queue_add(impl->work, node, SPA_RESULT_RETURN_ASYNC(node->pending_start),
+				  complete_streaming, port);
+		return SPA_RESULT_OK;
+	}
+	if (node->info.state == PW_NODE_STATE_RUNNING) {
+		complete_streaming(node, port, SPA_RESULT_OK, 0);
+		return SPA_RESULT_OK;
+	}
+
+	if ((res = pw_node_set_state(node, PW_NODE_STATE_RUNNING)) < 0)
+		return res;
+
+	if (SPA_RESULT_IS_ASYNC(res))
+		pw_work_queue_add(impl->work, node, res, complete_streaming, port);
+	else
+		complete_streaming(node, port, res, 0);
+
+	return SPA_RESULT_OK;
+}
+
 static int do_start(struct pw_link *this, uint32_t in_state, uint32_t out_state)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
 	char *error = NULL;
 	int res;
-	struct pw_port *input, *output;
 
 	if (in_state < PW_PORT_STATE_PAUSED || out_state < PW_PORT_STATE_PAUSED)
 		return SPA_RESULT_OK;
 
 	pw_link_update_state(this, PW_LINK_STATE_PAUSED, NULL);
 
-	input = this->input;
-	output = this->output;
-
 	if (in_state == PW_PORT_STATE_PAUSED) {
-		if  ((res = pw_node_set_state(input->node, PW_NODE_STATE_RUNNING)) < 0) {
+		if ((res = start_port(impl, this->input)) < 0) {
 			asprintf(&error, "error starting input node: %d", res);
 			goto error;
 		}
-
-		if (SPA_RESULT_IS_ASYNC(res))
-			pw_work_queue_add(impl->work, input->node, res, complete_streaming, input);
-		else
-			complete_streaming(input->node, input, res, 0);
 	}
 	if (out_state == PW_PORT_STATE_PAUSED) {
-		if ((res = pw_node_set_state(output->node, PW_NODE_STATE_RUNNING)) < 0) {
+		if ((res = start_port(impl, this->output)) < 0) {
 			asprintf(&error, "error starting output node: %d", res);
 			goto error;
 		}
-
-		if (SPA_RESULT_IS_ASYNC(res))
-			pw_work_queue_add(impl->work, output->node, res, complete_streaming, output);
-		else
-			complete_streaming(output->node, output, res, 0);
 	}
 	return SPA_RESULT_OK;
 
@@ -751,6 +840,17 @@ static int check_states(struct pw_link *this, void *user_data, int res)
 	    output->node->info.state == PW_NODE_STATE_ERROR)
 		return SPA_RESULT_ERROR;
 
+	/* a port can be changed by another link, wait for it and continue
+	 * with the new state */
+	if (input->pending_seq != SPA_ID_INVALID || output->pending_seq != SPA_ID_INVALID) {
+		pw_log_debug("link %p: wait for ports %u %u", this,
+			     input->pending_seq, output->pending_seq);
+		wait_port(impl, input);
+		wait_port(impl, output);
+		res = SPA_RESULT_OK;
+		goto exit;
+	}
+
 	in_state = input->state;
 	out_state = output->state;
 
@@ -808,8 +908,11 @@ output_node_async_complete(void *data, uint32_t seq, int res)
 	pw_work_queue_complete(impl->work, node, seq, res);
 }
 
+/* the buffers of an input port that mixes are kept for its other links */
 static void clear_port_buffers(struct pw_link *link, struct pw_port *port)
 {
+	if (port == link->input && has_other_links(port, link))
+		return;
 	if (link->buffer_owner != port)
 		pw_port_use_buffers(port, NULL, 0);
 }
@@ -878,7 +981,7 @@ static void on_port_destroy(struct pw_link *this, struct pw_port *port)
 		this->n_buffers = 0;
 
 		pw_log_debug("link %p: clear allocated buffers on port %p", this, other);
-		pw_port_use_buffers(other, NULL, 0);
+		clear_port_buffers(this, other);
 		this->buffer_owner = NULL;
 	}
 
@@ -1146,11 +1249,12 @@ struct pw_link *pw_link_new(struct pw_core *core,
 	this->rt.in_port.scheduler_data = this;
 	this->rt.out_port.scheduler_data = this;
 
-	/* nodes can be in different data loops so we do this twice */
+	/* nodes can be in different data loops so we do this twice. Wait for
+	 * the data loop so that many new links don't overflow its queue */
 	pw_loop_invoke(output_node->data_loop, do_add_link,
-		       SPA_ID_INVALID, sizeof(struct pw_port *), &output, false, this);
+		       SPA_ID_INVALID, sizeof(struct pw_port *), &output, true, this);
 	pw_loop_invoke(input_node->data_loop, do_add_link,
-		       SPA_ID_INVALID, sizeof(struct pw_port *), &input, false, this);
+		       SPA_ID_INVALID, sizeof(struct pw_port *), &input, true, this);
 
 	spa_hook_list_call(&output->listener_list, struct pw_port_events, link_added, this);
 	spa_hook_list_call(&input->listener_list, struct pw_port_events, link_added, this);
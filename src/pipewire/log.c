@@ -24,6 +24,7 @@
 enum spa_log_level pw_log_level = DEFAULT_LOG_LEVEL;
 
 static struct spa_log *global_log = NULL;
+static struct spa_log_binary *global_binary = NULL;
 
 /** Set the global log interface
  * \param log the global log to set
@@ -45,6 +46,29 @@ struct spa_log *pw_log_get(void)
 	return global_log;
 }
 
+/** Set the binary interface of the global log
+ * \param binary the binary log interface or NULL
+ * \memberof pw_log
+ */
+void pw_log_set_binary(struct spa_log_binary *binary)
+{
+	global_binary = binary;
+}
+
+/** Write the binary log messages to a file descriptor
+ * \param fd the file descriptor to write to
+ * \return \ref SPA_RESULT_OK on success, \ref SPA_RESULT_NOT_IMPLEMENTED
+ *	when the global log is not in binary mode
+ * \memberof pw_log
+ */
+int pw_log_dump(int fd)
+{
+	if (global_binary == NULL)
+		return SPA_RESULT_NOT_IMPLEMENTED;
+
+	return spa_log_binary_dump(global_binary, fd);
+}
+
 /** Set the global log level
  * \param level the new log level
  * \memberof pw_log
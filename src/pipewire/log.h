@@ -21,6 +21,7 @@
 #define __PIPEWIRE_LOG_H__
 
 #include <spa/log.h>
+#include <spa/log-binary.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,6 +34,12 @@ extern "C" {
  * Logging is performed to stdout and stderr. Trace logging is performed
  * in a lockfree ringbuffer and written out from the main thread as to not
  * block the realtime threads.
+ *
+ * When the PIPEWIRE_LOG_BINARY environment variable is set to a file name,
+ * debug and trace messages are stored unformatted in a ringbuffer per
+ * thread. They are written to a file descriptor with pw_log_dump() and to
+ * the file when the logger is destroyed and can be read with
+ * spa-trace-decode.
  */
 
 /** The global log level */
@@ -41,6 +48,10 @@ extern enum spa_log_level pw_log_level;
 void pw_log_set(struct spa_log *log);
 struct spa_log *pw_log_get(void);
 
+void pw_log_set_binary(struct spa_log_binary *binary);
+
+int pw_log_dump(int fd);
+
 void
 pw_log_set_level(enum spa_log_level level);
 
@@ -58,8 +69,9 @@ pw_log_logv(enum spa_log_level level,
 	    const char *fmt, va_list args) SPA_PRINTF_FUNC(5, 0);
 
 
-/** Check if a loglevel is enabled \memberof pw_log */
-#define pw_log_level_enabled(lev) (pw_log_level >= (lev))
+/** Check if a loglevel is enabled, levels above \ref SPA_LOG_MAX_LEVEL
+ * are never enabled \memberof pw_log */
+#define pw_log_level_enabled(lev) ((lev) <= SPA_LOG_MAX_LEVEL && pw_log_level >= (lev))
 
 #if __STDC_VERSION__ >= 199901L
 
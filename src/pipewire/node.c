@@ -98,7 +98,7 @@ static int suspend_node(struct pw_node *this)
 	return res;
 }
 
-static void send_clock_update(struct pw_node *this)
+void pw_node_send_clock_update(struct pw_node *this)
 {
 	int res;
 	struct spa_command_node_clock_update cu =
@@ -123,11 +123,37 @@ static void send_clock_update(struct pw_node *this)
 					 &cu.body.ticks.value,
 					 &cu.body.monotonic_time.value);
 	}
+	cu.body.latency.value = (int64_t) this->core->quantum * SPA_NSEC_PER_SEC /
+				PW_CORE_QUANTUM_RATE;
+	if (this->follows)
+		cu.body.flags.value |= SPA_COMMAND_NODE_CLOCK_UPDATE_FLAG_SLAVE;
+
 	res = spa_node_send_command(this->node, (struct spa_command *) &cu);
 	if (res < 0)
 		pw_log_debug("node %p: send clock update error %d", this, res);
 }
 
+static void update_latency(struct pw_node *node)
+{
+	const char *str;
+	uint32_t frames, rate;
+
+	node->latency = 0;
+	if ((str = pw_properties_get(node->properties, PW_NODE_PROP_LATENCY)) == NULL)
+		return;
+
+	switch (sscanf(str, "%u/%u", &frames, &rate)) {
+	case 2:
+		if (rate > 0)
+			node->latency = (uint64_t) frames * PW_CORE_QUANTUM_RATE / rate;
+		break;
+	case 1:
+		node->latency = frames;
+		break;
+	}
+	pw_log_debug("node %p: latency %u", node, node->latency);
+}
+
 static void node_unbind_func(void *data)
 {
 	struct pw_resource *resource = data;
@@ -348,6 +374,9 @@ void pw_node_register(struct pw_node *this,
 					  core->type.node, PW_VERSION_NODE,
 					  node_bind_func, this);
 
+	pw_core_index_node(core, this, PW_DIRECTION_INPUT);
+	pw_core_index_node(core, this, PW_DIRECTION_OUTPUT);
+
 	this->info.id = this->global->id;
 	spa_hook_list_call(&this->listener_list, struct pw_node_events, initialized);
 
@@ -379,6 +408,7 @@ struct pw_node *pw_node_new(struct pw_core *core,
 		goto no_mem;
 
 	this->properties = properties;
+	update_latency(this);
 
 	impl->work = pw_work_queue_new(this->core->main_loop);
 	this->info.name = strdup(name);
@@ -392,6 +422,7 @@ struct pw_node *pw_node_new(struct pw_core *core,
 	spa_hook_list_init(&this->listener_list);
 
 	this->info.state = PW_NODE_STATE_CREATING;
+	this->pending_start = SPA_ID_INVALID;
 	this->info.props = &this->properties->dict;
 
 	spa_list_init(&this->input_ports);
@@ -443,6 +474,13 @@ void pw_node_update_properties(struct pw_node *node, const struct spa_dict *dict
 
 	node->info.props = &node->properties->dict;
 
+	if (spa_dict_lookup(dict, PW_NODE_PROP_LATENCY) ||
+	    spa_dict_lookup(dict, PW_NODE_PROP_DRIVER)) {
+		update_latency(node);
+		if (node->global)
+			pw_core_update_graph(node->core);
+	}
+
 	node->info.change_mask = PW_NODE_CHANGE_MASK_PROPS;
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, info_changed, &node->info);
 
@@ -456,8 +494,18 @@ static void node_done(void *data, int seq, int res)
 {
 	struct pw_node *node = data;
 	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+	struct pw_port *port;
 
 	pw_log_debug("node %p: async complete event %d %d", node, seq, res);
+
+	/* update the ports and the node before the links see the completion */
+	spa_list_for_each(port, &node->input_ports, link)
+		pw_port_async_complete(port, seq, res);
+	spa_list_for_each(port, &node->output_ports, link)
+		pw_port_async_complete(port, seq, res);
+	if (node->pending_start == seq)
+		node->pending_start = SPA_ID_INVALID;
+
 	pw_work_queue_complete(impl->work, node, seq, res);
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, async_complete, seq, res);
 }
@@ -468,7 +516,7 @@ static void node_event(void *data, struct spa_event *event)
 
 	pw_log_trace("node %p: event %d", node, SPA_EVENT_TYPE(event));
         if (SPA_EVENT_TYPE(event) == node->core->type.event_node.RequestClockUpdate) {
-                send_clock_update(node);
+                pw_node_send_clock_update(node);
         }
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, event, event);
 }
@@ -477,13 +525,22 @@ static void node_need_input(void *data)
 {
 	struct pw_node *node = data;
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, need_input);
+
+	/* followers that end a cycle are woken up by the driver or the timer */
+	if (node->rt.follower)
+		return;
+
 	spa_graph_need_input(node->rt.graph, &node->rt.node);
+	if (node == node->core->rt.driver)
+		pw_core_wake_followers(node->core);
 }
 
 static void node_have_output(void *data)
 {
 	struct pw_node *node = data;
 	spa_graph_have_output(node->rt.graph, &node->rt.node);
+	if (node == node->core->rt.driver)
+		pw_core_wake_followers(node->core);
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, have_output);
 }
 
@@ -547,6 +604,14 @@ do_node_remove(struct spa_loop *loop,
 
 	spa_graph_node_remove(&this->rt.node);
 
+	if (this->rt.follower_link.next) {
+		spa_list_remove(&this->rt.follower_link);
+		this->rt.follower_link.next = NULL;
+	}
+	this->rt.follower = false;
+	if (this->core->rt.driver == this)
+		this->core->rt.driver = NULL;
+
 	return SPA_RESULT_OK;
 }
 
@@ -571,8 +636,10 @@ void pw_node_destroy(struct pw_node *node)
 
 	if (node->global) {
 		spa_list_remove(&node->link);
+		pw_core_unindex_node(node->core, node);
 		pw_global_destroy(node->global);
 		node->global = NULL;
+		pw_core_update_graph(node->core);
 	}
 
 	spa_list_for_each_safe(resource, tmp, &node->resource_list, link)
@@ -792,8 +859,10 @@ int pw_node_set_state(struct pw_node *node, enum pw_node_state state)
 	case PW_NODE_STATE_RUNNING:
 		if (node->active) {
 			node_activate(node);
-			send_clock_update(node);
+			pw_node_send_clock_update(node);
 			res = start_node(node);
+			if (SPA_RESULT_IS_ASYNC(res))
+				node->pending_start = SPA_RESULT_ASYNC_SEQ(res);
 		}
 		break;
 
@@ -848,6 +917,9 @@ void pw_node_update_state(struct pw_node *node, enum pw_node_state state, char *
 			pw_node_resource_info(resource, &node->info);
 
 		node->info.change_mask = 0;
+
+		if (node->global)
+			pw_core_update_graph(node->core);
 	}
 }
 
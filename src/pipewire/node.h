@@ -90,6 +90,12 @@ struct pw_node_events {
 #define PW_NODE_PROP_AUTOCONNECT	"pipewire.autoconnect"
 /** Try to connect the node to this node id */
 #define PW_NODE_PROP_TARGET_NODE	"pipewire.target.node"
+/** The latency the node wants as "frames/rate" or "frames" at
+ * \ref PW_CORE_QUANTUM_RATE. The graph runs with the smallest latency
+ * of all nodes */
+#define PW_NODE_PROP_LATENCY		"node.latency"
+/** The node can start the cycles of the graph, boolean */
+#define PW_NODE_PROP_DRIVER		"node.driver"
 
 /** Create a new node \memberof pw_node */
 struct pw_node *
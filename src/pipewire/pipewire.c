@@ -74,7 +74,9 @@ open_support(const char *path,
 static void *
 load_interface(struct support_info *info,
 	       const char *factory_name,
-	       const char *type)
+	       const char *type,
+	       const struct spa_dict *props,
+	       struct spa_handle **handle_out)
 {
         int res;
         struct spa_handle *handle;
@@ -89,7 +91,7 @@ load_interface(struct support_info *info,
 
         handle = calloc(1, factory->size);
         if ((res = spa_handle_factory_init(factory,
-                                           handle, NULL, info->support, info->n_support)) < 0) {
+                                           handle, props, info->support, info->n_support)) < 0) {
                 fprintf(stderr, "can't make factory instance: %d\n", res);
                 goto init_failed;
         }
@@ -101,6 +103,8 @@ load_interface(struct support_info *info,
                 fprintf(stderr, "can't get %s interface %d\n", type, res);
                 goto interface_failed;
         }
+	if (handle_out)
+		*handle_out = handle;
         return iface;
 
       interface_failed:
@@ -127,16 +131,32 @@ static void configure_debug(const char *str)
 static void configure_support(struct support_info *info)
 {
 	void *iface;
+	struct spa_handle *handle;
+	struct spa_dict_item items[1];
+	struct spa_dict props = SPA_DICT_INIT(0, items);
+	const char *str;
 
-	iface = load_interface(info, "mapper", SPA_TYPE__TypeMap);
+	iface = load_interface(info, "mapper", SPA_TYPE__TypeMap, NULL, NULL);
 	if (iface != NULL) {
 		info->support[info->n_support++] = SPA_SUPPORT_INIT(SPA_TYPE__TypeMap, iface);
 	}
 
-	iface = load_interface(info, "logger", SPA_TYPE__Log);
+	if ((str = getenv("PIPEWIRE_LOG_BINARY")))
+		items[props.n_items++] = (struct spa_dict_item) { SPA_LOG_BINARY_KEY_FILE, str };
+
+	iface = load_interface(info, "logger", SPA_TYPE__Log, &props, &handle);
 	if (iface != NULL) {
+		struct spa_type_map *map = pw_get_support_interface(SPA_TYPE__TypeMap);
+		void *binary;
+
 		info->support[info->n_support++] = SPA_SUPPORT_INIT(SPA_TYPE__Log, iface);
 		pw_log_set(iface);
+
+		if (str && map &&
+		    spa_handle_get_interface(handle,
+					     spa_type_map_get_id(map, SPA_TYPE__LogBinary),
+					     &binary) == SPA_RESULT_OK)
+			pw_log_set_binary(binary);
 	}
 }
 
@@ -189,6 +209,9 @@ const struct spa_support *pw_get_support(uint32_t *n_support)
  *
  * The environment variable \a PIPEWIRE_DEBUG
  *
+ * The environment variable \a PIPEWIRE_LOG_BINARY enables the binary
+ * log, see \ref pw_log
+ *
  * \memberof pw_pipewire
  */
 void pw_init(int *argc, char **argv[])
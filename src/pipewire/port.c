@@ -21,19 +21,51 @@
 #include <stdlib.h>
 #include <errno.h>
 
+#include <spa/audio/format-utils.h>
+
 #include "pipewire/pipewire.h"
 #include "pipewire/private.h"
 #include "pipewire/port.h"
 
+#include "spa/plugins/audiomixer/conv.h"
+
 /** \cond */
+#define MAX_BUFFERS	64
+
+struct type {
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+};
+
 struct impl {
 	struct pw_port this;
 
 	struct spa_node mix_node;
+
+	struct type type;
+	struct spa_audiomixer_ops ops;
+	mix_func_t copy;			/**< copy samples of the format */
+	mix_func_t add;				/**< add samples of the format, NULL
+						  *  when the format can't be mixed */
+	struct spa_graph_port *mix_first;	/**< input with the buffer passed on */
+
+	struct spa_graph_port *buffer_link[MAX_BUFFERS];	/**< mix: link of a buffer */
+	bool busy[MAX_BUFFERS];			/**< mix: port buffers used by the node */
+	uint32_t refs[MAX_BUFFERS];		/**< tee: links that use a buffer */
 };
 /** \endcond */
 
 
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+}
+
 static void port_update_state(struct pw_port *port, enum pw_port_state state)
 {
 	if (port->state != state) {
@@ -43,6 +75,18 @@ static void port_update_state(struct pw_port *port, enum pw_port_state state)
 	}
 }
 
+/* remember the state of the port when an async change completes, the
+ * links of the port wait for the same change */
+static void port_update_pending(struct pw_port *port, int res, enum pw_port_state state)
+{
+	if (SPA_RESULT_IS_ASYNC(res)) {
+		port->pending_seq = SPA_RESULT_ASYNC_SEQ(res);
+		port->pending_state = state;
+	} else {
+		port->pending_seq = SPA_ID_INVALID;
+	}
+}
+
 static int schedule_tee_input(struct spa_node *data)
 {
 	struct impl *impl = SPA_CONTAINER_OF(data, struct impl, mix_node);
@@ -57,15 +101,41 @@ static int schedule_tee_input(struct spa_node *data)
 		res = SPA_RESULT_NEED_BUFFER;
 	}
 	else {
+		uint32_t n_links = 0;
+
 		pw_log_trace("tee input %d %d", io->status, io->buffer_id);
-		spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link)
+		spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
 			*p->io = *io;
+			n_links++;
+		}
+		/* all links share the buffer, it goes back to the output when
+		 * the last link is done with it */
+		if (io->status == SPA_RESULT_HAVE_BUFFER && io->buffer_id < MAX_BUFFERS)
+			__atomic_store_n(&impl->refs[io->buffer_id], n_links, __ATOMIC_RELEASE);
+
 		io->status = SPA_RESULT_OK;
 		io->buffer_id = SPA_ID_INVALID;
 		res = SPA_RESULT_HAVE_BUFFER;
 	}
         return res;
 }
+/* a link is done with a buffer, returns true when it was the last one */
+static inline bool tee_release(struct impl *impl, uint32_t id)
+{
+	uint32_t refs;
+
+	if (id >= MAX_BUFFERS)
+		return true;
+
+	refs = __atomic_load_n(&impl->refs[id], __ATOMIC_ACQUIRE);
+	do {
+		if (refs == 0)
+			return true;
+	} while (!__atomic_compare_exchange_n(&impl->refs[id], &refs, refs - 1, false,
+					      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+	return refs == 1;
+}
+
 static int schedule_tee_output(struct spa_node *data)
 {
 	struct impl *impl = SPA_CONTAINER_OF(data, struct impl, mix_node);
@@ -74,8 +144,22 @@ static int schedule_tee_output(struct spa_node *data)
 	struct spa_graph_port *p;
 	struct spa_port_io *io = this->rt.mix_port.io;
 
-	spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link)
-		*io = *p->io;
+	spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
+		uint32_t id = p->io->buffer_id;
+
+		if (id == SPA_ID_INVALID)
+			continue;
+		p->io->buffer_id = SPA_ID_INVALID;
+
+		if (!tee_release(impl, id))
+			continue;
+
+		/* one buffer goes back in the io area, more with reuse_buffer */
+		if (io->buffer_id == SPA_ID_INVALID)
+			io->buffer_id = id;
+		else
+			spa_node_port_reuse_buffer(this->node->node, this->port_id, id);
+	}
 	io->status = SPA_RESULT_NEED_BUFFER;
 
 	return SPA_RESULT_NEED_BUFFER;
@@ -83,6 +167,13 @@ static int schedule_tee_output(struct spa_node *data)
 
 static int schedule_tee_reuse_buffer(struct spa_node *data, uint32_t port_id, uint32_t buffer_id)
 {
+	struct impl *impl = SPA_CONTAINER_OF(data, struct impl, mix_node);
+        struct pw_port *this = &impl->this;
+
+	pw_log_trace("tee reuse buffer %d", buffer_id);
+	if (tee_release(impl, buffer_id))
+		return spa_node_port_reuse_buffer(this->node->node, this->port_id, buffer_id);
+
 	return SPA_RESULT_OK;
 }
 
@@ -94,6 +185,102 @@ static const struct spa_node schedule_tee_node = {
 	.port_reuse_buffer = schedule_tee_reuse_buffer,
 };
 
+/* copy or add the samples of src to dst, dst grows to the size of src when
+ * src is larger and there is room */
+static void mix_buffer(struct impl *impl, struct spa_buffer *dst, struct spa_buffer *src, bool first)
+{
+	struct spa_data *dd = &dst->datas[0], *sd = &src->datas[0];
+	uint32_t dsize, soffs, ssize, n_bytes;
+	void *d, *s;
+
+	if (dd->data == NULL || sd->data == NULL)
+		return;
+
+	soffs = SPA_MIN(sd->chunk->offset, sd->maxsize);
+	ssize = SPA_MIN(sd->chunk->size, sd->maxsize - soffs);
+	s = SPA_MEMBER(sd->data, soffs, void);
+	d = dd->data;
+
+	if (first) {
+		n_bytes = SPA_MIN(ssize, dd->maxsize);
+		impl->copy(d, s, n_bytes);
+		dd->chunk->offset = 0;
+		dd->chunk->size = n_bytes;
+		dd->chunk->stride = sd->chunk->stride;
+		return;
+	}
+
+	dsize = dd->chunk->size;
+	n_bytes = SPA_MIN(dsize, ssize);
+	impl->add(d, s, n_bytes);
+
+	if (ssize > n_bytes) {
+		uint32_t extra = SPA_MIN(ssize, dd->maxsize) - n_bytes;
+		impl->copy(SPA_MEMBER(d, n_bytes, void), SPA_MEMBER(s, n_bytes, void), extra);
+		dd->chunk->size = n_bytes + extra;
+	}
+}
+
+/* a port buffer that the node does not have */
+static inline uint32_t get_free_buffer(struct impl *impl)
+{
+	struct pw_port *this = &impl->this;
+	uint32_t i;
+
+	for (i = 0; i < this->n_buffers && i < MAX_BUFFERS; i++) {
+		if (!impl->busy[i]) {
+			impl->busy[i] = true;
+			return i;
+		}
+	}
+	return SPA_ID_INVALID;
+}
+
+static inline void release_buffer(struct impl *impl, uint32_t id)
+{
+	if (id < MAX_BUFFERS)
+		impl->busy[id] = false;
+}
+
+/* Mix the buffers of all links into a buffer of the port. Each link has its
+ * own buffers, see do_allocation() in link.c, and the buffers of the port
+ * are only used by the node. The buffers of the links stay in the io area
+ * of their link and are recycled by their output in process_output. */
+static int mix_input(struct impl *impl)
+{
+        struct pw_port *this = &impl->this;
+	struct spa_graph_node *node = &this->rt.mix_node;
+	struct spa_graph_port *p;
+	struct spa_port_io *io = this->rt.mix_port.io;
+	uint32_t id = SPA_ID_INVALID;
+	bool first = true;
+
+	spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link) {
+		struct pw_link *link = p->scheduler_data;
+
+		if (p->io->status != SPA_RESULT_HAVE_BUFFER || link == NULL ||
+		    p->io->buffer_id >= link->n_buffers)
+			continue;
+
+		if (id == SPA_ID_INVALID &&
+		    (id = get_free_buffer(impl)) == SPA_ID_INVALID) {
+			pw_log_trace("mix %p: no free buffer", node);
+			break;
+		}
+		pw_log_trace("mix %p: add input %p %d", node, p, p->io->buffer_id);
+		mix_buffer(impl, this->buffers[id], link->buffers[p->io->buffer_id], first);
+		p->io->status = SPA_RESULT_OK;
+		first = false;
+	}
+	io->buffer_id = id;
+	io->status = id == SPA_ID_INVALID ? SPA_RESULT_NEED_BUFFER : SPA_RESULT_HAVE_BUFFER;
+
+	return SPA_RESULT_HAVE_BUFFER;
+}
+
+/* When the format of the port can be mixed, the buffers of all inputs are
+ * mixed into a buffer of the port. Otherwise the port only has one link and
+ * its buffer is passed on. */
 static int schedule_mix_input(struct spa_node *data)
 {
 	struct impl *impl = SPA_CONTAINER_OF(data, struct impl, mix_node);
@@ -102,12 +289,18 @@ static int schedule_mix_input(struct spa_node *data)
 	struct spa_graph_port *p;
 	struct spa_port_io *io = this->rt.mix_port.io;
 
+	if (this->mix != NULL)
+		return mix_input(impl);
+
 	spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link) {
 		pw_log_trace("mix %p: input %p %p->%p %d %d", node,
 				p, p->io, io, p->io->status, p->io->buffer_id);
 		*io = *p->io;
 		p->io->status = SPA_RESULT_OK;
 		p->io->buffer_id = SPA_ID_INVALID;
+		impl->mix_first = p;
+		if (io->buffer_id < MAX_BUFFERS)
+			impl->buffer_link[io->buffer_id] = p;
 		break;
 	}
 	return SPA_RESULT_HAVE_BUFFER;
@@ -122,15 +315,54 @@ static int schedule_mix_output(struct spa_node *data)
 	struct spa_port_io *io = this->rt.mix_port.io;
 
 	io->status = SPA_RESULT_NEED_BUFFER;
-	spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link)
-		*p->io = *io;
+	if (this->mix != NULL) {
+		/* the node gives back a buffer of the port, the inputs keep
+		 * the id of their buffer to recycle */
+		release_buffer(impl, io->buffer_id);
+		spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link)
+			p->io->status = SPA_RESULT_NEED_BUFFER;
+	} else {
+		spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link) {
+			if (impl->mix_first == NULL || p == impl->mix_first)
+				*p->io = *io;
+			else
+				p->io->status = SPA_RESULT_NEED_BUFFER;
+		}
+	}
 	io->buffer_id = SPA_ID_INVALID;
+	impl->mix_first = NULL;
 
 	return SPA_RESULT_NEED_BUFFER;
 }
 
+/* a mixed buffer is free again, other buffers go back to the output of the
+ * link they came from */
 static int schedule_mix_reuse_buffer(struct spa_node *data, uint32_t port_id, uint32_t buffer_id)
 {
+	struct impl *impl = SPA_CONTAINER_OF(data, struct impl, mix_node);
+        struct pw_port *this = &impl->this;
+	struct spa_graph_node *node = &this->rt.mix_node;
+	struct spa_graph_port *p, *pp;
+
+	if (buffer_id >= MAX_BUFFERS)
+		return SPA_RESULT_OK;
+
+	if (this->mix != NULL) {
+		pw_log_trace("mix release buffer %d", buffer_id);
+		release_buffer(impl, buffer_id);
+		return SPA_RESULT_OK;
+	}
+
+	spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link) {
+		if (p != impl->buffer_link[buffer_id])
+			continue;
+
+		pw_log_trace("mix reuse buffer %d", buffer_id);
+		if ((pp = p->peer) != NULL)
+			return spa_node_port_reuse_buffer(pp->node->implementation,
+							  pp->port_id, buffer_id);
+		break;
+	}
 	return SPA_RESULT_OK;
 }
 
@@ -166,6 +398,7 @@ struct pw_port *pw_port_new(enum pw_direction direction,
 	this->port_id = port_id;
 	this->properties = properties;
 	this->state = PW_PORT_STATE_INIT;
+	this->pending_seq = SPA_ID_INVALID;
 	this->io.status = SPA_RESULT_NEED_BUFFER;
 	this->io.buffer_id = SPA_ID_INVALID;
 
@@ -194,6 +427,8 @@ struct pw_port *pw_port_new(enum pw_direction direction,
 	this->rt.mix_port.scheduler_data = this;
 	this->rt.port.scheduler_data = this;
 
+	spa_audiomixer_get_ops(&impl->ops);
+
 	return this;
 
        no_mem:
@@ -259,10 +494,13 @@ static int do_add_port(struct spa_loop *loop,
 
 bool pw_port_add(struct pw_port *port, struct pw_node *node)
 {
+	struct impl *impl = SPA_CONTAINER_OF(port, struct impl, this);
 	uint32_t port_id = port->port_id;
 
 	port->node = node;
 
+	init_type(&impl->type, node->core->type.map);
+
 	pw_log_debug("port %p: add to node %p", port, node);
 	if (port->direction == PW_DIRECTION_INPUT) {
 		spa_list_insert(&node->input_ports, &port->link);
@@ -279,6 +517,8 @@ bool pw_port_add(struct pw_port *port, struct pw_node *node)
 
 	spa_node_port_set_io(node->node, port->direction, port_id, &port->io);
 
+	pw_core_index_node(node->core, node, port->direction);
+
 	port->rt.graph = node->rt.graph;
 	pw_loop_invoke(node->data_loop, do_add_port, SPA_ID_INVALID, 0, NULL, false, port);
 
@@ -328,6 +568,8 @@ void pw_port_destroy(struct pw_port *port)
 		}
 		spa_list_remove(&port->link);
 		spa_hook_list_call(&node->listener_list, struct pw_node_events, port_removed, port);
+
+		pw_core_index_node(node->core, node, port->direction);
 	}
 
 	pw_log_debug("port %p: free", port);
@@ -354,6 +596,85 @@ do_port_pause(struct spa_loop *loop,
 				&SPA_COMMAND_INIT(node->core->type.command_node.Pause));
 }
 
+/* select the functions to mix the inputs of an input port in the format,
+ * only raw audio in the formats of the audiomixer is mixed */
+static void update_mix(struct pw_port *port, const struct spa_format *format)
+{
+	struct impl *impl = SPA_CONTAINER_OF(port, struct impl, this);
+	struct type *t = &impl->type;
+	struct spa_audio_info info = { 0, };
+	int conv = -1;
+
+	if (port->direction == PW_DIRECTION_INPUT && format != NULL &&
+	    SPA_FORMAT_MEDIA_TYPE(format) == t->media_type.audio &&
+	    SPA_FORMAT_MEDIA_SUBTYPE(format) == t->media_subtype.raw &&
+	    spa_format_audio_raw_parse(format, &info.info.raw, &t->format_audio) &&
+	    info.info.raw.layout == SPA_AUDIO_LAYOUT_INTERLEAVED) {
+		if (info.info.raw.format == t->audio_format.S16)
+			conv = CONV_S16_S16;
+		else if (info.info.raw.format == t->audio_format.F32)
+			conv = CONV_F32_F32;
+	}
+
+	if (conv >= 0) {
+		impl->copy = impl->ops.copy[conv];
+		impl->add = impl->ops.add[conv];
+		port->mix = &impl->mix_node;
+	} else {
+		impl->copy = impl->add = NULL;
+		port->mix = NULL;
+	}
+	pw_log_debug("port %p: mix inputs %d", port, port->mix != NULL);
+}
+
+static int
+do_reset_mix(struct spa_loop *loop,
+             bool async, uint32_t seq, size_t size, const void *data, void *user_data)
+{
+	struct impl *impl = user_data;
+	int i;
+
+	for (i = 0; i < MAX_BUFFERS; i++)
+		impl->busy[i] = false;
+	impl->mix_first = NULL;
+
+	return SPA_RESULT_OK;
+}
+
+/* the mixed buffers of the old pool are not used by the node anymore */
+static void reset_mix(struct pw_port *port)
+{
+	struct impl *impl = SPA_CONTAINER_OF(port, struct impl, this);
+
+	if (port->direction == PW_DIRECTION_INPUT)
+		pw_loop_invoke(port->node->data_loop, do_reset_mix, 0, 0, NULL, true, impl);
+}
+
+/** Signal that the possible formats of a port changed
+ *
+ * \param port a port
+ *
+ * Removes the formats negotiated with \a port from the format cache of
+ * the core and looks up the media type of the port again on the next
+ * pw_core_find_port().
+ *
+ * \memberof pw_port
+ */
+void pw_port_formats_changed(struct pw_port *port)
+{
+	struct pw_node *node = port->node;
+
+	pw_log_debug("port %p: possible formats changed", port);
+
+	if (node == NULL)
+		return;
+
+	pw_core_clear_format_cache(node->core, node, port->direction, port->port_id);
+
+	port->have_summary = false;
+	pw_core_index_node(node->core, node, port->direction);
+}
+
 int pw_port_set_format(struct pw_port *port, uint32_t flags, const struct spa_format *format)
 {
 	int res;
@@ -361,7 +682,11 @@ int pw_port_set_format(struct pw_port *port, uint32_t flags, const struct spa_fo
 	res = spa_node_port_set_format(port->node->node, port->direction, port->port_id, flags, format);
 	pw_log_debug("port %p: set format %d", port, res);
 
+	port_update_pending(port, res, format ? PW_PORT_STATE_READY : PW_PORT_STATE_CONFIGURE);
+
 	if (!SPA_RESULT_IS_ASYNC(res)) {
+		update_mix(port, format);
+
 		if (format == NULL) {
 			if (port->allocated) {
 				free(port->buffers);
@@ -405,6 +730,9 @@ int pw_port_use_buffers(struct pw_port *port, struct spa_buffer **buffers, uint3
 	port->buffers = buffers;
 	port->n_buffers = n_buffers;
 	port->allocated = false;
+	reset_mix(port);
+
+	port_update_pending(port, res, n_buffers ? PW_PORT_STATE_PAUSED : PW_PORT_STATE_READY);
 
 	if (n_buffers == 0)
 		port_update_state (port, PW_PORT_STATE_READY);
@@ -441,9 +769,48 @@ int pw_port_alloc_buffers(struct pw_port *port,
 	port->buffers = buffers;
 	port->n_buffers = *n_buffers;
 	port->allocated = true;
+	reset_mix(port);
+
+	port_update_pending(port, res, PW_PORT_STATE_PAUSED);
 
 	if (!SPA_RESULT_IS_ASYNC(res))
 		port_update_state (port, PW_PORT_STATE_PAUSED);
 
 	return res;
 }
+
+/** Complete an async change of a port
+ *
+ * \param port a port
+ * \param seq the seq of the completed async operation of the port node
+ * \param res the result
+ *
+ * Update the state of \a port when \a seq is the format or buffers change
+ * in progress. This is called by the node before the links that wait for
+ * the change are completed so that they all see the new state.
+ *
+ * \memberof pw_port
+ */
+void pw_port_async_complete(struct pw_port *port, uint32_t seq, int res)
+{
+	if (port->pending_seq != seq)
+		return;
+
+	port->pending_seq = SPA_ID_INVALID;
+
+	if (SPA_RESULT_IS_OK(res)) {
+		const struct spa_format *format;
+
+		/* the format can be set or cleared */
+		if (spa_node_port_get_format(port->node->node, port->direction, port->port_id,
+					     &format) < 0)
+			format = NULL;
+		update_mix(port, format);
+
+		port_update_state(port, port->pending_state);
+	} else {
+		update_mix(port, NULL);
+		pw_log_warn("port %p: failed to go to state %d: %d", port, port->pending_state, res);
+		port_update_state(port, PW_PORT_STATE_ERROR);
+	}
+}
@@ -96,6 +96,9 @@ uint32_t pw_port_get_id(struct pw_port *port);
 /** Get the port parent node or NULL when not yet set */
 struct pw_node *pw_port_get_node(struct pw_port *port);
 
+/** Signal that the possible formats of the port changed */
+void pw_port_formats_changed(struct pw_port *port);
+
 /** Add an event listener on the port */
 void pw_port_add_listener(struct pw_port *port,
 			  struct spa_hook *listener,
@@ -132,6 +132,10 @@ struct pw_core {
 	struct spa_list node_list;		/**< list of nodes */
 	struct spa_list factory_list;		/**< list of factories */
 	struct spa_list link_list;		/**< list of links */
+	struct spa_list format_cache;		/**< cache of negotiated formats */
+	uint32_t n_format_cache;		/**< number of cached formats */
+	struct spa_list port_index;		/**< nodes by port direction, media type and
+						  *  subtype */
 
 	struct spa_hook_list listener_list;
 
@@ -142,8 +146,17 @@ struct pw_core {
 	struct spa_support support[4];	/**< support for spa plugins */
 	uint32_t n_support;		/**< number of support items */
 
+	uint32_t quantum;		/**< frames per cycle at \ref PW_CORE_QUANTUM_RATE */
+	struct pw_node *driver;		/**< node that starts the cycles, NULL when
+					  *  the timer does */
+	struct spa_source *timer;	/**< starts the cycles when there is no driver */
+	bool timer_running;		/**< if the timer is armed */
+
 	struct {
 		struct spa_graph graph;
+		struct pw_node *driver;		/**< the driver seen from the data loop */
+		struct spa_list followers;	/**< followers that end a cycle, started
+						  *  by the driver */
 	} rt;
 };
 
@@ -227,6 +240,7 @@ struct pw_node {
 
 	bool active;			/**< if the node is active */
 	bool live;			/**< if the node is live */
+	uint32_t pending_start;		/**< seq of the start in progress or SPA_ID_INVALID */
 	struct spa_clock *clock;	/**< handle to SPA clock if any */
 	struct spa_node *node;		/**< SPA node implementation */
 
@@ -246,9 +260,20 @@ struct pw_node {
 
 	struct pw_loop *data_loop;		/**< the data loop for this node */
 
+	uint32_t latency;		/**< requested frames per cycle or 0 */
+	bool follows;			/**< if the node follows the driver or the timer */
+
+	struct {
+		struct port_bucket *bucket;	/**< bucket in core port_index or NULL */
+		struct spa_list link;		/**< link in the bucket */
+	} index[2];			/**< for the input and output ports */
+
 	struct {
 		struct spa_graph *graph;
 		struct spa_graph_node node;
+		bool follower;			/**< if the node ends a cycle and waits
+						  *  for the driver */
+		struct spa_list follower_link;	/**< link in core rt.followers */
 	} rt;
 
         void *user_data;                /**< extra user data */
@@ -264,6 +289,9 @@ struct pw_port {
 	struct pw_properties *properties;
 
 	enum pw_port_state state;	/**< state of the port */
+	uint32_t pending_seq;		/**< seq of the format or buffers change in progress
+					  *  or SPA_ID_INVALID */
+	enum pw_port_state pending_state;	/**< state when pending_seq completes */
 
 	struct spa_port_io io;		/**< io area of the port */
 
@@ -274,9 +302,16 @@ struct pw_port {
 
 	struct spa_list links;		/**< list of \ref pw_link */
 
+	bool have_summary;		/**< if media_type and media_subtype were looked up */
+	uint32_t media_type;		/**< media type of the first possible format or
+					  *  SPA_ID_INVALID */
+	uint32_t media_subtype;		/**< media subtype of the first possible format or
+					  *  SPA_ID_INVALID */
+
 	struct spa_hook_list listener_list;
 
-	struct spa_node *mix;		/**< optional port buffer mix/split */
+	struct spa_node *mix;		/**< mixer of the links of an input port, NULL when
+				  *  the format can not be mixed */
 
 	struct {
 		struct spa_graph *graph;
@@ -412,6 +447,27 @@ int pw_port_alloc_buffers(struct pw_port *port,
 			  struct spa_param **params, uint32_t n_params,
 			  struct spa_buffer **buffers, uint32_t *n_buffers);
 
+/** Complete an async format or buffers change on a port \memberof pw_port */
+void pw_port_async_complete(struct pw_port *port, uint32_t seq, int res);
+
+/** Recalculate the graph quantum and select the driver, called when
+ * nodes are added, removed or change state \memberof pw_core */
+void pw_core_update_graph(struct pw_core *core);
+
+/** Start a cycle in the followers, called from the data loop by the
+ * driver \memberof pw_core */
+void pw_core_wake_followers(struct pw_core *core);
+
+/** Index the ports of \a node in \a direction again, called when the node
+ * is registered and when its ports change \memberof pw_core */
+void pw_core_index_node(struct pw_core *core, struct pw_node *node, enum pw_direction direction);
+
+/** Remove \a node from the port index \memberof pw_core */
+void pw_core_unindex_node(struct pw_core *core, struct pw_node *node);
+
+/** Send the clock and the graph quantum to a node */
+void pw_node_send_clock_update(struct pw_node *node);
+
 /** Change the state of the node */
 int pw_node_set_state(struct pw_node *node, enum pw_node_state state);
 
@@ -458,7 +458,18 @@ static void handle_rtnode_message(struct pw_proxy *proxy, struct pw_client_node_
 		pw_log_trace("remote %p: process output", data->remote);
 		spa_graph_need_input(data->node->rt.graph, &data->out_node);
 	}
-	else if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_REUSE_BUFFER) {
+	else if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_PROCESS) {
+		struct pw_client_node_message_process *p =
+		    (struct pw_client_node_message_process *) message;
+
+		pw_log_trace("remote %p: process %d", data->remote, p->body.flags.value);
+		if (p->body.flags.value & PW_CLIENT_NODE_PROCESS_INPUT)
+			spa_graph_have_output(data->node->rt.graph, &data->in_node);
+		if (p->body.flags.value & PW_CLIENT_NODE_PROCESS_OUTPUT)
+			spa_graph_need_input(data->node->rt.graph, &data->out_node);
+	}
+	else if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_REUSE_BUFFER ||
+		 PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS) {
 	}
 	else {
 		pw_log_warn("unexpected node message %d", PW_CLIENT_NODE_MESSAGE_TYPE(message));
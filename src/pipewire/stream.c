@@ -25,11 +25,13 @@
 #include <time.h>
 
 #include "spa/lib/debug.h"
+#include "spa/probe.h"
 
 #include "pipewire/pipewire.h"
 #include "pipewire/private.h"
 #include "pipewire/interfaces.h"
 #include "pipewire/array.h"
+#include "pipewire/data-loop.h"
 #include "pipewire/stream.h"
 #include "pipewire/utils.h"
 #include "pipewire/stream.h"
@@ -41,6 +43,7 @@
 #define MAX_FDS         32
 #define MAX_INPUTS      64
 #define MAX_OUTPUTS     64
+#define MAX_BUFFERS     64
 
 struct mem_id {
 	uint32_t id;
@@ -78,6 +81,9 @@ struct stream {
 
 	enum pw_stream_mode mode;
 
+	struct pw_data_loop *data_loop_impl;
+	struct pw_loop *data_loop;
+
 	int rtwritefd;
 	struct spa_source *rtsocket_source;
 
@@ -89,12 +95,14 @@ struct stream {
 	struct pw_client_node_transport *trans;
 
 	struct spa_source *timeout_source;
+	struct spa_source *hangup_event;	/**< signaled from the data loop on errors */
 
 	struct pw_array mem_ids;
 	struct pw_array buffer_ids;
 	bool in_order;
 
 	struct spa_list free;
+	struct spa_list queued;
 	bool in_need_buffer;
 
 	int64_t last_ticks;
@@ -152,6 +160,7 @@ static void clear_buffers(struct pw_stream *stream)
 	impl->buffer_ids.size = 0;
 	impl->in_order = true;
 	spa_list_init(&impl->free);
+	spa_list_init(&impl->queued);
 }
 
 static bool stream_set_state(struct pw_stream *stream, enum pw_stream_state state, char *error)
@@ -233,6 +242,7 @@ struct pw_stream *pw_stream_new(struct pw_remote *remote,
 	pw_array_ensure_size(&impl->buffer_ids, sizeof(struct buffer_id) * 64);
 	impl->pending_seq = SPA_ID_INVALID;
 	spa_list_init(&impl->free);
+	spa_list_init(&impl->queued);
 
 	spa_list_insert(&remote->stream_list, &this->link);
 
@@ -276,13 +286,9 @@ do_remove_sources(struct spa_loop *loop,
 	struct pw_stream *stream = &impl->this;
 
 	if (impl->rtsocket_source) {
-		pw_loop_destroy_source(stream->remote->core->data_loop, impl->rtsocket_source);
+		pw_loop_destroy_source(impl->data_loop, impl->rtsocket_source);
 		impl->rtsocket_source = NULL;
 	}
-	if (impl->timeout_source) {
-		pw_loop_destroy_source(stream->remote->core->data_loop, impl->timeout_source);
-		impl->timeout_source = NULL;
-	}
 	if (impl->rtwritefd != -1) {
 		close(impl->rtwritefd);
 		impl->rtwritefd = -1;
@@ -294,7 +300,18 @@ static void unhandle_socket(struct pw_stream *stream)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
 
-        pw_loop_invoke(stream->remote->core->data_loop,
+	if (impl->timeout_source) {
+		pw_loop_destroy_source(stream->remote->core->main_loop, impl->timeout_source);
+		impl->timeout_source = NULL;
+	}
+	if (impl->hangup_event) {
+		pw_loop_destroy_source(stream->remote->core->main_loop, impl->hangup_event);
+		impl->hangup_event = NULL;
+	}
+	if (impl->data_loop == NULL)
+		return;
+
+        pw_loop_invoke(impl->data_loop,
                        do_remove_sources, 1, 0, NULL, true, impl);
 }
 
@@ -368,6 +385,9 @@ void pw_stream_destroy(struct pw_stream *stream)
 	clear_mems(stream);
 	pw_array_clear(&impl->mem_ids);
 
+	if (impl->data_loop_impl)
+		pw_data_loop_destroy(impl->data_loop_impl);
+
 	if (stream->properties)
 		pw_properties_free(stream->properties);
 
@@ -503,48 +523,90 @@ static inline void reuse_buffer(struct pw_stream *stream, uint32_t id)
 
 	if ((bid = find_buffer(stream, id)) && bid->used) {
 		pw_log_trace("stream %p: reuse buffer %u", stream, id);
+		SPA_PROBE(pipewire, buffer_reuse, stream, 0, id);
 		bid->used = false;
 		spa_list_insert(impl->free.prev, &bid->link);
 		spa_hook_list_call(&stream->listener_list, struct pw_stream_events, new_buffer, id);
 	}
 }
 
-static void handle_rtnode_message(struct pw_stream *stream, struct pw_client_node_message *message)
+static inline bool dequeue_output(struct pw_stream *stream)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct buffer_id *bid;
 
-	if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_PROCESS_INPUT) {
-		int i;
+	if (spa_list_is_empty(&impl->queued))
+		return false;
 
-		for (i = 0; i < impl->trans->area->n_input_ports; i++) {
-			struct spa_port_io *input = &impl->trans->inputs[i];
+	bid = spa_list_first(&impl->queued, struct buffer_id, link);
+	spa_list_remove(&bid->link);
 
-			pw_log_trace("stream %p: process input %d %d", stream, input->status,
-				     input->buffer_id);
-			if (input->buffer_id == SPA_ID_INVALID)
-				continue;
+	impl->trans->outputs[0].buffer_id = bid->id;
+	impl->trans->outputs[0].status = SPA_RESULT_HAVE_BUFFER;
+	pw_log_trace("stream %p: send queued buffer %d", stream, bid->id);
 
-			spa_hook_list_call(&stream->listener_list, struct pw_stream_events,
-					 new_buffer, input->buffer_id);
-			input->buffer_id = SPA_ID_INVALID;
-		}
-		send_need_input(stream);
-	} else if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_PROCESS_OUTPUT) {
-		int i;
+	return true;
+}
 
-		for (i = 0; i < impl->trans->area->n_output_ports; i++) {
-			struct spa_port_io *output = &impl->trans->outputs[i];
+static void process_input(struct pw_stream *stream)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	int i;
 
-			if (output->buffer_id == SPA_ID_INVALID)
-				continue;
+	for (i = 0; i < impl->trans->area->n_input_ports; i++) {
+		struct spa_port_io *input = &impl->trans->inputs[i];
 
-			reuse_buffer(stream, output->buffer_id);
-			output->buffer_id = SPA_ID_INVALID;
-		}
-		pw_log_trace("stream %p: process output", stream);
-		impl->in_need_buffer = true;
-		spa_hook_list_call(&stream->listener_list, struct pw_stream_events, need_buffer);
-		impl->in_need_buffer = false;
+		pw_log_trace("stream %p: process input %d %d", stream, input->status,
+			     input->buffer_id);
+		if (input->buffer_id == SPA_ID_INVALID)
+			continue;
+
+		spa_hook_list_call(&stream->listener_list, struct pw_stream_events,
+				 new_buffer, input->buffer_id);
+		input->buffer_id = SPA_ID_INVALID;
+	}
+	send_need_input(stream);
+}
+
+static void process_output(struct pw_stream *stream)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	int i;
+
+	for (i = 0; i < impl->trans->area->n_output_ports; i++) {
+		struct spa_port_io *output = &impl->trans->outputs[i];
+
+		if (output->buffer_id == SPA_ID_INVALID)
+			continue;
+
+		reuse_buffer(stream, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+	pw_log_trace("stream %p: process output", stream);
+	if (dequeue_output(stream))
+		return;
+
+	impl->in_need_buffer = true;
+	spa_hook_list_call(&stream->listener_list, struct pw_stream_events, need_buffer);
+	impl->in_need_buffer = false;
+}
+
+static void handle_rtnode_message(struct pw_stream *stream, struct pw_client_node_message *message)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+
+	if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_PROCESS_INPUT) {
+		process_input(stream);
+	} else if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_PROCESS_OUTPUT) {
+		process_output(stream);
+	} else if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_PROCESS) {
+		struct pw_client_node_message_process *p =
+		    (struct pw_client_node_message_process *) message;
+
+		if (p->body.flags.value & PW_CLIENT_NODE_PROCESS_INPUT)
+			process_input(stream);
+		if (p->body.flags.value & PW_CLIENT_NODE_PROCESS_OUTPUT)
+			process_output(stream);
 	} else if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_REUSE_BUFFER) {
 		struct pw_client_node_message_reuse_buffer *p =
 		    (struct pw_client_node_message_reuse_buffer *) message;
@@ -555,6 +617,25 @@ static void handle_rtnode_message(struct pw_stream *stream, struct pw_client_nod
 			return;
 
 		reuse_buffer(stream, p->body.buffer_id.value);
+	} else if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS) {
+		struct pw_client_node_message_reuse_buffers *p =
+		    (struct pw_client_node_message_reuse_buffers *) message;
+		uint32_t i, *ids = PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_IDS(p);
+		uint32_t n_ids;
+
+		if (!PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_IS_VALID(p)) {
+			pw_log_warn("stream %p: invalid reuse buffers message", stream);
+			return;
+		}
+		if (p->body.port_id.value != impl->port_id)
+			return;
+		if (impl->direction != SPA_DIRECTION_OUTPUT)
+			return;
+
+		n_ids = PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_N_IDS(p);
+
+		for (i = 0; i < n_ids; i++)
+			reuse_buffer(stream, ids[i]);
 	} else {
 		pw_log_warn("unexpected node message %d", PW_CLIENT_NODE_MESSAGE_TYPE(message));
 	}
@@ -568,7 +649,10 @@ on_rtsocket_condition(void *data, int fd, enum spa_io mask)
 
 	if (mask & (SPA_IO_ERR | SPA_IO_HUP)) {
 		pw_log_warn("got error");
-		unhandle_socket(stream);
+		/* we are in the data loop, only remove our source here and let
+		 * the main loop clean up the rest */
+		do_remove_sources(NULL, false, 0, 0, NULL, impl);
+		pw_loop_signal_event(stream->remote->core->main_loop, impl->hangup_event);
 		return;
 	}
 
@@ -587,13 +671,22 @@ on_rtsocket_condition(void *data, int fd, enum spa_io mask)
 	}
 }
 
+static void on_hangup(void *data, uint64_t count)
+{
+	struct pw_stream *stream = data;
+
+	unhandle_socket(stream);
+}
+
 static void handle_socket(struct pw_stream *stream, int rtreadfd, int rtwritefd)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
 	struct timespec interval;
 
+	impl->hangup_event = pw_loop_add_event(stream->remote->core->main_loop, on_hangup, stream);
+
 	impl->rtwritefd = rtwritefd;
-	impl->rtsocket_source = pw_loop_add_io(stream->remote->core->data_loop,
+	impl->rtsocket_source = pw_loop_add_io(impl->data_loop,
 					       rtreadfd,
 					       SPA_IO_ERR | SPA_IO_HUP,
 					       true, on_rtsocket_condition, stream);
@@ -617,7 +710,7 @@ handle_node_command(struct pw_stream *stream, uint32_t seq, const struct spa_com
 		if (stream->state == PW_STREAM_STATE_STREAMING) {
 			pw_log_debug("stream %p: pause %d", stream, seq);
 
-			pw_loop_update_io(stream->remote->core->data_loop,
+			pw_loop_update_io(impl->data_loop,
 					  impl->rtsocket_source, SPA_IO_ERR | SPA_IO_HUP);
 
 			stream_set_state(stream, PW_STREAM_STATE_PAUSED, NULL);
@@ -628,7 +721,7 @@ handle_node_command(struct pw_stream *stream, uint32_t seq, const struct spa_com
 		if (stream->state == PW_STREAM_STATE_PAUSED) {
 			pw_log_debug("stream %p: start %d %d", stream, seq, impl->direction);
 
-			pw_loop_update_io(stream->remote->core->data_loop,
+			pw_loop_update_io(impl->data_loop,
 					  impl->rtsocket_source,
 					  SPA_IO_IN | SPA_IO_ERR | SPA_IO_HUP);
 
@@ -957,6 +1050,19 @@ pw_stream_connect(struct pw_stream *stream,
 	if (flags & PW_STREAM_FLAG_AUTOCONNECT)
 		pw_properties_set(stream->properties, PW_NODE_PROP_AUTOCONNECT, "1");
 
+	if (flags & PW_STREAM_FLAG_RT_PROCESS) {
+		if (impl->data_loop_impl == NULL) {
+			impl->data_loop_impl = pw_data_loop_new(NULL);
+			if (impl->data_loop_impl == NULL)
+				return false;
+			pw_data_loop_start(impl->data_loop_impl);
+		}
+		impl->data_loop = pw_data_loop_get_loop(impl->data_loop_impl);
+	} else {
+		impl->data_loop = stream->remote->core->data_loop;
+	}
+	pw_log_debug("stream %p: using data loop %p", stream, impl->data_loop);
+
 	impl->node_proxy = pw_core_proxy_create_object(stream->remote->core_proxy,
 			       "client-node",
 			       impl->type_client_node,
@@ -1050,6 +1156,20 @@ uint32_t pw_stream_get_empty_buffer(struct pw_stream *stream)
 	return bid->id;
 }
 
+uint32_t pw_stream_get_empty_buffers(struct pw_stream *stream, uint32_t *ids, uint32_t n_ids)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct buffer_id *bid;
+	uint32_t n = 0;
+
+	spa_list_for_each(bid, &impl->free, link) {
+		if (n == n_ids)
+			break;
+		ids[n++] = bid->id;
+	}
+	return n;
+}
+
 bool pw_stream_recycle_buffer(struct pw_stream *stream, uint32_t id)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
@@ -1070,6 +1190,45 @@ bool pw_stream_recycle_buffer(struct pw_stream *stream, uint32_t id)
 	return true;
 }
 
+uint32_t pw_stream_recycle_buffers(struct pw_stream *stream, const uint32_t *ids, uint32_t n_ids)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct {
+		struct pw_client_node_message_reuse_buffers rb;
+		uint32_t ids[MAX_BUFFERS];
+	} msg;
+	struct buffer_id *bid;
+	uint32_t i, n = 0, n_msg = 0;
+	uint64_t cmd = 1;
+
+	for (i = 0; i < n_ids; i++) {
+		if ((bid = find_buffer(stream, ids[i])) == NULL || !bid->used)
+			continue;
+
+		bid->used = false;
+		spa_list_insert(impl->free.prev, &bid->link);
+
+		msg.ids[n_msg++] = ids[i];
+		n++;
+
+		if (n_msg == MAX_BUFFERS) {
+			msg.rb = PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_INIT(impl->port_id, n_msg);
+			pw_client_node_transport_add_message(impl->trans,
+					(struct pw_client_node_message *) &msg);
+			n_msg = 0;
+		}
+	}
+	if (n_msg > 0) {
+		msg.rb = PW_CLIENT_NODE_MESSAGE_REUSE_BUFFERS_INIT(impl->port_id, n_msg);
+		pw_client_node_transport_add_message(impl->trans, (struct pw_client_node_message *) &msg);
+	}
+	if (n > 0) {
+		pw_log_trace("stream %p: recycled %u buffers", stream, n);
+		write(impl->rtwritefd, &cmd, 8);
+	}
+	return n;
+}
+
 struct spa_buffer *pw_stream_peek_buffer(struct pw_stream *stream, uint32_t id)
 {
 	struct buffer_id *bid;
@@ -1105,3 +1264,28 @@ bool pw_stream_send_buffer(struct pw_stream *stream, uint32_t id)
 
 	return true;
 }
+
+uint32_t pw_stream_send_buffers(struct pw_stream *stream, const uint32_t *ids, uint32_t n_ids)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct buffer_id *bid;
+	uint32_t i, n = 0;
+	bool was_empty = impl->trans->outputs[0].buffer_id == SPA_ID_INVALID;
+
+	for (i = 0; i < n_ids; i++) {
+		if ((bid = find_buffer(stream, ids[i])) == NULL || bid->used) {
+			pw_log_debug("stream %p: output %u was used", stream, ids[i]);
+			continue;
+		}
+		bid->used = true;
+		spa_list_remove(&bid->link);
+		spa_list_insert(impl->queued.prev, &bid->link);
+		n++;
+	}
+	pw_log_trace("stream %p: queued %u buffers", stream, n);
+
+	if (was_empty && dequeue_output(stream) && !impl->in_need_buffer)
+		send_have_output(stream);
+
+	return n;
+}
@@ -214,6 +214,8 @@ enum pw_stream_flags {
 						  *  this stream */
 	PW_STREAM_FLAG_CLOCK_UPDATE = (1 << 1),	/**< request periodic clock updates for
 						  *  this stream */
+	PW_STREAM_FLAG_RT_PROCESS = (1 << 2),	/**< process data in a dedicated realtime
+						  *  thread for this stream */
 };
 
 /** \enum pw_stream_mode The method for transfering data for a stream \memberof pw_stream */
@@ -262,7 +264,12 @@ const struct pw_properties *pw_stream_get_properties(struct pw_stream *stream);
  *
  * When \a mode is \ref PW_STREAM_MODE_BUFFER, you should connect to the new-buffer
  * event and use pw_stream_peek_buffer() to get the latest metadata and
- * data. */
+ * data.
+ *
+ * With \ref PW_STREAM_FLAG_RT_PROCESS, the new-buffer and need-buffer events
+ * are emitted from a realtime thread owned by the stream instead of the
+ * shared data loop of the core. All other events are emitted from the main
+ * loop of the remote. */
 bool
 pw_stream_connect(struct pw_stream *stream,		/**< a \ref pw_stream */
 		  enum pw_direction direction,		/**< the stream direction */
@@ -301,11 +308,22 @@ bool pw_stream_get_time(struct pw_stream *stream, struct pw_time *time);
  * available.  */
 uint32_t pw_stream_get_empty_buffer(struct pw_stream *stream);
 
+/** Get the ids of up to \a n_ids empty buffers that can be filled \memberof pw_stream
+ * \return the number of ids written in \a ids */
+uint32_t pw_stream_get_empty_buffers(struct pw_stream *stream, uint32_t *ids, uint32_t n_ids);
+
 /** Recycle the buffer with \a id \memberof pw_stream
  * \return true on success, false when \a id is invalid or not a used buffer
  * Let the PipeWire server know that it can reuse the buffer with \a id. */
 bool pw_stream_recycle_buffer(struct pw_stream *stream, uint32_t id);
 
+/** Recycle \a n_ids buffers from \a ids \memberof pw_stream
+ * \return the number of buffers that were recycled
+ *
+ * Invalid or unused ids are skipped. The server is notified with one
+ * message and one wakeup for the complete batch. */
+uint32_t pw_stream_recycle_buffers(struct pw_stream *stream, const uint32_t *ids, uint32_t n_ids);
+
 /** Get the buffer with \a id from \a stream \memberof pw_stream
  * \return a \ref spa_buffer or NULL when there is no buffer
  *
@@ -320,6 +338,14 @@ pw_stream_peek_buffer(struct pw_stream *stream, uint32_t id);
  * there is a new buffer available. */
 bool pw_stream_send_buffer(struct pw_stream *stream, uint32_t id);
 
+/** Queue \a n_ids buffers from \a ids for sending on \a stream \memberof pw_stream
+ * \return the number of buffers that were queued
+ *
+ * The buffers are sent in order, one for each cycle of the server. The
+ * server is woken up at most once and the need-buffer event is not emitted
+ * until the queue is drained. */
+uint32_t pw_stream_send_buffers(struct pw_stream *stream, const uint32_t *ids, uint32_t n_ids);
+
 #ifdef __cplusplus
 }
 #endif
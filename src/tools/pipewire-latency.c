@@ -0,0 +1,718 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure the latency of buffers going through a running daemon.
+ *
+ * By default an output stream and an input stream are created and the
+ * input stream is linked to the output stream. The output stream sends a
+ * buffer every interval with the send time in the pts of the header
+ * metadata and, for audio, an impulse on the first sample. The input
+ * stream matches the buffers it receives with the sent buffers, with the
+ * header when it is there and with the impulses otherwise.
+ *
+ * With --target only an input stream is created and linked to the given
+ * node. The pts of the source are then used as the send time, which only
+ * gives a latency for live sources that timestamp with the monotonic
+ * clock, like audiotestsrc with live=true:
+ *
+ *   load-module libpipewire-module-spa-node audiotestsrc/libspa-audiotestsrc \
+ *		audiotestsrc audiotestsrc Spa:POD:Object:Props:live=true
+ *
+ * The arrival jitter and the number of dropped buffers are reported in
+ * both cases.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <spa/type-map.h>
+#include <spa/format-utils.h>
+#include <spa/audio/format-utils.h>
+#include <spa/video/format-utils.h>
+#include <spa/format-builder.h>
+
+#include <pipewire/pipewire.h>
+
+#define DEFAULT_INTERVAL	10
+#define DEFAULT_RATE		48000
+#define DEFAULT_COUNT		1000
+
+#define WIDTH			320
+#define HEIGHT			240
+#define BPP			3
+
+#define IMPULSE			0x7fff
+#define MAX_PENDING		64
+
+struct type {
+	uint32_t format;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
+}
+
+struct endpoint {
+	struct data *data;
+	struct pw_stream *stream;
+	struct spa_hook listener;
+	uint8_t params_buffer[1024];
+};
+
+struct data {
+	struct type type;
+
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_type *t;
+
+	struct pw_remote *remote;
+	struct spa_hook remote_listener;
+
+	struct endpoint source;
+	struct endpoint sink;
+	struct spa_source *timer;
+
+	/* options */
+	const char *target;
+	bool video;
+	uint32_t interval;
+	uint32_t rate;
+	uint32_t count;
+
+	uint32_t size;
+	uint32_t stride;
+
+	/* send side */
+	uint32_t seq;
+	uint64_t n_sent;
+	uint64_t n_busy;
+	uint64_t pending[MAX_PENDING];
+
+	/* receive side */
+	bool have_last;
+	uint32_t last_seq;
+	int64_t last_pts;
+	int64_t last_arrival;
+	int64_t min_delta;
+	uint64_t n_impulses;
+	uint64_t n_received;
+	uint64_t n_dropped;
+	uint64_t n_no_pts;
+	double jitter;
+	int64_t *latency;
+	uint32_t n_latency;
+};
+
+static int64_t get_time(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+static void *map_data(struct data *data, struct spa_data *d, void **map, int prot)
+{
+	*map = NULL;
+
+	if (d->type == data->type.data.MemFd) {
+		*map = mmap(NULL, d->maxsize + d->mapoffset, prot, MAP_SHARED, d->fd, 0);
+		if (*map == MAP_FAILED) {
+			fprintf(stderr, "failed to mmap: %s\n", strerror(errno));
+			*map = NULL;
+			return NULL;
+		}
+		return SPA_MEMBER(*map, d->mapoffset, void);
+	} else if (d->type == data->type.data.MemPtr)
+		return d->data;
+
+	return NULL;
+}
+
+static void unmap_data(struct spa_data *d, void *map)
+{
+	if (map)
+		munmap(map, d->maxsize + d->mapoffset);
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+	int64_t va = *(const int64_t *) a, vb = *(const int64_t *) b;
+
+	return va < vb ? -1 : va > vb;
+}
+
+static void report(struct data *data)
+{
+	int64_t *l = data->latency;
+	uint32_t n = data->n_latency, i;
+	double mean = 0.0;
+
+	printf("\n");
+	if (data->target == NULL)
+		printf("sent:      %" PRIu64 " buffers, %" PRIu64 " not sent because the "
+		       "previous buffer was not consumed\n", data->n_sent, data->n_busy);
+	printf("received:  %" PRIu64 " buffers, %" PRIu64 " dropped\n",
+	       data->n_received, data->n_dropped);
+	printf("jitter:    %.1f us\n", data->jitter / 1000.0);
+
+	if (n == 0) {
+		if (data->n_no_pts)
+			printf("latency:   no buffers with usable timestamps, "
+			       "is the source live?\n");
+		return;
+	}
+
+	qsort(l, n, sizeof(int64_t), compare_int64);
+	for (i = 0; i < n; i++)
+		mean += l[i];
+	mean /= n;
+
+	printf("latency:   %u samples\n", n);
+	printf("  min      %10.1f us\n", l[0] / 1000.0);
+	printf("  mean     %10.1f us\n", mean / 1000.0);
+	printf("  p50      %10.1f us\n", l[n / 2] / 1000.0);
+	printf("  p90      %10.1f us\n", l[(n * 90) / 100] / 1000.0);
+	printf("  p99      %10.1f us\n", l[(n * 99) / 100] / 1000.0);
+	printf("  max      %10.1f us\n", l[n - 1] / 1000.0);
+}
+
+static void add_latency(struct data *data, int64_t latency)
+{
+	if (data->n_latency < data->count)
+		data->latency[data->n_latency++] = latency;
+}
+
+/* the jitter estimate of RFC 3550, the difference of the spacing of the
+ * buffers at the receiver and at the sender */
+static void update_jitter(struct data *data, int64_t pts, int64_t arrival)
+{
+	int64_t d;
+
+	if (data->have_last) {
+		d = (arrival - data->last_arrival) - (pts - data->last_pts);
+		data->jitter += (llabs(d) - data->jitter) / 16.0;
+	}
+	data->last_pts = pts;
+	data->last_arrival = arrival;
+}
+
+static void handle_header(struct data *data, struct spa_meta_header *h, int64_t now)
+{
+	if (data->target == NULL) {
+		if (data->have_last && h->seq != data->last_seq + 1)
+			data->n_dropped += h->seq - data->last_seq - 1;
+		data->last_seq = h->seq;
+		add_latency(data, now - h->pts);
+	} else {
+		/* the seq of the sources is not always in buffers, use the
+		 * smallest spacing of the pts to find the gaps */
+		if (data->have_last) {
+			int64_t delta = h->pts - data->last_pts;
+
+			if (delta > 0 && (data->min_delta == 0 || delta < data->min_delta))
+				data->min_delta = delta;
+			if (data->min_delta > 0 && delta > data->min_delta * 3 / 2)
+				data->n_dropped += (delta + data->min_delta / 2) / data->min_delta - 1;
+		}
+		if (h->pts > 0 && h->pts <= now && now - h->pts < SPA_NSEC_PER_SEC)
+			add_latency(data, now - h->pts);
+		else
+			data->n_no_pts++;
+	}
+	update_jitter(data, h->pts, now);
+	data->have_last = true;
+}
+
+/* without header metadata, match the impulses with the send times */
+static void handle_impulse(struct data *data, struct spa_buffer *buf, int64_t now)
+{
+	struct spa_data *d = &buf->datas[0];
+	int16_t *samples;
+	void *map;
+
+	if (data->target != NULL || data->video)
+		return;
+
+	if ((samples = map_data(data, d, &map, PROT_READ)) == NULL)
+		return;
+
+	if (d->chunk->size >= sizeof(int16_t) && samples[0] == IMPULSE) {
+		if (data->n_impulses < data->n_sent) {
+			if (data->n_sent - data->n_impulses > MAX_PENDING) {
+				data->n_dropped += data->n_sent - data->n_impulses - MAX_PENDING;
+				data->n_impulses = data->n_sent - MAX_PENDING;
+			}
+			add_latency(data, now - data->pending[data->n_impulses % MAX_PENDING]);
+			update_jitter(data, data->pending[data->n_impulses % MAX_PENDING], now);
+			data->have_last = true;
+			data->n_impulses++;
+		}
+	}
+	unmap_data(d, map);
+}
+
+static void on_sink_new_buffer(void *_data, uint32_t id)
+{
+	struct endpoint *e = _data;
+	struct data *data = e->data;
+	int64_t now = get_time();
+	struct spa_buffer *buf;
+	struct spa_meta_header *h;
+
+	if ((buf = pw_stream_peek_buffer(e->stream, id)) == NULL)
+		return;
+
+	data->n_received++;
+
+	if ((h = spa_buffer_find_meta(buf, data->type.meta.Header)))
+		handle_header(data, h, now);
+	else
+		handle_impulse(data, buf, now);
+
+	pw_stream_recycle_buffer(e->stream, id);
+
+	if (data->n_received >= data->count)
+		pw_main_loop_quit(data->loop);
+}
+
+static void fill_buffer(struct data *data, struct spa_buffer *buf)
+{
+	struct spa_data *d = &buf->datas[0];
+	void *map;
+	uint8_t *p;
+	uint32_t size = SPA_MIN(data->size, d->maxsize);
+
+	if ((p = map_data(data, d, &map, PROT_READ | PROT_WRITE)) == NULL)
+		return;
+
+	memset(p, 0, size);
+	if (!data->video && size >= sizeof(int16_t))
+		*(int16_t *) p = IMPULSE;
+
+	d->chunk->offset = 0;
+	d->chunk->size = size;
+	d->chunk->stride = data->stride;
+
+	unmap_data(d, map);
+}
+
+static void on_timeout(void *_data, uint64_t expirations)
+{
+	struct data *data = _data;
+	struct pw_stream *stream = data->source.stream;
+	struct spa_buffer *buf;
+	struct spa_meta_header *h;
+	uint32_t id;
+	int64_t now;
+
+	id = pw_stream_get_empty_buffer(stream);
+	if (id == SPA_ID_INVALID) {
+		data->n_busy++;
+		return;
+	}
+	buf = pw_stream_peek_buffer(stream, id);
+
+	fill_buffer(data, buf);
+
+	now = get_time();
+	if ((h = spa_buffer_find_meta(buf, data->type.meta.Header))) {
+		h->flags = 0;
+		h->seq = data->seq;
+		h->pts = now;
+		h->dts_offset = 0;
+	}
+	if (!pw_stream_send_buffer(stream, id)) {
+		data->n_busy++;
+		return;
+	}
+	data->pending[data->n_sent % MAX_PENDING] = now;
+	data->n_sent++;
+	data->seq++;
+}
+
+#define PROP(f,key,type,...)							\
+	SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)						\
+	SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |				\
+			SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_U_EN(f,key,type,n,...)						\
+	SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |				\
+			SPA_POD_PROP_RANGE_ENUM,type,n,__VA_ARGS__)
+
+static void on_format_changed(void *_data, struct spa_format *format)
+{
+	struct endpoint *e = _data;
+	struct data *data = e->data;
+	struct pw_type *t = data->t;
+	struct spa_pod_builder b = { NULL };
+	struct spa_pod_frame f[2];
+	struct spa_param *params[2];
+	uint32_t n_params = 0;
+
+	if (format == NULL) {
+		pw_stream_finish_format(e->stream, SPA_RESULT_OK, NULL, 0);
+		return;
+	}
+
+	spa_pod_builder_init(&b, e->params_buffer, sizeof(e->params_buffer));
+
+	/* with a target, the source decides on the buffer size */
+	if (data->target == NULL) {
+		spa_pod_builder_object(&b, &f[0], 0, t->param_alloc_buffers.Buffers,
+			PROP(&f[1], t->param_alloc_buffers.size, SPA_POD_TYPE_INT, data->size),
+			PROP(&f[1], t->param_alloc_buffers.stride, SPA_POD_TYPE_INT, data->stride),
+			PROP_U_MM(&f[1], t->param_alloc_buffers.buffers, SPA_POD_TYPE_INT,
+				8,
+				2, 32),
+			PROP(&f[1], t->param_alloc_buffers.align, SPA_POD_TYPE_INT, 16));
+		params[n_params++] = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_param);
+	}
+
+	spa_pod_builder_object(&b, &f[0], 0, t->param_alloc_meta_enable.MetaEnable,
+		PROP(&f[1], t->param_alloc_meta_enable.type, SPA_POD_TYPE_ID, t->meta.Header),
+		PROP(&f[1], t->param_alloc_meta_enable.size, SPA_POD_TYPE_INT,
+			sizeof(struct spa_meta_header)));
+	params[n_params++] = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_param);
+
+	pw_stream_finish_format(e->stream, SPA_RESULT_OK, params, n_params);
+}
+
+static void connect_sink(struct data *data, const char *path);
+
+static void on_source_state_changed(void *_data, enum pw_stream_state old,
+				    enum pw_stream_state state, const char *error)
+{
+	struct endpoint *e = _data;
+	struct data *data = e->data;
+	struct pw_loop *l = pw_main_loop_get_loop(data->loop);
+
+	switch (state) {
+	case PW_STREAM_STATE_ERROR:
+		fprintf(stderr, "source stream error: %s\n", error);
+		pw_main_loop_quit(data->loop);
+		break;
+
+	case PW_STREAM_STATE_CONFIGURE:
+		/* now we know the node id of the source and can link the sink to it */
+		if (data->sink.stream == NULL) {
+			char path[16];
+			snprintf(path, sizeof(path), "%u", pw_stream_get_node_id(e->stream));
+			connect_sink(data, path);
+		}
+		break;
+
+	case PW_STREAM_STATE_STREAMING:
+	{
+		struct timespec timeout, interval;
+
+		timeout.tv_sec = 0;
+		timeout.tv_nsec = 1;
+		interval.tv_sec = data->interval / SPA_MSEC_PER_SEC;
+		interval.tv_nsec = (data->interval % SPA_MSEC_PER_SEC) * SPA_NSEC_PER_MSEC;
+
+		pw_loop_update_timer(l, data->timer, &timeout, &interval, false);
+		break;
+	}
+	default:
+		pw_loop_update_timer(l, data->timer, NULL, NULL, false);
+		break;
+	}
+}
+
+static void on_sink_state_changed(void *_data, enum pw_stream_state old,
+				  enum pw_stream_state state, const char *error)
+{
+	struct endpoint *e = _data;
+	struct data *data = e->data;
+
+	if (state == PW_STREAM_STATE_ERROR) {
+		fprintf(stderr, "sink stream error: %s\n", error);
+		pw_main_loop_quit(data->loop);
+	}
+}
+
+static const struct pw_stream_events source_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_source_state_changed,
+	.format_changed = on_format_changed,
+};
+
+static const struct pw_stream_events sink_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_sink_state_changed,
+	.format_changed = on_format_changed,
+	.new_buffer = on_sink_new_buffer,
+};
+
+static const struct spa_format *build_format(struct data *data, struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+	struct type *type = &data->type;
+
+	if (data->video && data->target == NULL) {
+		spa_pod_builder_format(b, &f[0], type->format,
+			type->media_type.video, type->media_subtype.raw,
+			PROP(&f[1], type->format_video.format, SPA_POD_TYPE_ID,
+				type->video_format.RGB),
+			PROP(&f[1], type->format_video.size, SPA_POD_TYPE_RECTANGLE,
+				WIDTH, HEIGHT),
+			PROP(&f[1], type->format_video.framerate, SPA_POD_TYPE_FRACTION,
+				1000, data->interval));
+	} else if (data->video) {
+		spa_pod_builder_format(b, &f[0], type->format,
+			type->media_type.video, type->media_subtype.raw,
+			PROP_U_EN(&f[1], type->format_video.format, SPA_POD_TYPE_ID, 5,
+				type->video_format.RGB,
+				type->video_format.RGB,
+				type->video_format.UYVY,
+				type->video_format.I420,
+				type->video_format.NV12),
+			PROP_U_MM(&f[1], type->format_video.size, SPA_POD_TYPE_RECTANGLE,
+				WIDTH, HEIGHT,
+				1, 1, INT32_MAX, INT32_MAX),
+			PROP_U_MM(&f[1], type->format_video.framerate, SPA_POD_TYPE_FRACTION,
+				25, 1,
+				0, 1, INT32_MAX, 1));
+	} else if (data->target == NULL) {
+		spa_pod_builder_format(b, &f[0], type->format,
+			type->media_type.audio, type->media_subtype.raw,
+			PROP(&f[1], type->format_audio.format, SPA_POD_TYPE_ID,
+				type->audio_format.S16),
+			PROP(&f[1], type->format_audio.rate, SPA_POD_TYPE_INT, data->rate),
+			PROP(&f[1], type->format_audio.channels, SPA_POD_TYPE_INT, 1));
+	} else {
+		spa_pod_builder_format(b, &f[0], type->format,
+			type->media_type.audio, type->media_subtype.raw,
+			PROP_U_EN(&f[1], type->format_audio.format, SPA_POD_TYPE_ID, 3,
+				type->audio_format.S16,
+				type->audio_format.S16,
+				type->audio_format.F32),
+			PROP_U_MM(&f[1], type->format_audio.rate, SPA_POD_TYPE_INT,
+				data->rate,
+				1, INT32_MAX),
+			PROP_U_MM(&f[1], type->format_audio.channels, SPA_POD_TYPE_INT,
+				2,
+				1, INT32_MAX));
+	}
+	return SPA_POD_BUILDER_DEREF(b, f[0].ref, struct spa_format);
+}
+
+static void connect_sink(struct data *data, const char *path)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	const struct spa_format *formats[1];
+
+	formats[0] = build_format(data, &b);
+
+	data->sink.stream = pw_stream_new(data->remote, "latency-sink", NULL);
+	pw_stream_add_listener(data->sink.stream, &data->sink.listener,
+			       &sink_events, &data->sink);
+	pw_stream_connect(data->sink.stream, PW_DIRECTION_INPUT, PW_STREAM_MODE_BUFFER,
+			  path, PW_STREAM_FLAG_AUTOCONNECT, 1, formats);
+}
+
+static void connect_source(struct data *data)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	const struct spa_format *formats[1];
+
+	formats[0] = build_format(data, &b);
+
+	data->source.stream = pw_stream_new(data->remote, "latency-source", NULL);
+	pw_stream_add_listener(data->source.stream, &data->source.listener,
+			       &source_events, &data->source);
+	pw_stream_connect(data->source.stream, PW_DIRECTION_OUTPUT, PW_STREAM_MODE_BUFFER,
+			  NULL, PW_STREAM_FLAG_NONE, 1, formats);
+}
+
+static void on_state_changed(void *_data, enum pw_remote_state old,
+			     enum pw_remote_state state, const char *error)
+{
+	struct data *data = _data;
+
+	switch (state) {
+	case PW_REMOTE_STATE_ERROR:
+		fprintf(stderr, "remote error: %s\n", error);
+		pw_main_loop_quit(data->loop);
+		break;
+
+	case PW_REMOTE_STATE_CONNECTED:
+		if (data->target)
+			connect_sink(data, data->target);
+		else
+			connect_source(data);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.state_changed = on_state_changed,
+};
+
+static void do_quit(void *data, int signal_number)
+{
+	struct data *d = data;
+	pw_main_loop_quit(d->loop);
+}
+
+static void show_help(const char *name)
+{
+	fprintf(stdout, "%s [options]\n"
+		"  -h, --help                            Show this help\n"
+		"  -r, --remote                          Remote daemon name\n"
+		"  -t, --target                          Node id of a source to measure, by\n"
+		"                                          default buffers are sent by this tool\n"
+		"  -v, --video                           Use video instead of audio\n"
+		"  -i, --interval                        Milliseconds between buffers (default %d)\n"
+		"  -R, --rate                            Audio sample rate (default %d)\n"
+		"  -n, --count                           Number of buffers to receive (default %d)\n",
+		name, DEFAULT_INTERVAL, DEFAULT_RATE, DEFAULT_COUNT);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 };
+	struct pw_loop *l;
+	struct pw_properties *props = NULL;
+	static const struct option long_options[] = {
+		{ "help",	0, NULL, 'h' },
+		{ "remote",	1, NULL, 'r' },
+		{ "target",	1, NULL, 't' },
+		{ "video",	0, NULL, 'v' },
+		{ "interval",	1, NULL, 'i' },
+		{ "rate",	1, NULL, 'R' },
+		{ "count",	1, NULL, 'n' },
+		{ NULL,	0, NULL, 0}
+	};
+	int c;
+
+	pw_init(&argc, &argv);
+
+	data.interval = DEFAULT_INTERVAL;
+	data.rate = DEFAULT_RATE;
+	data.count = DEFAULT_COUNT;
+
+	while ((c = getopt_long(argc, argv, "hr:t:vi:R:n:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		case 'r':
+			props = pw_properties_new(PW_REMOTE_PROP_REMOTE_NAME, optarg, NULL);
+			break;
+		case 't':
+			data.target = optarg;
+			break;
+		case 'v':
+			data.video = true;
+			break;
+		case 'i':
+			data.interval = atoi(optarg);
+			break;
+		case 'R':
+			data.rate = atoi(optarg);
+			break;
+		case 'n':
+			data.count = atoi(optarg);
+			break;
+		default:
+			show_help(argv[0]);
+			return -1;
+		}
+	}
+	if (data.interval == 0 || data.rate == 0 || data.count == 0) {
+		fprintf(stderr, "interval, rate and count must be larger than 0\n");
+		return -1;
+	}
+
+	if (data.video) {
+		data.stride = SPA_ROUND_UP_N(WIDTH * BPP, 4);
+		data.size = data.stride * HEIGHT;
+	} else {
+		data.stride = sizeof(int16_t);
+		data.size = SPA_MAX(data.rate * data.interval / 1000, 1) * data.stride;
+	}
+	data.latency = calloc(data.count, sizeof(int64_t));
+	data.source.data = &data;
+	data.sink.data = &data;
+
+	data.loop = pw_main_loop_new(NULL);
+	if (data.loop == NULL)
+		return -1;
+
+	l = pw_main_loop_get_loop(data.loop);
+	pw_loop_add_signal(l, SIGINT, do_quit, &data);
+	pw_loop_add_signal(l, SIGTERM, do_quit, &data);
+	data.timer = pw_loop_add_timer(l, on_timeout, &data);
+
+	data.core = pw_core_new(l, NULL);
+	if (data.core == NULL)
+		return -1;
+	data.t = pw_core_get_type(data.core);
+	init_type(&data.type, data.t->map);
+
+	data.remote = pw_remote_new(data.core, props, 0);
+	if (data.remote == NULL)
+		return -1;
+
+	pw_remote_add_listener(data.remote, &data.remote_listener, &remote_events, &data);
+	if (pw_remote_connect(data.remote) < 0)
+		return -1;
+
+	pw_main_loop_run(data.loop);
+
+	report(&data);
+
+	pw_remote_destroy(data.remote);
+	pw_core_destroy(data.core);
+	pw_main_loop_destroy(data.loop);
+	free(data.latency);
+
+	return 0;
+}